@@ -16,11 +16,20 @@
 #define PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY -001
 #define PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE -002
 #define PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE     -003
+#define PROTOBUF2JSON_ERR_INVALID_ARGUMENT       -004
 
 /* protobuf2json_string */
 #define PROTOBUF2JSON_ERR_CANNOT_DUMP_STRING     -101
 /* protobuf2json_file */
 #define PROTOBUF2JSON_ERR_CANNOT_DUMP_FILE       -102
+/* protobuf2json_buffer */
+#define PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE      -103
+/* protobuf2json_callback */
+#define PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK   -104
+/* protobuf2json_to_buffer */
+#define PROTOBUF2JSON_ERR_BUFFER_TOO_SMALL       -105
+/* protobuf2json_from_packed */
+#define PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED    -106
 /* protobuf2json */
 #define PROTOBUF2JSON_ERR_JANSSON_INTERNAL       -201
 
@@ -28,6 +37,8 @@
 #define PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING    -301
 /* json2protobuf_file */
 #define PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE      -302
+/* json2protobuf_stream_fd */
+#define PROTOBUF2JSON_ERR_STOPPED_BY_CALLBACK    -303
 /* json2protobuf */
 #define PROTOBUF2JSON_ERR_UNKNOWN_FIELD          -401
 #define PROTOBUF2JSON_ERR_IS_NOT_OBJECT          -402
@@ -37,6 +48,8 @@
 #define PROTOBUF2JSON_ERR_IS_NOT_BOOLEAN         -406
 #define PROTOBUF2JSON_ERR_IS_NOT_STRING          -407
 #define PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING    -408
+#define PROTOBUF2JSON_ERR_INTEGER_OUT_OF_RANGE   -409
+#define PROTOBUF2JSON_ERR_IS_NOT_BASE64          -410
 /*#define PROTOBUF2JSON_ERR_DUPLICATE_FIELD      -???*/
 
 #ifdef __cplusplus
@@ -69,6 +82,103 @@ int protobuf2json_file(
   size_t error_size
 );
 
+/* === Protobuf -> JSON === Direct writer === */
+
+int protobuf2json_buffer(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+);
+
+/* Length of JSON protobuf2json_buffer() would produce, without terminating NUL */
+int protobuf2json_encoded_size(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+);
+
+/* Same as protobuf2json_buffer(), but JSON is written into caller's json_buffer without
+ * terminating NUL. If it does not fit, PROTOBUF2JSON_ERR_BUFFER_TOO_SMALL is returned
+ * and json_length is set to the size needed.
+ * Nothing is allocated, except lookup tables built on the first call for each message
+ * and enum type, see protobuf2json_prepare_descriptor() */
+int protobuf2json_to_buffer(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  char *json_buffer,
+  size_t json_buffer_size,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+);
+
+/* Builds lookup tables of message type and of all message and enum types of its fields
+ * up front, instead of on first use, e.g. so protobuf2json_to_buffer() never allocates */
+int protobuf2json_prepare_descriptor(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  char *error_string,
+  size_t error_size
+);
+
+int protobuf2json_callback(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  json_dump_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+);
+
+int protobuf2json_fd(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  int fd,
+  char *error_string,
+  size_t error_size
+);
+
+/* Newline-delimited JSON: every message on its own line, each line ending with newline.
+ * Indentation of json_flags is ignored, messages may be of different types */
+int protobuf2json_batch_buffer(
+  ProtobufCMessage **protobuf_messages,
+  size_t protobuf_messages_count,
+  size_t json_flags,
+  char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+);
+
+/* Same as protobuf2json_batch_buffer(), but JSON is passed to callback by bounded chunks.
+ * Lines can be split between chunks. On error, some of them may have been passed already */
+int protobuf2json_batch_callback(
+  ProtobufCMessage **protobuf_messages,
+  size_t protobuf_messages_count,
+  size_t json_flags,
+  json_dump_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+);
+
+/* Same JSON as protobuf2json_buffer() writes for message unpacked from packed_buffer,
+ * but written straight from wire format, without unpacking */
+int protobuf2json_from_packed(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *packed_buffer,
+  size_t packed_length,
+  size_t json_flags,
+  char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+);
+
 /* === JSON -> Protobuf === */
 
 int json2protobuf_object(
@@ -97,6 +207,226 @@ int json2protobuf_file(
   size_t error_size
 );
 
+/* === JSON -> Protobuf === Direct reader === */
+
+int json2protobuf_buffer(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+);
+
+/* Same as json2protobuf_buffer(), but the whole message tree is allocated by `allocator`
+ * (NULL means malloc(3)), so it should be freed with protobuf_c_message_free_unpacked(message, allocator) */
+int json2protobuf_buffer_allocator(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  ProtobufCAllocator *allocator,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+);
+
+/* Same bytes as protobuf_c_message_pack() gives for message json2protobuf_buffer() reads,
+ * but written straight from JSON, without building it. packed_buffer should be freed with free(3) */
+int json2protobuf_to_packed(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  uint8_t **packed_buffer,
+  size_t *packed_length,
+  char *error_string,
+  size_t error_size
+);
+
+/* Called for every message decoded by json2protobuf_stream_fd(), non-zero return stops reading.
+ * Message is valid only until callback returns, it should not be freed */
+typedef int (*json2protobuf_callback_t)(ProtobufCMessage *protobuf_message, void *callback_data);
+
+/* Decodes every JSON object read from fd, one per line or just concatenated, and passes it to callback.
+ * Memory usage depends on the longest object, not on the size of input. UTF-8 BOM at the start is skipped */
+int json2protobuf_stream_fd(
+  int fd,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  json2protobuf_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+);
+
+int json2protobuf_stream_file(
+  char *json_file,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  json2protobuf_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+);
+
+/* === Arena === */
+
+typedef struct protobuf2json_arena protobuf2json_arena_t;
+
+/* Returns NULL if memory cannot be allocated, block_size 0 means default */
+protobuf2json_arena_t *protobuf2json_arena_new(size_t block_size);
+
+/* Allocator to pass to json2protobuf_buffer_allocator(), its free() is no-op */
+ProtobufCAllocator *protobuf2json_arena_allocator(protobuf2json_arena_t *arena);
+
+/* Releases all messages allocated from arena at once, keeping memory for reuse */
+void protobuf2json_arena_reset(protobuf2json_arena_t *arena);
+
+void protobuf2json_arena_free(protobuf2json_arena_t *arena);
+
+/* Same as json2protobuf_buffer_allocator() with arena allocator, but strings without escapes
+ * are NUL-terminated right in json_buffer and not copied, so json_buffer is modified
+ * (even on error) and should be kept until arena is reset */
+int json2protobuf_buffer_insitu(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  protobuf2json_arena_t *arena,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+);
+
+/* === Context === */
+
+/* Keeps buffers and arena between calls, one per thread */
+typedef struct protobuf2json_ctx protobuf2json_ctx_t;
+
+/* Returns NULL if memory cannot be allocated */
+protobuf2json_ctx_t *protobuf2json_ctx_new(void);
+
+/* Releases JSON and messages produced with context so far, keeping memory for reuse */
+void protobuf2json_ctx_reset(protobuf2json_ctx_t *ctx);
+
+void protobuf2json_ctx_free(protobuf2json_ctx_t *ctx);
+
+/* Same as protobuf2json_buffer(), but json_buffer is owned by context
+ * and valid until the next protobuf2json_ctx_buffer() call or reset */
+int protobuf2json_ctx_buffer(
+  protobuf2json_ctx_t *ctx,
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  const char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+);
+
+/* Same as json2protobuf_buffer(), but message is allocated from context arena
+ * and valid until protobuf2json_ctx_reset(), it should not be freed */
+int json2protobuf_ctx_buffer(
+  protobuf2json_ctx_t *ctx,
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+);
+
+/* === Generated code === */
+
+/* Direct writer and reader states, only passed around by generated code */
+typedef struct protobuf2json_writer protobuf2json_writer_t;
+typedef struct json2protobuf_reader json2protobuf_reader_t;
+
+/*
+ * Message-specific code emitted by protoc-gen-protobuf2json-c. Once registered,
+ * the direct writer and the direct reader use it instead of walking the descriptor,
+ * messages of other types still take the generic path.
+ */
+typedef struct protobuf2json_codec {
+  const ProtobufCMessageDescriptor *descriptor;
+  /* Writes message the same way protobuf2json_buffer() does, except JSON_SORT_KEYS which is left to generic path */
+  int (*write)(
+    protobuf2json_writer_t *writer,
+    const ProtobufCMessage *protobuf_message,
+    int depth,
+    char *error_string,
+    size_t error_size
+  );
+  /* Reads JSON object into initialized message the same way json2protobuf_buffer() does */
+  int (*read)(
+    json2protobuf_reader_t *reader,
+    ProtobufCMessage *protobuf_message,
+    int depth,
+    char *error_string,
+    size_t error_size
+  );
+  /* Index in descriptor->fields of field with given name, -1 if there is none */
+  int (*field_index)(const char *name, size_t name_length);
+} protobuf2json_codec_t;
+
+/* Codecs should stay valid forever, registration cannot be undone */
+int protobuf2json_register_codecs(
+  const protobuf2json_codec_t *codecs,
+  size_t n_codecs,
+  char *error_string,
+  size_t error_size
+);
+
+/* Steps of writing message, used by generated code only */
+int protobuf2json_gen_begin_object(protobuf2json_writer_t *writer, int depth, char *error_string, size_t error_size);
+int protobuf2json_gen_key(protobuf2json_writer_t *writer, const char *key, size_t key_length, int depth, int *is_first, char *error_string, size_t error_size);
+int protobuf2json_gen_end_object(protobuf2json_writer_t *writer, int depth, int is_first, char *error_string, size_t error_size);
+int protobuf2json_gen_begin_array(protobuf2json_writer_t *writer, char *error_string, size_t error_size);
+int protobuf2json_gen_array_item(protobuf2json_writer_t *writer, int depth, size_t index, char *error_string, size_t error_size);
+int protobuf2json_gen_end_array(protobuf2json_writer_t *writer, int depth, char *error_string, size_t error_size);
+int protobuf2json_gen_int32(protobuf2json_writer_t *writer, int32_t value, char *error_string, size_t error_size);
+int protobuf2json_gen_uint32(protobuf2json_writer_t *writer, uint32_t value, char *error_string, size_t error_size);
+int protobuf2json_gen_int64(protobuf2json_writer_t *writer, int64_t value, char *error_string, size_t error_size);
+int protobuf2json_gen_uint64(protobuf2json_writer_t *writer, uint64_t value, char *error_string, size_t error_size);
+int protobuf2json_gen_float(protobuf2json_writer_t *writer, float value, char *error_string, size_t error_size);
+int protobuf2json_gen_double(protobuf2json_writer_t *writer, double value, char *error_string, size_t error_size);
+int protobuf2json_gen_bool(protobuf2json_writer_t *writer, protobuf_c_boolean value, char *error_string, size_t error_size);
+int protobuf2json_gen_enum(protobuf2json_writer_t *writer, const ProtobufCEnumDescriptor *protobuf_enum_descriptor, int value, char *error_string, size_t error_size);
+/* Field name is only used in error message about NULL value */
+int protobuf2json_gen_string(protobuf2json_writer_t *writer, const char *value, const char *field_name, char *error_string, size_t error_size);
+int protobuf2json_gen_bytes(protobuf2json_writer_t *writer, const ProtobufCBinaryData *value, char *error_string, size_t error_size);
+int protobuf2json_gen_message(protobuf2json_writer_t *writer, const ProtobufCMessage *value, const char *field_name, int depth, char *error_string, size_t error_size);
+
+/* Steps of reading message, used by generated code only */
+int json2protobuf_gen_begin_object(json2protobuf_reader_t *reader, int *more, char *error_string, size_t error_size);
+int json2protobuf_gen_key(json2protobuf_reader_t *reader, const char **key, size_t *key_length, char *error_string, size_t error_size);
+int json2protobuf_gen_unknown_field(const ProtobufCMessageDescriptor *protobuf_message_descriptor, const char *key, char *error_string, size_t error_size);
+int json2protobuf_gen_duplicate_field(json2protobuf_reader_t *reader, ProtobufCMessage *protobuf_message, const ProtobufCFieldDescriptor *field_descriptor, char *error_string, size_t error_size);
+void json2protobuf_gen_release_oneof(json2protobuf_reader_t *reader, ProtobufCMessage *protobuf_message, uint32_t *oneof_case);
+int json2protobuf_gen_colon(json2protobuf_reader_t *reader, char *error_string, size_t error_size);
+int json2protobuf_gen_next_field(json2protobuf_reader_t *reader, int *more, char *error_string, size_t error_size);
+int json2protobuf_gen_missing_field(const ProtobufCMessageDescriptor *protobuf_message_descriptor, const ProtobufCFieldDescriptor *field_descriptor, char *error_string, size_t error_size);
+/* Values of repeated field are pushed one by one, then moved into exactly sized array by end_array(), or freed by abort_array() on error */
+int json2protobuf_gen_begin_array(json2protobuf_reader_t *reader, int depth, size_t *values_start, int *more, char *error_string, size_t error_size);
+int json2protobuf_gen_push_value(json2protobuf_reader_t *reader, const ProtobufCFieldDescriptor *field_descriptor, void *value, size_t value_size, int *more, char *error_string, size_t error_size);
+void json2protobuf_gen_abort_array(json2protobuf_reader_t *reader, const ProtobufCFieldDescriptor *field_descriptor, size_t values_start);
+int json2protobuf_gen_end_array(json2protobuf_reader_t *reader, const ProtobufCFieldDescriptor *field_descriptor, size_t values_start, void *values, size_t *n_values, char *error_string, size_t error_size);
+/* Integer type tells range checked and name used in errors */
+int json2protobuf_gen_int32(json2protobuf_reader_t *reader, ProtobufCType type, int32_t *value, char *error_string, size_t error_size);
+int json2protobuf_gen_uint32(json2protobuf_reader_t *reader, ProtobufCType type, uint32_t *value, char *error_string, size_t error_size);
+int json2protobuf_gen_int64(json2protobuf_reader_t *reader, ProtobufCType type, int64_t *value, char *error_string, size_t error_size);
+int json2protobuf_gen_uint64(json2protobuf_reader_t *reader, ProtobufCType type, uint64_t *value, char *error_string, size_t error_size);
+int json2protobuf_gen_float(json2protobuf_reader_t *reader, float *value, char *error_string, size_t error_size);
+int json2protobuf_gen_double(json2protobuf_reader_t *reader, double *value, char *error_string, size_t error_size);
+int json2protobuf_gen_bool(json2protobuf_reader_t *reader, protobuf_c_boolean *value, char *error_string, size_t error_size);
+int json2protobuf_gen_enum(json2protobuf_reader_t *reader, const ProtobufCEnumDescriptor *protobuf_enum_descriptor, int *value, char *error_string, size_t error_size);
+int json2protobuf_gen_string(json2protobuf_reader_t *reader, char **value, char *error_string, size_t error_size);
+int json2protobuf_gen_bytes(json2protobuf_reader_t *reader, ProtobufCBinaryData *value, char *error_string, size_t error_size);
+/* Depth is the one of nested message itself */
+int json2protobuf_gen_message(json2protobuf_reader_t *reader, const ProtobufCMessageDescriptor *protobuf_message_descriptor, ProtobufCMessage **value, int depth, char *error_string, size_t error_size);
+
 /* === END === */
 
 #ifdef __cplusplus
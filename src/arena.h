@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <stdlib.h>
+
+#define ARENA_MIN_BLOCK_SIZE 4096
+#define ARENA_ALIGNMENT 16
+
+#define arena_align(size) (((size) + (ARENA_ALIGNMENT - 1)) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+} arena_block_t;
+
+#define ARENA_BLOCK_HEADER_SIZE arena_align(sizeof(arena_block_t))
+
+/* Bump allocator: memory is only released all at once by arena_reset() or arena_free() */
+typedef struct arena {
+  arena_block_t *head;
+  size_t block_size;
+} arena_t;
+
+static arena_block_t *arena_block_alloc(size_t size)
+{
+  arena_block_t *block = malloc(ARENA_BLOCK_HEADER_SIZE + size);
+  if (!block) {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
+
+static void arena_init(arena_t *arena, size_t block_size)
+{
+  arena->head = NULL;
+  arena->block_size = block_size < ARENA_MIN_BLOCK_SIZE ? ARENA_MIN_BLOCK_SIZE : arena_align(block_size);
+}
+
+static void *arena_alloc(arena_t *arena, size_t size)
+{
+  arena_block_t *block = arena->head;
+
+  size = arena_align(size ? size : 1);
+
+  if (block && block->size - block->used >= size) {
+    void *data = (char *)block + ARENA_BLOCK_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return data;
+  }
+
+  if (size > arena->block_size / 4) {
+    /* Large chunk gets its own block, so space left in the current one is not wasted */
+    block = arena_block_alloc(size);
+    if (!block) {
+      return NULL;
+    }
+
+    block->used = size;
+
+    if (arena->head) {
+      block->next = arena->head->next;
+      arena->head->next = block;
+    } else {
+      arena->head = block;
+    }
+
+    return (char *)block + ARENA_BLOCK_HEADER_SIZE;
+  }
+
+  block = arena_block_alloc(arena->block_size);
+  if (!block) {
+    return NULL;
+  }
+
+  block->next = arena->head;
+  block->used = size;
+  arena->head = block;
+
+  return (char *)block + ARENA_BLOCK_HEADER_SIZE;
+}
+
+static void arena_free(arena_t *arena)
+{
+  arena_block_t *block = arena->head;
+
+  while (block) {
+    arena_block_t *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  arena->head = NULL;
+}
+
+/*
+ * Releases everything allocated so far. If more than one block was used,
+ * they are replaced by a single block of the same total size, so the next
+ * round of allocations of the same volume fits in it and reset is O(1).
+ */
+static void arena_reset(arena_t *arena)
+{
+  arena_block_t *block = arena->head;
+
+  if (!block) {
+    return;
+  }
+
+  if (!block->next) {
+    block->used = 0;
+    return;
+  }
+
+  size_t total_size = 0;
+  for (; block; block = block->next) {
+    total_size += block->size;
+  }
+
+  arena_free(arena);
+
+  arena->head = arena_block_alloc(total_size);
+}
+
+#endif /* ARENA_H */
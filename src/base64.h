@@ -11,6 +11,8 @@
 #ifndef BASE64_H
 #define BASE64_H 1
 
+#include "simd.h"
+
 #define base64_encoded_len(len) (((len + 2) / 3) * 4)
 #define base64_decoded_len(len) (((len + 3) / 4) * 3)
 
@@ -44,12 +46,222 @@ static const base64_tables_t base64_default_tables = {
   .padding = '='
 };
 
-size_t base64_encode(char *dst, const char *src, size_t src_len)
+/*
+ * Vectorized kernels process whole blocks at the beginning of input and
+ * return number of bytes consumed, scalar code finishes the rest.
+ * They are compiled for x86 with GCC/clang function targets and selected
+ * at runtime, so the library itself still runs on any CPU.
+ */
+#if defined(SIMD_TARGET_ATTRIBUTE) && !defined(BASE64_NO_SIMD)
+#define BASE64_SIMD 1
+#endif
+
+#ifdef BASE64_SIMD
+
+#include <immintrin.h>
+
+__attribute__((target("sse4.1")))
+static size_t base64_encode_sse41(char *dst, const char *src, size_t src_len)
+{
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i shift_lut = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0
+  );
+  size_t i = 0;
+
+  /* 12 bytes are used, but 16 are loaded */
+  for (; i + 16 <= src_len; i += 12) {
+    __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), shuffle);
+
+    /* 3 bytes in each 32-bit word -> 4 6-bit indices -> ASCII by offset of index range */
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(t1, t3);
+    __m128i offsets = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i is_upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    offsets = _mm_or_si128(offsets, _mm_and_si128(is_upper, _mm_set1_epi8(13)));
+
+    _mm_storeu_si128((__m128i *)(dst + i / 3 * 4), _mm_add_epi8(_mm_shuffle_epi8(shift_lut, offsets), indices));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_encode_avx2(char *dst, const char *src, size_t src_len)
+{
+  const __m256i shuffle = _mm256_setr_epi8(
+    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+  );
+  const __m256i shift_lut = _mm256_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0
+  );
+  size_t i = 0;
+
+  /* 12 bytes into each 128-bit lane, 28 bytes are loaded for 24 used */
+  for (; i + 28 <= src_len; i += 24) {
+    __m256i in = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+      _mm_loadu_si128((const __m128i *)(src + i + 12)),
+      1
+    );
+    in = _mm256_shuffle_epi8(in, shuffle);
+
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+    __m256i offsets = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i is_upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    offsets = _mm256_or_si256(offsets, _mm256_and_si256(is_upper, _mm256_set1_epi8(13)));
+
+    _mm256_storeu_si256((__m256i *)(dst + i / 3 * 4), _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, offsets), indices));
+  }
+
+  return i;
+}
+
+/*
+ * Classifies characters by nibbles: valid ones are translated to 6-bit values,
+ * anything else (including padding) stops vectorized decoding before the block.
+ */
+__attribute__((target("sse4.1")))
+static size_t base64_decode_sse41(char *dst, const char *src, size_t src_len)
+{
+  const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_lut = _mm_setr_epi8(
+    (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+    (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54
+  );
+  const __m128i bit_lut = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t i = 0;
+
+  /* 16 bytes are stored for 12 decoded, so keep away from the end of dst */
+  for (; i + 24 <= src_len; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+
+    __m128i valid = _mm_and_si128(_mm_shuffle_epi8(mask_lut, lo), _mm_shuffle_epi8(bit_lut, hi));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128()))) {
+      break;
+    }
+
+    __m128i shift = _mm_blendv_epi8(
+      _mm_shuffle_epi8(shift_lut, hi),
+      _mm_set1_epi8(16),
+      _mm_cmpeq_epi8(in, _mm_set1_epi8('/'))
+    );
+    __m128i values = _mm_add_epi8(in, shift);
+
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+
+    _mm_storeu_si128((__m128i *)(dst + i / 4 * 3), _mm_shuffle_epi8(out, pack));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(char *dst, const char *src, size_t src_len)
+{
+  const __m256i shift_lut = _mm256_setr_epi8(
+    0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+  );
+  const __m256i mask_lut = _mm256_setr_epi8(
+    (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+    (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+    (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+    (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54
+  );
+  const __m256i bit_lut = _mm256_setr_epi8(
+    1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0
+  );
+  const __m256i pack = _mm256_setr_epi8(
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+  );
+  size_t i = 0;
+
+  /* 32 bytes are stored for 24 decoded, so keep away from the end of dst */
+  for (; i + 48 <= src_len; i += 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+    __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+
+    __m256i valid = _mm256_and_si256(_mm256_shuffle_epi8(mask_lut, lo), _mm256_shuffle_epi8(bit_lut, hi));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(valid, _mm256_setzero_si256()))) {
+      break;
+    }
+
+    __m256i shift = _mm256_blendv_epi8(
+      _mm256_shuffle_epi8(shift_lut, hi),
+      _mm256_set1_epi8(16),
+      _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'))
+    );
+    __m256i values = _mm256_add_epi8(in, shift);
+
+    __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i out = _mm256_shuffle_epi8(_mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000)), pack);
+
+    /* 12 bytes at the beginning of each lane -> 24 contiguous bytes */
+    out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+    _mm256_storeu_si256((__m256i *)(dst + i / 4 * 3), out);
+  }
+
+  return i;
+}
+
+/* Vector kernels do not pay off below it */
+#define BASE64_SIMD_MIN_LENGTH 64
+
+static int base64_has_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static int base64_has_sse41(void)
+{
+  return __builtin_cpu_supports("sse4.1");
+}
+
+#endif /* BASE64_SIMD */
+
+static size_t base64_encode(char *dst, const char *src, size_t src_len)
 {
   char                *d = dst;
   const unsigned char *s = (void*)src;
   const unsigned char *basis64 = base64_default_tables.encode;
 
+#ifdef BASE64_SIMD
+  if (src_len >= BASE64_SIMD_MIN_LENGTH) {
+    size_t processed = 0;
+
+    if (base64_has_avx2()) {
+      processed = base64_encode_avx2(dst, src, src_len);
+    } else if (base64_has_sse41()) {
+      processed = base64_encode_sse41(dst, src, src_len);
+    }
+
+    d += processed / 3 * 4;
+    s += processed;
+    src_len -= processed;
+  }
+#endif
+
   while (src_len > 2) {
     *d++ = basis64[(s[0] >> 2) & 0x3f];
     *d++ = basis64[((s[0] & 3) << 4) | (s[1] >> 4)];
@@ -77,7 +289,8 @@ size_t base64_encode(char *dst, const char *src, size_t src_len)
   return (d - dst);
 }
 
-size_t base64_decode(char *dst, const char *src, size_t src_len)
+/* Returns (size_t)-1 for invalid input */
+static size_t base64_decode_scalar(char *dst, const char *src, size_t src_len)
 {
   size_t               len;
   char                *d = dst;
@@ -90,12 +303,12 @@ size_t base64_decode(char *dst, const char *src, size_t src_len)
     }
 
     if (basis[s[len]] == 77) {
-      return 0;
+      return (size_t)-1;
     }
   }
 
   if (len % 4 == 1) {
-    return 0;
+    return (size_t)-1;
   }
 
   while (len > 3) {
@@ -118,4 +331,28 @@ size_t base64_decode(char *dst, const char *src, size_t src_len)
   return (d - dst);
 }
 
+/* Returns (size_t)-1 for invalid input, dst should have base64_decoded_len(src_len) bytes */
+static size_t base64_decode(char *dst, const char *src, size_t src_len)
+{
+  size_t processed = 0;
+
+#ifdef BASE64_SIMD
+  /* Kernels stop before padding or invalid character, scalar code deals with them */
+  if (src_len >= BASE64_SIMD_MIN_LENGTH) {
+    if (base64_has_avx2()) {
+      processed = base64_decode_avx2(dst, src, src_len);
+    } else if (base64_has_sse41()) {
+      processed = base64_decode_sse41(dst, src, src_len);
+    }
+  }
+#endif
+
+  size_t length = base64_decode_scalar(dst + processed / 4 * 3, src + processed, src_len - processed);
+  if (length == (size_t)-1) {
+    return length;
+  }
+
+  return processed / 4 * 3 + length;
+}
+
 #endif /* BASE64_H */
@@ -9,28 +9,71 @@
 #ifndef BITMAP_H
 #define BITMAP_H 1
 
-typedef unsigned char bitmap_word_t;
-typedef bitmap_word_t* bitmap_t;
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef uint64_t bitmap_word_t;
 
 #define bitmap_word_t_bits (8 * sizeof(bitmap_word_t))
 #define bitmap_words_needed(size)  (((size) + (bitmap_word_t_bits - 1)) / bitmap_word_t_bits)
 
-bitmap_t bitmap_alloc(int size)
+/* Enough for messages with up to 256 fields, larger ones fall back to calloc(3) */
+#define BITMAP_INLINE_WORDS 4
+
+/* Lives on the stack of its user, so should not be copied */
+typedef struct bitmap {
+  bitmap_word_t *words;
+  bitmap_word_t inline_words[BITMAP_INLINE_WORDS];
+} bitmap_t;
+
+/* Returns -1 if calloc(3) fails */
+static int bitmap_init(bitmap_t *bitmap, size_t size)
+{
+  size_t words = bitmap_words_needed(size);
+
+  if (words <= BITMAP_INLINE_WORDS) {
+    memset(bitmap->inline_words, 0, sizeof(bitmap->inline_words));
+    bitmap->words = bitmap->inline_words;
+    return 0;
+  }
+
+  bitmap->words = calloc(words, sizeof(bitmap_word_t));
+
+  return bitmap->words ? 0 : -1;
+}
+
+static void bitmap_free(bitmap_t *bitmap)
 {
-  return (bitmap_t)calloc(bitmap_words_needed(size), sizeof(bitmap_word_t));
+  if (bitmap->words != bitmap->inline_words) {
+    free(bitmap->words);
+  }
+
+  bitmap->words = NULL;
 }
 
-void bitmap_free(bitmap_t bitmap)
+static void bitmap_set(bitmap_t *bitmap, size_t i)
 {
-  free(bitmap);
+  bitmap->words[i / bitmap_word_t_bits] |= (bitmap_word_t)1 << (i % bitmap_word_t_bits);
 }
 
-void bitmap_set(bitmap_t bitmap, unsigned int i) {
-    bitmap[i / bitmap_word_t_bits] |= (1 << (i & (bitmap_word_t_bits - 1)));
+static int bitmap_get(const bitmap_t *bitmap, size_t i)
+{
+  return (bitmap->words[i / bitmap_word_t_bits] >> (i % bitmap_word_t_bits)) & 1;
 }
 
-int bitmap_get(bitmap_t bitmap, unsigned int i) {
-    return (bitmap[i / bitmap_word_t_bits] & (1 << (i & (bitmap_word_t_bits - 1)))) ? 1 : 0;
+/* Checks that every bit set in `mask` of `words` words is set in bitmap too */
+static int bitmap_contains(const bitmap_t *bitmap, const bitmap_word_t *mask, size_t words)
+{
+  size_t i;
+
+  for (i = 0; i < words; i++) {
+    if (mask[i] & ~bitmap->words[i]) {
+      return 0;
+    }
+  }
+
+  return 1;
 }
 
 #endif /* BITMAP_H */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H 1
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_MIN_SIZE 256
+
+typedef struct buffer {
+  char *data;
+  size_t length;
+  size_t size;
+} buffer_t;
+
+static void buffer_init(buffer_t *buffer)
+{
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->size = 0;
+}
+
+static void buffer_free(buffer_t *buffer)
+{
+  free(buffer->data);
+  buffer_init(buffer);
+}
+
+/* Makes room for at least `length` more bytes, returns -1 if realloc(3) fails */
+static int buffer_reserve(buffer_t *buffer, size_t length)
+{
+  if (buffer->size - buffer->length >= length) {
+    return 0;
+  }
+
+  size_t new_size = buffer->size ? buffer->size : BUFFER_MIN_SIZE;
+  while (new_size - buffer->length < length) {
+    if (new_size > ((size_t)-1) / 2) {
+      return -1;
+    }
+    new_size *= 2;
+  }
+
+  char *new_data = realloc(buffer->data, new_size);
+  if (!new_data) {
+    return -1;
+  }
+
+  buffer->data = new_data;
+  buffer->size = new_size;
+
+  return 0;
+}
+
+static int buffer_append_byte(buffer_t *buffer, char byte)
+{
+  if (buffer->length == buffer->size && buffer_reserve(buffer, 1)) {
+    return -1;
+  }
+
+  buffer->data[buffer->length++] = byte;
+
+  return 0;
+}
+
+/* NUL-terminates the data and hands it over to the caller, who should free(3) it */
+static char *buffer_steal(buffer_t *buffer)
+{
+  if (buffer_append_byte(buffer, '\0')) {
+    return NULL;
+  }
+
+  char *data = buffer->data;
+  buffer_init(buffer);
+
+  return data;
+}
+
+#endif /* BUFFER_H */
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * Code based on dtoa_milo.h by Milo Yip, also used by RapidJSON:
+ * cached powers, digit generation with rounding and formatting of digits.
+ *
+ *   Copyright (C) 2014 Milo Yip
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *   THE SOFTWARE.
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef DTOA_H
+#define DTOA_H 1
+
+/*
+ * Shortest decimal representation of float and double values that reads
+ * back as the same value, using Grisu2 by Florian Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers" (2010).
+ * Grisu2 always round-trips, and digits are the shortest possible for all but
+ * a fraction of a percent of values, which get one or two digits more.
+ *
+ * Float values are formatted at float precision, so 0.33f is "0.33"
+ * rather than "0.33000001311302185" of the widened double.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/* Enough for "-0.000001" followed by 17 digits, or sign, 17 digits, point and exponent */
+#define DTOA_BUFFER_SIZE 32
+
+/* f * 2^e */
+typedef struct dtoa_fp {
+  uint64_t f;
+  int e;
+} dtoa_fp_t;
+
+/* Normalized 10^k for k = -348, -340, ..., 340 */
+static const uint64_t dtoa_cached_powers_f[] = {
+  UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+  UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+  UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+  UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+  UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+  UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+  UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+  UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+  UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+  UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+  UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+  UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+  UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+  UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+  UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+  UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+  UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+  UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+  UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+  UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+  UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+  UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+  UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+  UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+  UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+  UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+  UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+  UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+  UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b)
+};
+
+static const int16_t dtoa_cached_powers_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+  -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+  -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+  -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+  56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+  694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+  1013, 1039, 1066
+};
+
+static dtoa_fp_t dtoa_fp_normalize(dtoa_fp_t v)
+{
+#if defined(__GNUC__)
+  int shift = __builtin_clzll(v.f);
+  v.f <<= shift;
+  v.e -= shift;
+#else
+  while (!(v.f & ((uint64_t)1 << 63))) {
+    v.f <<= 1;
+    v.e--;
+  }
+#endif
+
+  return v;
+}
+
+/* Upper 64 bits of product, rounded */
+static dtoa_fp_t dtoa_fp_multiply(dtoa_fp_t a, dtoa_fp_t b)
+{
+  const uint64_t mask = 0xFFFFFFFF;
+
+  uint64_t a_hi = a.f >> 32, a_lo = a.f & mask;
+  uint64_t b_hi = b.f >> 32, b_lo = b.f & mask;
+
+  uint64_t hi_hi = a_hi * b_hi;
+  uint64_t hi_lo = a_hi * b_lo;
+  uint64_t lo_hi = a_lo * b_hi;
+  uint64_t lo_lo = a_lo * b_lo;
+
+  uint64_t middle = (lo_lo >> 32) + (hi_lo & mask) + (lo_hi & mask) + ((uint64_t)1 << 31);
+
+  dtoa_fp_t result;
+  result.f = hi_hi + (hi_lo >> 32) + (lo_hi >> 32) + (middle >> 32);
+  result.e = a.e + b.e + 64;
+
+  return result;
+}
+
+/* Returns c = 10^-k such that e + c.e + 64 is in [-60, -32] */
+static dtoa_fp_t dtoa_cached_power(int e, int *k)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0) {
+    ik++;
+  }
+
+  unsigned int index = (unsigned int)((ik >> 3) + 1);
+
+  *k = -(-348 + (int)(index << 3));
+
+  dtoa_fp_t c;
+  c.f = dtoa_cached_powers_f[index];
+  c.e = dtoa_cached_powers_e[index];
+
+  return c;
+}
+
+static int dtoa_count_digits(uint32_t n)
+{
+  if (n < 10) return 1;
+  if (n < 100) return 2;
+  if (n < 1000) return 3;
+  if (n < 10000) return 4;
+  if (n < 100000) return 5;
+  if (n < 1000000) return 6;
+  if (n < 10000000) return 7;
+  if (n < 100000000) return 8;
+  if (n < 1000000000) return 9;
+  return 10;
+}
+
+static const uint64_t dtoa_pow10[] = {
+  UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+  UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000),
+  UINT64_C(1000000000), UINT64_C(10000000000), UINT64_C(100000000000),
+  UINT64_C(1000000000000), UINT64_C(10000000000000), UINT64_C(100000000000000),
+  UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+  UINT64_C(100000000000000000), UINT64_C(1000000000000000000),
+  UINT64_C(10000000000000000000)
+};
+
+/* Moves last digit closer to w while it stays inside of the interval */
+static void dtoa_round(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa
+    && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    digits[length - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+/* Generates as few digits of w as needed to stay within delta below mp */
+static int dtoa_digits(dtoa_fp_t w, dtoa_fp_t mp, uint64_t delta, char *digits, int *k)
+{
+  const int shift = -mp.e;
+  const uint64_t one = (uint64_t)1 << shift;
+  const uint64_t wp_w = mp.f - w.f;
+
+  uint32_t p1 = (uint32_t)(mp.f >> shift);
+  uint64_t p2 = mp.f & (one - 1);
+  int kappa = dtoa_count_digits(p1);
+  int length = 0;
+
+  while (kappa > 0) {
+    uint32_t d = p1 / (uint32_t)dtoa_pow10[kappa - 1];
+    p1 %= (uint32_t)dtoa_pow10[kappa - 1];
+
+    if (d || length) {
+      digits[length++] = (char)('0' + d);
+    }
+
+    kappa--;
+
+    uint64_t rest = ((uint64_t)p1 << shift) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      dtoa_round(digits, length, delta, rest, dtoa_pow10[kappa] << shift, wp_w);
+      return length;
+    }
+  }
+
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+
+    char d = (char)(p2 >> shift);
+    if (d || length) {
+      digits[length++] = (char)('0' + d);
+    }
+
+    p2 &= one - 1;
+    kappa--;
+
+    if (p2 < delta) {
+      *k += kappa;
+      dtoa_round(digits, length, delta, p2, one, -kappa < 20 ? wp_w * dtoa_pow10[-kappa] : 0);
+      return length;
+    }
+  }
+}
+
+/*
+ * Digits of f * 2^e as digits * 10^k, returns number of digits.
+ * Lower boundary is closer when f is a power of two and the previous value has smaller exponent.
+ */
+static int dtoa_grisu2(uint64_t f, int e, int lower_closer, char *digits, int *k)
+{
+  dtoa_fp_t v = { f, e };
+
+  /* Boundaries are halfway to neighbour values */
+  dtoa_fp_t plus = { (f << 1) + 1, e - 1 };
+  plus = dtoa_fp_normalize(plus);
+
+  dtoa_fp_t minus;
+  if (lower_closer) {
+    minus.f = (f << 2) - 1;
+    minus.e = e - 2;
+  } else {
+    minus.f = (f << 1) - 1;
+    minus.e = e - 1;
+  }
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  dtoa_fp_t c = dtoa_cached_power(plus.e, k);
+
+  dtoa_fp_t w = dtoa_fp_multiply(dtoa_fp_normalize(v), c);
+  dtoa_fp_t wp = dtoa_fp_multiply(plus, c);
+  dtoa_fp_t wm = dtoa_fp_multiply(minus, c);
+
+  /* Products are imprecise by one unit, stay on the safe side */
+  wm.f++;
+  wp.f--;
+
+  return dtoa_digits(w, wp, wp.f - wm.f, digits, k);
+}
+
+/* Jansson style: no '+' and no leading zeros */
+static char *dtoa_write_exponent(int exponent, char *p)
+{
+  *p++ = 'e';
+
+  if (exponent < 0) {
+    *p++ = '-';
+    exponent = -exponent;
+  }
+
+  if (exponent >= 100) {
+    *p++ = (char)('0' + exponent / 100);
+    exponent %= 100;
+    *p++ = (char)('0' + exponent / 10);
+  } else if (exponent >= 10) {
+    *p++ = (char)('0' + exponent / 10);
+  }
+  *p++ = (char)('0' + exponent % 10);
+
+  return p;
+}
+
+/*
+ * Places decimal point the way JavaScript Number.prototype.toString() does,
+ * but integral values get ".0", so reals always look like reals.
+ */
+static char *dtoa_format(char *digits, int length, int k)
+{
+  const int kk = length + k;
+  int i;
+
+  if (0 <= k && kk <= 21) {
+    /* 1234e7 -> 12340000000.0 */
+    for (i = length; i < kk; i++) {
+      digits[i] = '0';
+    }
+    digits[kk] = '.';
+    digits[kk + 1] = '0';
+    return &digits[kk + 2];
+  }
+
+  if (0 < kk && kk <= 21) {
+    /* 1234e-2 -> 12.34 */
+    memmove(&digits[kk + 1], &digits[kk], (size_t)(length - kk));
+    digits[kk] = '.';
+    return &digits[length + 1];
+  }
+
+  if (-6 < kk && kk <= 0) {
+    /* 1234e-6 -> 0.001234 */
+    const int offset = 2 - kk;
+    memmove(&digits[offset], &digits[0], (size_t)length);
+    digits[0] = '0';
+    digits[1] = '.';
+    for (i = 2; i < offset; i++) {
+      digits[i] = '0';
+    }
+    return &digits[length + offset];
+  }
+
+  if (length == 1) {
+    /* 1e30 */
+    return dtoa_write_exponent(kk - 1, &digits[1]);
+  }
+
+  /* 1234e30 -> 1.234e33 */
+  memmove(&digits[2], &digits[1], (size_t)(length - 1));
+  digits[1] = '.';
+  return dtoa_write_exponent(kk - 1, &digits[length + 1]);
+}
+
+/* Writes finite double value to buffer of DTOA_BUFFER_SIZE bytes, returns length */
+static size_t dtoa_double(double value, char *buffer)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  char *p = buffer;
+  if (bits >> 63) {
+    *p++ = '-';
+  }
+
+  uint64_t significand = bits & ((UINT64_C(1) << 52) - 1);
+  int biased_exponent = (int)((bits >> 52) & 0x7FF);
+
+  if (!significand && !biased_exponent) {
+    memcpy(p, "0.0", 3);
+    return (size_t)(p + 3 - buffer);
+  }
+
+  uint64_t f;
+  int e;
+
+  if (biased_exponent) {
+    f = significand | (UINT64_C(1) << 52);
+    e = biased_exponent - 1075;
+  } else {
+    f = significand;
+    e = -1074;
+  }
+
+  int k;
+  int length = dtoa_grisu2(f, e, !significand && biased_exponent > 1, p, &k);
+
+  return (size_t)(dtoa_format(p, length, k) - buffer);
+}
+
+/* Same as dtoa_double(), with digits enough to tell float values apart */
+static size_t dtoa_float(float value, char *buffer)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  char *p = buffer;
+  if (bits >> 31) {
+    *p++ = '-';
+  }
+
+  uint32_t significand = bits & ((UINT32_C(1) << 23) - 1);
+  int biased_exponent = (int)((bits >> 23) & 0xFF);
+
+  if (!significand && !biased_exponent) {
+    memcpy(p, "0.0", 3);
+    return (size_t)(p + 3 - buffer);
+  }
+
+  uint64_t f;
+  int e;
+
+  if (biased_exponent) {
+    f = significand | (UINT32_C(1) << 23);
+    e = biased_exponent - 150;
+  } else {
+    f = significand;
+    e = -149;
+  }
+
+  int k;
+  int length = dtoa_grisu2(f, e, !significand && biased_exponent > 1, p, &k);
+
+  return (size_t)(dtoa_format(p, length, k) - buffer);
+}
+
+#endif /* DTOA_H */
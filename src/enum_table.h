@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef ENUM_TABLE_H
+#define ENUM_TABLE_H 1
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Same hashing and quoting as field names */
+#include "field_table.h"
+
+/* Values are looked up by direct index when range is not much wider than number of values */
+#define ENUM_TABLE_MAX_SPARSENESS 2
+#define ENUM_TABLE_MIN_RANGE 16
+
+typedef struct enum_table_slot {
+  uint32_t hash;
+  /* Index in descriptor->values_by_name plus one, zero for empty slot */
+  uint32_t name;
+  size_t name_length;
+} enum_table_slot_t;
+
+/*
+ * Enum name -> value hash table of enum descriptor, built the same way
+ * as field_table_t, and value -> descriptor->values index array when
+ * values are dense enough.
+ *
+ * Also keeps names quoted, ready to be copied to output.
+ */
+typedef struct enum_table {
+  /* Should be first, see registry.h */
+  const ProtobufCEnumDescriptor *descriptor;
+  /* Indexed the same way as descriptor->values, NULL data if name needs escaping */
+  field_table_key_t *names;
+  /* Index in descriptor->values plus one by value - min_value, NULL if values are sparse */
+  uint32_t *by_value;
+  int32_t min_value;
+  uint32_t value_range;
+  uint32_t mask;
+  enum_table_slot_t slots[];
+} enum_table_t;
+
+static enum_table_t *enum_table_alloc(const ProtobufCEnumDescriptor *descriptor)
+{
+  size_t size = 2;
+  while (size < 2 * (size_t)descriptor->n_value_names) {
+    size *= 2;
+  }
+
+  size_t names_length = 0;
+  int64_t min_value = 0, max_value = -1;
+  unsigned int i;
+  for (i = 0; i < descriptor->n_values; i++) {
+    const ProtobufCEnumValue *enum_value = &descriptor->values[i];
+
+    names_length += strlen(enum_value->name) + 2;
+
+    if (i == 0 || enum_value->value < min_value) {
+      min_value = enum_value->value;
+    }
+    if (i == 0 || enum_value->value > max_value) {
+      max_value = enum_value->value;
+    }
+  }
+
+  uint64_t value_range = (uint64_t)(max_value - min_value + 1);
+  if (value_range > ENUM_TABLE_MIN_RANGE && value_range > (uint64_t)descriptor->n_values * ENUM_TABLE_MAX_SPARSENESS) {
+    value_range = 0;
+  }
+
+  /* Everything in one block, so table is freed at once */
+  size_t slots_size = size * sizeof(enum_table_slot_t);
+  size_t by_value_size = value_range * sizeof(uint32_t);
+  size_t names_size = descriptor->n_values * sizeof(field_table_key_t);
+
+  enum_table_t *table = calloc(1, sizeof(enum_table_t) + slots_size + by_value_size + names_size + names_length);
+  if (!table) {
+    return NULL;
+  }
+
+  table->descriptor = descriptor;
+  table->mask = size - 1;
+  table->names = (field_table_key_t *)((char *)table->slots + slots_size);
+
+  if (value_range) {
+    table->by_value = (uint32_t *)((char *)table->names + names_size);
+    table->min_value = (int32_t)min_value;
+    table->value_range = (uint32_t)value_range;
+  }
+
+  char *name_data = (char *)table->names + names_size + by_value_size;
+
+  for (i = 0; i < descriptor->n_values; i++) {
+    const ProtobufCEnumValue *enum_value = &descriptor->values[i];
+    size_t name_length = strlen(enum_value->name);
+
+    if (field_table_name_is_plain(enum_value->name, name_length)) {
+      table->names[i].data = name_data;
+      table->names[i].length = name_length + 2;
+
+      *name_data++ = '"';
+      memcpy(name_data, enum_value->name, name_length);
+      name_data += name_length;
+      *name_data++ = '"';
+    }
+
+    /* The first one of aliases, as protobuf_c_enum_descriptor_get_value() does */
+    if (table->by_value && !table->by_value[enum_value->value - table->min_value]) {
+      table->by_value[enum_value->value - table->min_value] = i + 1;
+    }
+  }
+
+  for (i = 0; i < descriptor->n_value_names; i++) {
+    const char *name = descriptor->values_by_name[i].name;
+    size_t name_length = strlen(name);
+    uint32_t hash = field_table_hash(name, name_length);
+
+    uint32_t j = hash & table->mask;
+    while (table->slots[j].name) {
+      j = (j + 1) & table->mask;
+    }
+
+    table->slots[j].hash = hash;
+    table->slots[j].name = i + 1;
+    table->slots[j].name_length = name_length;
+  }
+
+  return table;
+}
+
+/* Same as protobuf_c_enum_descriptor_get_value() */
+static const ProtobufCEnumValue *enum_table_get(const enum_table_t *table, int value)
+{
+  if (!table->by_value) {
+    return protobuf_c_enum_descriptor_get_value(table->descriptor, value);
+  }
+
+  /* Values below min_value wrap around to huge index */
+  uint64_t index = (uint64_t)((int64_t)value - table->min_value);
+  if (index >= table->value_range || !table->by_value[index]) {
+    return NULL;
+  }
+
+  return &table->descriptor->values[table->by_value[index] - 1];
+}
+
+/* Same as protobuf_c_enum_descriptor_get_value_by_name(), but name is not NUL-terminated */
+static const ProtobufCEnumValue *enum_table_get_by_name(const enum_table_t *table, const char *name, size_t name_length)
+{
+  uint32_t hash = field_table_hash(name, name_length);
+  uint32_t i = hash & table->mask;
+
+  for (;;) {
+    const enum_table_slot_t *slot = &table->slots[i];
+    if (!slot->name) {
+      return NULL;
+    }
+
+    if (slot->hash == hash && slot->name_length == name_length) {
+      const ProtobufCEnumValueIndex *value_index = &table->descriptor->values_by_name[slot->name - 1];
+
+      if (!memcmp(value_index->name, name, name_length)) {
+        return &table->descriptor->values[value_index->index];
+      }
+    }
+
+    i = (i + 1) & table->mask;
+  }
+}
+
+#endif /* ENUM_TABLE_H */
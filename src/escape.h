@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef ESCAPE_H
+#define ESCAPE_H 1
+
+#include <stddef.h>
+
+#include "simd.h"
+
+/*
+ * Finds where JSON string contents stop being plain printable ASCII,
+ * which is copied as is. Quotes, backslashes, control characters,
+ * slashes when asked to escape them and non-ASCII bytes (UTF-8 has to be
+ * validated) are left for the caller.
+ *
+ * Vectorized kernels check whole 16/32-byte blocks and are selected at
+ * runtime the same way as base64 ones.
+ */
+#if defined(SIMD_TARGET_ATTRIBUTE) && !defined(ESCAPE_NO_SIMD)
+#define ESCAPE_SIMD 1
+#endif
+
+#ifdef ESCAPE_SIMD
+
+#include <immintrin.h>
+
+/* Vector kernels do not pay off below it */
+#define ESCAPE_SIMD_MIN_LENGTH 16
+
+__attribute__((target("sse2")))
+static size_t escape_plain_length_sse2(const char *string, size_t length, int escape_slash)
+{
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  /* Never matches anything below 0x20 when slash is not escaped */
+  const __m128i slash = _mm_set1_epi8(escape_slash ? '/' : 0);
+  size_t i = 0;
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(string + i));
+
+    /* Signed comparison catches both control characters and bytes above 0x7F */
+    __m128i special = _mm_or_si128(
+      _mm_or_si128(_mm_cmplt_epi8(block, space), _mm_cmpeq_epi8(block, quote)),
+      _mm_or_si128(_mm_cmpeq_epi8(block, backslash), _mm_cmpeq_epi8(block, slash))
+    );
+
+    int mask = _mm_movemask_epi8(special);
+    if (mask) {
+      return i + (size_t)__builtin_ctz((unsigned int)mask);
+    }
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t escape_plain_length_avx2(const char *string, size_t length, int escape_slash)
+{
+  const __m256i space = _mm256_set1_epi8(0x20);
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i slash = _mm256_set1_epi8(escape_slash ? '/' : 0);
+  size_t i = 0;
+
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(string + i));
+
+    __m256i special = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpgt_epi8(space, block), _mm256_cmpeq_epi8(block, quote)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(block, backslash), _mm256_cmpeq_epi8(block, slash))
+    );
+
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i;
+}
+
+static int escape_has_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static int escape_has_sse2(void)
+{
+  return __builtin_cpu_supports("sse2");
+}
+
+#endif /* ESCAPE_SIMD */
+
+static size_t escape_plain_length(const char *string, size_t length, int escape_slash)
+{
+  size_t i = 0;
+
+#ifdef ESCAPE_SIMD
+  if (length >= ESCAPE_SIMD_MIN_LENGTH) {
+    if (length >= 32 && escape_has_avx2()) {
+      i = escape_plain_length_avx2(string, length, escape_slash);
+    }
+
+    /* Tail shorter than 32 bytes, SSE2 kernel stops right away if special character is found */
+    if (escape_has_sse2()) {
+      i += escape_plain_length_sse2(string + i, length - i, escape_slash);
+    }
+  }
+#endif
+
+  for (; i < length; i++) {
+    unsigned char c = (unsigned char)string[i];
+
+    if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\' || (escape_slash && c == '/')) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+#endif /* ESCAPE_H */
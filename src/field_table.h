@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef FIELD_TABLE_H
+#define FIELD_TABLE_H 1
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+
+typedef struct field_table_slot {
+  uint32_t hash;
+  /* Index in descriptor->fields plus one, zero for empty slot */
+  uint32_t field;
+  size_t name_length;
+} field_table_slot_t;
+
+/* Quoted field name followed by key separator, NULL data if name needs escaping */
+typedef struct field_table_key {
+  const char *data;
+  size_t length;
+} field_table_key_t;
+
+/*
+ * Field name -> field descriptor hash table of message descriptor.
+ * Open addressing with at most 50% load, so lookup of known name usually
+ * takes one probe and unknown one stops at the first empty slot.
+ *
+ * Also keeps JSON keys ready to be copied to output, as `"name": `,
+ * which becomes `"name":` for JSON_COMPACT by dropping the last byte,
+ * and mask of required fields without default value, to be checked
+ * against presence bitmap of decoded message.
+ */
+typedef struct field_table {
+  /* Should be first, see registry.h */
+  const ProtobufCMessageDescriptor *descriptor;
+  /* Indexed the same way as descriptor->fields */
+  field_table_key_t *keys;
+  /* bitmap_words_needed(descriptor->n_fields) words, NULL if nothing is required */
+  const bitmap_word_t *required;
+  uint32_t mask;
+  field_table_slot_t slots[];
+} field_table_t;
+
+/* Name can be written as is, whatever json_flags are */
+static int field_table_name_is_plain(const char *name, size_t name_length)
+{
+  size_t i;
+
+  for (i = 0; i < name_length; i++) {
+    unsigned char c = name[i];
+    if (c < 0x20 || c >= 0x7F || c == '"' || c == '\\' || c == '/') {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* FNV-1a */
+static uint32_t field_table_hash(const char *name, size_t name_length)
+{
+  uint32_t hash = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < name_length; i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+static field_table_t *field_table_alloc(const ProtobufCMessageDescriptor *descriptor)
+{
+  size_t size = 2;
+  while (size < 2 * (size_t)descriptor->n_fields) {
+    size *= 2;
+  }
+
+  size_t keys_length = 0;
+  int has_required = 0;
+  unsigned int i;
+  for (i = 0; i < descriptor->n_fields; i++) {
+    const ProtobufCFieldDescriptor *field_descriptor = &descriptor->fields[i];
+
+    keys_length += strlen(field_descriptor->name) + sizeof("\"\": ") - 1;
+
+    if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED && !field_descriptor->default_value) {
+      has_required = 1;
+    }
+  }
+
+  /* Everything in one block, so table is freed at once */
+  size_t slots_size = size * sizeof(field_table_slot_t);
+  size_t required_size = has_required ? bitmap_words_needed(descriptor->n_fields) * sizeof(bitmap_word_t) : 0;
+  size_t keys_size = descriptor->n_fields * sizeof(field_table_key_t);
+
+  field_table_t *table = calloc(1, sizeof(field_table_t) + slots_size + required_size + keys_size + keys_length);
+  if (!table) {
+    return NULL;
+  }
+
+  table->descriptor = descriptor;
+  table->keys = (field_table_key_t *)((char *)table->slots + slots_size + required_size);
+  table->mask = size - 1;
+
+  if (has_required) {
+    bitmap_word_t *required = (bitmap_word_t *)((char *)table->slots + slots_size);
+
+    for (i = 0; i < descriptor->n_fields; i++) {
+      const ProtobufCFieldDescriptor *field_descriptor = &descriptor->fields[i];
+
+      if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED && !field_descriptor->default_value) {
+        required[i / bitmap_word_t_bits] |= (bitmap_word_t)1 << (i % bitmap_word_t_bits);
+      }
+    }
+
+    table->required = required;
+  }
+
+  char *key_data = (char *)table->keys + keys_size;
+
+  for (i = 0; i < descriptor->n_fields; i++) {
+    const char *name = descriptor->fields[i].name;
+    size_t name_length = strlen(name);
+    uint32_t hash = field_table_hash(name, name_length);
+
+    if (field_table_name_is_plain(name, name_length)) {
+      table->keys[i].data = key_data;
+      table->keys[i].length = name_length + 4;
+
+      *key_data++ = '"';
+      memcpy(key_data, name, name_length);
+      key_data += name_length;
+      *key_data++ = '"';
+      *key_data++ = ':';
+      *key_data++ = ' ';
+    }
+
+    uint32_t j = hash & table->mask;
+    while (table->slots[j].field) {
+      j = (j + 1) & table->mask;
+    }
+
+    table->slots[j].hash = hash;
+    table->slots[j].field = i + 1;
+    table->slots[j].name_length = name_length;
+  }
+
+  return table;
+}
+
+static const ProtobufCFieldDescriptor *field_table_get(const field_table_t *table, const char *name, size_t name_length)
+{
+  uint32_t hash = field_table_hash(name, name_length);
+  uint32_t i = hash & table->mask;
+
+  for (;;) {
+    const field_table_slot_t *slot = &table->slots[i];
+    if (!slot->field) {
+      return NULL;
+    }
+
+    if (slot->hash == hash && slot->name_length == name_length) {
+      const ProtobufCFieldDescriptor *field_descriptor = &table->descriptor->fields[slot->field - 1];
+
+      if (!memcmp(field_descriptor->name, name, name_length)) {
+        return field_descriptor;
+      }
+    }
+
+    i = (i + 1) & table->mask;
+  }
+}
+
+#endif /* FIELD_TABLE_H */
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef ITOA_H
+#define ITOA_H 1
+
+/*
+ * Integer to decimal text without snprintf(3): length is known upfront
+ * from the bit length, then digits are written from the end two at a time.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/* Enough for "-9223372036854775808" */
+#define ITOA_BUFFER_SIZE 20
+
+static const char itoa_digit_pairs[200] = {
+  '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+  '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+  '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+  '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+  '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+  '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+  '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+  '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+  '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+  '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static const uint64_t itoa_pow10[] = {
+  UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+  UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000),
+  UINT64_C(1000000000), UINT64_C(10000000000), UINT64_C(100000000000),
+  UINT64_C(1000000000000), UINT64_C(10000000000000), UINT64_C(100000000000000),
+  UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+  UINT64_C(100000000000000000), UINT64_C(1000000000000000000),
+  UINT64_C(10000000000000000000)
+};
+
+static int itoa_count_digits(uint64_t value)
+{
+#if defined(__GNUC__)
+  /* 1233 / 4096 ~ log10(2), so this is the number of digits or one less */
+  int digits = ((64 - __builtin_clzll(value | 1)) * 1233) >> 12;
+
+  /* Zero has one digit too */
+  return digits + ((value | 1) >= itoa_pow10[digits]);
+#else
+  int digits = 1;
+
+  while (digits < 20 && value >= itoa_pow10[digits]) {
+    digits++;
+  }
+
+  return digits;
+#endif
+}
+
+/* Returns length, buffer should have room for ITOA_BUFFER_SIZE bytes, no NUL is written */
+static size_t itoa_u32(uint32_t value, char *buffer)
+{
+  int length = itoa_count_digits(value);
+  char *p = buffer + length;
+
+  while (value >= 100) {
+    unsigned int pair = (value % 100) * 2;
+    value /= 100;
+
+    p -= 2;
+    memcpy(p, &itoa_digit_pairs[pair], 2);
+  }
+
+  if (value >= 10) {
+    p -= 2;
+    memcpy(p, &itoa_digit_pairs[value * 2], 2);
+  } else {
+    *--p = (char)('0' + value);
+  }
+
+  return (size_t)length;
+}
+
+static size_t itoa_i32(int32_t value, char *buffer)
+{
+  if (value < 0) {
+    *buffer = '-';
+    /* Negating in unsigned, so INT32_MIN is fine */
+    return itoa_u32(0 - (uint32_t)value, buffer + 1) + 1;
+  }
+
+  return itoa_u32((uint32_t)value, buffer);
+}
+
+static size_t itoa_u64(uint64_t value, char *buffer)
+{
+  /* Division in 32-bit arithmetic is cheaper, and most values are small */
+  if (value <= UINT32_MAX) {
+    return itoa_u32((uint32_t)value, buffer);
+  }
+
+  int length = itoa_count_digits(value);
+  char *p = buffer + length;
+
+  while (value > UINT32_MAX) {
+    unsigned int pair = (unsigned int)(value % 100) * 2;
+    value /= 100;
+
+    p -= 2;
+    memcpy(p, &itoa_digit_pairs[pair], 2);
+  }
+
+  uint32_t rest = (uint32_t)value;
+
+  while (rest >= 100) {
+    unsigned int pair = (rest % 100) * 2;
+    rest /= 100;
+
+    p -= 2;
+    memcpy(p, &itoa_digit_pairs[pair], 2);
+  }
+
+  if (rest >= 10) {
+    p -= 2;
+    memcpy(p, &itoa_digit_pairs[rest * 2], 2);
+  } else {
+    *--p = (char)('0' + rest);
+  }
+
+  return (size_t)length;
+}
+
+static size_t itoa_i64(int64_t value, char *buffer)
+{
+  if (value < 0) {
+    *buffer = '-';
+    return itoa_u64(0 - (uint64_t)value, buffer + 1) + 1;
+  }
+
+  return itoa_u64((uint64_t)value, buffer);
+}
+
+#endif /* ITOA_H */
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef NUMBER_H
+#define NUMBER_H 1
+
+/*
+ * Parsing of JSON number tokens that are already validated,
+ * so digits are not checked again and there is no need for NUL terminator.
+ *
+ * Eight digits are converted at once (SWAR) on little-endian targets.
+ * Reals are exact when significand fits in 53 bits and power of ten
+ * in [-22, 22] (Clinger's fast path), which covers most real-world values;
+ * the rest should be left to strtod(3).
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NUMBER_SWAR 1
+#endif
+
+/* Double arithmetic without excess precision, e.g. not x87 */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define NUMBER_FAST_REAL 1
+#endif
+
+/* value = mantissa * 10^exponent */
+typedef struct number {
+  uint64_t mantissa;
+  int exponent;
+  /* Significant digits in mantissa, at most 19 so it cannot overflow */
+  int digits;
+  int negative;
+  /* Some non-zero digits did not fit in mantissa */
+  int truncated;
+} number_t;
+
+#ifdef NUMBER_SWAR
+static int number_is_eight_digits(uint64_t chunk)
+{
+  return !(((chunk + UINT64_C(0x4646464646464646)) | (chunk - UINT64_C(0x3030303030303030))) & UINT64_C(0x8080808080808080));
+}
+
+/* "12345678" -> 12345678 with three multiplications */
+static uint32_t number_eight_digits(uint64_t chunk)
+{
+  const uint64_t mask = UINT64_C(0x000000FF000000FF);
+  const uint64_t mul1 = UINT64_C(0x000F424000000064); /* 100 + (1000000 << 32) */
+  const uint64_t mul2 = UINT64_C(0x0000271000000001); /* 1 + (10000 << 32) */
+
+  chunk -= UINT64_C(0x3030303030303030);
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+
+  return (uint32_t)chunk;
+}
+#endif
+
+/* Accumulates digits of integer or fraction part, returns pointer past them */
+static const char *number_parse_digits(const char *p, const char *end, number_t *number, int fraction)
+{
+#ifdef NUMBER_SWAR
+  while (end - p >= 8 && number->digits <= 19 - 8) {
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+
+    if (!number_is_eight_digits(chunk)) {
+      break;
+    }
+
+    uint32_t value = number_eight_digits(chunk);
+
+    if (number->mantissa) {
+      number->digits += 8;
+    } else {
+      /* Leading zeros of fraction are not significant */
+      uint32_t rest;
+      for (rest = value; rest; rest /= 10) {
+        number->digits++;
+      }
+    }
+
+    number->mantissa = number->mantissa * 100000000 + value;
+    if (fraction) {
+      number->exponent -= 8;
+    }
+
+    p += 8;
+  }
+#endif
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (number->digits < 19) {
+      number->mantissa = number->mantissa * 10 + (uint64_t)(*p - '0');
+      if (number->mantissa) {
+        number->digits++;
+      }
+      if (fraction) {
+        number->exponent--;
+      }
+    } else {
+      if (!fraction) {
+        number->exponent++;
+      }
+      if (*p != '0') {
+        number->truncated = 1;
+      }
+    }
+  }
+
+  return p;
+}
+
+static void number_parse(const char *p, const char *end, number_t *number)
+{
+  number->mantissa = 0;
+  number->exponent = 0;
+  number->digits = 0;
+  number->negative = 0;
+  number->truncated = 0;
+
+  if (p < end && *p == '-') {
+    number->negative = 1;
+    p++;
+  }
+
+  p = number_parse_digits(p, end, number, 0);
+
+  if (p < end && *p == '.') {
+    p = number_parse_digits(p + 1, end, number, 1);
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    int exponent_negative = 0;
+    int exponent = 0;
+
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) {
+      exponent_negative = (*p == '-');
+      p++;
+    }
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      /* Anything above is overflow or zero anyway */
+      if (exponent < 100000) {
+        exponent = exponent * 10 + (*p - '0');
+      }
+    }
+
+    number->exponent += exponent_negative ? -exponent : exponent;
+  }
+}
+
+/* Returns -1 if value cannot be computed exactly this way */
+static int number_to_double(const number_t *number, double *value)
+{
+#ifdef NUMBER_FAST_REAL
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22
+  };
+
+  if (number->truncated || number->mantissa > (UINT64_C(1) << 53)) {
+    return -1;
+  }
+
+  double result = (double)number->mantissa;
+
+  if (number->mantissa) {
+    if (number->exponent < -22 || number->exponent > 22) {
+      return -1;
+    }
+
+    if (number->exponent < 0) {
+      result /= powers[-number->exponent];
+    } else {
+      result *= powers[number->exponent];
+    }
+  }
+
+  *value = number->negative ? -result : result;
+
+  return 0;
+#else
+  (void)number;
+  (void)value;
+
+  return -1;
+#endif
+}
+
+/* Digits of integer without sign, returns -1 if it does not fit in 64 bits */
+static int number_parse_uint64(const char *p, const char *end, uint64_t *value)
+{
+  uint64_t result = 0;
+
+  /* JSON integers have no leading zeros */
+  if (end - p > 20) {
+    return -1;
+  }
+
+#ifdef NUMBER_SWAR
+  while (end - p >= 8 && result < UINT64_C(100000000000)) {
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+
+    result = result * 100000000 + number_eight_digits(chunk);
+    p += 8;
+  }
+#endif
+
+  for (; p < end; p++) {
+    unsigned int digit = (unsigned int)(*p - '0');
+
+    if (result > (UINT64_MAX - digit) / 10) {
+      return -1;
+    }
+
+    result = result * 10 + digit;
+  }
+
+  *value = result;
+
+  return 0;
+}
+
+#endif /* NUMBER_H */
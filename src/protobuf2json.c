@@ -10,16 +10,51 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <locale.h>
+#include <inttypes.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 /* Interface definitions */
 #include "protobuf2json.h"
 
-/* Simple bitmap implementation */
+/* Presence bitmap of decoded message fields */
 #include "bitmap.h"
 
 /* Simple base64 implementation */
 #include "base64.h"
 
+/* Growable output buffer */
+#include "buffer.h"
+
+/* Shortest round-trip formatting of reals */
+#include "dtoa.h"
+
+/* Integer formatting without snprintf(3) */
+#include "itoa.h"
+
+/* Bulk copying of string contents which need no escaping */
+#include "escape.h"
+
+/* Validation of UTF-8 string contents by blocks */
+#include "utf8.h"
+
+/* Parsing of validated number tokens */
+#include "number.h"
+
+/* Bump allocator for decoded messages */
+#include "arena.h"
+
+/* Protobuf wire format primitives */
+#include "wire.h"
+
+/* Lock-free per-descriptor caches */
+#include "registry.h"
+#include "field_table.h"
+#include "enum_table.h"
+
 /* === Defines === obviously private === */
 
 #define SET_ERROR_STRING_AND_RETURN(error, error_string_format, ...)                           \
@@ -34,6 +69,319 @@ do {
   return error;                                                                                \
 } while (0)
 
+/* === Errors === Private === */
+
+/*
+ * Puts formatted prefix in front of error already in `error_string`,
+ * moving the error right instead of copying it, so nothing is cut
+ * short of `error_size`.
+ */
+static void protobuf2json_prefix_error(
+  char *error_string,
+  size_t error_size,
+  const char *prefix_format,
+  ...
+) {
+  char prefix[64];
+  va_list args;
+
+  if (!error_string || !error_size) {
+    return;
+  }
+
+  va_start(args, prefix_format);
+  int prefix_result = vsnprintf(prefix, sizeof(prefix), prefix_format, args);
+  va_end(args);
+
+  if (prefix_result < 0) {
+    return;
+  }
+
+  size_t available = error_size - 1;
+  size_t prefix_length = (size_t)prefix_result < sizeof(prefix) ? (size_t)prefix_result : sizeof(prefix) - 1;
+  if (prefix_length > available) {
+    prefix_length = available;
+  }
+
+  const char *error_end = memchr(error_string, '\0', error_size);
+  size_t error_length = error_end ? (size_t)(error_end - error_string) : available;
+  if (error_length > available - prefix_length) {
+    error_length = available - prefix_length;
+  }
+
+  memmove(error_string + prefix_length, error_string, error_length);
+  memcpy(error_string, prefix, prefix_length);
+  error_string[prefix_length + error_length] = '\0';
+}
+
+/* === Descriptor caches === Private === */
+
+static registry_t protobuf2json_field_tables;
+
+/* Returns table built once per descriptor, NULL if it cannot be allocated or registered */
+static const field_table_t *protobuf2json_field_table(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor
+) {
+  field_table_t *table = registry_get(&protobuf2json_field_tables, protobuf_message_descriptor);
+
+  if (!table && !registry_is_full(&protobuf2json_field_tables)) {
+    table = field_table_alloc(protobuf_message_descriptor);
+
+    if (table) {
+      field_table_t *registered_table = registry_put(&protobuf2json_field_tables, table);
+      if (registered_table != table) {
+        free(table);
+        table = registered_table;
+      }
+    }
+  }
+
+  return table;
+}
+
+/* Generated codecs registered with protobuf2json_register_codecs() */
+static registry_t protobuf2json_codecs;
+
+static const protobuf2json_codec_t *protobuf2json_codec(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor
+) {
+  return registry_get(&protobuf2json_codecs, protobuf_message_descriptor);
+}
+
+/*
+ * Same as protobuf_c_message_descriptor_get_field_by_name(), but hash table
+ * is built once per descriptor instead of binary search with strcmp(3) for every key.
+ * Name should be NUL-terminated anyway, for fallback when table is not available.
+ */
+static const ProtobufCFieldDescriptor *protobuf2json_field_by_name(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *name,
+  size_t name_length
+) {
+  const protobuf2json_codec_t *codec = protobuf2json_codec(protobuf_message_descriptor);
+
+  if (codec && codec->field_index) {
+    int field_index = codec->field_index(name, name_length);
+
+    return field_index < 0 ? NULL : &protobuf_message_descriptor->fields[field_index];
+  }
+
+  const field_table_t *table = protobuf2json_field_table(protobuf_message_descriptor);
+
+  if (!table) {
+    return protobuf_c_message_descriptor_get_field_by_name(protobuf_message_descriptor, name);
+  }
+
+  return field_table_get(table, name, name_length);
+}
+
+static registry_t protobuf2json_enum_tables;
+
+/* Same as protobuf2json_field_table() for enum descriptor */
+static const enum_table_t *protobuf2json_enum_table(
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor
+) {
+  enum_table_t *table = registry_get(&protobuf2json_enum_tables, protobuf_enum_descriptor);
+
+  if (!table && !registry_is_full(&protobuf2json_enum_tables)) {
+    table = enum_table_alloc(protobuf_enum_descriptor);
+
+    if (table) {
+      enum_table_t *registered_table = registry_put(&protobuf2json_enum_tables, table);
+      if (registered_table != table) {
+        free(table);
+        table = registered_table;
+      }
+    }
+  }
+
+  return table;
+}
+
+/* Same as protobuf_c_enum_descriptor_get_value(), but by direct index for dense enums */
+static const ProtobufCEnumValue *protobuf2json_enum_value(
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor,
+  int value
+) {
+  const enum_table_t *table = protobuf2json_enum_table(protobuf_enum_descriptor);
+
+  if (!table) {
+    return protobuf_c_enum_descriptor_get_value(protobuf_enum_descriptor, value);
+  }
+
+  return enum_table_get(table, value);
+}
+
+/* Same as protobuf_c_enum_descriptor_get_value_by_name(), but by hash table and name is not NUL-terminated */
+static const ProtobufCEnumValue *protobuf2json_enum_value_by_name(
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor,
+  const char *name,
+  size_t name_length
+) {
+  const enum_table_t *table = protobuf2json_enum_table(protobuf_enum_descriptor);
+
+  if (table) {
+    return enum_table_get_by_name(table, name, name_length);
+  }
+
+  /* Binary search by sorted names, as protobuf_c_enum_descriptor_get_value_by_name() does */
+  unsigned int start = 0, count = protobuf_enum_descriptor->n_value_names;
+  while (count) {
+    unsigned int middle = start + count / 2;
+    const ProtobufCEnumValueIndex *value_index = &protobuf_enum_descriptor->values_by_name[middle];
+
+    size_t value_name_length = strlen(value_index->name);
+
+    int compare = memcmp(value_index->name, name, value_name_length < name_length ? value_name_length : name_length);
+    if (!compare) {
+      compare = (value_name_length > name_length) - (value_name_length < name_length);
+    }
+
+    if (!compare) {
+      return &protobuf_enum_descriptor->values[value_index->index];
+    } else if (compare < 0) {
+      count = start + count - middle - 1;
+      start = middle + 1;
+    } else {
+      count = middle - start;
+    }
+  }
+
+  return NULL;
+}
+
+/* Returns required field without default value that is not presented, NULL if there is none */
+static const ProtobufCFieldDescriptor *protobuf2json_missing_required_field(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const bitmap_t *presented_fields
+) {
+  const field_table_t *table = protobuf2json_field_table(protobuf_message_descriptor);
+
+  if (table) {
+    if (!table->required) {
+      return NULL;
+    }
+
+    if (bitmap_contains(presented_fields, table->required, bitmap_words_needed(protobuf_message_descriptor->n_fields))) {
+      return NULL;
+    }
+  }
+
+  /* Find out which one is missing, or check them all if table is not available */
+  unsigned int i = 0;
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf_message_descriptor->fields + i;
+
+    if ((field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) && !field_descriptor->default_value && !bitmap_get(presented_fields, i)) {
+      return field_descriptor;
+    }
+  }
+
+  return NULL;
+}
+
+/* === Descriptor caches === Public === */
+
+/* Builds tables of message type and its enums, appends types of its message fields not listed yet */
+static int protobuf2json_prepare_message(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  buffer_t *descriptors,
+  char *error_string,
+  size_t error_size
+) {
+  /* Tables are not built past registry capacity, lookups do without them then */
+  if (!protobuf2json_field_table(protobuf_message_descriptor) && !registry_is_full(&protobuf2json_field_tables)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate field table of message '%s'",
+      protobuf_message_descriptor->name
+    );
+  }
+
+  unsigned i;
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    const ProtobufCFieldDescriptor *field_descriptor = &protobuf_message_descriptor->fields[i];
+
+    if (field_descriptor->type == PROTOBUF_C_TYPE_ENUM) {
+      const ProtobufCEnumDescriptor *protobuf_enum_descriptor = field_descriptor->descriptor;
+
+      if (!protobuf2json_enum_table(protobuf_enum_descriptor) && !registry_is_full(&protobuf2json_enum_tables)) {
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+          "Cannot allocate value table of enum '%s'",
+          protobuf_enum_descriptor->name
+        );
+      }
+    } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
+      const ProtobufCMessageDescriptor *nested_descriptor = field_descriptor->descriptor;
+      const ProtobufCMessageDescriptor **listed = (const ProtobufCMessageDescriptor **)descriptors->data;
+      size_t n_listed = descriptors->length / sizeof(*listed);
+      size_t j;
+
+      for (j = 0; j < n_listed && listed[j] != nested_descriptor; j++);
+
+      if (j < n_listed) {
+        continue;
+      }
+
+      if (buffer_reserve(descriptors, sizeof(nested_descriptor))) {
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+          "Cannot allocate %zu bytes using realloc(3)",
+          descriptors->length + sizeof(nested_descriptor)
+        );
+      }
+
+      ((const ProtobufCMessageDescriptor **)descriptors->data)[n_listed] = nested_descriptor;
+      descriptors->length += sizeof(nested_descriptor);
+    }
+  }
+
+  return 0;
+}
+
+int protobuf2json_prepare_descriptor(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  char *error_string,
+  size_t error_size
+) {
+  if (!protobuf_message_descriptor) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_INVALID_ARGUMENT,
+      "Cannot prepare NULL descriptor"
+    );
+  }
+
+  /* Every message type reachable from the given one, listed once, so recursive types end */
+  buffer_t descriptors;
+  buffer_init(&descriptors);
+
+  if (buffer_reserve(&descriptors, sizeof(protobuf_message_descriptor))) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      (size_t)BUFFER_MIN_SIZE
+    );
+  }
+
+  ((const ProtobufCMessageDescriptor **)descriptors.data)[0] = protobuf_message_descriptor;
+  descriptors.length = sizeof(protobuf_message_descriptor);
+
+  int result = 0;
+  size_t i;
+
+  /* List grows while it is walked, and may be moved by realloc(3) */
+  for (i = 0; i < descriptors.length / sizeof(protobuf_message_descriptor) && !result; i++) {
+    const ProtobufCMessageDescriptor *descriptor = ((const ProtobufCMessageDescriptor **)descriptors.data)[i];
+
+    result = protobuf2json_prepare_message(descriptor, &descriptors, error_string, error_size);
+  }
+
+  buffer_free(&descriptors);
+
+  return result;
+}
+
 /* === Protobuf -> JSON === Private === */
 
 static size_t protobuf2json_value_size_by_type(ProtobufCType type) {
@@ -113,7 +461,7 @@ static int protobuf2json_process_field(
       *json_value = json_boolean(*(protobuf_c_boolean *)protobuf_value);
       break;
     case PROTOBUF_C_TYPE_ENUM: {
-      const ProtobufCEnumValue *protobuf_enum_value = protobuf_c_enum_descriptor_get_value(
+      const ProtobufCEnumValue *protobuf_enum_value = protobuf2json_enum_value(
         field_descriptor->descriptor,
         *(int *)protobuf_value
       );
@@ -160,6 +508,8 @@ static int protobuf2json_process_field(
 
       int result = protobuf2json_process_message(*protobuf_message, json_value, error_string, error_size);
       if (result) {
+        json_decref(*json_value);
+        *json_value = NULL;
         return result;
       }
 
@@ -269,6 +619,8 @@ static int protobuf2json_process_message(
 
         size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
         if (!value_size) {
+          json_decref(array);
+
           SET_ERROR_STRING_AND_RETURN(
             PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
             "Cannot calculate value size for %d using protobuf2json_value_size_by_type()",
@@ -284,10 +636,13 @@ static int protobuf2json_process_message(
 
           int result = protobuf2json_process_field(field_descriptor, (const void *)protobuf_value_repeated, &json_value, error_string, error_size);
           if (result) {
+            json_decref(array);
             return result;
           }
 
           if (json_array_append_new(array, json_value)) {
+            json_decref(array);
+
             SET_ERROR_STRING_AND_RETURN(
               PROTOBUF2JSON_ERR_JANSSON_INTERNAL,
               "Error in json_array_append_new()"
@@ -411,544 +766,5807 @@ int protobuf2json_file(
   return 0;
 }
 
-/* === JSON -> Protobuf === Private === */
+/* === Protobuf -> JSON === Writer === Private === */
 
-static int json2protobuf_process_message(
-  json_t *json_object,
-  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
-  ProtobufCMessage **protobuf_message,
+/*
+ * Direct writer emits JSON text while walking the message descriptor,
+ * without building an intermediate jansson tree. Output is formatted
+ * the same way json_dumps() does for the same json_flags.
+ *
+ * Without callback everything is accumulated in the buffer. With callback
+ * the buffer is kept at PROTOBUF2JSON_WRITER_CHUNK_SIZE and passed to
+ * callback each time it fills up, so memory usage does not depend on
+ * message size.
+ *
+ * In measure mode nothing is stored: the buffer is left empty and only its
+ * length counts bytes of output, so the size of JSON is known exactly
+ * without producing it.
+ *
+ * Fixed buffer is owned by caller and never grows: once output does not
+ * fit, writer switches to measure mode to find out how much room is needed.
+ */
+
+#define PROTOBUF2JSON_WRITER_INDENT(flags) ((flags) & JSON_MAX_INDENT)
+#define PROTOBUF2JSON_WRITER_PRECISION(flags) (((flags) >> 11) & 0x1F)
+
+#define PROTOBUF2JSON_WRITER_CHUNK_SIZE 4096
+#define PROTOBUF2JSON_WRITER_BASE64_CHUNK_SIZE (PROTOBUF2JSON_WRITER_CHUNK_SIZE / 4 * 3)
+
+/* Typedef is public, see protobuf2json_codec_t */
+struct protobuf2json_writer {
+  buffer_t buffer;
+  size_t json_flags;
+  json_dump_callback_t callback;
+  void *callback_data;
+  int measure;
+  int fixed;
+};
+
+static void protobuf2json_writer_init(protobuf2json_writer_t *writer, size_t json_flags) {
+  buffer_init(&writer->buffer);
+  writer->json_flags = json_flags;
+  writer->callback = NULL;
+  writer->callback_data = NULL;
+  writer->measure = 0;
+  writer->fixed = 0;
+}
+
+static int protobuf2json_writer_flush(
+  protobuf2json_writer_t *writer,
   char *error_string,
   size_t error_size
-);
+) {
+  if (!writer->callback || !writer->buffer.length) {
+    return 0;
+  }
 
-static const char* json2protobuf_integer_name_by_c_type(ProtobufCType type) {
-  switch (type) {
-    case PROTOBUF_C_TYPE_INT32:
-      return "int32";
-    case PROTOBUF_C_TYPE_SINT32:
-      return "sint32";
-    case PROTOBUF_C_TYPE_SFIXED32:
-      return "sfixed32";
-    case PROTOBUF_C_TYPE_UINT32:
-      return "uint32";
-    case PROTOBUF_C_TYPE_FIXED32:
-      return "fixed32";
-    case PROTOBUF_C_TYPE_INT64:
-      return "int64";
-    case PROTOBUF_C_TYPE_SINT64:
-      return "sint64";
-    case PROTOBUF_C_TYPE_SFIXED64:
-      return "sfixed64";
-    case PROTOBUF_C_TYPE_UINT64:
-      return "uint64";
-    case PROTOBUF_C_TYPE_FIXED64:
-      return "fixed64";
-    default:
-      assert(0);
-      return "unknown";
+  if (writer->callback(writer->buffer.data, writer->buffer.length, writer->callback_data)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK,
+      "Callback failed to write %zu bytes of JSON",
+      writer->buffer.length
+    );
   }
+
+  writer->buffer.length = 0;
+
+  return 0;
 }
 
-static int json2protobuf_process_field(
-  const ProtobufCFieldDescriptor *field_descriptor,
-  json_t *json_value,
-  void *protobuf_value,
+/* Makes room for `length` contiguous bytes at the end of writer buffer */
+static int protobuf2json_writer_reserve(
+  protobuf2json_writer_t *writer,
+  size_t length,
   char *error_string,
   size_t error_size
 ) {
-  if (field_descriptor->type == PROTOBUF_C_TYPE_INT32
-   || field_descriptor->type == PROTOBUF_C_TYPE_SINT32
-   || field_descriptor->type == PROTOBUF_C_TYPE_SFIXED32
-  ) {
-    if (!json_is_integer(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
-        "JSON value is not an integer required for GPB %s",
-        json2protobuf_integer_name_by_c_type(field_descriptor->type)
-      );
-    }
+  if (writer->measure || writer->buffer.size - writer->buffer.length >= length) {
+    return 0;
+  }
 
-    int32_t value_int32_t = (int32_t)json_integer_value(json_value);
+  if (writer->fixed) {
+    writer->measure = 1;
 
-    memcpy(protobuf_value, &value_int32_t, sizeof(value_int32_t));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_UINT32
-          || field_descriptor->type == PROTOBUF_C_TYPE_FIXED32
-  ) {
-    if (!json_is_integer(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
-        "JSON value is not an integer required for GPB %s",
-        json2protobuf_integer_name_by_c_type(field_descriptor->type)
-      );
-    }
+    return 0;
+  }
 
-    uint32_t value_uint32_t = (uint32_t)json_integer_value(json_value);
+  int result = protobuf2json_writer_flush(writer, error_string, error_size);
+  if (result) {
+    return result;
+  }
 
-    memcpy(protobuf_value, &value_uint32_t, sizeof(value_uint32_t));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_INT64
-          || field_descriptor->type == PROTOBUF_C_TYPE_SINT64
-          || field_descriptor->type == PROTOBUF_C_TYPE_SFIXED64
-  ) {
-    if (!json_is_integer(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
-        "JSON value is not an integer required for GPB %s",
-        json2protobuf_integer_name_by_c_type(field_descriptor->type)
-      );
-    }
+  if (buffer_reserve(&writer->buffer, length)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      writer->buffer.length + length
+    );
+  }
 
-    int64_t value_int64_t = (int64_t)json_integer_value(json_value);
+  return 0;
+}
+
+static int protobuf2json_writer_append(
+  protobuf2json_writer_t *writer,
+  const char *data,
+  size_t length,
+  char *error_string,
+  size_t error_size
+) {
+  if (writer->measure) {
+    writer->buffer.length += length;
+
+    return 0;
+  }
+
+  if (writer->buffer.size - writer->buffer.length >= length) {
+    memcpy(writer->buffer.data + writer->buffer.length, data, length);
+    writer->buffer.length += length;
+
+    return 0;
+  }
+
+  if (writer->fixed) {
+    writer->measure = 1;
+    writer->buffer.length += length;
+
+    return 0;
+  }
+
+  /* Large pieces go to callback as is, there is no need to copy them */
+  if (writer->callback && length >= PROTOBUF2JSON_WRITER_CHUNK_SIZE) {
+    int result = protobuf2json_writer_flush(writer, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    if (writer->callback(data, length, writer->callback_data)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK,
+        "Callback failed to write %zu bytes of JSON",
+        length
+      );
+    }
+
+    return 0;
+  }
+
+  int result = protobuf2json_writer_reserve(writer, length, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  memcpy(writer->buffer.data + writer->buffer.length, data, length);
+  writer->buffer.length += length;
+
+  return 0;
+}
+
+#define PROTOBUF2JSON_WRITER_APPEND(data, length)                                              \
+do {                                                                                           \
+  int append_result = protobuf2json_writer_append(writer, data, length, error_string, error_size); \
+  if (append_result) {                                                                         \
+    return append_result;                                                                      \
+  }                                                                                            \
+} while (0)
+
+static int protobuf2json_writer_append_indent(
+  protobuf2json_writer_t *writer,
+  int depth,
+  int space,
+  char *error_string,
+  size_t error_size
+) {
+  static const char spaces[] = "                                ";
+
+  size_t indent = PROTOBUF2JSON_WRITER_INDENT(writer->json_flags);
+
+  if (indent > 0) {
+    PROTOBUF2JSON_WRITER_APPEND("\n", 1);
+
+    size_t n_spaces = depth * indent;
+    while (n_spaces > 0) {
+      size_t chunk = n_spaces < sizeof(spaces) - 1 ? n_spaces : sizeof(spaces) - 1;
+
+      PROTOBUF2JSON_WRITER_APPEND(spaces, chunk);
+      n_spaces -= chunk;
+    }
+  } else if (space && !(writer->json_flags & JSON_COMPACT)) {
+    PROTOBUF2JSON_WRITER_APPEND(" ", 1);
+  }
+
+  return 0;
+}
+
+static int protobuf2json_writer_append_escaped(
+  protobuf2json_writer_t *writer,
+  const char *string,
+  size_t string_length,
+  char *error_string,
+  size_t error_size
+) {
+  static const char hex[] = "0123456789ABCDEF";
+
+  const unsigned char *s = (const unsigned char *)string;
+  size_t run_start = 0, i = 0;
+
+  while (i < string_length) {
+    i += escape_plain_length(string + i, string_length - i, (writer->json_flags & JSON_ESCAPE_SLASH) != 0);
+    if (i == string_length) {
+      break;
+    }
+
+    unsigned char c = s[i];
+    int32_t codepoint = c;
+    size_t sequence_length = 1;
+
+    if (c >= 0x80) {
+      /* Valid UTF-8 text is copied as is, unless it has to be escaped, and so does slash */
+      if (!(writer->json_flags & (JSON_ENSURE_ASCII | JSON_ESCAPE_SLASH))) {
+        size_t valid_length = utf8_string_length(string + i, string_length - i);
+        if (valid_length) {
+          i += valid_length;
+          continue;
+        }
+      }
+
+      sequence_length = utf8_sequence(s + i, string_length - i, &codepoint);
+      if (!sequence_length) {
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE,
+          "Invalid UTF-8 sequence at position %zu in string value",
+          i
+        );
+      }
+
+      if (!(writer->json_flags & JSON_ENSURE_ASCII)) {
+        i += sequence_length;
+        continue;
+      }
+    }
+
+    PROTOBUF2JSON_WRITER_APPEND(string + run_start, i - run_start);
+
+    char escape[12];
+    size_t escape_length = 2;
+
+    escape[0] = '\\';
+    switch (codepoint) {
+      case '\\': escape[1] = '\\'; break;
+      case '"':  escape[1] = '"';  break;
+      case '\b': escape[1] = 'b';  break;
+      case '\f': escape[1] = 'f';  break;
+      case '\n': escape[1] = 'n';  break;
+      case '\r': escape[1] = 'r';  break;
+      case '\t': escape[1] = 't';  break;
+      case '/':  escape[1] = '/';  break;
+      default: {
+        int32_t units[2];
+        size_t n_units = 1, u;
+
+        if (codepoint < 0x10000) {
+          units[0] = codepoint;
+        } else {
+          codepoint -= 0x10000;
+          units[0] = 0xD800 | ((codepoint & 0xFFC00) >> 10);
+          units[1] = 0xDC00 | (codepoint & 0x003FF);
+          n_units = 2;
+        }
+
+        escape_length = 0;
+        for (u = 0; u < n_units; u++) {
+          escape[escape_length++] = '\\';
+          escape[escape_length++] = 'u';
+          escape[escape_length++] = hex[(units[u] >> 12) & 0xF];
+          escape[escape_length++] = hex[(units[u] >> 8) & 0xF];
+          escape[escape_length++] = hex[(units[u] >> 4) & 0xF];
+          escape[escape_length++] = hex[units[u] & 0xF];
+        }
+        break;
+      }
+    }
+
+    PROTOBUF2JSON_WRITER_APPEND(escape, escape_length);
+
+    i += sequence_length;
+    run_start = i;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND(string + run_start, i - run_start);
+
+  return 0;
+}
+
+static int protobuf2json_writer_append_string(
+  protobuf2json_writer_t *writer,
+  const char *string,
+  size_t string_length,
+  char *error_string,
+  size_t error_size
+) {
+  PROTOBUF2JSON_WRITER_APPEND("\"", 1);
+
+  int result = protobuf2json_writer_append_escaped(writer, string, string_length, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND("\"", 1);
+
+  return 0;
+}
+
+static int protobuf2json_writer_append_base64(
+  protobuf2json_writer_t *writer,
+  const char *data,
+  size_t length,
+  char *error_string,
+  size_t error_size
+) {
+  /* Encode by chunks of whole base64 quantums, so no output buffer grows above chunk size */
+  char base64_encoded_data[base64_encoded_len(PROTOBUF2JSON_WRITER_BASE64_CHUNK_SIZE)];
+  size_t offset = 0;
+
+  PROTOBUF2JSON_WRITER_APPEND("\"", 1);
+
+  while (offset < length) {
+    size_t chunk = length - offset;
+    if (chunk > PROTOBUF2JSON_WRITER_BASE64_CHUNK_SIZE) {
+      chunk = PROTOBUF2JSON_WRITER_BASE64_CHUNK_SIZE;
+    }
+
+    if (writer->json_flags & JSON_ESCAPE_SLASH) {
+      size_t base64_encoded_length = base64_encode(base64_encoded_data, data + offset, chunk);
+
+      int result = protobuf2json_writer_append_escaped(writer, base64_encoded_data, base64_encoded_length, error_string, error_size);
+      if (result) {
+        return result;
+      }
+    } else {
+      /* Base64 alphabet needs no escaping, so encode right into the output */
+      int result = protobuf2json_writer_reserve(writer, base64_encoded_len(chunk), error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      if (writer->measure) {
+        writer->buffer.length += base64_encoded_len(chunk);
+      } else {
+        writer->buffer.length += base64_encode(writer->buffer.data + writer->buffer.length, data + offset, chunk);
+      }
+    }
+
+    offset += chunk;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND("\"", 1);
+
+  return 0;
+}
+
+/* Integers are formatted right into writer buffer, unless it is fixed and almost full */
+static int protobuf2json_writer_append_integer(
+  protobuf2json_writer_t *writer,
+  ProtobufCType type,
+  const void *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char digits[ITOA_BUFFER_SIZE];
+  char *number = digits;
+  size_t length;
+
+  int in_place = !writer->measure && !(writer->fixed && writer->buffer.size - writer->buffer.length < ITOA_BUFFER_SIZE);
+  if (in_place) {
+    int result = protobuf2json_writer_reserve(writer, ITOA_BUFFER_SIZE, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    number = writer->buffer.data + writer->buffer.length;
+  }
+
+  switch (type) {
+    case PROTOBUF_C_TYPE_INT32:
+    case PROTOBUF_C_TYPE_SINT32:
+    case PROTOBUF_C_TYPE_SFIXED32:
+      length = itoa_i32(*(const int32_t *)protobuf_value, number);
+      break;
+    case PROTOBUF_C_TYPE_UINT32:
+    case PROTOBUF_C_TYPE_FIXED32:
+      length = itoa_u32(*(const uint32_t *)protobuf_value, number);
+      break;
+    case PROTOBUF_C_TYPE_INT64:
+    case PROTOBUF_C_TYPE_SINT64:
+    case PROTOBUF_C_TYPE_SFIXED64:
+      length = itoa_i64(*(const int64_t *)protobuf_value, number);
+      break;
+    default: // PROTOBUF_C_TYPE_UINT64, PROTOBUF_C_TYPE_FIXED64
+      length = itoa_u64(*(const uint64_t *)protobuf_value, number);
+      break;
+  }
+
+  if (in_place) {
+    writer->buffer.length += length;
+  } else {
+    PROTOBUF2JSON_WRITER_APPEND(digits, length);
+  }
+
+  return 0;
+}
+
+/*
+ * Without JSON_REAL_PRECISION reals are written as the shortest representation
+ * that reads back as the same value, at float precision for float fields.
+ * With it, the same way jansson does.
+ */
+static int protobuf2json_writer_append_real(
+  protobuf2json_writer_t *writer,
+  double value,
+  int is_float,
+  char *error_string,
+  size_t error_size
+) {
+  if (!isfinite(value)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE,
+      "Cannot dump non-finite real value %f",
+      value
+    );
+  }
+
+  int precision = PROTOBUF2JSON_WRITER_PRECISION(writer->json_flags);
+  if (!precision) {
+    char shortest[DTOA_BUFFER_SIZE];
+    size_t shortest_length = is_float ? dtoa_float((float)value, shortest) : dtoa_double(value, shortest);
+
+    PROTOBUF2JSON_WRITER_APPEND(shortest, shortest_length);
+
+    return 0;
+  }
+
+  char real[64];
+  size_t length = (size_t)snprintf(real, sizeof(real), "%.*g", precision, value);
+
+  /* Same as jansson: decimal point is always '.', reals always look like reals */
+  char *point = strchr(real, ',');
+  if (point) {
+    *point = '.';
+  }
+
+  if (strspn(real, "0123456789-") == length) {
+    real[length++] = '.';
+    real[length++] = '0';
+    real[length] = '\0';
+  }
+
+  /* Same as jansson: drop '+' and leading zeros from the exponent */
+  char *exponent = strchr(real, 'e');
+  if (exponent) {
+    char *start = exponent + 1;
+    char *end = start + 1;
+
+    if (*start == '-') {
+      start++;
+    }
+
+    while (*end == '0') {
+      end++;
+    }
+
+    if (end != start) {
+      memmove(start, end, length - (size_t)(end - real) + 1);
+      length -= (size_t)(end - start);
+    }
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND(real, length);
+
+  return 0;
+}
+
+static int protobuf2json_write_message(
+  protobuf2json_writer_t *writer,
+  const ProtobufCMessage *protobuf_message,
+  int depth,
+  char *error_string,
+  size_t error_size
+);
+
+/* Writes quoted name of enum value */
+static int protobuf2json_writer_append_enum(
+  protobuf2json_writer_t *writer,
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor,
+  int value,
+  char *error_string,
+  size_t error_size
+) {
+  const enum_table_t *enum_table = protobuf2json_enum_table(protobuf_enum_descriptor);
+
+  const ProtobufCEnumValue *protobuf_enum_value = enum_table
+    ? enum_table_get(enum_table, value)
+    : protobuf_c_enum_descriptor_get_value(protobuf_enum_descriptor, value);
+
+  if (!protobuf_enum_value) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE,
+      "Unknown value %d for enum '%s'",
+      value, protobuf_enum_descriptor->name
+    );
+  }
+
+  if (enum_table && enum_table->names[protobuf_enum_value - protobuf_enum_descriptor->values].data) {
+    const field_table_key_t *name = &enum_table->names[protobuf_enum_value - protobuf_enum_descriptor->values];
+
+    PROTOBUF2JSON_WRITER_APPEND(name->data, name->length);
+
+    return 0;
+  }
+
+  return protobuf2json_writer_append_string(writer, protobuf_enum_value->name, strlen(protobuf_enum_value->name), error_string, error_size);
+}
+
+static int protobuf2json_write_string_value(
+  protobuf2json_writer_t *writer,
+  const char *protobuf_string,
+  const char *field_name,
+  char *error_string,
+  size_t error_size
+) {
+  if (!protobuf_string) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE,
+      "Cannot dump NULL string value of field '%s'",
+      field_name
+    );
+  }
+
+  return protobuf2json_writer_append_string(writer, protobuf_string, strlen(protobuf_string), error_string, error_size);
+}
+
+static int protobuf2json_write_message_value(
+  protobuf2json_writer_t *writer,
+  const ProtobufCMessage *protobuf_message,
+  const char *field_name,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  if (!protobuf_message) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE,
+      "Cannot dump NULL message value of field '%s'",
+      field_name
+    );
+  }
+
+  return protobuf2json_write_message(writer, protobuf_message, depth, error_string, error_size);
+}
+
+static int protobuf2json_write_value(
+  protobuf2json_writer_t *writer,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  const void *protobuf_value,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  switch (field_descriptor->type) {
+    case PROTOBUF_C_TYPE_INT32:
+    case PROTOBUF_C_TYPE_SINT32:
+    case PROTOBUF_C_TYPE_SFIXED32:
+    case PROTOBUF_C_TYPE_UINT32:
+    case PROTOBUF_C_TYPE_FIXED32:
+    case PROTOBUF_C_TYPE_INT64:
+    case PROTOBUF_C_TYPE_SINT64:
+    case PROTOBUF_C_TYPE_SFIXED64:
+    case PROTOBUF_C_TYPE_UINT64:
+    case PROTOBUF_C_TYPE_FIXED64:
+      return protobuf2json_writer_append_integer(writer, field_descriptor->type, protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_FLOAT:
+      return protobuf2json_writer_append_real(writer, *(const float *)protobuf_value, 1, error_string, error_size);
+    case PROTOBUF_C_TYPE_DOUBLE:
+      return protobuf2json_writer_append_real(writer, *(const double *)protobuf_value, 0, error_string, error_size);
+    case PROTOBUF_C_TYPE_BOOL:
+      if (*(const protobuf_c_boolean *)protobuf_value) {
+        PROTOBUF2JSON_WRITER_APPEND("true", 4);
+      } else {
+        PROTOBUF2JSON_WRITER_APPEND("false", 5);
+      }
+      break;
+    case PROTOBUF_C_TYPE_ENUM:
+      return protobuf2json_writer_append_enum(writer, field_descriptor->descriptor, *(const int *)protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_STRING:
+      return protobuf2json_write_string_value(writer, *(char * const *)protobuf_value, field_descriptor->name, error_string, error_size);
+    case PROTOBUF_C_TYPE_BYTES: {
+      const ProtobufCBinaryData *protobuf_binary = (const ProtobufCBinaryData *)protobuf_value;
+
+      return protobuf2json_writer_append_base64(writer, (const char *)protobuf_binary->data, protobuf_binary->len, error_string, error_size);
+    }
+    case PROTOBUF_C_TYPE_MESSAGE:
+      return protobuf2json_write_message_value(writer, *(ProtobufCMessage * const *)protobuf_value, field_descriptor->name, depth, error_string, error_size);
+    default:
+      assert(0);
+  }
+
+  return 0;
+}
+
+/* Same rules as protobuf2json_process_message() use */
+static int protobuf2json_field_is_present(
+  const ProtobufCFieldDescriptor *field_descriptor,
+  const ProtobufCMessage *protobuf_message
+) {
+  const void *protobuf_value = ((const char *)protobuf_message) + field_descriptor->offset;
+  const void *protobuf_value_quantifier = ((const char *)protobuf_message) + field_descriptor->quantifier_offset;
+
+  if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) {
+    return 1;
+  } else if (field_descriptor->label == PROTOBUF_C_LABEL_REPEATED) {
+    return *(const size_t *)protobuf_value_quantifier ? 1 : 0;
+  }
+
+  if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
+    if (*(const uint32_t *)protobuf_value_quantifier != field_descriptor->id) {
+      return 0;
+    }
+
+    if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE || field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
+      return *(const void * const *)protobuf_value ? 1 : 0;
+    }
+
+    return 1;
+  }
+
+  if (field_descriptor->default_value) {
+    return 1;
+  }
+
+  if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE || field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
+    return *(const void * const *)protobuf_value ? 1 : 0;
+  }
+
+  return *(const protobuf_c_boolean *)protobuf_value_quantifier ? 1 : 0;
+}
+
+/* Writes separator of object members, indentation and key of field followed by key separator */
+static int protobuf2json_writer_append_key(
+  protobuf2json_writer_t *writer,
+  const field_table_t *field_table,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  unsigned field_index,
+  int depth,
+  int *is_first,
+  char *error_string,
+  size_t error_size
+) {
+  int space = 0;
+  if (*is_first) {
+    *is_first = 0;
+  } else {
+    PROTOBUF2JSON_WRITER_APPEND(",", 1);
+    space = 1;
+  }
+
+  int result = protobuf2json_writer_append_indent(writer, depth + 1, space, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  size_t key_separator_length = (writer->json_flags & JSON_COMPACT) ? 1 : 2;
+
+  if (field_table && field_table->keys[field_index].data) {
+    /* Key separator is the tail of prepared key */
+    const field_table_key_t *key = &field_table->keys[field_index];
+
+    PROTOBUF2JSON_WRITER_APPEND(key->data, key->length - 2 + key_separator_length);
+
+    return 0;
+  }
+
+  result = protobuf2json_writer_append_string(writer, field_descriptor->name, strlen(field_descriptor->name), error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND((writer->json_flags & JSON_COMPACT) ? ":" : ": ", key_separator_length);
+
+  return 0;
+}
+
+static int protobuf2json_write_message(
+  protobuf2json_writer_t *writer,
+  const ProtobufCMessage *protobuf_message,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor = protobuf_message->descriptor;
+
+  /* Generated code writes fields in declaration order only */
+  if (!(writer->json_flags & JSON_SORT_KEYS)) {
+    const protobuf2json_codec_t *codec = protobuf2json_codec(protobuf_message_descriptor);
+
+    if (codec && codec->write) {
+      return codec->write(writer, protobuf_message, depth, error_string, error_size);
+    }
+  }
+
+  const field_table_t *field_table = protobuf2json_field_table(protobuf_message_descriptor);
+
+  int embed = (depth == 0) && (writer->json_flags & JSON_EMBED);
+  int is_first = 1;
+  int result;
+
+  if (!embed) {
+    PROTOBUF2JSON_WRITER_APPEND("{", 1);
+  }
+
+  unsigned i;
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    unsigned field_index = i;
+    if ((writer->json_flags & JSON_SORT_KEYS) && protobuf_message_descriptor->fields_sorted_by_name) {
+      field_index = protobuf_message_descriptor->fields_sorted_by_name[i];
+    }
+
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf_message_descriptor->fields + field_index;
+    const void *protobuf_value = ((const char *)protobuf_message) + field_descriptor->offset;
+
+    if (!protobuf2json_field_is_present(field_descriptor, protobuf_message)) {
+      continue;
+    }
+
+    result = protobuf2json_writer_append_key(writer, field_table, field_descriptor, field_index, depth, &is_first, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    if (field_descriptor->label != PROTOBUF_C_LABEL_REPEATED) {
+      result = protobuf2json_write_value(writer, field_descriptor, protobuf_value, depth + 1, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      continue;
+    }
+
+    size_t protobuf_values_count = *(const size_t *)(((const char *)protobuf_message) + field_descriptor->quantifier_offset);
+
+    size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
+    if (!value_size) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
+        "Cannot calculate value size for %d using protobuf2json_value_size_by_type()",
+        field_descriptor->type
+      );
+    }
+
+    PROTOBUF2JSON_WRITER_APPEND("[", 1);
+
+    size_t j;
+    for (j = 0; j < protobuf_values_count; j++) {
+      const char *protobuf_value_repeated = (*(char * const *)protobuf_value) + j * value_size;
+
+      if (j) {
+        PROTOBUF2JSON_WRITER_APPEND(",", 1);
+      }
+
+      result = protobuf2json_writer_append_indent(writer, depth + 2, j ? 1 : 0, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      result = protobuf2json_write_value(writer, field_descriptor, (const void *)protobuf_value_repeated, depth + 2, error_string, error_size);
+      if (result) {
+        return result;
+      }
+    }
+
+    result = protobuf2json_writer_append_indent(writer, depth + 1, 0, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    PROTOBUF2JSON_WRITER_APPEND("]", 1);
+  }
+
+  if (!is_first) {
+    result = protobuf2json_writer_append_indent(writer, depth, 0, error_string, error_size);
+    if (result) {
+      return result;
+    }
+  }
+
+  if (!embed) {
+    PROTOBUF2JSON_WRITER_APPEND("}", 1);
+  }
+
+  return 0;
+}
+
+static int protobuf2json_write(
+  protobuf2json_writer_t *writer,
+  const ProtobufCMessage *protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  int result = protobuf2json_write_message(writer, protobuf_message, 0, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  return protobuf2json_writer_flush(writer, error_string, error_size);
+}
+
+/* Prefixes error of message in batch with its index */
+static int protobuf2json_batch_error(
+  size_t index,
+  int result,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_prefix_error(error_string, error_size, "Message %zu: ", index);
+
+  return result;
+}
+
+/*
+ * Writes messages as newline-delimited JSON, each one followed by newline.
+ * Indentation would break lines, so it is ignored, separators are kept.
+ */
+static int protobuf2json_write_batch(
+  protobuf2json_writer_t *writer,
+  ProtobufCMessage **protobuf_messages,
+  size_t protobuf_messages_count,
+  char *error_string,
+  size_t error_size
+) {
+  size_t i;
+
+  if (!protobuf_messages && protobuf_messages_count) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_INVALID_ARGUMENT,
+      "Cannot dump NULL array of %zu messages",
+      protobuf_messages_count
+    );
+  }
+
+  /* Checked before anything is written, so callback never gets part of invalid batch */
+  for (i = 0; i < protobuf_messages_count; i++) {
+    if (!protobuf_messages[i]) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_INVALID_ARGUMENT,
+        "Message %zu: Cannot dump NULL message",
+        i
+      );
+    }
+  }
+
+  writer->json_flags &= ~(size_t)JSON_MAX_INDENT;
+
+  for (i = 0; i < protobuf_messages_count; i++) {
+    int result = protobuf2json_write_message(writer, protobuf_messages[i], 0, error_string, error_size);
+    if (result) {
+      return protobuf2json_batch_error(i, result, error_string, error_size);
+    }
+
+    PROTOBUF2JSON_WRITER_APPEND("\n", 1);
+  }
+
+  return protobuf2json_writer_flush(writer, error_string, error_size);
+}
+
+typedef struct protobuf2json_fd_data {
+  int fd;
+  int error;
+} protobuf2json_fd_data_t;
+
+static int protobuf2json_fd_callback(const char *buffer, size_t size, void *data) {
+  protobuf2json_fd_data_t *fd_data = (protobuf2json_fd_data_t *)data;
+
+  while (size > 0) {
+    ssize_t written = write(fd_data->fd, buffer, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      fd_data->error = errno;
+      return -1;
+    }
+
+    buffer += written;
+    size -= (size_t)written;
+  }
+
+  return 0;
+}
+
+/* === Protobuf -> JSON === Writer === Public === */
+
+int protobuf2json_buffer(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  protobuf2json_writer_init(&writer, json_flags);
+
+  int result = protobuf2json_write(&writer, protobuf_message, error_string, error_size);
+  if (result) {
+    buffer_free(&writer.buffer);
+    return result;
+  }
+
+  size_t length = writer.buffer.length;
+
+  // NOTICE: Should be freed by caller
+  *json_buffer = buffer_steal(&writer.buffer);
+  if (!*json_buffer) {
+    buffer_free(&writer.buffer);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      length + 1
+    );
+  }
+
+  if (json_length) {
+    *json_length = length;
+  }
+
+  return 0;
+}
+
+int protobuf2json_encoded_size(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  protobuf2json_writer_init(&writer, json_flags);
+  writer.measure = 1;
+
+  int result = protobuf2json_write(&writer, protobuf_message, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  *json_length = writer.buffer.length;
+
+  return 0;
+}
+
+int protobuf2json_to_buffer(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  char *json_buffer,
+  size_t json_buffer_size,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  protobuf2json_writer_init(&writer, json_flags);
+  writer.buffer.data = json_buffer;
+  writer.buffer.size = json_buffer_size;
+  writer.fixed = 1;
+  /* Nothing fits into empty buffer, which may be NULL as well */
+  writer.measure = json_buffer_size ? 0 : 1;
+
+  int result = protobuf2json_write(&writer, protobuf_message, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (json_length) {
+    *json_length = writer.buffer.length;
+  }
+
+  if (writer.measure) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_BUFFER_TOO_SMALL,
+      "JSON of %zu bytes does not fit into buffer of %zu bytes",
+      writer.buffer.length, json_buffer_size
+    );
+  }
+
+  return 0;
+}
+
+int protobuf2json_callback(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  json_dump_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  if (!callback) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK,
+      "Cannot dump JSON to NULL callback"
+    );
+  }
+
+  protobuf2json_writer_init(&writer, json_flags);
+  writer.callback = callback;
+  writer.callback_data = callback_data;
+
+  if (buffer_reserve(&writer.buffer, PROTOBUF2JSON_WRITER_CHUNK_SIZE)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      (size_t)PROTOBUF2JSON_WRITER_CHUNK_SIZE
+    );
+  }
+
+  int result = protobuf2json_write(&writer, protobuf_message, error_string, error_size);
+
+  buffer_free(&writer.buffer);
+
+  return result;
+}
+
+int protobuf2json_fd(
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  int fd,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_fd_data_t fd_data;
+
+  fd_data.fd = fd;
+  fd_data.error = 0;
+
+  int result = protobuf2json_callback(protobuf_message, json_flags, protobuf2json_fd_callback, &fd_data, error_string, error_size);
+  if (result == PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_FILE,
+      "Cannot write JSON to fd %d, errno=%d",
+      fd, fd_data.error
+    );
+  }
+
+  return result;
+}
+
+int protobuf2json_batch_buffer(
+  ProtobufCMessage **protobuf_messages,
+  size_t protobuf_messages_count,
+  size_t json_flags,
+  char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  protobuf2json_writer_init(&writer, json_flags);
+
+  int result = protobuf2json_write_batch(&writer, protobuf_messages, protobuf_messages_count, error_string, error_size);
+  if (result) {
+    buffer_free(&writer.buffer);
+    return result;
+  }
+
+  size_t length = writer.buffer.length;
+
+  // NOTICE: Should be freed by caller, even if there are no messages
+  *json_buffer = buffer_steal(&writer.buffer);
+  if (!*json_buffer) {
+    buffer_free(&writer.buffer);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      length + 1
+    );
+  }
+
+  if (json_length) {
+    *json_length = length;
+  }
+
+  return 0;
+}
+
+int protobuf2json_batch_callback(
+  ProtobufCMessage **protobuf_messages,
+  size_t protobuf_messages_count,
+  size_t json_flags,
+  json_dump_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  if (!callback) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK,
+      "Cannot dump JSON to NULL callback"
+    );
+  }
+
+  protobuf2json_writer_init(&writer, json_flags);
+  writer.callback = callback;
+  writer.callback_data = callback_data;
+
+  if (buffer_reserve(&writer.buffer, PROTOBUF2JSON_WRITER_CHUNK_SIZE)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      (size_t)PROTOBUF2JSON_WRITER_CHUNK_SIZE
+    );
+  }
+
+  int result = protobuf2json_write_batch(&writer, protobuf_messages, protobuf_messages_count, error_string, error_size);
+
+  buffer_free(&writer.buffer);
+
+  return result;
+}
+
+/* === Protobuf -> JSON === Generated code === Public === */
+
+/*
+ * Building blocks of encoders generated by protoc-gen-protobuf2json-c.
+ * Each one does the same as the matching step of protobuf2json_write_message(),
+ * so generated code writes exactly the same text.
+ */
+
+int protobuf2json_register_codecs(
+  const protobuf2json_codec_t *codecs,
+  size_t n_codecs,
+  char *error_string,
+  size_t error_size
+) {
+  size_t i;
+
+  for (i = 0; i < n_codecs; i++) {
+    if (!registry_put(&protobuf2json_codecs, (void *)&codecs[i])) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+        "Cannot register codec for message '%s', registry is full",
+        codecs[i].descriptor->name
+      );
+    }
+  }
+
+  return 0;
+}
+
+int protobuf2json_gen_begin_object(
+  protobuf2json_writer_t *writer,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  if (depth == 0 && (writer->json_flags & JSON_EMBED)) {
+    return 0;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND("{", 1);
+
+  return 0;
+}
+
+int protobuf2json_gen_key(
+  protobuf2json_writer_t *writer,
+  const char *key,
+  size_t key_length,
+  int depth,
+  int *is_first,
+  char *error_string,
+  size_t error_size
+) {
+  int space = 0;
+  if (*is_first) {
+    *is_first = 0;
+  } else {
+    PROTOBUF2JSON_WRITER_APPEND(",", 1);
+    space = 1;
+  }
+
+  int result = protobuf2json_writer_append_indent(writer, depth + 1, space, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND(key, key_length);
+
+  if (writer->json_flags & JSON_COMPACT) {
+    PROTOBUF2JSON_WRITER_APPEND(":", 1);
+  } else {
+    PROTOBUF2JSON_WRITER_APPEND(": ", 2);
+  }
+
+  return 0;
+}
+
+int protobuf2json_gen_end_object(
+  protobuf2json_writer_t *writer,
+  int depth,
+  int is_first,
+  char *error_string,
+  size_t error_size
+) {
+  if (!is_first) {
+    int result = protobuf2json_writer_append_indent(writer, depth, 0, error_string, error_size);
+    if (result) {
+      return result;
+    }
+  }
+
+  if (depth == 0 && (writer->json_flags & JSON_EMBED)) {
+    return 0;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND("}", 1);
+
+  return 0;
+}
+
+int protobuf2json_gen_begin_array(
+  protobuf2json_writer_t *writer,
+  char *error_string,
+  size_t error_size
+) {
+  PROTOBUF2JSON_WRITER_APPEND("[", 1);
+
+  return 0;
+}
+
+int protobuf2json_gen_array_item(
+  protobuf2json_writer_t *writer,
+  int depth,
+  size_t index,
+  char *error_string,
+  size_t error_size
+) {
+  if (index) {
+    PROTOBUF2JSON_WRITER_APPEND(",", 1);
+  }
+
+  return protobuf2json_writer_append_indent(writer, depth + 2, index ? 1 : 0, error_string, error_size);
+}
+
+int protobuf2json_gen_end_array(
+  protobuf2json_writer_t *writer,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  int result = protobuf2json_writer_append_indent(writer, depth + 1, 0, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  PROTOBUF2JSON_WRITER_APPEND("]", 1);
+
+  return 0;
+}
+
+int protobuf2json_gen_int32(protobuf2json_writer_t *writer, int32_t value, char *error_string, size_t error_size) {
+  return protobuf2json_writer_append_integer(writer, PROTOBUF_C_TYPE_INT32, &value, error_string, error_size);
+}
+
+int protobuf2json_gen_uint32(protobuf2json_writer_t *writer, uint32_t value, char *error_string, size_t error_size) {
+  return protobuf2json_writer_append_integer(writer, PROTOBUF_C_TYPE_UINT32, &value, error_string, error_size);
+}
+
+int protobuf2json_gen_int64(protobuf2json_writer_t *writer, int64_t value, char *error_string, size_t error_size) {
+  return protobuf2json_writer_append_integer(writer, PROTOBUF_C_TYPE_INT64, &value, error_string, error_size);
+}
+
+int protobuf2json_gen_uint64(protobuf2json_writer_t *writer, uint64_t value, char *error_string, size_t error_size) {
+  return protobuf2json_writer_append_integer(writer, PROTOBUF_C_TYPE_UINT64, &value, error_string, error_size);
+}
+
+int protobuf2json_gen_float(protobuf2json_writer_t *writer, float value, char *error_string, size_t error_size) {
+  return protobuf2json_writer_append_real(writer, value, 1, error_string, error_size);
+}
+
+int protobuf2json_gen_double(protobuf2json_writer_t *writer, double value, char *error_string, size_t error_size) {
+  return protobuf2json_writer_append_real(writer, value, 0, error_string, error_size);
+}
+
+int protobuf2json_gen_bool(protobuf2json_writer_t *writer, protobuf_c_boolean value, char *error_string, size_t error_size) {
+  if (value) {
+    PROTOBUF2JSON_WRITER_APPEND("true", 4);
+  } else {
+    PROTOBUF2JSON_WRITER_APPEND("false", 5);
+  }
+
+  return 0;
+}
+
+int protobuf2json_gen_enum(
+  protobuf2json_writer_t *writer,
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor,
+  int value,
+  char *error_string,
+  size_t error_size
+) {
+  return protobuf2json_writer_append_enum(writer, protobuf_enum_descriptor, value, error_string, error_size);
+}
+
+int protobuf2json_gen_string(
+  protobuf2json_writer_t *writer,
+  const char *value,
+  const char *field_name,
+  char *error_string,
+  size_t error_size
+) {
+  return protobuf2json_write_string_value(writer, value, field_name, error_string, error_size);
+}
+
+int protobuf2json_gen_bytes(
+  protobuf2json_writer_t *writer,
+  const ProtobufCBinaryData *value,
+  char *error_string,
+  size_t error_size
+) {
+  return protobuf2json_writer_append_base64(writer, (const char *)value->data, value->len, error_string, error_size);
+}
+
+int protobuf2json_gen_message(
+  protobuf2json_writer_t *writer,
+  const ProtobufCMessage *value,
+  const char *field_name,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  return protobuf2json_write_message_value(writer, value, field_name, depth, error_string, error_size);
+}
+
+/* === Protobuf -> JSON === Packed === Private === */
+
+/*
+ * Packed transcoder writes JSON straight from protobuf wire format,
+ * producing the same text protobuf2json_buffer() does for the message
+ * protobuf_c_message_unpack() would return, without unpacking it.
+ *
+ * JSON fields go in descriptor order, while wire fields may come in any,
+ * so every message is scanned first: each value is recorded by its place
+ * in the input and linked to the previous value of the same field.
+ * Values are decoded only when written. Singular fields take the last
+ * value, singular messages merge all of them, and so do oneofs: the last
+ * member in input wins.
+ *
+ * Records of all messages being written live in two stacks reused
+ * at every depth, so nothing is allocated per message.
+ */
+
+#define PROTOBUF2JSON_PACKED_MAX_DEPTH 2048
+
+typedef struct protobuf2json_packed_value {
+  /* Varint or fixed-size value itself, contents of length-prefixed one */
+  const uint8_t *data;
+  size_t length;
+  /* Index of next value of the same field plus one, zero for the last one */
+  size_t next;
+  int wire_type;
+} protobuf2json_packed_value_t;
+
+typedef struct protobuf2json_packed_field {
+  /* Indexes of the first and the last value plus one, zero if there are none */
+  size_t first;
+  size_t last;
+  /* Number of values, packed repeated ones are counted by elements */
+  size_t count;
+} protobuf2json_packed_field_t;
+
+typedef struct protobuf2json_packed {
+  /* Start of input, for offsets in error messages */
+  const uint8_t *packed_buffer;
+  protobuf2json_packed_value_t *values;
+  size_t n_values;
+  size_t values_size;
+  protobuf2json_packed_field_t *fields;
+  size_t n_fields;
+  size_t fields_size;
+} protobuf2json_packed_t;
+
+typedef union protobuf2json_packed_scalar {
+  int32_t int32;
+  uint32_t uint32;
+  int64_t int64;
+  uint64_t uint64;
+  float real32;
+  double real64;
+  protobuf_c_boolean boolean;
+  int enum_value;
+} protobuf2json_packed_scalar_t;
+
+static void protobuf2json_packed_init(protobuf2json_packed_t *packed, const uint8_t *packed_buffer) {
+  memset(packed, 0, sizeof(*packed));
+  packed->packed_buffer = packed_buffer;
+}
+
+static void protobuf2json_packed_free(protobuf2json_packed_t *packed) {
+  free(packed->values);
+  free(packed->fields);
+}
+
+/* Grows array of `size` items of `item_size` bytes to fit at least `length` */
+static int protobuf2json_packed_grow(
+  void **items,
+  size_t *size,
+  size_t length,
+  size_t item_size,
+  char *error_string,
+  size_t error_size
+) {
+  if (length <= *size) {
+    return 0;
+  }
+
+  size_t new_size = *size ? *size : 64;
+  while (new_size < length) {
+    new_size *= 2;
+  }
+
+  void *new_items = realloc(*items, new_size * item_size);
+  if (!new_items) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      new_size * item_size
+    );
+  }
+
+  *items = new_items;
+  *size = new_size;
+
+  return 0;
+}
+
+static int protobuf2json_packed_error(
+  const protobuf2json_packed_t *packed,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *position,
+  const char *reason,
+  char *error_string,
+  size_t error_size
+) {
+  SET_ERROR_STRING_AND_RETURN(
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message '%s' at offset %zu: %s",
+    protobuf_message_descriptor->name, (size_t)(position - packed->packed_buffer), reason
+  );
+}
+
+static int protobuf2json_packed_wire_type(ProtobufCType type) {
+  switch (type) {
+    case PROTOBUF_C_TYPE_SFIXED32:
+    case PROTOBUF_C_TYPE_FIXED32:
+    case PROTOBUF_C_TYPE_FLOAT:
+      return WIRE_TYPE_32BIT;
+    case PROTOBUF_C_TYPE_SFIXED64:
+    case PROTOBUF_C_TYPE_FIXED64:
+    case PROTOBUF_C_TYPE_DOUBLE:
+      return WIRE_TYPE_64BIT;
+    case PROTOBUF_C_TYPE_STRING:
+    case PROTOBUF_C_TYPE_BYTES:
+    case PROTOBUF_C_TYPE_MESSAGE:
+      return WIRE_TYPE_LENGTH_PREFIXED;
+    default:
+      return WIRE_TYPE_VARINT;
+  }
+}
+
+/* Counts elements of packed repeated value, returns 0 and sets *count if they are all complete */
+static int protobuf2json_packed_count(
+  int wire_type,
+  const uint8_t *data,
+  size_t length,
+  size_t *count
+) {
+  if (wire_type == WIRE_TYPE_32BIT || wire_type == WIRE_TYPE_64BIT) {
+    size_t element_size = wire_type == WIRE_TYPE_32BIT ? 4 : 8;
+    if (length % element_size) {
+      return -1;
+    }
+
+    *count = length / element_size;
+
+    return 0;
+  }
+
+  size_t offset = 0;
+
+  *count = 0;
+  while (offset < length) {
+    size_t varint_length = wire_varint_length(data + offset, length - offset);
+    if (!varint_length) {
+      return -1;
+    }
+
+    offset += varint_length;
+    (*count)++;
+  }
+
+  return 0;
+}
+
+/* Records values of one serialized message, appending to fields of `fields_base` */
+static int protobuf2json_packed_scan(
+  protobuf2json_packed_t *packed,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  size_t fields_base,
+  const uint8_t *data,
+  size_t length,
+  char *error_string,
+  size_t error_size
+) {
+  const uint8_t *end = data + length;
+
+  while (data < end) {
+    const uint8_t *start = data;
+    uint64_t tag;
+    size_t tag_length = wire_read_varint(data, (size_t)(end - data), &tag);
+    if (!tag_length || tag > UINT32_MAX || !(tag >> 3)) {
+      return protobuf2json_packed_error(packed, protobuf_message_descriptor, start, "invalid tag", error_string, error_size);
+    }
+
+    int wire_type = (int)(tag & 7);
+    const uint8_t *value = data + tag_length;
+    size_t value_length;
+
+    switch (wire_type) {
+      case WIRE_TYPE_VARINT:
+        value_length = wire_varint_length(value, (size_t)(end - value));
+        if (!value_length) {
+          return protobuf2json_packed_error(packed, protobuf_message_descriptor, value, "truncated varint", error_string, error_size);
+        }
+        break;
+      case WIRE_TYPE_64BIT:
+      case WIRE_TYPE_32BIT:
+        value_length = wire_type == WIRE_TYPE_32BIT ? 4 : 8;
+        if ((size_t)(end - value) < value_length) {
+          return protobuf2json_packed_error(packed, protobuf_message_descriptor, value, "truncated fixed-size value", error_string, error_size);
+        }
+        break;
+      case WIRE_TYPE_LENGTH_PREFIXED: {
+        uint64_t prefix;
+        size_t prefix_length = wire_read_varint(value, (size_t)(end - value), &prefix);
+        if (!prefix_length || prefix > (uint64_t)(end - value) - prefix_length) {
+          return protobuf2json_packed_error(packed, protobuf_message_descriptor, value, "truncated length-prefixed value", error_string, error_size);
+        }
+
+        value += prefix_length;
+        value_length = (size_t)prefix;
+        break;
+      }
+      default:
+        /* Groups are not supported by protobuf-c either */
+        return protobuf2json_packed_error(packed, protobuf_message_descriptor, start, "unsupported wire type", error_string, error_size);
+    }
+
+    data = value + value_length;
+
+    /* Unknown fields are skipped, the same way protobuf2json_buffer() ignores them */
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf_c_message_descriptor_get_field(protobuf_message_descriptor, (unsigned)(tag >> 3));
+    if (!field_descriptor) {
+      continue;
+    }
+
+    int field_wire_type = protobuf2json_packed_wire_type(field_descriptor->type);
+    size_t count = 1;
+
+    if (wire_type != field_wire_type) {
+      /* Repeated scalars may be packed, whatever their declaration says */
+      int is_packed = field_descriptor->label == PROTOBUF_C_LABEL_REPEATED
+        && wire_type == WIRE_TYPE_LENGTH_PREFIXED;
+
+      if (!is_packed) {
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+          "Cannot parse message '%s' at offset %zu: wire type %d does not match field '%s'",
+          protobuf_message_descriptor->name, (size_t)(start - packed->packed_buffer), wire_type, field_descriptor->name
+        );
+      }
+
+      if (protobuf2json_packed_count(field_wire_type, value, value_length, &count)) {
+        return protobuf2json_packed_error(packed, protobuf_message_descriptor, value, "truncated packed repeated value", error_string, error_size);
+      }
+    }
+
+    int result = protobuf2json_packed_grow((void **)&packed->values, &packed->values_size, packed->n_values + 1, sizeof(protobuf2json_packed_value_t), error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    protobuf2json_packed_field_t *field = &packed->fields[fields_base + (field_descriptor - protobuf_message_descriptor->fields)];
+    protobuf2json_packed_value_t *packed_value = &packed->values[packed->n_values++];
+
+    packed_value->data = value;
+    packed_value->length = value_length;
+    packed_value->next = 0;
+    packed_value->wire_type = wire_type;
+
+    if (field->last) {
+      packed->values[field->last - 1].next = packed->n_values;
+    } else {
+      field->first = packed->n_values;
+    }
+
+    field->last = packed->n_values;
+    field->count += count;
+  }
+
+  return 0;
+}
+
+/* Same rules as protobuf2json_field_is_present() use for unpacked message */
+static int protobuf2json_packed_field_is_present(
+  const protobuf2json_packed_t *packed,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  size_t fields_base,
+  unsigned field_index
+) {
+  const ProtobufCFieldDescriptor *field_descriptor = &protobuf_message_descriptor->fields[field_index];
+  const protobuf2json_packed_field_t *field = &packed->fields[fields_base + field_index];
+
+  if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) {
+    return 1;
+  } else if (field_descriptor->label == PROTOBUF_C_LABEL_REPEATED) {
+    return field->count ? 1 : 0;
+  }
+
+  if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
+    if (!field->count) {
+      return 0;
+    }
+
+    /* Members of the same oneof share case member */
+    unsigned i;
+    for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+      const ProtobufCFieldDescriptor *other_field_descriptor = &protobuf_message_descriptor->fields[i];
+
+      if (i != field_index
+        && (other_field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF)
+        && other_field_descriptor->quantifier_offset == field_descriptor->quantifier_offset
+        && packed->fields[fields_base + i].last > field->last) {
+        return 0;
+      }
+    }
+
+    return 1;
+  }
+
+  return field_descriptor->default_value || field->count ? 1 : 0;
+}
+
+/* Decodes one scalar value at data, returns its length on wire */
+static size_t protobuf2json_packed_read_scalar(
+  ProtobufCType type,
+  const uint8_t *data,
+  size_t length,
+  protobuf2json_packed_scalar_t *scalar
+) {
+  uint64_t varint = 0;
+
+  switch (protobuf2json_packed_wire_type(type)) {
+    case WIRE_TYPE_32BIT: {
+      uint32_t fixed32 = wire_read_fixed32(data);
+
+      if (type == PROTOBUF_C_TYPE_FLOAT) {
+        memcpy(&scalar->real32, &fixed32, sizeof(fixed32));
+      } else {
+        scalar->uint32 = fixed32;
+      }
+
+      return 4;
+    }
+    case WIRE_TYPE_64BIT: {
+      uint64_t fixed64 = wire_read_fixed64(data);
+
+      if (type == PROTOBUF_C_TYPE_DOUBLE) {
+        memcpy(&scalar->real64, &fixed64, sizeof(fixed64));
+      } else {
+        scalar->uint64 = fixed64;
+      }
+
+      return 8;
+    }
+  }
+
+  /* Values are validated by protobuf2json_packed_scan() */
+  size_t varint_length = wire_read_varint(data, length, &varint);
+
+  switch (type) {
+    case PROTOBUF_C_TYPE_SINT32:
+      scalar->int32 = wire_zigzag32_decode((uint32_t)varint);
+      break;
+    case PROTOBUF_C_TYPE_SINT64:
+      scalar->int64 = wire_zigzag64_decode(varint);
+      break;
+    case PROTOBUF_C_TYPE_INT64:
+    case PROTOBUF_C_TYPE_UINT64:
+      scalar->uint64 = varint;
+      break;
+    case PROTOBUF_C_TYPE_BOOL:
+      scalar->boolean = varint ? 1 : 0;
+      break;
+    case PROTOBUF_C_TYPE_ENUM:
+      scalar->enum_value = (int)(int32_t)(uint32_t)varint;
+      break;
+    default: // PROTOBUF_C_TYPE_INT32, PROTOBUF_C_TYPE_UINT32
+      scalar->uint32 = (uint32_t)varint;
+      break;
+  }
+
+  return varint_length;
+}
+
+static int protobuf2json_packed_write_message(
+  protobuf2json_writer_t *writer,
+  protobuf2json_packed_t *packed,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *data,
+  size_t length,
+  size_t next,
+  int depth,
+  char *error_string,
+  size_t error_size
+);
+
+/* Writes one value, `next` chains the rest of values of singular message to merge */
+static int protobuf2json_packed_write_value(
+  protobuf2json_writer_t *writer,
+  protobuf2json_packed_t *packed,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  const uint8_t *data,
+  size_t length,
+  size_t next,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  switch (field_descriptor->type) {
+    case PROTOBUF_C_TYPE_STRING: {
+      /* Unpacked string ends at the first NUL */
+      const uint8_t *nul = memchr(data, '\0', length);
+
+      return protobuf2json_writer_append_string(writer, (const char *)data, nul ? (size_t)(nul - data) : length, error_string, error_size);
+    }
+    case PROTOBUF_C_TYPE_BYTES:
+      return protobuf2json_writer_append_base64(writer, (const char *)data, length, error_string, error_size);
+    case PROTOBUF_C_TYPE_MESSAGE:
+      return protobuf2json_packed_write_message(writer, packed, field_descriptor->descriptor, data, length, next, depth, error_string, error_size);
+    default: {
+      protobuf2json_packed_scalar_t scalar;
+
+      protobuf2json_packed_read_scalar(field_descriptor->type, data, length, &scalar);
+
+      return protobuf2json_write_value(writer, field_descriptor, &scalar, depth, error_string, error_size);
+    }
+  }
+}
+
+static int protobuf2json_packed_write_repeated(
+  protobuf2json_writer_t *writer,
+  protobuf2json_packed_t *packed,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  size_t first,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  int field_wire_type = protobuf2json_packed_wire_type(field_descriptor->type);
+  size_t index = 0;
+  int result;
+
+  result = protobuf2json_gen_begin_array(writer, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  while (first) {
+    /* Stacks may be moved by nested messages */
+    protobuf2json_packed_value_t value = packed->values[first - 1];
+    first = value.next;
+
+    if (value.wire_type == field_wire_type) {
+      result = protobuf2json_gen_array_item(writer, depth, index++, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      result = protobuf2json_packed_write_value(writer, packed, field_descriptor, value.data, value.length, 0, depth + 2, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      continue;
+    }
+
+    /* Elements of packed value */
+    size_t offset = 0;
+    while (offset < value.length) {
+      protobuf2json_packed_scalar_t scalar;
+
+      result = protobuf2json_gen_array_item(writer, depth, index++, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      offset += protobuf2json_packed_read_scalar(field_descriptor->type, value.data + offset, value.length - offset, &scalar);
+
+      result = protobuf2json_write_value(writer, field_descriptor, &scalar, depth + 2, error_string, error_size);
+      if (result) {
+        return result;
+      }
+    }
+  }
+
+  return protobuf2json_gen_end_array(writer, depth, error_string, error_size);
+}
+
+static int protobuf2json_packed_write_message(
+  protobuf2json_writer_t *writer,
+  protobuf2json_packed_t *packed,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *data,
+  size_t length,
+  size_t next,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  if (depth > PROTOBUF2JSON_PACKED_MAX_DEPTH) {
+    return protobuf2json_packed_error(packed, protobuf_message_descriptor, data, "maximum nesting depth reached", error_string, error_size);
+  }
+
+  size_t fields_base = packed->n_fields;
+  size_t values_base = packed->n_values;
+  int result;
+
+  result = protobuf2json_packed_grow((void **)&packed->fields, &packed->fields_size, fields_base + protobuf_message_descriptor->n_fields, sizeof(protobuf2json_packed_field_t), error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  memset(&packed->fields[fields_base], 0, protobuf_message_descriptor->n_fields * sizeof(protobuf2json_packed_field_t));
+  packed->n_fields += protobuf_message_descriptor->n_fields;
+
+  /* Occurrences of singular message are merged, as if they were one */
+  for (;;) {
+    result = protobuf2json_packed_scan(packed, protobuf_message_descriptor, fields_base, data, length, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    if (!next) {
+      break;
+    }
+
+    data = packed->values[next - 1].data;
+    length = packed->values[next - 1].length;
+    next = packed->values[next - 1].next;
+  }
+
+  unsigned i;
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    const ProtobufCFieldDescriptor *field_descriptor = &protobuf_message_descriptor->fields[i];
+
+    if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED && !packed->fields[fields_base + i].count && !field_descriptor->default_value) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
+        "Required field '%s' is missing in message '%s'",
+        field_descriptor->name, protobuf_message_descriptor->name
+      );
+    }
+  }
+
+  const field_table_t *field_table = protobuf2json_field_table(protobuf_message_descriptor);
+  int is_first = 1;
+
+  result = protobuf2json_gen_begin_object(writer, depth, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    unsigned field_index = i;
+    if ((writer->json_flags & JSON_SORT_KEYS) && protobuf_message_descriptor->fields_sorted_by_name) {
+      field_index = protobuf_message_descriptor->fields_sorted_by_name[i];
+    }
+
+    const ProtobufCFieldDescriptor *field_descriptor = &protobuf_message_descriptor->fields[field_index];
+
+    if (!protobuf2json_packed_field_is_present(packed, protobuf_message_descriptor, fields_base, field_index)) {
+      continue;
+    }
+
+    result = protobuf2json_writer_append_key(writer, field_table, field_descriptor, field_index, depth, &is_first, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    /* Stacks may be moved by nested messages */
+    protobuf2json_packed_field_t field = packed->fields[fields_base + field_index];
+
+    if (field_descriptor->label == PROTOBUF_C_LABEL_REPEATED) {
+      result = protobuf2json_packed_write_repeated(writer, packed, field_descriptor, field.first, depth, error_string, error_size);
+    } else if (!field.count) {
+      /* Absent field with default value, strings are stored as pointers */
+      const void *default_value = field_descriptor->default_value;
+      const void *protobuf_value = field_descriptor->type == PROTOBUF_C_TYPE_STRING ? (const void *)&default_value : default_value;
+
+      result = protobuf2json_write_value(writer, field_descriptor, protobuf_value, depth + 1, error_string, error_size);
+    } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
+      protobuf2json_packed_value_t value = packed->values[field.first - 1];
+
+      result = protobuf2json_packed_write_value(writer, packed, field_descriptor, value.data, value.length, value.next, depth + 1, error_string, error_size);
+    } else {
+      protobuf2json_packed_value_t value = packed->values[field.last - 1];
+
+      result = protobuf2json_packed_write_value(writer, packed, field_descriptor, value.data, value.length, 0, depth + 1, error_string, error_size);
+    }
+
+    if (result) {
+      return result;
+    }
+  }
+
+  packed->n_fields = fields_base;
+  packed->n_values = values_base;
+
+  return protobuf2json_gen_end_object(writer, depth, is_first, error_string, error_size);
+}
+
+/* === Protobuf -> JSON === Packed === Public === */
+
+int protobuf2json_from_packed(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *packed_buffer,
+  size_t packed_length,
+  size_t json_flags,
+  char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+  protobuf2json_packed_t packed;
+
+  protobuf2json_writer_init(&writer, json_flags);
+  protobuf2json_packed_init(&packed, packed_buffer);
+
+  int result = protobuf2json_packed_write_message(&writer, &packed, protobuf_message_descriptor, packed_buffer, packed_length, 0, 0, error_string, error_size);
+
+  protobuf2json_packed_free(&packed);
+
+  if (result) {
+    buffer_free(&writer.buffer);
+    return result;
+  }
+
+  size_t length = writer.buffer.length;
+
+  // NOTICE: Should be freed by caller
+  *json_buffer = buffer_steal(&writer.buffer);
+  if (!*json_buffer) {
+    buffer_free(&writer.buffer);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      length + 1
+    );
+  }
+
+  if (json_length) {
+    *json_length = length;
+  }
+
+  return 0;
+}
+
+/* === JSON -> Protobuf === Private === */
+
+static int json2protobuf_process_message(
+  json_t *json_object,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+);
+
+static const char* json2protobuf_integer_name_by_c_type(ProtobufCType type) {
+  switch (type) {
+    case PROTOBUF_C_TYPE_INT32:
+      return "int32";
+    case PROTOBUF_C_TYPE_SINT32:
+      return "sint32";
+    case PROTOBUF_C_TYPE_SFIXED32:
+      return "sfixed32";
+    case PROTOBUF_C_TYPE_UINT32:
+      return "uint32";
+    case PROTOBUF_C_TYPE_FIXED32:
+      return "fixed32";
+    case PROTOBUF_C_TYPE_INT64:
+      return "int64";
+    case PROTOBUF_C_TYPE_SINT64:
+      return "sint64";
+    case PROTOBUF_C_TYPE_SFIXED64:
+      return "sfixed64";
+    case PROTOBUF_C_TYPE_UINT64:
+      return "uint64";
+    case PROTOBUF_C_TYPE_FIXED64:
+      return "fixed64";
+    default:
+      assert(0);
+      return "unknown";
+  }
+}
+
+/* Checks that integer fits GPB type, values of 64-bit types are already limited by parser */
+static int json2protobuf_integer_in_range(ProtobufCType type, int negative, uint64_t magnitude) {
+  switch (type) {
+    case PROTOBUF_C_TYPE_INT32:
+    case PROTOBUF_C_TYPE_SINT32:
+    case PROTOBUF_C_TYPE_SFIXED32:
+      return magnitude <= (negative ? (uint64_t)INT32_MAX + 1 : (uint64_t)INT32_MAX);
+    case PROTOBUF_C_TYPE_UINT32:
+    case PROTOBUF_C_TYPE_FIXED32:
+      return !magnitude || (!negative && magnitude <= UINT32_MAX);
+    case PROTOBUF_C_TYPE_UINT64:
+    case PROTOBUF_C_TYPE_FIXED64:
+      return !magnitude || !negative;
+    default:
+      return 1;
+  }
+}
+
+/* Same as json2protobuf_integer_in_range() for jansson integer */
+static int json2protobuf_process_integer_in_range(
+  const ProtobufCFieldDescriptor *field_descriptor,
+  json_int_t value,
+  char *error_string,
+  size_t error_size
+) {
+  int negative = (value < 0);
+  uint64_t magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+
+  if (!json2protobuf_integer_in_range(field_descriptor->type, negative, magnitude)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_INTEGER_OUT_OF_RANGE,
+      "JSON integer %s%" PRIu64 " is out of range for GPB %s",
+      negative ? "-" : "", magnitude,
+      json2protobuf_integer_name_by_c_type(field_descriptor->type)
+    );
+  }
+
+  return 0;
+}
+
+static int json2protobuf_process_field(
+  const ProtobufCFieldDescriptor *field_descriptor,
+  json_t *json_value,
+  void *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  if (field_descriptor->type == PROTOBUF_C_TYPE_INT32
+   || field_descriptor->type == PROTOBUF_C_TYPE_SINT32
+   || field_descriptor->type == PROTOBUF_C_TYPE_SFIXED32
+  ) {
+    if (!json_is_integer(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
+        "JSON value is not an integer required for GPB %s",
+        json2protobuf_integer_name_by_c_type(field_descriptor->type)
+      );
+    }
+
+    int result = json2protobuf_process_integer_in_range(field_descriptor, json_integer_value(json_value), error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    int32_t value_int32_t = (int32_t)json_integer_value(json_value);
+
+    memcpy(protobuf_value, &value_int32_t, sizeof(value_int32_t));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_UINT32
+          || field_descriptor->type == PROTOBUF_C_TYPE_FIXED32
+  ) {
+    if (!json_is_integer(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
+        "JSON value is not an integer required for GPB %s",
+        json2protobuf_integer_name_by_c_type(field_descriptor->type)
+      );
+    }
+
+    int result = json2protobuf_process_integer_in_range(field_descriptor, json_integer_value(json_value), error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    uint32_t value_uint32_t = (uint32_t)json_integer_value(json_value);
+
+    memcpy(protobuf_value, &value_uint32_t, sizeof(value_uint32_t));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_INT64
+          || field_descriptor->type == PROTOBUF_C_TYPE_SINT64
+          || field_descriptor->type == PROTOBUF_C_TYPE_SFIXED64
+  ) {
+    if (!json_is_integer(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
+        "JSON value is not an integer required for GPB %s",
+        json2protobuf_integer_name_by_c_type(field_descriptor->type)
+      );
+    }
+
+    int64_t value_int64_t = (int64_t)json_integer_value(json_value);
+
+    memcpy(protobuf_value, &value_int64_t, sizeof(value_int64_t));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_UINT64
+          || field_descriptor->type == PROTOBUF_C_TYPE_FIXED64
+  ) {
+    if (!json_is_integer(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
+        "JSON value is not an integer required for GPB %s",
+        json2protobuf_integer_name_by_c_type(field_descriptor->type)
+      );
+    }
+
+    int result = json2protobuf_process_integer_in_range(field_descriptor, json_integer_value(json_value), error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    uint64_t value_uint64_t = (uint64_t)json_integer_value(json_value);
+
+    memcpy(protobuf_value, &value_uint64_t, sizeof(value_uint64_t));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_FLOAT) {
+    float value_float;
+
+    if (json_is_integer(json_value)) {
+      value_float = (float)json_integer_value(json_value);
+    } else if (json_is_real(json_value)) {
+      value_float = (float)json_real_value(json_value);
+    } else {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_INTEGER_OR_REAL,
+        "JSON value is not a integer/real required for GPB float"
+      );
+    }
+
+    memcpy(protobuf_value, &value_float, sizeof(value_float));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_DOUBLE) {
+    double value_double;
+
+    if (json_is_integer(json_value)) {
+      value_double = (double)json_integer_value(json_value);
+    } else if (json_is_real(json_value)) {
+      value_double = (double)json_real_value(json_value);
+    } else {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_INTEGER_OR_REAL,
+        "JSON value is not a integer/real required for GPB double"
+      );
+    }
+
+    memcpy(protobuf_value, &value_double, sizeof(value_double));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_BOOL) {
+    if (!json_is_boolean(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_BOOLEAN,
+        "JSON value is not a boolean required for GPB bool"
+      );
+    }
+
+    protobuf_c_boolean value_boolean = (protobuf_c_boolean)json_boolean_value(json_value);
+
+    memcpy(protobuf_value, &value_boolean, sizeof(value_boolean));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_ENUM) {
+    if (!json_is_string(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_STRING,
+        "JSON value is not a string required for GPB enum"
+      );
+    }
+
+    const char* enum_value_name = json_string_value(json_value);
+
+    const ProtobufCEnumValue *enum_value;
+
+    enum_value = protobuf2json_enum_value_by_name(field_descriptor->descriptor, enum_value_name, strlen(enum_value_name));
+    if (!enum_value) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE,
+        "Unknown value '%s' for enum '%s'",
+        enum_value_name, ((ProtobufCEnumDescriptor *)field_descriptor->descriptor)->name
+      );
+    }
+
+    int32_t value_enum = (int32_t)enum_value->value;
+
+    memcpy(protobuf_value, &value_enum, sizeof(value_enum));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
+    if (!json_is_string(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_STRING,
+        "JSON value is not a string required for GPB string"
+      );
+    }
+
+    const char* value_string = json_string_value(json_value);
+    size_t value_string_length = strlen(value_string);
+
+    char* value_string_copy = calloc(value_string_length + 1, sizeof(char));
+    if (!value_string_copy) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+        "Cannot allocate %zu bytes using calloc(3)",
+        (value_string_length + 1) * sizeof(char)
+      );
+    }
+
+    memcpy(value_string_copy, value_string, value_string_length + 1);
+
+    *(char **)(protobuf_value) = value_string_copy;
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_BYTES) {
+    if (!json_is_string(json_value)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_STRING,
+        "JSON value is not a string required for GPB bytes"
+      );
+    }
+
+    const char* value_string = json_string_value(json_value);
+    size_t value_string_length = json_string_length(json_value);
+
+    size_t base64_decoded_length = base64_decoded_len(value_string_length);
+
+    ProtobufCBinaryData value_binary;
+
+    value_binary.data = NULL;
+    value_binary.len = 0;
+
+    if (base64_decoded_length) {
+      value_binary.data = malloc(base64_decoded_length + 1);
+      if (!value_binary.data) {
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+          "Cannot allocate %zu bytes using malloc(3)",
+          base64_decoded_length + 1
+        );
+      }
+
+      /* Decoded straight into the final buffer, which is at most 2 bytes longer than needed */
+      value_binary.len = base64_decode((char *)value_binary.data, value_string, value_string_length);
+      if (value_binary.len == (size_t)-1) {
+        free(value_binary.data);
+
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_IS_NOT_BASE64,
+          "JSON string is not base64 required for GPB bytes"
+        );
+      }
+
+      /* Terminated past its length, so textual bytes can still be read as C string */
+      value_binary.data[value_binary.len] = '\0';
+    }
+
+    memcpy(protobuf_value, &value_binary, sizeof(value_binary));
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
+    ProtobufCMessage *protobuf_message;
+
+    int result = json2protobuf_process_message(json_value, field_descriptor->descriptor, &protobuf_message, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    memcpy(protobuf_value, &protobuf_message, sizeof(protobuf_message));
+   } else {
+    assert(0);
+  }
+
+  return 0;
+}
+
+#define SAFE_FREE_BITMAP_AND_MESSAGE                           \
+do {                                                           \
+  bitmap_free(&presented_fields);                              \
+  if (protobuf_message) {                                      \
+    protobuf_c_message_free_unpacked(*protobuf_message, NULL); \
+    *protobuf_message = NULL;                                  \
+  }                                                            \
+} while (0)
+
+static int json2protobuf_process_message(
+  json_t *json_object,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  bitmap_t presented_fields;
+
+  int result = 0;
+
+  if (!json_is_object(json_object)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
+      "JSON is not an object required for GPB message"
+    );
+  }
+
+  *protobuf_message = calloc(1, protobuf_message_descriptor->sizeof_message);
+  if (!*protobuf_message) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using calloc(3)",
+      protobuf_message_descriptor->sizeof_message
+    );
+  }
+
+  protobuf_c_message_init(protobuf_message_descriptor, *protobuf_message);
+
+  if (bitmap_init(&presented_fields, protobuf_message_descriptor->n_fields)) {
+    protobuf_c_message_free_unpacked(*protobuf_message, NULL);
+    *protobuf_message = NULL;
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate bitmap structure using bitmap_init()"
+    );
+  }
+
+  const char *json_key;
+  json_t *json_object_value;
+  json_object_foreach(json_object, json_key, json_object_value) {
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf2json_field_by_name(protobuf_message_descriptor, json_key, strlen(json_key));
+    if (!field_descriptor) {
+      SAFE_FREE_BITMAP_AND_MESSAGE;
+
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_UNKNOWN_FIELD,
+        "Unknown field '%s' for message '%s'",
+        json_key, protobuf_message_descriptor->name
+      );
+    }
+
+    unsigned int field_number = field_descriptor - protobuf_message_descriptor->fields;
+
+    // This cannot happen because Jansson handle this on his side
+    /*if (bitmap_get(&presented_fields, field_number)) {
+      SAFE_FREE_BITMAP_AND_MESSAGE;
+
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_DUPLICATE_FIELD,
+        "Duplicate field '%s' for message '%s'",
+        json_key, protobuf_message_descriptor->name
+      );
+    }*/
+    bitmap_set(&presented_fields, field_number);
+
+    void *protobuf_value = ((char *)*protobuf_message) + field_descriptor->offset;
+    void *protobuf_value_quantifier = ((char *)*protobuf_message) + field_descriptor->quantifier_offset;
+
+    if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
+      *(uint32_t*)protobuf_value_quantifier = field_descriptor->id;
+    }
+
+    if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) {
+      result = json2protobuf_process_field(field_descriptor, json_object_value, protobuf_value, error_string, error_size);
+      if (result) {
+        SAFE_FREE_BITMAP_AND_MESSAGE;
+
+        return result;
+      }
+    } else if (field_descriptor->label == PROTOBUF_C_LABEL_OPTIONAL) {
+      if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE || field_descriptor->type == PROTOBUF_C_TYPE_STRING
+        || (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF)) {
+        // Do nothing
+      } else {
+        *(protobuf_c_boolean *)protobuf_value_quantifier = 1;
+      }
+
+      result = json2protobuf_process_field(field_descriptor, json_object_value, protobuf_value, error_string, error_size);
+      if (result) {
+        SAFE_FREE_BITMAP_AND_MESSAGE;
+
+        return result;
+      }
+    } else { // PROTOBUF_C_LABEL_REPEATED
+      if (!json_is_array(json_object_value)) {
+        SAFE_FREE_BITMAP_AND_MESSAGE;
+
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_IS_NOT_ARRAY,
+          "JSON is not an array required for repeatable GPB field"
+        );
+      }
+
+      size_t *protobuf_values_count = (size_t *)protobuf_value_quantifier;
+
+      *protobuf_values_count = json_array_size(json_object_value);
+
+      if (*protobuf_values_count) {
+        size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
+        if (!value_size) {
+          SAFE_FREE_BITMAP_AND_MESSAGE;
+
+          SET_ERROR_STRING_AND_RETURN(
+            PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
+            "Cannot calculate value size for %d using protobuf2json_value_size_by_type()",
+            field_descriptor->type
+          );
+        }
+
+        void *protobuf_value_repeated = calloc(*protobuf_values_count, value_size);
+        if (!protobuf_value_repeated) {
+          SAFE_FREE_BITMAP_AND_MESSAGE;
+
+          SET_ERROR_STRING_AND_RETURN(
+            PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+            "Cannot allocate %zu bytes using calloc(3)",
+            (size_t)*protobuf_values_count * value_size
+          );
+        }
+
+        size_t json_index;
+        json_t *json_array_value;
+        json_array_foreach(json_object_value, json_index, json_array_value) {
+          char *protobuf_value_repeated_value = (char *)protobuf_value_repeated + json_index * value_size;
+
+          result = json2protobuf_process_field(field_descriptor, json_array_value, (void *)protobuf_value_repeated_value, error_string, error_size);
+          if (result) {
+            /* Free already processed repeated field items */
+            {
+              if (field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
+                size_t t;
+                for (t = 0; t <= json_index; t++) {
+                  free(((char **)protobuf_value_repeated)[t]);
+                }
+              } else if (field_descriptor->type == PROTOBUF_C_TYPE_BYTES) {
+                size_t t;
+                for (t = 0; t <= json_index; t++) {
+                  free(((ProtobufCBinaryData *)protobuf_value_repeated)[t].data);
+                }
+              } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
+                size_t t;
+                for (t = 0; t <= json_index; t++) {
+                  if (((ProtobufCMessage **)protobuf_value_repeated)[t]) {
+                    protobuf_c_message_free_unpacked(
+                      ((ProtobufCMessage **)protobuf_value_repeated)[t],
+                      NULL
+                    );
+                  }
+                }
+              }
+
+              free(protobuf_value_repeated);
+              *protobuf_values_count = 0;
+            }
+
+            SAFE_FREE_BITMAP_AND_MESSAGE;
+
+            return result;
+          }
+        }
+
+        memcpy(protobuf_value, &protobuf_value_repeated, sizeof(protobuf_value_repeated));
+      }
+    }
+  }
+
+  const ProtobufCFieldDescriptor *missing_field_descriptor = protobuf2json_missing_required_field(protobuf_message_descriptor, &presented_fields);
+  if (missing_field_descriptor) {
+    SAFE_FREE_BITMAP_AND_MESSAGE;
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
+      "Required field '%s' is missing in message '%s'",
+      missing_field_descriptor->name, protobuf_message_descriptor->name
+    );
+  }
+
+  bitmap_free(&presented_fields);
+
+  return 0;
+}
+
+/* === JSON -> Protobuf === Reader === Private === */
+
+/*
+ * Direct reader decodes JSON text straight into the message structure
+ * in a single pass, looking up field descriptor for each key as soon as it
+ * is read, without building an intermediate jansson tree. Parsing errors
+ * are reported the same way json_loads() does for the same json_flags.
+ *
+ * Every value is stored into the message only after it is completely read,
+ * so message is consistent at any moment and can be freed on error
+ * with protobuf_c_message_free_unpacked().
+ */
+
+#define JSON2PROTOBUF_READER_MAX_DEPTH 2048
+#define JSON2PROTOBUF_READER_NEAR_MAX_LENGTH 20
+
+/* Typedef is public, see protobuf2json_codec_t */
+struct json2protobuf_reader {
+  const char *start;
+  const char *end;
+  const char *position;
+  /* Start of the token being read, quoted in parsing error messages */
+  const char *token;
+  size_t json_flags;
+  /* Keys, enum names and other short-lived strings are decoded here */
+  buffer_t scratch;
+  /* Repeated field values are collected here until closing bracket, as a stack for nested arrays */
+  buffer_t values;
+  /* Allocator for the message tree, NULL for malloc(3) */
+  ProtobufCAllocator *allocator;
+  /* Strings without escapes are NUL-terminated in the input and used in place */
+  int insitu;
+};
+
+/* Enough to hold any repeated field value */
+typedef union json2protobuf_reader_value {
+  int32_t value_int32;
+  int64_t value_int64;
+  float value_float;
+  double value_double;
+  protobuf_c_boolean value_boolean;
+  char *value_string;
+  ProtobufCBinaryData value_binary;
+  ProtobufCMessage *value_message;
+} json2protobuf_reader_value_t;
+
+static int json2protobuf_reader_error(
+  json2protobuf_reader_t *reader,
+  char *error_string,
+  size_t error_size,
+  const char *text_format,
+  ...
+) {
+  char text[128];
+  va_list args;
+
+  va_start(args, text_format);
+  vsnprintf(text, sizeof(text), text_format, args);
+  va_end(args);
+
+  int line = 1;
+  int column = 0;
+  const char *p;
+
+  for (p = reader->start; p < reader->position; p++) {
+    if (*p == '\n') {
+      line++;
+      column = 0;
+    } else if ((*(const unsigned char *)p & 0xC0) != 0x80) {
+      column++;
+    }
+  }
+
+  int position = (int)(reader->position - reader->start);
+  int token_length = (int)(reader->position - reader->token);
+
+  if (!token_length) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+      "JSON parsing error at line %d column %d (position %d): %s near end of file",
+      line, column, position, text
+    );
+  } else if (token_length <= JSON2PROTOBUF_READER_NEAR_MAX_LENGTH) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+      "JSON parsing error at line %d column %d (position %d): %s near '%.*s'",
+      line, column, position, text, token_length, reader->token
+    );
+  } else {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+      "JSON parsing error at line %d column %d (position %d): %s",
+      line, column, position, text
+    );
+  }
+}
+
+/* Skips whitespace and returns first character of the next token, or '\0' at the end of input */
+static char json2protobuf_reader_peek(json2protobuf_reader_t *reader) {
+  const char *p = reader->position;
+
+  while (p < reader->end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    p++;
+  }
+
+  reader->position = p;
+  reader->token = p;
+
+  return p < reader->end ? *p : '\0';
+}
+
+static int json2protobuf_reader_is_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/*
+ * Moves over number token at reader->token, returns -1 if it is malformed:
+ * then reader->position points to the character where it went wrong.
+ */
+static int json2protobuf_reader_scan_number(json2protobuf_reader_t *reader, int *real) {
+  const char *p = reader->token;
+  const char *end = reader->end;
+
+  *real = 0;
+
+  if (p < end && *p == '-') {
+    p++;
+  }
+
+  if (p < end && *p == '0') {
+    p++;
+    if (p < end && *p >= '0' && *p <= '9') {
+      reader->position = p;
+      return -1;
+    }
+  } else if (p < end && *p >= '1' && *p <= '9') {
+    while (p < end && *p >= '0' && *p <= '9') {
+      p++;
+    }
+  } else {
+    reader->position = p;
+    return -1;
+  }
+
+  if (p < end && *p == '.') {
+    *real = 1;
+    p++;
+    if (!(p < end && *p >= '0' && *p <= '9')) {
+      reader->position = p;
+      return -1;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+      p++;
+    }
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    *real = 1;
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) {
+      p++;
+    }
+    if (!(p < end && *p >= '0' && *p <= '9')) {
+      reader->position = p;
+      return -1;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+      p++;
+    }
+  }
+
+  reader->position = p;
+
+  return 0;
+}
+
+/* Moves over literal, number or a single character at reader->token, so error message can quote it */
+static void json2protobuf_reader_skip_token(json2protobuf_reader_t *reader) {
+  const char *p = reader->token;
+
+  if (p >= reader->end) {
+    reader->position = p;
+    return;
+  }
+
+  if (json2protobuf_reader_is_alpha(*p)) {
+    while (p < reader->end && json2protobuf_reader_is_alpha(*p)) {
+      p++;
+    }
+  } else if (*p == '-' || (*p >= '0' && *p <= '9')) {
+    int real;
+
+    json2protobuf_reader_scan_number(reader, &real);
+    return;
+  } else {
+    p++;
+  }
+
+  reader->position = p;
+}
+
+/* Reads literal token, returns its jansson type or -1 if it is not true, false or null */
+static int json2protobuf_reader_read_literal(json2protobuf_reader_t *reader) {
+  const char *p = reader->token;
+
+  while (p < reader->end && json2protobuf_reader_is_alpha(*p)) {
+    p++;
+  }
+
+  reader->position = p;
+
+  size_t length = p - reader->token;
+
+  if (length == 4 && !memcmp(reader->token, "true", 4)) {
+    return JSON_TRUE;
+  } else if (length == 5 && !memcmp(reader->token, "false", 5)) {
+    return JSON_FALSE;
+  } else if (length == 4 && !memcmp(reader->token, "null", 4)) {
+    return JSON_NULL;
+  }
+
+  return -1;
+}
+
+/* Slow path for reals which cannot be computed exactly by number_to_double() */
+static int json2protobuf_reader_strtod(
+  json2protobuf_reader_t *reader,
+  double *value_real,
+  char *error_string,
+  size_t error_size
+) {
+  /* strtod(3) needs NUL-terminated string */
+  char number_buffer[64];
+  char *number = number_buffer;
+  size_t number_length = reader->position - reader->token;
+
+  if (number_length >= sizeof(number_buffer)) {
+    reader->scratch.length = 0;
+    if (buffer_reserve(&reader->scratch, number_length + 1)) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+        "Cannot allocate %zu bytes using realloc(3)",
+        number_length + 1
+      );
+    }
+    number = reader->scratch.data;
+  }
+
+  memcpy(number, reader->token, number_length);
+  number[number_length] = '\0';
+
+  /* strtod(3) respects locale, so use its decimal point as jansson does */
+  char *decimal_point = strchr(number, '.');
+  if (decimal_point) {
+    *decimal_point = *localeconv()->decimal_point;
+  }
+
+  errno = 0;
+  double value = strtod(number, NULL);
+  if (errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL)) {
+    return json2protobuf_reader_error(reader, error_string, error_size, "real number overflow");
+  }
+
+  *value_real = value;
+
+  return 0;
+}
+
+/*
+ * Integers are returned as sign and magnitude, so the whole uint64 range fits.
+ * Only `unsigned64` fields accept integers above INT64_MAX, for the rest
+ * they are parsing errors, the same as for jansson.
+ */
+static int json2protobuf_reader_read_number(
+  json2protobuf_reader_t *reader,
+  int unsigned64,
+  int *negative,
+  uint64_t *magnitude,
+  double *value_real,
+  int *is_real,
+  char *error_string,
+  size_t error_size
+) {
+  int real;
+
+  if (json2protobuf_reader_scan_number(reader, &real)) {
+    return json2protobuf_reader_error(reader, error_string, error_size, "invalid token");
+  }
+
+  const char *digits = reader->token;
+  *negative = (*digits == '-');
+  if (*negative) {
+    digits++;
+  }
+
+  if (!real && !(reader->json_flags & JSON_DECODE_INT_AS_REAL)) {
+    uint64_t value;
+
+    if (number_parse_uint64(digits, reader->position, &value)
+      || (*negative && value > (uint64_t)INT64_MAX + 1)
+      || (!*negative && !unsigned64 && value > (uint64_t)INT64_MAX)
+    ) {
+      return json2protobuf_reader_error(
+        reader, error_string, error_size,
+        *negative ? "too big negative integer" : "too big integer"
+      );
+    }
+
+    *magnitude = value;
+    *is_real = 0;
+
+    return 0;
+  }
+
+  number_t number;
+  number_parse(reader->token, reader->position, &number);
+
+  *is_real = 1;
+
+  if (!number_to_double(&number, value_real)) {
+    return 0;
+  }
+
+  return json2protobuf_reader_strtod(reader, value_real, error_string, error_size);
+}
+
+/*
+ * Finds the end of string token at reader->token and validates its UTF-8
+ * and escape sequences, `raw` is set to string contents between quotes.
+ * Escaped code points are checked later by json2protobuf_reader_unescape().
+ */
+static int json2protobuf_reader_scan_string(
+  json2protobuf_reader_t *reader,
+  const char **raw,
+  size_t *raw_length,
+  int *escaped,
+  char *error_string,
+  size_t error_size
+) {
+  const unsigned char *start = (const unsigned char *)reader->token + 1;
+  const unsigned char *end = (const unsigned char *)reader->end;
+  const unsigned char *p = start;
+
+  *escaped = 0;
+
+  while (p < end) {
+    /* Long runs of plain ASCII and of valid UTF-8 text are skipped by blocks */
+    p += escape_plain_length((const char *)p, end - p, 0);
+    if (p == end) {
+      break;
+    }
+
+    unsigned char c = *p;
+
+    if (c == '"') {
+      *raw = (const char *)start;
+      *raw_length = p - start;
+      reader->position = (const char *)p + 1;
+
+      return 0;
+    } else if (c == '\\') {
+      if (end - p < 2) {
+        reader->position = reader->end;
+
+        return json2protobuf_reader_error(reader, error_string, error_size, "invalid escape");
+      }
+
+      *escaped = 1;
+      p++;
+      c = *p++;
+
+      if (c == 'u') {
+        int i;
+        for (i = 0; i < 4 && p < end; i++, p++) {
+          if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f') || (*p >= 'A' && *p <= 'F'))) {
+            reader->position = (const char *)p + 1;
+
+            return json2protobuf_reader_error(reader, error_string, error_size, "invalid escape");
+          }
+        }
+      } else if (!strchr("\"\\/bfnrt", c)) {
+        reader->position = (const char *)p;
+
+        return json2protobuf_reader_error(reader, error_string, error_size, "invalid escape");
+      }
+    } else if (c < 0x20) {
+      reader->position = (const char *)p;
+
+      return json2protobuf_reader_error(reader, error_string, error_size, "control character 0x%x", c);
+    } else if (c < 0x80) {
+      p++;
+    } else {
+      size_t valid_length = utf8_string_length((const char *)p, end - p);
+      if (valid_length) {
+        p += valid_length;
+        continue;
+      }
+
+      int32_t codepoint;
+      size_t sequence_length = utf8_sequence(p, end - p, &codepoint);
+      if (!sequence_length) {
+        reader->position = (const char *)p;
+
+        return json2protobuf_reader_error(reader, error_string, error_size, "unable to decode byte 0x%x", c);
+      }
+      p += sequence_length;
+    }
+  }
+
+  reader->position = reader->end;
+
+  return json2protobuf_reader_error(reader, error_string, error_size, "premature end of input");
+}
+
+static int32_t json2protobuf_reader_hex4(const char *p, const char *end) {
+  int32_t value = 0;
+  int i;
+
+  if (end - p < 4) {
+    return -1;
+  }
+
+  for (i = 0; i < 4; i++) {
+    char c = p[i];
+
+    value <<= 4;
+    if (c >= '0' && c <= '9') {
+      value |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else {
+      return -1;
+    }
+  }
+
+  return value;
+}
+
+static size_t json2protobuf_reader_utf8_encode(int32_t codepoint, char *buffer) {
+  if (codepoint < 0x80) {
+    buffer[0] = (char)codepoint;
+    return 1;
+  } else if (codepoint < 0x800) {
+    buffer[0] = (char)(0xC0 | (codepoint >> 6));
+    buffer[1] = (char)(0x80 | (codepoint & 0x3F));
+    return 2;
+  } else if (codepoint < 0x10000) {
+    buffer[0] = (char)(0xE0 | (codepoint >> 12));
+    buffer[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    buffer[2] = (char)(0x80 | (codepoint & 0x3F));
+    return 3;
+  } else {
+    buffer[0] = (char)(0xF0 | (codepoint >> 18));
+    buffer[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    buffer[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    buffer[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+  }
+}
+
+/*
+ * Decodes escape sequences of raw string contents into `value`,
+ * which should have room for raw_length + 1 bytes: decoded string
+ * is never longer than its JSON representation.
+ */
+static int json2protobuf_reader_unescape(
+  json2protobuf_reader_t *reader,
+  const char *raw,
+  size_t raw_length,
+  int allow_nul,
+  char *value,
+  size_t *value_length,
+  char *error_string,
+  size_t error_size
+) {
+  const char *p = raw;
+  const char *end = raw + raw_length;
+  char *v = value;
+
+  while (p < end) {
+    const char *escape = memchr(p, '\\', end - p);
+    if (!escape) {
+      escape = end;
+    }
+
+    memcpy(v, p, escape - p);
+    v += escape - p;
+    p = escape;
+
+    if (p == end) {
+      break;
+    }
+
+    /* json2protobuf_reader_scan_string() guarantees escape sequence is valid */
+    p++;
+
+    switch (*p++) {
+      case '"':
+        *v++ = '"';
+        break;
+      case '\\':
+        *v++ = '\\';
+        break;
+      case '/':
+        *v++ = '/';
+        break;
+      case 'b':
+        *v++ = '\b';
+        break;
+      case 'f':
+        *v++ = '\f';
+        break;
+      case 'n':
+        *v++ = '\n';
+        break;
+      case 'r':
+        *v++ = '\r';
+        break;
+      case 't':
+        *v++ = '\t';
+        break;
+      case 'u': {
+        /* json2protobuf_reader_scan_string() guarantees there are 4 hex digits */
+        int32_t codepoint = json2protobuf_reader_hex4(p, end);
+        p += 4;
+
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+          int32_t low_surrogate = -1;
+
+          if (end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            low_surrogate = json2protobuf_reader_hex4(p + 2, end);
+          }
+
+          if (low_surrogate < 0) {
+            return json2protobuf_reader_error(reader, error_string, error_size, "invalid Unicode '\\u%04X'", codepoint);
+          }
+
+          if (low_surrogate < 0xDC00 || low_surrogate > 0xDFFF) {
+            return json2protobuf_reader_error(
+              reader, error_string, error_size,
+              "invalid Unicode '\\u%04X\\u%04X'",
+              codepoint, low_surrogate
+            );
+          }
+
+          codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low_surrogate - 0xDC00);
+          p += 6;
+        } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+          return json2protobuf_reader_error(reader, error_string, error_size, "invalid Unicode '\\u%04X'", codepoint);
+        } else if (codepoint == 0 && !allow_nul) {
+          return json2protobuf_reader_error(reader, error_string, error_size, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+        }
+
+        v += json2protobuf_reader_utf8_encode(codepoint, v);
+        break;
+      }
+      default:
+        assert(0);
+        return json2protobuf_reader_error(reader, error_string, error_size, "invalid escape");
+    }
+  }
+
+  *v = '\0';
+  *value_length = v - value;
+
+  return 0;
+}
+
+/* Reads string token into reader scratch buffer as NUL-terminated string */
+static int json2protobuf_reader_read_scratch_string(
+  json2protobuf_reader_t *reader,
+  int allow_nul,
+  size_t *length,
+  char *error_string,
+  size_t error_size
+) {
+  const char *raw;
+  size_t raw_length;
+  int escaped;
+
+  int result = json2protobuf_reader_scan_string(reader, &raw, &raw_length, &escaped, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  reader->scratch.length = 0;
+  if (buffer_reserve(&reader->scratch, raw_length + 1)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      raw_length + 1
+    );
+  }
+
+  if (!escaped) {
+    memcpy(reader->scratch.data, raw, raw_length);
+    reader->scratch.data[raw_length] = '\0';
+    *length = raw_length;
+
+    return 0;
+  }
+
+  return json2protobuf_reader_unescape(reader, raw, raw_length, allow_nul, reader->scratch.data, length, error_string, error_size);
+}
+
+/* Same as read_scratch_string(), but string without escapes is not copied, so it is not NUL-terminated */
+static int json2protobuf_reader_read_string_view(
+  json2protobuf_reader_t *reader,
+  int allow_nul,
+  const char **value,
+  size_t *length,
+  char *error_string,
+  size_t error_size
+) {
+  const char *raw;
+  size_t raw_length;
+  int escaped;
+
+  int result = json2protobuf_reader_scan_string(reader, &raw, &raw_length, &escaped, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (!escaped) {
+    *value = raw;
+    *length = raw_length;
+
+    return 0;
+  }
+
+  reader->scratch.length = 0;
+  if (buffer_reserve(&reader->scratch, raw_length + 1)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      raw_length + 1
+    );
+  }
+
+  *value = reader->scratch.data;
+
+  return json2protobuf_reader_unescape(reader, raw, raw_length, allow_nul, reader->scratch.data, length, error_string, error_size);
+}
+
+/*
+ * Reports `text` quoting the token at reader->token. As jansson reads
+ * the whole token before looking at it, malformed string is reported instead.
+ */
+static int json2protobuf_reader_unexpected(
+  json2protobuf_reader_t *reader,
+  const char *text,
+  char *error_string,
+  size_t error_size
+) {
+  if (reader->token < reader->end && *reader->token == '"') {
+    size_t length;
+
+    int result = json2protobuf_reader_read_scratch_string(reader, 1, &length, error_string, error_size);
+    if (result) {
+      return result;
+    }
+  } else {
+    json2protobuf_reader_skip_token(reader);
+  }
+
+  return json2protobuf_reader_error(reader, error_string, error_size, "%s", text);
+}
+
+/*
+ * Called when value starting with `c` has wrong type for the field:
+ * reports parsing error if it is not a valid JSON value at all,
+ * otherwise returns 0 and lets caller report type mismatch.
+ */
+static int json2protobuf_reader_check_value(
+  json2protobuf_reader_t *reader,
+  char c,
+  char *error_string,
+  size_t error_size
+) {
+  if (c == '{' || c == '[' || c == '"' || c == '-' || (c >= '0' && c <= '9')) {
+    return 0;
+  }
+
+  if ((c == 't' || c == 'f' || c == 'n') && json2protobuf_reader_read_literal(reader) != -1) {
+    return 0;
+  }
+
+  if (reader->token == reader->end || c == '}' || c == ']' || c == ',' || c == ':') {
+    return json2protobuf_reader_unexpected(reader, "unexpected token", error_string, error_size);
+  }
+
+  return json2protobuf_reader_unexpected(reader, "invalid token", error_string, error_size);
+}
+
+#define JSON2PROTOBUF_READER_CHECK_VALUE(c)                                                  \
+do {                                                                                         \
+  int check_result = json2protobuf_reader_check_value(reader, c, error_string, error_size); \
+  if (check_result) {                                                                        \
+    return check_result;                                                                     \
+  }                                                                                          \
+} while (0)
+
+static int json2protobuf_reader_alloc(
+  json2protobuf_reader_t *reader,
+  size_t size,
+  void **data,
+  char *error_string,
+  size_t error_size
+) {
+  if (reader->allocator) {
+    *data = reader->allocator->alloc(reader->allocator->allocator_data, size);
+  } else {
+    *data = malloc(size);
+  }
+
+  if (!*data) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using %s",
+      size, reader->allocator ? "allocator" : "malloc(3)"
+    );
+  }
+
+  return 0;
+}
+
+static void json2protobuf_reader_free(json2protobuf_reader_t *reader, void *data) {
+  if (reader->allocator) {
+    reader->allocator->free(reader->allocator->allocator_data, data);
+  } else {
+    free(data);
+  }
+}
+
+/* Frees value allocated by reader, keeping default values intact */
+static void json2protobuf_reader_free_value(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  void *protobuf_value
+) {
+  if (field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
+    char *value_string = *(char **)protobuf_value;
+
+    if (value_string && value_string != (char *)field_descriptor->default_value) {
+      json2protobuf_reader_free(reader, value_string);
+    }
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_BYTES) {
+    ProtobufCBinaryData *value_binary = (ProtobufCBinaryData *)protobuf_value;
+    const ProtobufCBinaryData *default_binary = (const ProtobufCBinaryData *)field_descriptor->default_value;
+
+    if (value_binary->data && !(default_binary && value_binary->data == default_binary->data)) {
+      json2protobuf_reader_free(reader, value_binary->data);
+    }
+  } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
+    ProtobufCMessage *value_message = *(ProtobufCMessage **)protobuf_value;
+
+    if (value_message) {
+      protobuf_c_message_free_unpacked(value_message, reader->allocator);
+    }
+  }
+}
+
+/* Frees and zeroes already read field, so it can be read again: last value wins as in jansson */
+static void json2protobuf_reader_release_field(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  ProtobufCMessage *protobuf_message
+) {
+  void *protobuf_value = ((char *)protobuf_message) + field_descriptor->offset;
+  size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
+
+  if (field_descriptor->label == PROTOBUF_C_LABEL_REPEATED) {
+    size_t *protobuf_values_count = (size_t *)(((char *)protobuf_message) + field_descriptor->quantifier_offset);
+    char *protobuf_values = *(char **)protobuf_value;
+
+    size_t i;
+    for (i = 0; i < *protobuf_values_count; i++) {
+      json2protobuf_reader_free_value(reader, field_descriptor, protobuf_values + i * value_size);
+    }
+
+    if (protobuf_values) {
+      json2protobuf_reader_free(reader, protobuf_values);
+    }
+
+    *(char **)protobuf_value = NULL;
+    *protobuf_values_count = 0;
+  } else {
+    json2protobuf_reader_free_value(reader, field_descriptor, protobuf_value);
+
+    memset(protobuf_value, 0, value_size);
+  }
+}
+
+static int json2protobuf_reader_read_message(
+  json2protobuf_reader_t *reader,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  int depth,
+  char *error_string,
+  size_t error_size
+);
+
+/* Integer of any type, `type` tells its range and size */
+static int json2protobuf_reader_read_integer(
+  json2protobuf_reader_t *reader,
+  ProtobufCType type,
+  void *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  int negative = 0;
+  uint64_t magnitude = 0;
+  double value_real = 0;
+  int is_real = 0;
+
+  if (!(c == '-' || (c >= '0' && c <= '9'))) {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
+      "JSON value is not an integer required for GPB %s",
+      json2protobuf_integer_name_by_c_type(type)
+    );
+  }
+
+  int unsigned64 = (type == PROTOBUF_C_TYPE_UINT64 || type == PROTOBUF_C_TYPE_FIXED64);
+
+  int result = json2protobuf_reader_read_number(reader, unsigned64, &negative, &magnitude, &value_real, &is_real, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (is_real) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
+      "JSON value is not an integer required for GPB %s",
+      json2protobuf_integer_name_by_c_type(type)
+    );
+  }
+
+  if (!json2protobuf_integer_in_range(type, negative, magnitude)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_INTEGER_OUT_OF_RANGE,
+      "JSON integer %s%" PRIu64 " is out of range for GPB %s",
+      negative ? "-" : "", magnitude,
+      json2protobuf_integer_name_by_c_type(type)
+    );
+  }
+
+  if (type == PROTOBUF_C_TYPE_UINT32 || type == PROTOBUF_C_TYPE_FIXED32) {
+    uint32_t value_uint32_t = (uint32_t)magnitude;
+
+    memcpy(protobuf_value, &value_uint32_t, sizeof(value_uint32_t));
+  } else if (type == PROTOBUF_C_TYPE_INT64
+          || type == PROTOBUF_C_TYPE_SINT64
+          || type == PROTOBUF_C_TYPE_SFIXED64
+  ) {
+    /* Negating in unsigned, so INT64_MIN is fine */
+    int64_t value_int64_t = (int64_t)(negative ? 0 - magnitude : magnitude);
+
+    memcpy(protobuf_value, &value_int64_t, sizeof(value_int64_t));
+  } else if (unsigned64) {
+    uint64_t value_uint64_t = magnitude;
+
+    memcpy(protobuf_value, &value_uint64_t, sizeof(value_uint64_t));
+  } else {
+    int32_t value_int32_t = (int32_t)(negative ? 0 - (uint32_t)magnitude : (uint32_t)magnitude);
+
+    memcpy(protobuf_value, &value_int32_t, sizeof(value_int32_t));
+  }
+
+  return 0;
+}
+
+/* Float or double, as `type` tells */
+static int json2protobuf_reader_read_real(
+  json2protobuf_reader_t *reader,
+  ProtobufCType type,
+  void *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  int negative = 0;
+  uint64_t magnitude = 0;
+  double value_real = 0;
+  int is_real = 0;
+
+  if (!(c == '-' || (c >= '0' && c <= '9'))) {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_INTEGER_OR_REAL,
+      "JSON value is not a integer/real required for GPB %s",
+      type == PROTOBUF_C_TYPE_FLOAT ? "float" : "double"
+    );
+  }
+
+  int result = json2protobuf_reader_read_number(reader, 0, &negative, &magnitude, &value_real, &is_real, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (!is_real) {
+    /* Integer -0 is just 0, as it is for jansson */
+    value_real = (negative && magnitude) ? -(double)magnitude : (double)magnitude;
+  }
+
+  if (type == PROTOBUF_C_TYPE_FLOAT) {
+    float value_float = (float)value_real;
+
+    memcpy(protobuf_value, &value_float, sizeof(value_float));
+  } else {
+    memcpy(protobuf_value, &value_real, sizeof(value_real));
+  }
+
+  return 0;
+}
+
+static int json2protobuf_reader_read_bool(
+  json2protobuf_reader_t *reader,
+  protobuf_c_boolean *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+  int type = -1;
+
+  if (c == 't' || c == 'f') {
+    type = json2protobuf_reader_read_literal(reader);
+  }
+
+  if (type != JSON_TRUE && type != JSON_FALSE) {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_BOOLEAN,
+      "JSON value is not a boolean required for GPB bool"
+    );
+  }
+
+  *protobuf_value = (type == JSON_TRUE);
+
+  return 0;
+}
+
+static int json2protobuf_reader_read_enum(
+  json2protobuf_reader_t *reader,
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor,
+  void *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '"') {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_STRING,
+      "JSON value is not a string required for GPB enum"
+    );
+  }
+
+  const char *enum_value_name;
+  size_t enum_value_name_length;
+
+  /* Names without escapes are looked up right in the input */
+  int result = json2protobuf_reader_read_string_view(reader, reader->json_flags & JSON_ALLOW_NUL, &enum_value_name, &enum_value_name_length, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  /* Up to NUL, as jansson-based json2protobuf_string() sees it */
+  const char *nul = memchr(enum_value_name, '\0', enum_value_name_length);
+  if (nul) {
+    enum_value_name_length = nul - enum_value_name;
+  }
+
+  const ProtobufCEnumValue *enum_value;
+
+  enum_value = protobuf2json_enum_value_by_name(protobuf_enum_descriptor, enum_value_name, enum_value_name_length);
+  if (!enum_value) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE,
+      "Unknown value '%.*s' for enum '%s'",
+      (int)enum_value_name_length, enum_value_name, protobuf_enum_descriptor->name
+    );
+  }
+
+  int32_t value_enum = (int32_t)enum_value->value;
+
+  memcpy(protobuf_value, &value_enum, sizeof(value_enum));
+
+  return 0;
+}
+
+static int json2protobuf_reader_read_string(
+  json2protobuf_reader_t *reader,
+  char **protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '"') {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_STRING,
+      "JSON value is not a string required for GPB string"
+    );
+  }
+
+  const char *raw;
+  size_t raw_length;
+  int escaped;
+
+  int result = json2protobuf_reader_scan_string(reader, &raw, &raw_length, &escaped, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  char *value_string;
+
+  if (reader->insitu && !escaped) {
+    /* Closing quote is already read, so it becomes the terminator */
+    value_string = (char *)raw;
+    value_string[raw_length] = '\0';
+
+    *protobuf_value = value_string;
+
+    return 0;
+  }
+
+  result = json2protobuf_reader_alloc(reader, raw_length + 1, (void **)&value_string, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (escaped) {
+    size_t value_string_length;
+
+    result = json2protobuf_reader_unescape(reader, raw, raw_length, reader->json_flags & JSON_ALLOW_NUL, value_string, &value_string_length, error_string, error_size);
+    if (result) {
+      json2protobuf_reader_free(reader, value_string);
+      return result;
+    }
+  } else {
+    memcpy(value_string, raw, raw_length);
+    value_string[raw_length] = '\0';
+  }
+
+  *protobuf_value = value_string;
+
+  return 0;
+}
+
+static int json2protobuf_reader_read_bytes(
+  json2protobuf_reader_t *reader,
+  ProtobufCBinaryData *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '"') {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_STRING,
+      "JSON value is not a string required for GPB bytes"
+    );
+  }
+
+  const char *value_string;
+  size_t value_string_length;
+
+  /* Base64 text usually has no escapes, so it is decoded right from the input */
+  int result = json2protobuf_reader_read_string_view(reader, reader->json_flags & JSON_ALLOW_NUL, &value_string, &value_string_length, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  ProtobufCBinaryData value_binary;
+
+  value_binary.data = NULL;
+  value_binary.len = 0;
+
+  size_t base64_decoded_length = base64_decoded_len(value_string_length);
+  if (base64_decoded_length) {
+    result = json2protobuf_reader_alloc(reader, base64_decoded_length + 1, (void **)&value_binary.data, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    value_binary.len = base64_decode((char *)value_binary.data, value_string, value_string_length);
+    if (value_binary.len == (size_t)-1) {
+      json2protobuf_reader_free(reader, value_binary.data);
+
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_BASE64,
+        "JSON string is not base64 required for GPB bytes"
+      );
+    }
+
+    value_binary.data[value_binary.len] = '\0';
+  }
+
+  *protobuf_value = value_binary;
+
+  return 0;
+}
+
+/* Nested message, `depth` is its own depth */
+static int json2protobuf_reader_read_message_value(
+  json2protobuf_reader_t *reader,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_value,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '{') {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
+      "JSON is not an object required for GPB message"
+    );
+  }
+
+  return json2protobuf_reader_read_message(reader, protobuf_message_descriptor, protobuf_value, depth, error_string, error_size);
+}
+
+static int json2protobuf_reader_read_value(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  void *protobuf_value,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  switch (field_descriptor->type) {
+    case PROTOBUF_C_TYPE_INT32:
+    case PROTOBUF_C_TYPE_SINT32:
+    case PROTOBUF_C_TYPE_SFIXED32:
+    case PROTOBUF_C_TYPE_UINT32:
+    case PROTOBUF_C_TYPE_FIXED32:
+    case PROTOBUF_C_TYPE_INT64:
+    case PROTOBUF_C_TYPE_SINT64:
+    case PROTOBUF_C_TYPE_SFIXED64:
+    case PROTOBUF_C_TYPE_UINT64:
+    case PROTOBUF_C_TYPE_FIXED64:
+      return json2protobuf_reader_read_integer(reader, field_descriptor->type, protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_FLOAT:
+    case PROTOBUF_C_TYPE_DOUBLE:
+      return json2protobuf_reader_read_real(reader, field_descriptor->type, protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_BOOL:
+      return json2protobuf_reader_read_bool(reader, (protobuf_c_boolean *)protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_ENUM:
+      return json2protobuf_reader_read_enum(reader, field_descriptor->descriptor, protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_STRING:
+      return json2protobuf_reader_read_string(reader, (char **)protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_BYTES:
+      return json2protobuf_reader_read_bytes(reader, (ProtobufCBinaryData *)protobuf_value, error_string, error_size);
+    case PROTOBUF_C_TYPE_MESSAGE:
+      return json2protobuf_reader_read_message_value(reader, field_descriptor->descriptor, (ProtobufCMessage **)protobuf_value, depth + 1, error_string, error_size);
+    default:
+      assert(0);
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
+        "Unsupported field type %d",
+        field_descriptor->type
+      );
+  }
+}
+
+/*
+ * Values count is unknown until closing bracket, so values are collected
+ * on the shared stack first and then copied into exactly sized array.
+ * Nested repeated fields push on top of it, so only offsets are kept.
+ */
+
+/* Reads opening bracket, `more` is 0 for empty array */
+static int json2protobuf_reader_begin_array(
+  json2protobuf_reader_t *reader,
+  int depth,
+  size_t *values_start,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '[') {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_ARRAY,
+      "JSON is not an array required for repeatable GPB field"
+    );
+  }
+
+  if (depth > JSON2PROTOBUF_READER_MAX_DEPTH) {
+    reader->position++;
+    return json2protobuf_reader_error(reader, error_string, error_size, "maximum parsing depth reached");
+  }
+
+  reader->position++;
+
+  *values_start = reader->values.length;
+  *more = 0;
+
+  c = json2protobuf_reader_peek(reader);
+  if (c == ']') {
+    reader->position++;
+    return 0;
+  }
+
+  /* jansson stops reading array values at the end of input */
+  if (reader->position == reader->end) {
+    return json2protobuf_reader_unexpected(reader, "']' expected", error_string, error_size);
+  }
+
+  *more = 1;
+
+  return 0;
+}
+
+/* Pushes value onto reader->values stack and reads separator after it, `more` is 0 after the last one */
+static int json2protobuf_reader_push_value(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  void *value,
+  size_t value_size,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  if (buffer_reserve(&reader->values, value_size)) {
+    json2protobuf_reader_free_value(reader, field_descriptor, value);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      reader->values.length + value_size
+    );
+  }
+
+  memcpy(reader->values.data + reader->values.length, value, value_size);
+  reader->values.length += value_size;
+
+  *more = 0;
+
+  char c = json2protobuf_reader_peek(reader);
+  if (c == ']') {
+    reader->position++;
+    return 0;
+  } else if (c != ',') {
+    return json2protobuf_reader_unexpected(reader, "']' expected", error_string, error_size);
+  }
+
+  reader->position++;
+
+  json2protobuf_reader_peek(reader);
+  if (reader->position == reader->end) {
+    return json2protobuf_reader_unexpected(reader, "']' expected", error_string, error_size);
+  }
+
+  *more = 1;
+
+  return 0;
+}
+
+/* Frees values collected since `values_start` */
+static void json2protobuf_reader_abort_array(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  size_t values_start
+) {
+  size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
+  size_t values_count = (reader->values.length - values_start) / value_size;
+
+  size_t i;
+  for (i = 0; i < values_count; i++) {
+    json2protobuf_reader_value_t value;
+    memcpy(&value, reader->values.data + values_start + i * value_size, value_size);
+
+    json2protobuf_reader_free_value(reader, field_descriptor, &value);
+  }
+
+  reader->values.length = values_start;
+}
+
+/* Moves values collected since `values_start` into array stored at `protobuf_value` */
+static int json2protobuf_reader_end_array(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  size_t values_start,
+  void *protobuf_value,
+  size_t *protobuf_values_count,
+  char *error_string,
+  size_t error_size
+) {
+  size_t values_length = reader->values.length - values_start;
+  if (!values_length) {
+    return 0;
+  }
+
+  void *protobuf_values;
+
+  int result = json2protobuf_reader_alloc(reader, values_length, &protobuf_values, error_string, error_size);
+  if (result) {
+    json2protobuf_reader_abort_array(reader, field_descriptor, values_start);
+    return result;
+  }
+
+  memcpy(protobuf_values, reader->values.data + values_start, values_length);
+  memcpy(protobuf_value, &protobuf_values, sizeof(protobuf_values));
+  *protobuf_values_count = values_length / protobuf2json_value_size_by_type(field_descriptor->type);
+
+  reader->values.length = values_start;
+
+  return 0;
+}
+
+static int json2protobuf_reader_read_repeated(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  void *protobuf_value,
+  size_t *protobuf_values_count,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
+  if (!value_size) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
+      "Cannot calculate value size for %d using protobuf2json_value_size_by_type()",
+      field_descriptor->type
+    );
+  }
+
+  size_t values_start;
+  int more;
+
+  int result = json2protobuf_reader_begin_array(reader, depth, &values_start, &more, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  while (more) {
+    json2protobuf_reader_value_t value;
+    memset(&value, 0, sizeof(value));
+
+    result = json2protobuf_reader_read_value(reader, field_descriptor, &value, depth, error_string, error_size);
+    if (!result) {
+      result = json2protobuf_reader_push_value(reader, field_descriptor, &value, value_size, &more, error_string, error_size);
+    }
+
+    if (result) {
+      json2protobuf_reader_abort_array(reader, field_descriptor, values_start);
+      return result;
+    }
+  }
+
+  return json2protobuf_reader_end_array(reader, field_descriptor, values_start, protobuf_value, protobuf_values_count, error_string, error_size);
+}
+
+/* Reads opening brace, already checked by caller, `more` is 0 for empty object */
+static void json2protobuf_reader_begin_object(json2protobuf_reader_t *reader, int *more) {
+  reader->position++;
+
+  char c = json2protobuf_reader_peek(reader);
+  if (c == '}') {
+    reader->position++;
+    *more = 0;
+  } else {
+    *more = 1;
+  }
+}
+
+/* Reads object key into reader scratch buffer */
+static int json2protobuf_reader_read_key(
+  json2protobuf_reader_t *reader,
+  const char **key,
+  size_t *key_length,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+  if (c != '"') {
+    return json2protobuf_reader_unexpected(reader, "string or '}' expected", error_string, error_size);
+  }
+
+  /* NUL in key is checked below, the same way jansson does */
+  int result = json2protobuf_reader_read_scratch_string(reader, 1, key_length, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  *key = reader->scratch.data;
+
+  if (strlen(*key) != *key_length) {
+    return json2protobuf_reader_error(reader, error_string, error_size, "NUL byte in object key not supported");
+  }
+
+  return 0;
+}
+
+/* Reads key separator, after key is looked up, as jansson does */
+static int json2protobuf_reader_read_colon(
+  json2protobuf_reader_t *reader,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+  if (c != ':') {
+    return json2protobuf_reader_unexpected(reader, "':' expected", error_string, error_size);
+  }
+
+  reader->position++;
+
+  return 0;
+}
+
+static int json2protobuf_reader_unknown_field(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *key,
+  char *error_string,
+  size_t error_size
+) {
+  SET_ERROR_STRING_AND_RETURN(
+    PROTOBUF2JSON_ERR_UNKNOWN_FIELD,
+    "Unknown field '%s' for message '%s'",
+    key, protobuf_message_descriptor->name
+  );
+}
+
+/* Called for key that was already read: last value wins as in jansson, unless duplicates are rejected */
+static int json2protobuf_reader_duplicate_field(
+  json2protobuf_reader_t *reader,
+  ProtobufCMessage *protobuf_message,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  char *error_string,
+  size_t error_size
+) {
+  if (reader->json_flags & JSON_REJECT_DUPLICATES) {
+    return json2protobuf_reader_error(reader, error_string, error_size, "duplicate object key");
+  }
+
+  /* Oneof member is released with the whole oneof */
+  if (!(field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF)) {
+    json2protobuf_reader_release_field(reader, field_descriptor, protobuf_message);
+  }
+
+  return 0;
+}
+
+/* Members share the same memory, so release whichever one was read before */
+static void json2protobuf_reader_release_oneof(
+  json2protobuf_reader_t *reader,
+  ProtobufCMessage *protobuf_message,
+  uint32_t *protobuf_value_case
+) {
+  if (*protobuf_value_case) {
+    const ProtobufCFieldDescriptor *oneof_field_descriptor = protobuf_c_message_descriptor_get_field(protobuf_message->descriptor, *protobuf_value_case);
+    if (oneof_field_descriptor) {
+      json2protobuf_reader_release_field(reader, oneof_field_descriptor, protobuf_message);
+    }
+
+    *protobuf_value_case = 0;
+  }
+}
+
+/* Reads separator after object member, `more` is 0 after the last one */
+static int json2protobuf_reader_next_field(
+  json2protobuf_reader_t *reader,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+  if (c == ',') {
+    reader->position++;
+    *more = 1;
+  } else if (c == '}') {
+    reader->position++;
+    *more = 0;
+  } else {
+    return json2protobuf_reader_unexpected(reader, "'}' expected", error_string, error_size);
+  }
+
+  return 0;
+}
+
+static int json2protobuf_reader_missing_field(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  char *error_string,
+  size_t error_size
+) {
+  SET_ERROR_STRING_AND_RETURN(
+    PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
+    "Required field '%s' is missing in message '%s'",
+    field_descriptor->name, protobuf_message_descriptor->name
+  );
+}
+
+static int json2protobuf_reader_check_required(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const bitmap_t *presented_fields,
+  char *error_string,
+  size_t error_size
+) {
+  const ProtobufCFieldDescriptor *field_descriptor = protobuf2json_missing_required_field(protobuf_message_descriptor, presented_fields);
+  if (field_descriptor) {
+    return json2protobuf_reader_missing_field(protobuf_message_descriptor, field_descriptor, error_string, error_size);
+  }
+
+  return 0;
+}
+
+static int json2protobuf_reader_read_fields(
+  json2protobuf_reader_t *reader,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage *protobuf_message,
+  bitmap_t *presented_fields,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  int more;
+
+  json2protobuf_reader_begin_object(reader, &more);
+
+  while (more) {
+    const char *json_key;
+    size_t json_key_length;
+
+    int result = json2protobuf_reader_read_key(reader, &json_key, &json_key_length, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf2json_field_by_name(protobuf_message_descriptor, json_key, json_key_length);
+    if (!field_descriptor) {
+      return json2protobuf_reader_unknown_field(protobuf_message_descriptor, json_key, error_string, error_size);
+    }
+
+    unsigned int field_number = field_descriptor - protobuf_message_descriptor->fields;
+
+    void *protobuf_value = ((char *)protobuf_message) + field_descriptor->offset;
+    void *protobuf_value_quantifier = ((char *)protobuf_message) + field_descriptor->quantifier_offset;
+
+    if (bitmap_get(presented_fields, field_number)) {
+      result = json2protobuf_reader_duplicate_field(reader, protobuf_message, field_descriptor, error_string, error_size);
+      if (result) {
+        return result;
+      }
+    }
+    bitmap_set(presented_fields, field_number);
+
+    if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
+      json2protobuf_reader_release_oneof(reader, protobuf_message, (uint32_t *)protobuf_value_quantifier);
+    }
+
+    result = json2protobuf_reader_read_colon(reader, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) {
+      result = json2protobuf_reader_read_value(reader, field_descriptor, protobuf_value, depth, error_string, error_size);
+    } else if (field_descriptor->label == PROTOBUF_C_LABEL_OPTIONAL) {
+      if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE || field_descriptor->type == PROTOBUF_C_TYPE_STRING
+        || (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF)) {
+        // Do nothing
+      } else {
+        *(protobuf_c_boolean *)protobuf_value_quantifier = 1;
+      }
+
+      result = json2protobuf_reader_read_value(reader, field_descriptor, protobuf_value, depth, error_string, error_size);
+    } else { // PROTOBUF_C_LABEL_REPEATED
+      result = json2protobuf_reader_read_repeated(reader, field_descriptor, protobuf_value, (size_t *)protobuf_value_quantifier, depth + 1, error_string, error_size);
+    }
+
+    if (result) {
+      return result;
+    }
+
+    if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
+      *(uint32_t *)protobuf_value_quantifier = field_descriptor->id;
+    }
+
+    result = json2protobuf_reader_next_field(reader, &more, error_string, error_size);
+    if (result) {
+      return result;
+    }
+  }
+
+  return json2protobuf_reader_check_required(protobuf_message_descriptor, presented_fields, error_string, error_size);
+}
+
+/* Reads JSON object at reader->token into newly allocated message */
+static int json2protobuf_reader_read_message(
+  json2protobuf_reader_t *reader,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  if (depth > JSON2PROTOBUF_READER_MAX_DEPTH) {
+    reader->position++;
+    return json2protobuf_reader_error(reader, error_string, error_size, "maximum parsing depth reached");
+  }
+
+  ProtobufCMessage *message;
+
+  int result = json2protobuf_reader_alloc(reader, protobuf_message_descriptor->sizeof_message, (void **)&message, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  memset(message, 0, protobuf_message_descriptor->sizeof_message);
+  protobuf_c_message_init(protobuf_message_descriptor, message);
+
+  const protobuf2json_codec_t *codec = protobuf2json_codec(protobuf_message_descriptor);
+
+  if (codec && codec->read) {
+    result = codec->read(reader, message, depth, error_string, error_size);
+  } else {
+    bitmap_t presented_fields;
+    if (bitmap_init(&presented_fields, protobuf_message_descriptor->n_fields)) {
+      protobuf_c_message_free_unpacked(message, reader->allocator);
+
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+        "Cannot allocate bitmap structure using bitmap_init()"
+      );
+    }
+
+    result = json2protobuf_reader_read_fields(reader, protobuf_message_descriptor, message, &presented_fields, depth, error_string, error_size);
+
+    bitmap_free(&presented_fields);
+  }
+
+  if (result) {
+    protobuf_c_message_free_unpacked(message, reader->allocator);
+    return result;
+  }
+
+  *protobuf_message = message;
+
+  return 0;
+}
+
+static int json2protobuf_reader_read(
+  json2protobuf_reader_t *reader,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '{') {
+    if (c == '[' || (reader->json_flags & JSON_DECODE_ANY)) {
+      JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
+        "JSON is not an object required for GPB message"
+      );
+    }
+
+    return json2protobuf_reader_unexpected(reader, "'[' or '{' expected", error_string, error_size);
+  }
+
+  ProtobufCMessage *message;
+
+  int result = json2protobuf_reader_read_message(reader, protobuf_message_descriptor, &message, 1, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (!(reader->json_flags & JSON_DISABLE_EOF_CHECK)) {
+    json2protobuf_reader_peek(reader);
+
+    if (reader->position != reader->end) {
+      protobuf_c_message_free_unpacked(message, reader->allocator);
+
+      return json2protobuf_reader_unexpected(reader, "end of file expected", error_string, error_size);
+    }
+  }
+
+  *protobuf_message = message;
+
+  return 0;
+}
+
+/* === JSON -> Protobuf === Public === */
+
+int json2protobuf_object(
+  json_t *json_object,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  int result = json2protobuf_process_message(json_object, protobuf_message_descriptor, protobuf_message, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  return 0;
+}
+
+int json2protobuf_string(
+  char *json_string,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  json_t *json_object = NULL;
+  json_error_t error;
+
+  json_object = json_loads(json_string, json_flags, &error);
+  if (!json_object) {
+    json_decref(json_object);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+      "JSON parsing error at line %d column %d (position %d): %s",
+      error.line, error.column, error.position, error.text
+    );
+  }
+
+  int result = json2protobuf_object(json_object, protobuf_message_descriptor, protobuf_message, error_string, error_size);
+  if (result) {
+    json_decref(json_object);
+    return result;
+  }
+
+  json_decref(json_object);
+  return 0;
+}
+
+int json2protobuf_file(
+  char *json_file,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  json_t *json_object = NULL;
+  json_error_t error;
+
+  json_object = json_load_file(json_file, json_flags, &error);
+  if (!json_object) {
+    json_decref(json_object);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE,
+      "JSON parsing error at line %d column %d (position %d): %s",
+      error.line, error.column, error.position, error.text
+    );
+  }
+
+  int result = json2protobuf_object(json_object, protobuf_message_descriptor, protobuf_message, error_string, error_size);
+  if (result) {
+    json_decref(json_object);
+    return result;
+  }
+
+  json_decref(json_object);
+  return 0;
+}
+
+/* === JSON -> Protobuf === Reader === Public === */
+
+int json2protobuf_buffer(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_buffer_allocator(
+    json_buffer, json_length, json_flags, NULL,
+    protobuf_message_descriptor, protobuf_message,
+    error_string, error_size
+  );
+}
+
+/* Sets up everything but scratch and values buffers, which may be reused from context */
+static void json2protobuf_buffer_reader_init(
+  json2protobuf_reader_t *reader,
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  ProtobufCAllocator *allocator,
+  int insitu
+) {
+  reader->start = json_buffer;
+  reader->end = json_buffer + json_length;
+  reader->position = json_buffer;
+  reader->token = json_buffer;
+  reader->json_flags = json_flags;
+  reader->allocator = allocator;
+  reader->insitu = insitu;
+}
+
+static int json2protobuf_buffer_read(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  ProtobufCAllocator *allocator,
+  int insitu,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  json2protobuf_reader_t reader;
+
+  json2protobuf_buffer_reader_init(&reader, json_buffer, json_length, json_flags, allocator, insitu);
+  buffer_init(&reader.scratch);
+  buffer_init(&reader.values);
+
+  int result = json2protobuf_reader_read(&reader, protobuf_message_descriptor, protobuf_message, error_string, error_size);
+
+  buffer_free(&reader.scratch);
+  buffer_free(&reader.values);
+
+  return result;
+}
+
+int json2protobuf_buffer_allocator(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  ProtobufCAllocator *allocator,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_buffer_read(
+    json_buffer, json_length, json_flags, allocator, 0,
+    protobuf_message_descriptor, protobuf_message,
+    error_string, error_size
+  );
+}
+
+/* === JSON -> Protobuf === Generated code === Public === */
+
+/*
+ * Building blocks of decoders generated by protoc-gen-protobuf2json-c.
+ * Each one does the same as the matching step of json2protobuf_reader_read_fields(),
+ * so generated code reads the same JSON and fails with the same errors.
+ */
+
+int json2protobuf_gen_begin_object(
+  json2protobuf_reader_t *reader,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  json2protobuf_reader_begin_object(reader, more);
+
+  return 0;
+}
+
+int json2protobuf_gen_key(
+  json2protobuf_reader_t *reader,
+  const char **key,
+  size_t *key_length,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_read_key(reader, key, key_length, error_string, error_size);
+}
+
+int json2protobuf_gen_unknown_field(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *key,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_unknown_field(protobuf_message_descriptor, key, error_string, error_size);
+}
+
+int json2protobuf_gen_duplicate_field(
+  json2protobuf_reader_t *reader,
+  ProtobufCMessage *protobuf_message,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_duplicate_field(reader, protobuf_message, field_descriptor, error_string, error_size);
+}
+
+void json2protobuf_gen_release_oneof(
+  json2protobuf_reader_t *reader,
+  ProtobufCMessage *protobuf_message,
+  uint32_t *oneof_case
+) {
+  json2protobuf_reader_release_oneof(reader, protobuf_message, oneof_case);
+}
+
+int json2protobuf_gen_colon(
+  json2protobuf_reader_t *reader,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_read_colon(reader, error_string, error_size);
+}
+
+int json2protobuf_gen_next_field(
+  json2protobuf_reader_t *reader,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_next_field(reader, more, error_string, error_size);
+}
+
+int json2protobuf_gen_missing_field(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_missing_field(protobuf_message_descriptor, field_descriptor, error_string, error_size);
+}
+
+int json2protobuf_gen_begin_array(
+  json2protobuf_reader_t *reader,
+  int depth,
+  size_t *values_start,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_begin_array(reader, depth, values_start, more, error_string, error_size);
+}
+
+int json2protobuf_gen_push_value(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  void *value,
+  size_t value_size,
+  int *more,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_push_value(reader, field_descriptor, value, value_size, more, error_string, error_size);
+}
+
+void json2protobuf_gen_abort_array(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  size_t values_start
+) {
+  json2protobuf_reader_abort_array(reader, field_descriptor, values_start);
+}
+
+int json2protobuf_gen_end_array(
+  json2protobuf_reader_t *reader,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  size_t values_start,
+  void *values,
+  size_t *n_values,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_end_array(reader, field_descriptor, values_start, values, n_values, error_string, error_size);
+}
+
+int json2protobuf_gen_int32(json2protobuf_reader_t *reader, ProtobufCType type, int32_t *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_integer(reader, type, value, error_string, error_size);
+}
+
+int json2protobuf_gen_uint32(json2protobuf_reader_t *reader, ProtobufCType type, uint32_t *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_integer(reader, type, value, error_string, error_size);
+}
+
+int json2protobuf_gen_int64(json2protobuf_reader_t *reader, ProtobufCType type, int64_t *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_integer(reader, type, value, error_string, error_size);
+}
+
+int json2protobuf_gen_uint64(json2protobuf_reader_t *reader, ProtobufCType type, uint64_t *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_integer(reader, type, value, error_string, error_size);
+}
+
+int json2protobuf_gen_float(json2protobuf_reader_t *reader, float *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_real(reader, PROTOBUF_C_TYPE_FLOAT, value, error_string, error_size);
+}
+
+int json2protobuf_gen_double(json2protobuf_reader_t *reader, double *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_real(reader, PROTOBUF_C_TYPE_DOUBLE, value, error_string, error_size);
+}
+
+int json2protobuf_gen_bool(json2protobuf_reader_t *reader, protobuf_c_boolean *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_bool(reader, value, error_string, error_size);
+}
+
+int json2protobuf_gen_enum(
+  json2protobuf_reader_t *reader,
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptor,
+  int *value,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_read_enum(reader, protobuf_enum_descriptor, value, error_string, error_size);
+}
+
+int json2protobuf_gen_string(json2protobuf_reader_t *reader, char **value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_string(reader, value, error_string, error_size);
+}
+
+int json2protobuf_gen_bytes(json2protobuf_reader_t *reader, ProtobufCBinaryData *value, char *error_string, size_t error_size) {
+  return json2protobuf_reader_read_bytes(reader, value, error_string, error_size);
+}
+
+int json2protobuf_gen_message(
+  json2protobuf_reader_t *reader,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **value,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_reader_read_message_value(reader, protobuf_message_descriptor, value, depth, error_string, error_size);
+}
+
+/* === JSON -> Protobuf === Packed === Private === */
+
+/*
+ * Packer reads JSON with the direct reader, but writes protobuf wire format
+ * instead of filling the message structure: the same bytes
+ * protobuf_c_message_pack() gives for the message json2protobuf_buffer()
+ * would return, without building it.
+ *
+ * Encoding of each field goes to the end of output as soon as it is read,
+ * and its place is recorded. If keys come in declaration order and none
+ * repeats, that is already the order protobuf_c_message_pack() uses;
+ * otherwise the last encoding of every field is copied into order once
+ * the message is read. Length prefixes of nested messages are inserted
+ * once their length is known.
+ */
+
+typedef struct json2protobuf_packer_field {
+  /* Range of field encoding in output, empty if there is none */
+  size_t start;
+  size_t end;
+} json2protobuf_packer_field_t;
+
+typedef struct json2protobuf_packer {
+  buffer_t output;
+  /* Fields of all messages being read, as a stack */
+  json2protobuf_packer_field_t *fields;
+  size_t n_fields;
+  size_t fields_size;
+} json2protobuf_packer_t;
+
+#define JSON2PROTOBUF_PACKER_RESERVE(reserve_length)                                          \
+do {                                                                                          \
+  if (buffer_reserve(&packer->output, reserve_length)) {                                      \
+    SET_ERROR_STRING_AND_RETURN(                                                              \
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,                                               \
+      "Cannot allocate %zu bytes using realloc(3)",                                           \
+      packer->output.length + (reserve_length)                                                \
+    );                                                                                        \
+  }                                                                                           \
+} while (0)
+
+static int json2protobuf_packer_write_varint(
+  json2protobuf_packer_t *packer,
+  uint64_t value,
+  char *error_string,
+  size_t error_size
+) {
+  JSON2PROTOBUF_PACKER_RESERVE(WIRE_MAX_VARINT_LENGTH);
+
+  packer->output.length += wire_write_varint((uint8_t *)packer->output.data + packer->output.length, value);
+
+  return 0;
+}
+
+static int json2protobuf_packer_write_tag(
+  json2protobuf_packer_t *packer,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  int wire_type,
+  char *error_string,
+  size_t error_size
+) {
+  return json2protobuf_packer_write_varint(packer, ((uint64_t)field_descriptor->id << 3) | (uint64_t)wire_type, error_string, error_size);
+}
+
+/* Inserts length prefix before everything written since `start` */
+static int json2protobuf_packer_insert_length(
+  json2protobuf_packer_t *packer,
+  size_t start,
+  char *error_string,
+  size_t error_size
+) {
+  size_t length = packer->output.length - start;
+  size_t prefix_length = wire_varint_size(length);
+
+  JSON2PROTOBUF_PACKER_RESERVE(prefix_length);
+
+  uint8_t *data = (uint8_t *)packer->output.data + start;
+
+  memmove(data + prefix_length, data, length);
+  wire_write_varint(data, length);
+  packer->output.length += prefix_length;
+
+  return 0;
+}
+
+static int json2protobuf_packer_write_length_delimited(
+  json2protobuf_packer_t *packer,
+  const void *data,
+  size_t length,
+  char *error_string,
+  size_t error_size
+) {
+  int result = json2protobuf_packer_write_varint(packer, length, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  JSON2PROTOBUF_PACKER_RESERVE(length);
+
+  memcpy(packer->output.data + packer->output.length, data, length);
+  packer->output.length += length;
+
+  return 0;
+}
+
+/* Writes scalar value stored the way it is in message structure, without tag */
+static int json2protobuf_packer_write_scalar(
+  json2protobuf_packer_t *packer,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  const void *protobuf_value,
+  char *error_string,
+  size_t error_size
+) {
+  int32_t value_int32 = 0;
+  uint32_t value_uint32 = 0;
+  uint64_t value_uint64 = 0;
+  protobuf_c_boolean value_boolean = 0;
+
+  switch (field_descriptor->type) {
+    case PROTOBUF_C_TYPE_INT32:
+    case PROTOBUF_C_TYPE_ENUM:
+      memcpy(&value_int32, protobuf_value, sizeof(value_int32));
+
+      /* Negative ones take all 10 bytes */
+      return json2protobuf_packer_write_varint(packer, (uint64_t)(int64_t)value_int32, error_string, error_size);
+    case PROTOBUF_C_TYPE_SINT32:
+      memcpy(&value_int32, protobuf_value, sizeof(value_int32));
+      return json2protobuf_packer_write_varint(packer, wire_zigzag32_encode(value_int32), error_string, error_size);
+    case PROTOBUF_C_TYPE_UINT32:
+      memcpy(&value_uint32, protobuf_value, sizeof(value_uint32));
+      return json2protobuf_packer_write_varint(packer, value_uint32, error_string, error_size);
+    case PROTOBUF_C_TYPE_INT64:
+    case PROTOBUF_C_TYPE_UINT64:
+      memcpy(&value_uint64, protobuf_value, sizeof(value_uint64));
+      return json2protobuf_packer_write_varint(packer, value_uint64, error_string, error_size);
+    case PROTOBUF_C_TYPE_SINT64:
+      memcpy(&value_uint64, protobuf_value, sizeof(value_uint64));
+      return json2protobuf_packer_write_varint(packer, wire_zigzag64_encode((int64_t)value_uint64), error_string, error_size);
+    case PROTOBUF_C_TYPE_BOOL:
+      memcpy(&value_boolean, protobuf_value, sizeof(value_boolean));
+      return json2protobuf_packer_write_varint(packer, value_boolean ? 1 : 0, error_string, error_size);
+    case PROTOBUF_C_TYPE_SFIXED32:
+    case PROTOBUF_C_TYPE_FIXED32:
+    case PROTOBUF_C_TYPE_FLOAT:
+      JSON2PROTOBUF_PACKER_RESERVE(4);
+
+      memcpy(&value_uint32, protobuf_value, sizeof(value_uint32));
+      wire_write_fixed32((uint8_t *)packer->output.data + packer->output.length, value_uint32);
+      packer->output.length += 4;
+
+      return 0;
+    case PROTOBUF_C_TYPE_SFIXED64:
+    case PROTOBUF_C_TYPE_FIXED64:
+    case PROTOBUF_C_TYPE_DOUBLE:
+      JSON2PROTOBUF_PACKER_RESERVE(8);
+
+      memcpy(&value_uint64, protobuf_value, sizeof(value_uint64));
+      wire_write_fixed64((uint8_t *)packer->output.data + packer->output.length, value_uint64);
+      packer->output.length += 8;
+
+      return 0;
+    default:
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
+        "Unsupported field type %d",
+        field_descriptor->type
+      );
+  }
+}
+
+/*
+ * Required fields missing in JSON but having default value are set by
+ * protobuf_c_message_init(), so protobuf_c_message_pack() writes them too
+ */
+static int json2protobuf_packer_write_defaults(
+  json2protobuf_packer_t *packer,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  size_t fields_base,
+  const bitmap_t *presented_fields,
+  char *error_string,
+  size_t error_size
+) {
+  unsigned i;
+
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf_message_descriptor->fields + i;
+
+    if (field_descriptor->label != PROTOBUF_C_LABEL_REQUIRED || !field_descriptor->default_value || bitmap_get(presented_fields, i)) {
+      continue;
+    }
+
+    size_t start = packer->output.length;
+
+    int result = json2protobuf_packer_write_tag(packer, field_descriptor, protobuf2json_packed_wire_type(field_descriptor->type), error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    if (field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
+      const char *value_string = (const char *)field_descriptor->default_value;
+
+      result = json2protobuf_packer_write_length_delimited(packer, value_string, strlen(value_string), error_string, error_size);
+    } else if (field_descriptor->type == PROTOBUF_C_TYPE_BYTES) {
+      const ProtobufCBinaryData *value_binary = (const ProtobufCBinaryData *)field_descriptor->default_value;
+
+      result = json2protobuf_packer_write_length_delimited(packer, value_binary->data, value_binary->len, error_string, error_size);
+    } else {
+      result = json2protobuf_packer_write_scalar(packer, field_descriptor, field_descriptor->default_value, error_string, error_size);
+    }
+
+    if (result) {
+      return result;
+    }
+
+    packer->fields[fields_base + i].start = start;
+    packer->fields[fields_base + i].end = packer->output.length;
+  }
+
+  return 0;
+}
+
+/* Makes fields of message written since `start` follow in declaration order, dropping replaced ones */
+static int json2protobuf_packer_reorder(
+  json2protobuf_packer_t *packer,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  size_t fields_base,
+  size_t start,
+  char *error_string,
+  size_t error_size
+) {
+  const json2protobuf_packer_field_t *fields = &packer->fields[fields_base];
+  size_t expected_start = start, length = 0;
+  int ordered = 1;
+  unsigned i;
+
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    if (fields[i].end == fields[i].start) {
+      continue;
+    }
+
+    if (fields[i].start != expected_start) {
+      ordered = 0;
+    }
+
+    expected_start = fields[i].end;
+    length += fields[i].end - fields[i].start;
+  }
+
+  if (ordered && expected_start == packer->output.length) {
+    return 0;
+  }
+
+  /* Collected after the end of output first, as ranges may overlap with their new places */
+  JSON2PROTOBUF_PACKER_RESERVE(length);
+
+  char *ordered_data = packer->output.data + packer->output.length;
+  size_t offset = 0;
+
+  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+    memcpy(ordered_data + offset, packer->output.data + fields[i].start, fields[i].end - fields[i].start);
+    offset += fields[i].end - fields[i].start;
+  }
+
+  memmove(packer->output.data + start, ordered_data, length);
+  packer->output.length = start + length;
+
+  return 0;
+}
+
+static int json2protobuf_reader_pack_message(
+  json2protobuf_reader_t *reader,
+  json2protobuf_packer_t *packer,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  int depth,
+  char *error_string,
+  size_t error_size
+);
+
+/* Writes one value without tag, checking it the same way json2protobuf_reader_read_value() does */
+static int json2protobuf_reader_pack_value(
+  json2protobuf_reader_t *reader,
+  json2protobuf_packer_t *packer,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+  int result;
+
+  switch (field_descriptor->type) {
+    case PROTOBUF_C_TYPE_STRING: {
+      if (c != '"') {
+        JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_IS_NOT_STRING,
+          "JSON value is not a string required for GPB string"
+        );
+      }
+
+      const char *value_string;
+      size_t value_string_length;
+
+      result = json2protobuf_reader_read_string_view(reader, reader->json_flags & JSON_ALLOW_NUL, &value_string, &value_string_length, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      /* Decoded message keeps string up to NUL */
+      const char *nul = memchr(value_string, '\0', value_string_length);
+      if (nul) {
+        value_string_length = nul - value_string;
+      }
+
+      return json2protobuf_packer_write_length_delimited(packer, value_string, value_string_length, error_string, error_size);
+    }
+    case PROTOBUF_C_TYPE_BYTES: {
+      if (c != '"') {
+        JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_IS_NOT_STRING,
+          "JSON value is not a string required for GPB bytes"
+        );
+      }
+
+      const char *value_string;
+      size_t value_string_length;
+
+      result = json2protobuf_reader_read_string_view(reader, reader->json_flags & JSON_ALLOW_NUL, &value_string, &value_string_length, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      /* Decoded right after the longest prefix it may need, moved closer if it is shorter */
+      size_t base64_decoded_length = base64_decoded_len(value_string_length);
+      size_t prefix_length = wire_varint_size(base64_decoded_length);
+
+      JSON2PROTOBUF_PACKER_RESERVE(prefix_length + base64_decoded_length);
+
+      uint8_t *data = (uint8_t *)packer->output.data + packer->output.length;
+      size_t length = base64_decoded_length ? base64_decode((char *)data + prefix_length, value_string, value_string_length) : 0;
+      if (length == (size_t)-1) {
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_IS_NOT_BASE64,
+          "JSON string is not base64 required for GPB bytes"
+        );
+      }
+
+      size_t length_prefix_length = wire_write_varint(data, length);
+      if (length_prefix_length != prefix_length) {
+        memmove(data + length_prefix_length, data + prefix_length, length);
+      }
+
+      packer->output.length += length_prefix_length + length;
+
+      return 0;
+    }
+    case PROTOBUF_C_TYPE_MESSAGE: {
+      if (c != '{') {
+        JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+        SET_ERROR_STRING_AND_RETURN(
+          PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
+          "JSON is not an object required for GPB message"
+        );
+      }
+
+      size_t start = packer->output.length;
+
+      result = json2protobuf_reader_pack_message(reader, packer, field_descriptor->descriptor, depth + 1, error_string, error_size);
+      if (result) {
+        return result;
+      }
+
+      return json2protobuf_packer_insert_length(packer, start, error_string, error_size);
+    }
+    default:
+      break;
+  }
+
+  /* Scalars are read the same way they are for decoded message */
+  json2protobuf_reader_value_t value;
+  memset(&value, 0, sizeof(value));
+
+  result = json2protobuf_reader_read_value(reader, field_descriptor, &value, depth, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  return json2protobuf_packer_write_scalar(packer, field_descriptor, &value, error_string, error_size);
+}
+
+/* Same checks as json2protobuf_reader_read_repeated() does, empty array writes nothing */
+static int json2protobuf_reader_pack_repeated(
+  json2protobuf_reader_t *reader,
+  json2protobuf_packer_t *packer,
+  const ProtobufCFieldDescriptor *field_descriptor,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
+
+  if (c != '[') {
+    JSON2PROTOBUF_READER_CHECK_VALUE(c);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_IS_NOT_ARRAY,
+      "JSON is not an array required for repeatable GPB field"
+    );
+  }
+
+  if (depth > JSON2PROTOBUF_READER_MAX_DEPTH) {
+    reader->position++;
+    return json2protobuf_reader_error(reader, error_string, error_size, "maximum parsing depth reached");
+  }
+
+  reader->position++;
+
+  c = json2protobuf_reader_peek(reader);
+  if (c == ']') {
+    reader->position++;
+    return 0;
+  }
+
+  int wire_type = protobuf2json_packed_wire_type(field_descriptor->type);
+  int is_packed = (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_PACKED) != 0;
+  size_t start = 0;
+  int result;
+
+  if (is_packed) {
+    result = json2protobuf_packer_write_tag(packer, field_descriptor, WIRE_TYPE_LENGTH_PREFIXED, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    start = packer->output.length;
+  }
+
+  for (;;) {
+    /* jansson stops reading array values at the end of input */
+    json2protobuf_reader_peek(reader);
+    if (reader->position == reader->end) {
+      return json2protobuf_reader_unexpected(reader, "']' expected", error_string, error_size);
+    }
+
+    if (!is_packed) {
+      result = json2protobuf_packer_write_tag(packer, field_descriptor, wire_type, error_string, error_size);
+      if (result) {
+        return result;
+      }
+    }
+
+    result = json2protobuf_reader_pack_value(reader, packer, field_descriptor, depth, error_string, error_size);
+    if (result) {
+      return result;
+    }
+
+    c = json2protobuf_reader_peek(reader);
+    if (c == ',') {
+      reader->position++;
+    } else if (c == ']') {
+      reader->position++;
+      break;
+    } else {
+      return json2protobuf_reader_unexpected(reader, "']' expected", error_string, error_size);
+    }
+  }
+
+  if (is_packed) {
+    return json2protobuf_packer_insert_length(packer, start, error_string, error_size);
+  }
+
+  return 0;
+}
+
+/* Same as json2protobuf_reader_read_fields(), but packing values */
+static int json2protobuf_reader_pack_fields(
+  json2protobuf_reader_t *reader,
+  json2protobuf_packer_t *packer,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  size_t fields_base,
+  bitmap_t *presented_fields,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  /* Opening brace is already checked by caller */
+  reader->position++;
+
+  char c = json2protobuf_reader_peek(reader);
+  if (c == '}') {
+    reader->position++;
+    return json2protobuf_reader_check_required(protobuf_message_descriptor, presented_fields, error_string, error_size);
+  }
+
+  for (;;) {
+    if (c != '"') {
+      return json2protobuf_reader_unexpected(reader, "string or '}' expected", error_string, error_size);
+    }
 
-    memcpy(protobuf_value, &value_int64_t, sizeof(value_int64_t));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_UINT64
-          || field_descriptor->type == PROTOBUF_C_TYPE_FIXED64
-  ) {
-    if (!json_is_integer(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_INTEGER,
-        "JSON value is not an integer required for GPB %s",
-        json2protobuf_integer_name_by_c_type(field_descriptor->type)
-      );
+    size_t json_key_length;
+
+    /* NUL in key is checked below, the same way jansson does */
+    int result = json2protobuf_reader_read_scratch_string(reader, 1, &json_key_length, error_string, error_size);
+    if (result) {
+      return result;
     }
 
-    uint64_t value_uint64_t = (uint64_t)json_integer_value(json_value);
+    const char *json_key = reader->scratch.data;
 
-    memcpy(protobuf_value, &value_uint64_t, sizeof(value_uint64_t));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_FLOAT) {
-    float value_float;
+    if (strlen(json_key) != json_key_length) {
+      return json2protobuf_reader_error(reader, error_string, error_size, "NUL byte in object key not supported");
+    }
 
-    if (json_is_integer(json_value)) {
-      value_float = (float)json_integer_value(json_value);
-    } else if (json_is_real(json_value)) {
-      value_float = (float)json_real_value(json_value);
-    } else {
+    const ProtobufCFieldDescriptor *field_descriptor = protobuf2json_field_by_name(protobuf_message_descriptor, json_key, json_key_length);
+    if (!field_descriptor) {
       SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_INTEGER_OR_REAL,
-        "JSON value is not a integer/real required for GPB float"
+        PROTOBUF2JSON_ERR_UNKNOWN_FIELD,
+        "Unknown field '%s' for message '%s'",
+        json_key, protobuf_message_descriptor->name
       );
     }
 
-    memcpy(protobuf_value, &value_float, sizeof(value_float));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_DOUBLE) {
-    double value_double;
+    unsigned int field_number = field_descriptor - protobuf_message_descriptor->fields;
 
-    if (json_is_integer(json_value)) {
-      value_double = (double)json_integer_value(json_value);
-    } else if (json_is_real(json_value)) {
-      value_double = (double)json_real_value(json_value);
-    } else {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_INTEGER_OR_REAL,
-        "JSON value is not a integer/real required for GPB double"
-      );
+    if (bitmap_get(presented_fields, field_number) && (reader->json_flags & JSON_REJECT_DUPLICATES)) {
+      return json2protobuf_reader_error(reader, error_string, error_size, "duplicate object key");
     }
+    bitmap_set(presented_fields, field_number);
 
-    memcpy(protobuf_value, &value_double, sizeof(value_double));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_BOOL) {
-    if (!json_is_boolean(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_BOOLEAN,
-        "JSON value is not a boolean required for GPB bool"
-      );
+    if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
+      /* The last member read wins */
+      unsigned i;
+      for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
+        if ((protobuf_message_descriptor->fields[i].flags & PROTOBUF_C_FIELD_FLAG_ONEOF)
+          && protobuf_message_descriptor->fields[i].quantifier_offset == field_descriptor->quantifier_offset) {
+          packer->fields[fields_base + i].end = packer->fields[fields_base + i].start;
+        }
+      }
     }
 
-    protobuf_c_boolean value_boolean = (protobuf_c_boolean)json_boolean_value(json_value);
-
-    memcpy(protobuf_value, &value_boolean, sizeof(value_boolean));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_ENUM) {
-    if (!json_is_string(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_STRING,
-        "JSON value is not a string required for GPB enum"
-      );
+    c = json2protobuf_reader_peek(reader);
+    if (c != ':') {
+      return json2protobuf_reader_unexpected(reader, "':' expected", error_string, error_size);
     }
+    reader->position++;
 
-    const char* enum_value_name = json_string_value(json_value);
+    /* Replaces previous encoding of the same field, if any */
+    size_t start = packer->output.length;
 
-    const ProtobufCEnumValue *enum_value;
+    if (field_descriptor->label == PROTOBUF_C_LABEL_REPEATED) {
+      result = json2protobuf_reader_pack_repeated(reader, packer, field_descriptor, depth + 1, error_string, error_size);
+    } else {
+      result = json2protobuf_packer_write_tag(packer, field_descriptor, protobuf2json_packed_wire_type(field_descriptor->type), error_string, error_size);
+      if (!result) {
+        result = json2protobuf_reader_pack_value(reader, packer, field_descriptor, depth, error_string, error_size);
+      }
+    }
 
-    enum_value = protobuf_c_enum_descriptor_get_value_by_name(field_descriptor->descriptor, enum_value_name);
-    if (!enum_value) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE,
-        "Unknown value '%s' for enum '%s'",
-        enum_value_name, ((ProtobufCEnumDescriptor *)field_descriptor->descriptor)->name
-      );
+    if (result) {
+      return result;
     }
 
-    int32_t value_enum = (int32_t)enum_value->value;
+    /* Stack may be moved by nested messages */
+    packer->fields[fields_base + field_number].start = start;
+    packer->fields[fields_base + field_number].end = packer->output.length;
 
-    memcpy(protobuf_value, &value_enum, sizeof(value_enum));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
-    if (!json_is_string(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_STRING,
-        "JSON value is not a string required for GPB string"
-      );
+    c = json2protobuf_reader_peek(reader);
+    if (c == ',') {
+      reader->position++;
+      c = json2protobuf_reader_peek(reader);
+    } else if (c == '}') {
+      reader->position++;
+      break;
+    } else {
+      return json2protobuf_reader_unexpected(reader, "'}' expected", error_string, error_size);
     }
+  }
 
-    const char* value_string = json_string_value(json_value);
-    size_t value_string_length = strlen(value_string);
+  return json2protobuf_reader_check_required(protobuf_message_descriptor, presented_fields, error_string, error_size);
+}
 
-    char* value_string_copy = calloc(value_string_length + 1, sizeof(char));
-    if (!value_string_copy) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
-        "Cannot allocate %zu bytes using calloc(3)",
-        (value_string_length + 1) * sizeof(char)
-      );
-    }
+/* Packs JSON object at reader->token to the end of packer output, without length prefix */
+static int json2protobuf_reader_pack_message(
+  json2protobuf_reader_t *reader,
+  json2protobuf_packer_t *packer,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  int depth,
+  char *error_string,
+  size_t error_size
+) {
+  if (depth > JSON2PROTOBUF_READER_MAX_DEPTH) {
+    reader->position++;
+    return json2protobuf_reader_error(reader, error_string, error_size, "maximum parsing depth reached");
+  }
 
-    memcpy(value_string_copy, value_string, value_string_length + 1);
+  size_t fields_base = packer->n_fields;
+  size_t start = packer->output.length;
 
-    *(char **)(protobuf_value) = value_string_copy;
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_BYTES) {
-    if (!json_is_string(json_value)) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_IS_NOT_STRING,
-        "JSON value is not a string required for GPB bytes"
-      );
-    }
+  int result = protobuf2json_packed_grow((void **)&packer->fields, &packer->fields_size, fields_base + protobuf_message_descriptor->n_fields, sizeof(json2protobuf_packer_field_t), error_string, error_size);
+  if (result) {
+    return result;
+  }
 
-    const char* value_string = json_string_value(json_value);
-    size_t value_string_length = json_string_length(json_value);
+  memset(&packer->fields[fields_base], 0, protobuf_message_descriptor->n_fields * sizeof(json2protobuf_packer_field_t));
+  packer->n_fields += protobuf_message_descriptor->n_fields;
+
+  bitmap_t presented_fields;
+  if (bitmap_init(&presented_fields, protobuf_message_descriptor->n_fields)) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate bitmap structure using bitmap_init()"
+    );
+  }
+
+  result = json2protobuf_reader_pack_fields(reader, packer, protobuf_message_descriptor, fields_base, &presented_fields, depth, error_string, error_size);
+  if (!result) {
+    result = json2protobuf_packer_write_defaults(packer, protobuf_message_descriptor, fields_base, &presented_fields, error_string, error_size);
+  }
+
+  bitmap_free(&presented_fields);
+
+  if (result) {
+    return result;
+  }
+
+  result = json2protobuf_packer_reorder(packer, protobuf_message_descriptor, fields_base, start, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  packer->n_fields = fields_base;
+
+  return 0;
+}
+
+/* Same as json2protobuf_reader_read(), but packing the message */
+static int json2protobuf_reader_pack(
+  json2protobuf_reader_t *reader,
+  json2protobuf_packer_t *packer,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  char *error_string,
+  size_t error_size
+) {
+  char c = json2protobuf_reader_peek(reader);
 
-    int base64_decoded_length = base64_decoded_len(value_string_length);
+  if (c != '{') {
+    if (c == '[' || (reader->json_flags & JSON_DECODE_ANY)) {
+      JSON2PROTOBUF_READER_CHECK_VALUE(c);
 
-    char* base64_decoded_data = calloc(base64_decoded_length, sizeof(char));
-    if (!base64_decoded_data) {
       SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
-        "Cannot allocate %zu bytes using calloc(3)",
-        base64_decoded_length * sizeof(char)
+        PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
+        "JSON is not an object required for GPB message"
       );
     }
 
-    /* @todo: check for zero length / error */
-    base64_decoded_length = base64_decode(base64_decoded_data, value_string, value_string_length);
+    return json2protobuf_reader_unexpected(reader, "'[' or '{' expected", error_string, error_size);
+  }
 
-    char* value_string_copy = calloc(base64_decoded_length, sizeof(char));
-    if (!value_string_copy) {
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
-        "Cannot allocate %zu bytes using calloc(3)",
-        base64_decoded_length * sizeof(char)
-      );
+  int result = json2protobuf_reader_pack_message(reader, packer, protobuf_message_descriptor, 1, error_string, error_size);
+  if (result) {
+    return result;
+  }
+
+  if (!(reader->json_flags & JSON_DISABLE_EOF_CHECK)) {
+    json2protobuf_reader_peek(reader);
+
+    if (reader->position != reader->end) {
+      return json2protobuf_reader_unexpected(reader, "end of file expected", error_string, error_size);
     }
+  }
 
-    memcpy(value_string_copy, base64_decoded_data, base64_decoded_length);
+  return 0;
+}
 
-    free(base64_decoded_data);
+/* === JSON -> Protobuf === Packed === Public === */
 
-    ProtobufCBinaryData value_binary;
+int json2protobuf_to_packed(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  uint8_t **packed_buffer,
+  size_t *packed_length,
+  char *error_string,
+  size_t error_size
+) {
+  json2protobuf_reader_t reader;
+  json2protobuf_packer_t packer;
 
-    value_binary.data = (uint8_t *)value_string_copy;
-    value_binary.len = base64_decoded_length;
+  json2protobuf_buffer_reader_init(&reader, json_buffer, json_length, json_flags, NULL, 0);
+  buffer_init(&reader.scratch);
+  buffer_init(&reader.values);
 
-    memcpy(protobuf_value, &value_binary, sizeof(value_binary));
-  } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
-    ProtobufCMessage *protobuf_message;
+  memset(&packer, 0, sizeof(packer));
+  buffer_init(&packer.output);
 
-    int result = json2protobuf_process_message(json_value, field_descriptor->descriptor, &protobuf_message, error_string, error_size);
-    if (result) {
-      return result;
-    }
+  int result = json2protobuf_reader_pack(&reader, &packer, protobuf_message_descriptor, error_string, error_size);
 
-    memcpy(protobuf_value, &protobuf_message, sizeof(protobuf_message));
-   } else {
-    assert(0);
+  buffer_free(&reader.scratch);
+  buffer_free(&reader.values);
+  free(packer.fields);
+
+  if (result) {
+    buffer_free(&packer.output);
+    return result;
+  }
+
+  size_t length = packer.output.length;
+
+  // NOTICE: Should be freed by caller, even if message is empty
+  *packed_buffer = (uint8_t *)buffer_steal(&packer.output);
+  if (!*packed_buffer) {
+    buffer_free(&packer.output);
+
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      length + 1
+    );
+  }
+
+  if (packed_length) {
+    *packed_length = length;
   }
 
   return 0;
 }
 
-#define SAFE_FREE_BITMAP_AND_MESSAGE                           \
-do {                                                           \
-  if (presented_fields) {                                      \
-    bitmap_free(presented_fields);                             \
-  }                                                            \
-  if (protobuf_message) {                                      \
-    protobuf_c_message_free_unpacked(*protobuf_message, NULL); \
-    *protobuf_message = NULL;                                  \
-  }                                                            \
-} while (0)
+/* === Arena === Public === */
+
+struct protobuf2json_arena {
+  arena_t arena;
+  ProtobufCAllocator allocator;
+};
+
+int json2protobuf_buffer_insitu(
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
+  protobuf2json_arena_t *arena,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  ProtobufCMessage **protobuf_message,
+  char *error_string,
+  size_t error_size
+) {
+  /* Arena never frees anything by itself, so strings inside json_buffer are safe */
+  return json2protobuf_buffer_read(
+    json_buffer, json_length, json_flags, &arena->allocator, 1,
+    protobuf_message_descriptor, protobuf_message,
+    error_string, error_size
+  );
+}
+
+static void *protobuf2json_arena_alloc(void *allocator_data, size_t size) {
+  return arena_alloc(allocator_data, size);
+}
+
+static void protobuf2json_arena_free_nothing(void *allocator_data, void *data) {
+  /* Memory is released by protobuf2json_arena_reset() and protobuf2json_arena_free() */
+  (void)allocator_data;
+  (void)data;
+}
+
+static void protobuf2json_arena_init(protobuf2json_arena_t *arena, size_t block_size) {
+  arena_init(&arena->arena, block_size);
+
+  arena->allocator.alloc = protobuf2json_arena_alloc;
+  arena->allocator.free = protobuf2json_arena_free_nothing;
+  arena->allocator.allocator_data = &arena->arena;
+}
+
+protobuf2json_arena_t *protobuf2json_arena_new(size_t block_size) {
+  protobuf2json_arena_t *arena = malloc(sizeof(*arena));
+  if (!arena) {
+    return NULL;
+  }
+
+  protobuf2json_arena_init(arena, block_size);
+
+  return arena;
+}
+
+ProtobufCAllocator *protobuf2json_arena_allocator(protobuf2json_arena_t *arena) {
+  return &arena->allocator;
+}
+
+void protobuf2json_arena_reset(protobuf2json_arena_t *arena) {
+  arena_reset(&arena->arena);
+}
+
+void protobuf2json_arena_free(protobuf2json_arena_t *arena) {
+  if (!arena) {
+    return;
+  }
+
+  arena_free(&arena->arena);
+  free(arena);
+}
+
+/* === Context === Public === */
+
+/*
+ * Everything a conversion needs besides descriptor caches, which are
+ * shared by all threads already. Buffers only grow, so after a few
+ * messages of the usual size calls with context do not allocate at all.
+ */
+struct protobuf2json_ctx {
+  /* JSON produced by protobuf2json_ctx_buffer() */
+  buffer_t output;
+  /* Reader buffers, see json2protobuf_reader_t */
+  buffer_t scratch;
+  buffer_t values;
+  /* Messages produced by json2protobuf_ctx_buffer() */
+  struct protobuf2json_arena arena;
+};
+
+protobuf2json_ctx_t *protobuf2json_ctx_new(void) {
+  protobuf2json_ctx_t *ctx = malloc(sizeof(*ctx));
+  if (!ctx) {
+    return NULL;
+  }
+
+  buffer_init(&ctx->output);
+  buffer_init(&ctx->scratch);
+  buffer_init(&ctx->values);
+  protobuf2json_arena_init(&ctx->arena, 0);
+
+  return ctx;
+}
+
+void protobuf2json_ctx_reset(protobuf2json_ctx_t *ctx) {
+  ctx->output.length = 0;
+  arena_reset(&ctx->arena.arena);
+}
+
+void protobuf2json_ctx_free(protobuf2json_ctx_t *ctx) {
+  if (!ctx) {
+    return;
+  }
+
+  buffer_free(&ctx->output);
+  buffer_free(&ctx->scratch);
+  buffer_free(&ctx->values);
+  arena_free(&ctx->arena.arena);
+  free(ctx);
+}
+
+int protobuf2json_ctx_buffer(
+  protobuf2json_ctx_t *ctx,
+  ProtobufCMessage *protobuf_message,
+  size_t json_flags,
+  const char **json_buffer,
+  size_t *json_length,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_writer_t writer;
+
+  protobuf2json_writer_init(&writer, json_flags);
+  writer.buffer = ctx->output;
+  writer.buffer.length = 0;
+
+  int result = protobuf2json_write(&writer, protobuf_message, error_string, error_size);
+
+  /* Buffer may have been reallocated even if writing failed */
+  ctx->output = writer.buffer;
+
+  if (result) {
+    return result;
+  }
+
+  if (buffer_append_byte(&ctx->output, '\0')) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
+      "Cannot allocate %zu bytes using realloc(3)",
+      ctx->output.length + 1
+    );
+  }
+
+  ctx->output.length--;
 
-static int json2protobuf_process_message(
-  json_t *json_object,
+  // NOTICE: Owned by context, valid until its next use
+  *json_buffer = ctx->output.data;
+
+  if (json_length) {
+    *json_length = ctx->output.length;
+  }
+
+  return 0;
+}
+
+int json2protobuf_ctx_buffer(
+  protobuf2json_ctx_t *ctx,
+  char *json_buffer,
+  size_t json_length,
+  size_t json_flags,
   const ProtobufCMessageDescriptor *protobuf_message_descriptor,
   ProtobufCMessage **protobuf_message,
   char *error_string,
   size_t error_size
 ) {
-  bitmap_t presented_fields = NULL;
+  json2protobuf_reader_t reader;
 
-  int result = 0;
+  json2protobuf_buffer_reader_init(&reader, json_buffer, json_length, json_flags, &ctx->arena.allocator, 0);
+  reader.scratch = ctx->scratch;
+  reader.values = ctx->values;
+  reader.values.length = 0;
 
-  if (!json_is_object(json_object)) {
-    SET_ERROR_STRING_AND_RETURN(
-      PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
-      "JSON is not an object required for GPB message"
-    );
-  }
+  int result = json2protobuf_reader_read(&reader, protobuf_message_descriptor, protobuf_message, error_string, error_size);
 
-  *protobuf_message = calloc(1, protobuf_message_descriptor->sizeof_message);
-  if (!*protobuf_message) {
-    SET_ERROR_STRING_AND_RETURN(
-      PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
-      "Cannot allocate %zu bytes using calloc(3)",
-      protobuf_message_descriptor->sizeof_message
-    );
-  }
+  ctx->scratch = reader.scratch;
+  ctx->values = reader.values;
 
-  protobuf_c_message_init(protobuf_message_descriptor, *protobuf_message);
+  return result;
+}
 
-  presented_fields = bitmap_alloc(protobuf_message_descriptor->n_fields);
-  if (!presented_fields) {
-    SAFE_FREE_BITMAP_AND_MESSAGE;
+/* === JSON -> Protobuf === Stream === Private === */
+
+/*
+ * Stream reader decodes a sequence of JSON objects, one per line (NDJSON)
+ * or just concatenated, read from fd by chunks. Boundaries of each record
+ * are found by counting brackets outside of strings, then the record is
+ * decoded in place, right in the input buffer, into arena which is reset
+ * after callback. So memory usage depends on the longest record only,
+ * not on the size of input, and no allocations are made once buffers
+ * have grown.
+ */
+
+#define JSON2PROTOBUF_STREAM_CHUNK_SIZE 65536
+
+typedef struct json2protobuf_stream {
+  int fd;
+  int eof;
+  /* Bytes read so far and not consumed yet, the record being read starts at `position` */
+  buffer_t input;
+  size_t position;
+  /* Scanning state of the record being read, kept while more input is read */
+  size_t scan;
+  int depth;
+  int in_string;
+  int escaped;
+  size_t scan_lines;
+  /* Line and number of the record being read, for error messages */
+  size_t line;
+  size_t record;
+  /* UTF-8 byte order mark is skipped at the start of stream only */
+  int bom_checked;
+  /* Reader buffers and messages, reused by all records */
+  buffer_t scratch;
+  buffer_t values;
+  struct protobuf2json_arena arena;
+} json2protobuf_stream_t;
+
+/* Drops consumed input and reads next chunk after the rest */
+static int json2protobuf_stream_fill(
+  json2protobuf_stream_t *stream,
+  char *error_string,
+  size_t error_size
+) {
+  if (stream->position) {
+    memmove(stream->input.data, stream->input.data + stream->position, stream->input.length - stream->position);
+    stream->input.length -= stream->position;
+    stream->scan -= stream->position;
+    stream->position = 0;
+  }
 
+  if (buffer_reserve(&stream->input, JSON2PROTOBUF_STREAM_CHUNK_SIZE)) {
     SET_ERROR_STRING_AND_RETURN(
       PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
-      "Cannot allocate bitmap structure using bitmap_alloc()"
+      "Cannot allocate %zu bytes using realloc(3)",
+      stream->input.length + JSON2PROTOBUF_STREAM_CHUNK_SIZE
     );
   }
 
-  const char *json_key;
-  json_t *json_object_value;
-  json_object_foreach(json_object, json_key, json_object_value) {
-    const ProtobufCFieldDescriptor *field_descriptor = protobuf_c_message_descriptor_get_field_by_name(protobuf_message_descriptor, json_key);
-    if (!field_descriptor) {
-      SAFE_FREE_BITMAP_AND_MESSAGE;
+  for (;;) {
+    ssize_t count = read(stream->fd, stream->input.data + stream->input.length, stream->input.size - stream->input.length);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
 
       SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_UNKNOWN_FIELD,
-        "Unknown field '%s' for message '%s'",
-        json_key, protobuf_message_descriptor->name
+        PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE,
+        "Cannot read JSON from fd %d, errno=%d",
+        stream->fd, errno
       );
     }
 
-    unsigned int field_number = field_descriptor - protobuf_message_descriptor->fields;
+    if (!count) {
+      stream->eof = 1;
+    }
 
-    // This cannot happen because Jansson handle this on his side
-    /*if (bitmap_get(presented_fields, field_number)) {
-      SAFE_FREE_BITMAP_AND_MESSAGE;
+    stream->input.length += (size_t)count;
 
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_DUPLICATE_FIELD,
-        "Duplicate field '%s' for message '%s'",
-        json_key, protobuf_message_descriptor->name
-      );
-    }*/
-    bitmap_set(presented_fields, field_number);
+    return 0;
+  }
+}
 
-    void *protobuf_value = ((char *)*protobuf_message) + field_descriptor->offset;
-    void *protobuf_value_quantifier = ((char *)*protobuf_message) + field_descriptor->quantifier_offset;
+/*
+ * Looks for the end of record starting at `position`, continuing where
+ * the previous call stopped. Returns 1 and sets `end` once it is found.
+ * Object or array ends with its closing bracket, anything else ends
+ * at newline, so garbage is reported by decoding it, line by line.
+ */
+static int json2protobuf_stream_scan(json2protobuf_stream_t *stream, size_t *end) {
+  const char *data = stream->input.data;
+
+  for (; stream->scan < stream->input.length; stream->scan++) {
+    char c = data[stream->scan];
+
+    if (stream->in_string) {
+      if (stream->escaped) {
+        stream->escaped = 0;
+      } else if (c == '\\') {
+        stream->escaped = 1;
+      } else if (c == '"') {
+        stream->in_string = 0;
+      } else if (c == '\n') {
+        /* Strings cannot have raw newlines, so it is broken anyway */
+        *end = stream->scan;
+        return 1;
+      }
+    } else if (c == '"') {
+      stream->in_string = 1;
+    } else if (c == '{' || c == '[') {
+      stream->depth++;
+    } else if (c == '}' || c == ']') {
+      if (--stream->depth <= 0) {
+        *end = ++stream->scan;
+        return 1;
+      }
+    } else if (c == '\n' && stream->depth == 0) {
+      *end = stream->scan;
+      return 1;
+    }
 
-    if (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF) {
-      *(uint32_t*)protobuf_value_quantifier = field_descriptor->id;
+    /* Newline ending the record is counted as whitespace after it */
+    if (c == '\n') {
+      stream->scan_lines++;
     }
+  }
 
-    if (field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) {
-      result = json2protobuf_process_field(field_descriptor, json_object_value, protobuf_value, error_string, error_size);
-      if (result) {
-        SAFE_FREE_BITMAP_AND_MESSAGE;
+  return 0;
+}
 
-        return result;
-      }
-    } else if (field_descriptor->label == PROTOBUF_C_LABEL_OPTIONAL) {
-      if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE || field_descriptor->type == PROTOBUF_C_TYPE_STRING
-        || (field_descriptor->flags & PROTOBUF_C_FIELD_FLAG_ONEOF)) {
-        // Do nothing
-      } else {
-        *(protobuf_c_boolean *)protobuf_value_quantifier = 1;
-      }
+/* Prefixes error of decoding the record with its place in stream */
+static int json2protobuf_stream_error(
+  json2protobuf_stream_t *stream,
+  int result,
+  char *error_string,
+  size_t error_size
+) {
+  protobuf2json_prefix_error(error_string, error_size, "Record %zu at line %zu: ", stream->record, stream->line);
 
-      result = json2protobuf_process_field(field_descriptor, json_object_value, protobuf_value, error_string, error_size);
-      if (result) {
-        SAFE_FREE_BITMAP_AND_MESSAGE;
+  return result;
+}
 
-        return result;
-      }
-    } else { // PROTOBUF_C_LABEL_REPEATED
-      if (!json_is_array(json_object_value)) {
-        SAFE_FREE_BITMAP_AND_MESSAGE;
+static int json2protobuf_stream_read(
+  json2protobuf_stream_t *stream,
+  size_t json_flags,
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  json2protobuf_callback_t callback,
+  void *callback_data,
+  char *error_string,
+  size_t error_size
+) {
+  for (;;) {
+    if (!stream->bom_checked) {
+      if (stream->input.length < 3 && !stream->eof) {
+        int result = json2protobuf_stream_fill(stream, error_string, error_size);
+        if (result) {
+          return result;
+        }
 
-        SET_ERROR_STRING_AND_RETURN(
-          PROTOBUF2JSON_ERR_IS_NOT_ARRAY,
-          "JSON is not an array required for repeatable GPB field"
-        );
+        continue;
       }
 
-      size_t *protobuf_values_count = (size_t *)protobuf_value_quantifier;
+      if (stream->input.length >= 3 && !memcmp(stream->input.data, "\xEF\xBB\xBF", 3)) {
+        stream->position = 3;
+      }
 
-      *protobuf_values_count = json_array_size(json_object_value);
+      stream->bom_checked = 1;
+    }
 
-      if (*protobuf_values_count) {
-        size_t value_size = protobuf2json_value_size_by_type(field_descriptor->type);
-        if (!value_size) {
-          SAFE_FREE_BITMAP_AND_MESSAGE;
+    /* Whitespace between records, including empty lines */
+    while (stream->position < stream->input.length) {
+      char c = stream->input.data[stream->position];
 
-          SET_ERROR_STRING_AND_RETURN(
-            PROTOBUF2JSON_ERR_UNSUPPORTED_FIELD_TYPE,
-            "Cannot calculate value size for %d using protobuf2json_value_size_by_type()",
-            field_descriptor->type
-          );
-        }
+      if (c == '\n') {
+        stream->line++;
+      } else if (c != ' ' && c != '\t' && c != '\r') {
+        break;
+      }
 
-        void *protobuf_value_repeated = calloc(*protobuf_values_count, value_size);
-        if (!protobuf_value_repeated) {
-          SAFE_FREE_BITMAP_AND_MESSAGE;
+      stream->position++;
+    }
 
-          SET_ERROR_STRING_AND_RETURN(
-            PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY,
-            "Cannot allocate %zu bytes using calloc(3)",
-            (size_t)*protobuf_values_count * value_size
-          );
-        }
+    if (stream->position == stream->input.length) {
+      if (stream->eof) {
+        return 0;
+      }
 
-        size_t json_index;
-        json_t *json_array_value;
-        json_array_foreach(json_object_value, json_index, json_array_value) {
-          char *protobuf_value_repeated_value = (char *)protobuf_value_repeated + json_index * value_size;
+      int result = json2protobuf_stream_fill(stream, error_string, error_size);
+      if (result) {
+        return result;
+      }
 
-          result = json2protobuf_process_field(field_descriptor, json_array_value, (void *)protobuf_value_repeated_value, error_string, error_size);
-          if (result) {
-            /* Free already processed repeated field items */
-            {
-              if (field_descriptor->type == PROTOBUF_C_TYPE_STRING) {
-                size_t t;
-                for (t = 0; t <= json_index; t++) {
-                  free(((char **)protobuf_value_repeated)[t]);
-                }
-              } else if (field_descriptor->type == PROTOBUF_C_TYPE_BYTES) {
-                size_t t;
-                for (t = 0; t <= json_index; t++) {
-                  free(((ProtobufCBinaryData *)protobuf_value_repeated)[t].data);
-                }
-              } else if (field_descriptor->type == PROTOBUF_C_TYPE_MESSAGE) {
-                size_t t;
-                for (t = 0; t <= json_index; t++) {
-                  if (((ProtobufCMessage **)protobuf_value_repeated)[t]) {
-                    protobuf_c_message_free_unpacked(
-                      ((ProtobufCMessage **)protobuf_value_repeated)[t],
-                      NULL
-                    );
-                  }
-                }
-              }
+      continue;
+    }
 
-              free(protobuf_value_repeated);
-              *protobuf_values_count = 0;
-            }
+    stream->scan = stream->position;
+    stream->depth = 0;
+    stream->in_string = 0;
+    stream->escaped = 0;
+    stream->scan_lines = 0;
+    stream->record++;
 
-            SAFE_FREE_BITMAP_AND_MESSAGE;
+    size_t end;
 
-            return result;
-          }
-        }
+    while (!json2protobuf_stream_scan(stream, &end)) {
+      if (stream->eof) {
+        /* Truncated record is reported by decoding it */
+        end = stream->input.length;
+        break;
+      }
 
-        memcpy(protobuf_value, &protobuf_value_repeated, sizeof(protobuf_value_repeated));
+      int result = json2protobuf_stream_fill(stream, error_string, error_size);
+      if (result) {
+        return result;
       }
     }
-  }
 
-  unsigned int i = 0;
-  for (i = 0; i < protobuf_message_descriptor->n_fields; i++) {
-    const ProtobufCFieldDescriptor *field_descriptor = protobuf_message_descriptor->fields + i;
+    json2protobuf_reader_t reader;
+    ProtobufCMessage *protobuf_message = NULL;
 
-    if ((field_descriptor->label == PROTOBUF_C_LABEL_REQUIRED) && !field_descriptor->default_value && !bitmap_get(presented_fields, i)) {
-      SAFE_FREE_BITMAP_AND_MESSAGE;
+    json2protobuf_buffer_reader_init(&reader, stream->input.data + stream->position, end - stream->position, json_flags, &stream->arena.allocator, 1);
+    reader.scratch = stream->scratch;
+    reader.values = stream->values;
+    reader.values.length = 0;
 
-      SET_ERROR_STRING_AND_RETURN(
-        PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
-        "Required field '%s' is missing in message '%s'",
-        field_descriptor->name, protobuf_message_descriptor->name
-      );
+    int result = json2protobuf_reader_read(&reader, protobuf_message_descriptor, &protobuf_message, error_string, error_size);
+
+    stream->scratch = reader.scratch;
+    stream->values = reader.values;
+
+    if (result) {
+      return json2protobuf_stream_error(stream, result, error_string, error_size);
     }
-  }
 
-  bitmap_free(presented_fields);
+    result = callback(protobuf_message, callback_data);
 
-  return 0;
-}
+    /* Message and strings in place are gone with the record */
+    arena_reset(&stream->arena.arena);
 
-/* === JSON -> Protobuf === Public === */
+    if (result) {
+      SET_ERROR_STRING_AND_RETURN(
+        PROTOBUF2JSON_ERR_STOPPED_BY_CALLBACK,
+        "Callback stopped reading at record %zu at line %zu",
+        stream->record, stream->line
+      );
+    }
 
-int json2protobuf_object(
-  json_t *json_object,
-  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
-  ProtobufCMessage **protobuf_message,
-  char *error_string,
-  size_t error_size
-) {
-  int result = json2protobuf_process_message(json_object, protobuf_message_descriptor, protobuf_message, error_string, error_size);
-  if (result) {
-    return result;
+    stream->position = end;
+    stream->line += stream->scan_lines;
   }
-
-  return 0;
 }
 
-int json2protobuf_string(
-  char *json_string,
+/* === JSON -> Protobuf === Stream === Public === */
+
+int json2protobuf_stream_fd(
+  int fd,
   size_t json_flags,
   const ProtobufCMessageDescriptor *protobuf_message_descriptor,
-  ProtobufCMessage **protobuf_message,
+  json2protobuf_callback_t callback,
+  void *callback_data,
   char *error_string,
   size_t error_size
 ) {
-  json_t *json_object = NULL;
-  json_error_t error;
-
-  json_object = json_loads(json_string, json_flags, &error);
-  if (!json_object) {
-    json_decref(json_object);
+  json2protobuf_stream_t stream;
 
+  if (!protobuf_message_descriptor) {
     SET_ERROR_STRING_AND_RETURN(
-      PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
-      "JSON parsing error at line %d column %d (position %d): %s",
-      error.line, error.column, error.position, error.text
+      PROTOBUF2JSON_ERR_INVALID_ARGUMENT,
+      "Cannot decode messages with NULL descriptor"
     );
   }
 
-  int result = json2protobuf_object(json_object, protobuf_message_descriptor, protobuf_message, error_string, error_size);
-  if (result) {
-    json_decref(json_object);
-    return result;
+  if (!callback) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_INVALID_ARGUMENT,
+      "Cannot pass messages to NULL callback"
+    );
   }
 
-  json_decref(json_object);
-  return 0;
+  memset(&stream, 0, sizeof(stream));
+  stream.fd = fd;
+  stream.line = 1;
+  buffer_init(&stream.input);
+  buffer_init(&stream.scratch);
+  buffer_init(&stream.values);
+  protobuf2json_arena_init(&stream.arena, 0);
+
+  int result = json2protobuf_stream_read(&stream, json_flags, protobuf_message_descriptor, callback, callback_data, error_string, error_size);
+
+  buffer_free(&stream.input);
+  buffer_free(&stream.scratch);
+  buffer_free(&stream.values);
+  arena_free(&stream.arena.arena);
+
+  return result;
 }
 
-int json2protobuf_file(
+int json2protobuf_stream_file(
   char *json_file,
   size_t json_flags,
   const ProtobufCMessageDescriptor *protobuf_message_descriptor,
-  ProtobufCMessage **protobuf_message,
+  json2protobuf_callback_t callback,
+  void *callback_data,
   char *error_string,
   size_t error_size
 ) {
-  json_t *json_object = NULL;
-  json_error_t error;
-
-  json_object = json_load_file(json_file, json_flags, &error);
-  if (!json_object) {
-    json_decref(json_object);
-
+  if (!json_file) {
     SET_ERROR_STRING_AND_RETURN(
       PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE,
-      "JSON parsing error at line %d column %d (position %d): %s",
-      error.line, error.column, error.position, error.text
+      "Cannot open NULL to load JSON"
     );
   }
 
-  int result = json2protobuf_object(json_object, protobuf_message_descriptor, protobuf_message, error_string, error_size);
-  if (result) {
-    json_decref(json_object);
-    return result;
+  int fd = open(json_file, O_RDONLY);
+  if (fd < 0) {
+    SET_ERROR_STRING_AND_RETURN(
+      PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE,
+      "Cannot open file '%s' to load JSON, errno=%d",
+      json_file, errno
+    );
   }
 
-  return 0;
+  int result = json2protobuf_stream_fd(fd, json_flags, protobuf_message_descriptor, callback, callback_data, error_string, error_size);
+
+  close(fd);
+
+  return result;
 }
 
 /* === END === */
@@ -0,0 +1,1363 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+/*
+ * protoc plugin emitting message-specific JSON codecs for protobuf-c
+ * generated code, see protobuf2json_codec_t:
+ *
+ *   protoc --plugin=protoc-gen-protobuf2json-c --protobuf2json-c_out=. foo.proto
+ *
+ * produces foo.pb2json-c.c and foo.pb2json-c.h next to protoc-c's
+ * foo.pb-c.c and foo.pb-c.h, with foo__protobuf2json_register().
+ *
+ * CodeGeneratorRequest is decoded right from the wire format, only fields
+ * needed here are looked at, so the plugin needs neither libprotoc
+ * nor generated code for descriptor.proto.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+/* === Wire format === */
+
+#define WIRE_VARINT 0
+#define WIRE_FIXED64 1
+#define WIRE_LENGTH_DELIMITED 2
+#define WIRE_FIXED32 5
+
+typedef struct wire {
+  const uint8_t *data;
+  size_t length;
+  size_t offset;
+} wire_t;
+
+typedef struct wire_field {
+  uint32_t number;
+  int type;
+  uint64_t value;
+  const uint8_t *bytes;
+  size_t bytes_length;
+} wire_field_t;
+
+static void wire_init(wire_t *wire, const uint8_t *data, size_t length) {
+  wire->data = data;
+  wire->length = length;
+  wire->offset = 0;
+}
+
+static int wire_varint(wire_t *wire, uint64_t *value) {
+  unsigned shift;
+
+  *value = 0;
+  for (shift = 0; shift < 64; shift += 7) {
+    if (wire->offset >= wire->length) {
+      return -1;
+    }
+
+    uint8_t byte = wire->data[wire->offset++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80)) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* Returns 1 and the next field, 0 at the end, -1 if data is malformed */
+static int wire_next(wire_t *wire, wire_field_t *field) {
+  uint64_t key;
+
+  if (wire->offset >= wire->length) {
+    return 0;
+  }
+
+  if (wire_varint(wire, &key)) {
+    return -1;
+  }
+
+  field->number = (uint32_t)(key >> 3);
+  field->type = (int)(key & 7);
+  field->value = 0;
+  field->bytes = NULL;
+  field->bytes_length = 0;
+
+  switch (field->type) {
+    case WIRE_VARINT:
+      return wire_varint(wire, &field->value) ? -1 : 1;
+    case WIRE_FIXED64:
+      if (wire->length - wire->offset < 8) {
+        return -1;
+      }
+      wire->offset += 8;
+      return 1;
+    case WIRE_FIXED32:
+      if (wire->length - wire->offset < 4) {
+        return -1;
+      }
+      wire->offset += 4;
+      return 1;
+    case WIRE_LENGTH_DELIMITED:
+      if (wire_varint(wire, &field->value) || field->value > wire->length - wire->offset) {
+        return -1;
+      }
+      field->bytes = wire->data + wire->offset;
+      field->bytes_length = (size_t)field->value;
+      wire->offset += field->bytes_length;
+      return 1;
+    default:
+      return -1;
+  }
+}
+
+static char *wire_string(const wire_field_t *field) {
+  char *string = malloc(field->bytes_length + 1);
+  if (!string) {
+    fprintf(stderr, "protoc-gen-protobuf2json-c: out of memory\n");
+    exit(1);
+  }
+
+  memcpy(string, field->bytes, field->bytes_length);
+  string[field->bytes_length] = '\0';
+
+  return string;
+}
+
+/* === Growable arrays and text === */
+
+static void *grow(void *data, size_t count, size_t item_size) {
+  data = realloc(data, (count + 1) * item_size);
+  if (!data) {
+    fprintf(stderr, "protoc-gen-protobuf2json-c: out of memory\n");
+    exit(1);
+  }
+
+  return data;
+}
+
+typedef struct text {
+  char *data;
+  size_t length;
+  size_t size;
+} text_t;
+
+static void text_printf(text_t *text, const char *format, ...) {
+  va_list args;
+
+  for (;;) {
+    size_t available = text->size - text->length;
+
+    va_start(args, format);
+    int length = vsnprintf(text->data ? text->data + text->length : NULL, available, format, args);
+    va_end(args);
+
+    if (length < 0) {
+      fprintf(stderr, "protoc-gen-protobuf2json-c: cannot format output\n");
+      exit(1);
+    }
+
+    if ((size_t)length < available) {
+      text->length += (size_t)length;
+      return;
+    }
+
+    text->size = (text->size + (size_t)length + 1) * 2;
+    text->data = realloc(text->data, text->size);
+    if (!text->data) {
+      fprintf(stderr, "protoc-gen-protobuf2json-c: out of memory\n");
+      exit(1);
+    }
+  }
+}
+
+/* === Descriptors === */
+
+/* FieldDescriptorProto.Type */
+#define TYPE_DOUBLE   1
+#define TYPE_FLOAT    2
+#define TYPE_INT64    3
+#define TYPE_UINT64   4
+#define TYPE_INT32    5
+#define TYPE_FIXED64  6
+#define TYPE_FIXED32  7
+#define TYPE_BOOL     8
+#define TYPE_STRING   9
+#define TYPE_GROUP    10
+#define TYPE_MESSAGE  11
+#define TYPE_BYTES    12
+#define TYPE_UINT32   13
+#define TYPE_ENUM     14
+#define TYPE_SFIXED32 15
+#define TYPE_SFIXED64 16
+#define TYPE_SINT32   17
+#define TYPE_SINT64   18
+
+/* FieldDescriptorProto.Label */
+#define LABEL_OPTIONAL 1
+#define LABEL_REQUIRED 2
+#define LABEL_REPEATED 3
+
+/* CodeGeneratorResponse.Feature */
+#define FEATURE_PROTO3_OPTIONAL 1
+
+typedef struct field {
+  char *name;
+  int number;
+  /* Full name of message or enum type with leading '.', NULL for other types */
+  char *type_name;
+  int label;
+  int type;
+  int oneof_index;
+  int has_default_value;
+  int proto3_optional;
+} field_t;
+
+typedef struct message {
+  char *full_name;
+  char **oneofs;
+  size_t n_oneofs;
+  field_t *fields;
+  size_t n_fields;
+} message_t;
+
+typedef struct file {
+  char *name;
+  char *package;
+  int proto3;
+  message_t *messages;
+  size_t n_messages;
+} file_t;
+
+static int parse_field(field_t *field, const uint8_t *data, size_t length) {
+  wire_t wire;
+  wire_field_t wire_field;
+  int result;
+
+  memset(field, 0, sizeof(*field));
+  field->oneof_index = -1;
+
+  wire_init(&wire, data, length);
+  while ((result = wire_next(&wire, &wire_field)) > 0) {
+    switch (wire_field.number) {
+      case 1: field->name = wire_string(&wire_field); break;
+      case 3: field->number = (int)wire_field.value; break;
+      case 4: field->label = (int)wire_field.value; break;
+      case 5: field->type = (int)wire_field.value; break;
+      case 6: free(field->type_name); field->type_name = wire_string(&wire_field); break;
+      case 7: field->has_default_value = 1; break;
+      case 9: field->oneof_index = (int)wire_field.value; break;
+      case 17: field->proto3_optional = (int)wire_field.value; break;
+    }
+  }
+
+  return result < 0 || !field->name ? -1 : 0;
+}
+
+/* Adds message and its nested messages to file, `scope` is full name of parent or package */
+static int parse_message(file_t *file, const char *scope, const uint8_t *data, size_t length) {
+  wire_t wire;
+  wire_field_t wire_field;
+  int result;
+
+  /* Name goes first, but nested messages need it anyway */
+  char *name = NULL;
+  wire_init(&wire, data, length);
+  while ((result = wire_next(&wire, &wire_field)) > 0) {
+    if (wire_field.number == 1 && wire_field.type == WIRE_LENGTH_DELIMITED) {
+      free(name);
+      name = wire_string(&wire_field);
+    }
+  }
+
+  if (result < 0 || !name) {
+    free(name);
+    return -1;
+  }
+
+  file->messages = grow(file->messages, file->n_messages, sizeof(message_t));
+  size_t index = file->n_messages++;
+  message_t *message = &file->messages[index];
+
+  memset(message, 0, sizeof(*message));
+  message->full_name = malloc(strlen(scope) + strlen(name) + 2);
+  if (!message->full_name) {
+    fprintf(stderr, "protoc-gen-protobuf2json-c: out of memory\n");
+    exit(1);
+  }
+  sprintf(message->full_name, "%s%s%s", scope, *scope ? "." : "", name);
+  free(name);
+
+  wire_init(&wire, data, length);
+  while ((result = wire_next(&wire, &wire_field)) > 0) {
+    if (wire_field.type != WIRE_LENGTH_DELIMITED) {
+      continue;
+    }
+
+    /* Nested messages may move messages array */
+    message = &file->messages[index];
+
+    switch (wire_field.number) {
+      case 2: {
+        message->fields = grow(message->fields, message->n_fields, sizeof(field_t));
+        if (parse_field(&message->fields[message->n_fields], wire_field.bytes, wire_field.bytes_length)) {
+          return -1;
+        }
+        message->n_fields++;
+        break;
+      }
+      case 3: {
+        char *full_name = message->full_name;
+        if (parse_message(file, full_name, wire_field.bytes, wire_field.bytes_length)) {
+          return -1;
+        }
+        break;
+      }
+      case 8: {
+        /* OneofDescriptorProto, name only */
+        wire_t oneof_wire;
+        wire_field_t oneof_field;
+        char *oneof_name = NULL;
+
+        wire_init(&oneof_wire, wire_field.bytes, wire_field.bytes_length);
+        while ((result = wire_next(&oneof_wire, &oneof_field)) > 0) {
+          if (oneof_field.number == 1 && oneof_field.type == WIRE_LENGTH_DELIMITED) {
+            free(oneof_name);
+            oneof_name = wire_string(&oneof_field);
+          }
+        }
+
+        if (result < 0 || !oneof_name) {
+          free(oneof_name);
+          return -1;
+        }
+
+        message->oneofs = grow(message->oneofs, message->n_oneofs, sizeof(char *));
+        message->oneofs[message->n_oneofs++] = oneof_name;
+        break;
+      }
+    }
+  }
+
+  return result < 0 ? -1 : 0;
+}
+
+static int parse_file(file_t *file, const uint8_t *data, size_t length) {
+  wire_t wire;
+  wire_field_t wire_field;
+  int result;
+
+  memset(file, 0, sizeof(*file));
+
+  wire_init(&wire, data, length);
+  while ((result = wire_next(&wire, &wire_field)) > 0) {
+    if (wire_field.type != WIRE_LENGTH_DELIMITED) {
+      continue;
+    }
+
+    switch (wire_field.number) {
+      case 1: file->name = wire_string(&wire_field); break;
+      case 2: file->package = wire_string(&wire_field); break;
+      case 12: file->proto3 = wire_field.bytes_length == 6 && !memcmp(wire_field.bytes, "proto3", 6); break;
+    }
+  }
+
+  if (result < 0 || !file->name) {
+    return -1;
+  }
+
+  if (!file->package) {
+    file->package = calloc(1, 1);
+    if (!file->package) {
+      fprintf(stderr, "protoc-gen-protobuf2json-c: out of memory\n");
+      exit(1);
+    }
+  }
+
+  wire_init(&wire, data, length);
+  while ((result = wire_next(&wire, &wire_field)) > 0) {
+    if (wire_field.number == 4 && wire_field.type == WIRE_LENGTH_DELIMITED) {
+      if (parse_message(file, file->package, wire_field.bytes, wire_field.bytes_length)) {
+        return -1;
+      }
+    }
+  }
+
+  return result < 0 ? -1 : 0;
+}
+
+static void file_free(file_t *file) {
+  size_t i, j;
+
+  for (i = 0; i < file->n_messages; i++) {
+    message_t *message = &file->messages[i];
+
+    for (j = 0; j < message->n_fields; j++) {
+      free(message->fields[j].name);
+      free(message->fields[j].type_name);
+    }
+    for (j = 0; j < message->n_oneofs; j++) {
+      free(message->oneofs[j]);
+    }
+
+    free(message->fields);
+    free(message->oneofs);
+    free(message->full_name);
+  }
+
+  free(file->messages);
+  free(file->name);
+  free(file->package);
+}
+
+/* === Names === Same as protobuf-c generator makes them === */
+
+static const char *c_keywords[] = {
+  "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "class",
+  "compl", "const", "const_cast", "continue", "default", "delete", "do", "double", "dynamic_cast", "else",
+  "enum", "explicit", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long",
+  "mutable", "namespace", "new", "not", "not_eq", "operator", "or", "or_eq", "private", "protected",
+  "public", "register", "reinterpret_cast", "return", "short", "signed", "sizeof", "static",
+  "static_cast", "struct", "switch", "template", "this", "throw", "true", "try", "typedef", "typeid",
+  "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor",
+  "xor_eq"
+};
+
+/* "foo_bar" -> "FooBar" */
+static void name_to_camel(text_t *text, const char *name, size_t length) {
+  int next_is_upper = 1;
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    if (name[i] == '_') {
+      next_is_upper = 1;
+    } else if (next_is_upper) {
+      text_printf(text, "%c", toupper((unsigned char)name[i]));
+      next_is_upper = 0;
+    } else {
+      text_printf(text, "%c", name[i]);
+    }
+  }
+}
+
+/* "FooBar" -> "foo_bar" */
+static void name_camel_to_lower(text_t *text, const char *name, size_t length) {
+  int was_upper = 1;
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    int is_upper = isupper((unsigned char)name[i]) ? 1 : 0;
+
+    if (is_upper) {
+      if (!was_upper) {
+        text_printf(text, "_");
+      }
+      text_printf(text, "%c", tolower((unsigned char)name[i]));
+    } else {
+      text_printf(text, "%c", name[i]);
+    }
+
+    was_upper = is_upper;
+  }
+}
+
+/* "foo.bar.BazQux" -> "Foo__Bar__BazQux" or "foo__bar__baz_qux" */
+static char *full_name_to_c(const char *full_name, int lower) {
+  text_t text = {NULL, 0, 0};
+  const char *piece = full_name;
+
+  text_printf(&text, "%s", "");
+
+  while (*piece) {
+    const char *end = strchr(piece, '.');
+    size_t length = end ? (size_t)(end - piece) : strlen(piece);
+
+    if (length) {
+      if (text.length) {
+        text_printf(&text, "__");
+      }
+
+      if (lower) {
+        name_camel_to_lower(&text, piece, length);
+      } else {
+        name_to_camel(&text, piece, length);
+      }
+    }
+
+    piece += length + (end ? 1 : 0);
+  }
+
+  return text.data;
+}
+
+/* Struct member name of field */
+static char *field_member_name(const char *name) {
+  text_t text = {NULL, 0, 0};
+  size_t i;
+
+  text_printf(&text, "%s", name);
+  for (i = 0; i < text.length; i++) {
+    text.data[i] = (char)tolower((unsigned char)text.data[i]);
+  }
+
+  for (i = 0; i < sizeof(c_keywords) / sizeof(c_keywords[0]); i++) {
+    if (!strcmp(text.data, c_keywords[i])) {
+      text_printf(&text, "_");
+      break;
+    }
+  }
+
+  return text.data;
+}
+
+/* "dir/foo.proto" -> "dir/foo" */
+static char *file_base_name(const char *name) {
+  text_t text = {NULL, 0, 0};
+
+  text_printf(&text, "%s", name);
+  if (text.length > 6 && !strcmp(text.data + text.length - 6, ".proto")) {
+    text.length -= 6;
+    text.data[text.length] = '\0';
+  }
+
+  return text.data;
+}
+
+/* "dir/foo-bar" -> "dir_foo_bar", prefix of file-level symbols */
+static char *file_symbol_name(const char *base_name) {
+  text_t text = {NULL, 0, 0};
+  size_t i;
+
+  text_printf(&text, "%s", base_name);
+  for (i = 0; i < text.length; i++) {
+    if (!isalnum((unsigned char)text.data[i])) {
+      text.data[i] = '_';
+    }
+  }
+
+  return text.data;
+}
+
+/* === Code generation === */
+
+static int field_compare_numbers(const void *a, const void *b) {
+  return ((const field_t *)a)->number - ((const field_t *)b)->number;
+}
+
+/*
+ * protobuf-c cannot represent groups, such messages are left to generic path.
+ * Message and enum fields need type name to refer to their descriptors.
+ */
+static int message_is_supported(const message_t *message) {
+  size_t i;
+
+  for (i = 0; i < message->n_fields; i++) {
+    const field_t *field = &message->fields[i];
+
+    if (field->type == TYPE_GROUP || field->type < TYPE_DOUBLE || field->type > TYPE_SINT64) {
+      return 0;
+    }
+
+    if ((field->type == TYPE_MESSAGE || field->type == TYPE_ENUM) && !field->type_name) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Integer and real types, NULL for others */
+static const char *field_scalar_function(const field_t *field) {
+  switch (field->type) {
+    case TYPE_INT32:
+    case TYPE_SINT32:
+    case TYPE_SFIXED32:
+      return "int32";
+    case TYPE_UINT32:
+    case TYPE_FIXED32:
+      return "uint32";
+    case TYPE_INT64:
+    case TYPE_SINT64:
+    case TYPE_SFIXED64:
+      return "int64";
+    case TYPE_UINT64:
+    case TYPE_FIXED64:
+      return "uint64";
+    case TYPE_FLOAT:
+      return "float";
+    case TYPE_DOUBLE:
+      return "double";
+    case TYPE_BOOL:
+      return "bool";
+  }
+
+  return NULL;
+}
+
+/* ProtobufCType of integer field, tells range and name in errors of reader */
+static const char *field_integer_type(const field_t *field) {
+  switch (field->type) {
+    case TYPE_INT32: return "PROTOBUF_C_TYPE_INT32";
+    case TYPE_SINT32: return "PROTOBUF_C_TYPE_SINT32";
+    case TYPE_SFIXED32: return "PROTOBUF_C_TYPE_SFIXED32";
+    case TYPE_UINT32: return "PROTOBUF_C_TYPE_UINT32";
+    case TYPE_FIXED32: return "PROTOBUF_C_TYPE_FIXED32";
+    case TYPE_INT64: return "PROTOBUF_C_TYPE_INT64";
+    case TYPE_SINT64: return "PROTOBUF_C_TYPE_SINT64";
+    case TYPE_SFIXED64: return "PROTOBUF_C_TYPE_SFIXED64";
+    case TYPE_UINT64: return "PROTOBUF_C_TYPE_UINT64";
+    case TYPE_FIXED64: return "PROTOBUF_C_TYPE_FIXED64";
+  }
+
+  return NULL;
+}
+
+/* C type of single value as protobuf-c stores it in repeated field */
+static const char *field_value_type(const field_t *field) {
+  switch (field->type) {
+    case TYPE_INT32:
+    case TYPE_SINT32:
+    case TYPE_SFIXED32:
+      return "int32_t";
+    case TYPE_UINT32:
+    case TYPE_FIXED32:
+      return "uint32_t";
+    case TYPE_INT64:
+    case TYPE_SINT64:
+    case TYPE_SFIXED64:
+      return "int64_t";
+    case TYPE_UINT64:
+    case TYPE_FIXED64:
+      return "uint64_t";
+    case TYPE_FLOAT:
+      return "float";
+    case TYPE_DOUBLE:
+      return "double";
+    case TYPE_BOOL:
+      return "protobuf_c_boolean";
+    case TYPE_ENUM:
+      return "int";
+    case TYPE_STRING:
+      return "char *";
+    case TYPE_BYTES:
+      return "ProtobufCBinaryData";
+    case TYPE_MESSAGE:
+      return "ProtobufCMessage *";
+  }
+
+  return NULL;
+}
+
+/* ".foo.Bar" -> "foo__bar__descriptor" */
+static char *type_descriptor_name(const char *type_name) {
+  text_t text = {NULL, 0, 0};
+  char *lower_name = full_name_to_c(type_name, 1);
+
+  text_printf(&text, "%s__descriptor", lower_name);
+  free(lower_name);
+
+  return text.data;
+}
+
+/* Name of `_case` member of real oneof the field belongs to, NULL if there is none */
+static char *field_oneof_case_name(const message_t *message, const field_t *field) {
+  if (field->oneof_index < 0 || field->proto3_optional || (size_t)field->oneof_index >= message->n_oneofs) {
+    return NULL;
+  }
+
+  text_t text = {NULL, 0, 0};
+  const char *oneof_name = message->oneofs[field->oneof_index];
+
+  text_printf(&text, "%s", "");
+  name_camel_to_lower(&text, oneof_name, strlen(oneof_name));
+  text_printf(&text, "_case");
+
+  return text.data;
+}
+
+/* Call of protobuf2json_gen_*() writing `value` of `field` */
+static void generate_value(text_t *text, const field_t *field, const char *value, const char *depth) {
+  const char *function = field_scalar_function(field);
+
+  if (function) {
+    text_printf(text, "PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_%s(writer, %s, error_string, error_size));\n", function, value);
+    return;
+  }
+
+  char *descriptor_name = field->type_name ? type_descriptor_name(field->type_name) : NULL;
+
+  switch (field->type) {
+    case TYPE_ENUM:
+      text_printf(
+        text,
+        "PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_enum(writer, &%s, %s, error_string, error_size));\n",
+        descriptor_name, value
+      );
+      break;
+    case TYPE_STRING:
+      text_printf(
+        text,
+        "PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_string(writer, %s, \"%s\", error_string, error_size));\n",
+        value, field->name
+      );
+      break;
+    case TYPE_BYTES:
+      text_printf(text, "PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_bytes(writer, &%s, error_string, error_size));\n", value);
+      break;
+    case TYPE_MESSAGE:
+      text_printf(
+        text,
+        "PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_message(writer, (const ProtobufCMessage *)%s, \"%s\", %s, error_string, error_size));\n",
+        value, field->name, depth
+      );
+      break;
+  }
+
+  free(descriptor_name);
+}
+
+/* Call of json2protobuf_gen_*() reading into `value` of field, as pointer expression, returning its result */
+static void generate_read_value(text_t *text, const field_t *field, const char *value, const char *depth) {
+  const char *function = field_scalar_function(field);
+  const char *integer_type = field_integer_type(field);
+
+  if (integer_type) {
+    text_printf(text, "json2protobuf_gen_%s(reader, %s, %s, error_string, error_size)", function, integer_type, value);
+    return;
+  }
+
+  if (function) {
+    text_printf(text, "json2protobuf_gen_%s(reader, %s, error_string, error_size)", function, value);
+    return;
+  }
+
+  char *descriptor_name = field->type_name ? type_descriptor_name(field->type_name) : NULL;
+
+  switch (field->type) {
+    case TYPE_ENUM:
+      text_printf(text, "json2protobuf_gen_enum(reader, &%s, %s, error_string, error_size)", descriptor_name, value);
+      break;
+    case TYPE_STRING:
+      text_printf(text, "json2protobuf_gen_string(reader, %s, error_string, error_size)", value);
+      break;
+    case TYPE_BYTES:
+      text_printf(text, "json2protobuf_gen_bytes(reader, %s, error_string, error_size)", value);
+      break;
+    case TYPE_MESSAGE:
+      text_printf(text, "json2protobuf_gen_message(reader, &%s, %s, %s, error_string, error_size)", descriptor_name, value, depth);
+      break;
+  }
+
+  free(descriptor_name);
+}
+
+/* Same conditions as protobuf2json_field_is_present() checks */
+static void generate_presence(text_t *text, const file_t *file, const message_t *message, const field_t *field, const char *member) {
+  int is_pointer = field->type == TYPE_STRING || field->type == TYPE_MESSAGE;
+  char *oneof_case_name = field_oneof_case_name(message, field);
+
+  if (field->label == LABEL_REQUIRED) {
+    text_printf(text, "1");
+  } else if (field->label == LABEL_REPEATED) {
+    text_printf(text, "message->n_%s", member);
+  } else if (oneof_case_name) {
+    text_printf(text, "message->%s == %d", oneof_case_name, field->number);
+    if (is_pointer) {
+      text_printf(text, " && message->%s", member);
+    }
+  } else if (field->has_default_value) {
+    text_printf(text, "1");
+  } else if (is_pointer) {
+    text_printf(text, "message->%s", member);
+  } else if (file->proto3 && !field->proto3_optional) {
+    /* No quantifier at all, generic path sees such field as always present */
+    text_printf(text, "1");
+  } else {
+    text_printf(text, "message->has_%s", member);
+  }
+
+  free(oneof_case_name);
+}
+
+/* Same as presence is set by json2protobuf_reader_read_fields(): optional scalars only */
+static int field_has_quantifier(const file_t *file, const message_t *message, const field_t *field) {
+  char *oneof_case_name = field_oneof_case_name(message, field);
+  int has_quantifier = !oneof_case_name
+    && field->label == LABEL_OPTIONAL
+    && field->type != TYPE_STRING && field->type != TYPE_MESSAGE
+    && !(file->proto3 && !field->proto3_optional);
+
+  free(oneof_case_name);
+
+  return has_quantifier;
+}
+
+static void generate_write(text_t *text, const message_t *message, const file_t *file, const char *type_name, const char *lower_name) {
+  int has_repeated = 0;
+  size_t i;
+
+  for (i = 0; i < message->n_fields; i++) {
+    if (message->fields[i].label == LABEL_REPEATED) {
+      has_repeated = 1;
+    }
+  }
+
+  text_printf(text, "static int protobuf2json_write_%s(\n", lower_name);
+  text_printf(text, "  protobuf2json_writer_t *writer,\n");
+  text_printf(text, "  const ProtobufCMessage *protobuf_message,\n");
+  text_printf(text, "  int depth,\n");
+  text_printf(text, "  char *error_string,\n");
+  text_printf(text, "  size_t error_size\n");
+  text_printf(text, ") {\n");
+  text_printf(text, "  const %s *message = (const %s *)protobuf_message;\n", type_name, type_name);
+  text_printf(text, "  int is_first = 1;\n");
+  if (has_repeated) {
+    text_printf(text, "  size_t i;\n");
+  }
+  text_printf(text, "\n");
+  text_printf(text, "  PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_begin_object(writer, depth, error_string, error_size));\n");
+
+  for (i = 0; i < message->n_fields; i++) {
+    const field_t *field = &message->fields[i];
+    char *member = field_member_name(field->name);
+    text_t value = {NULL, 0, 0};
+
+    text_t presence = {NULL, 0, 0};
+
+    generate_presence(&presence, file, message, field, member);
+    if (!strcmp(presence.data, "1")) {
+      text_printf(text, "\n  {\n");
+    } else {
+      text_printf(text, "\n  if (%s) {\n", presence.data);
+    }
+
+    free(presence.data);
+
+    text_printf(
+      text,
+      "    PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_key(writer, \"\\\"%s\\\"\", %zu, depth, &is_first, error_string, error_size));\n",
+      field->name, strlen(field->name) + 2
+    );
+
+    if (field->label == LABEL_REPEATED) {
+      text_printf(&value, "message->%s[i]", member);
+
+      text_printf(text, "    PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_begin_array(writer, error_string, error_size));\n");
+      text_printf(text, "    for (i = 0; i < message->n_%s; i++) {\n", member);
+      text_printf(text, "      PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_array_item(writer, depth, i, error_string, error_size));\n");
+      text_printf(text, "      ");
+      generate_value(text, field, value.data, "depth + 2");
+      text_printf(text, "    }\n");
+      text_printf(text, "    PROTOBUF2JSON_GEN_CHECK(protobuf2json_gen_end_array(writer, depth, error_string, error_size));\n");
+    } else {
+      text_printf(&value, "message->%s", member);
+
+      text_printf(text, "    ");
+      generate_value(text, field, value.data, "depth + 1");
+    }
+
+    text_printf(text, "  }\n");
+
+    free(value.data);
+    free(member);
+  }
+
+  text_printf(text, "\n");
+  text_printf(text, "  return protobuf2json_gen_end_object(writer, depth, is_first, error_string, error_size);\n");
+  text_printf(text, "}\n\n");
+}
+
+static void generate_field_index(text_t *text, const message_t *message, const char *lower_name) {
+  size_t i;
+
+  /* Keys are matched by length first, then by contents */
+  text_printf(text, "static int protobuf2json_field_index_%s(const char *name, size_t name_length) {\n", lower_name);
+
+  if (message->n_fields) {
+    size_t length, max_length = 0;
+
+    for (i = 0; i < message->n_fields; i++) {
+      if (strlen(message->fields[i].name) > max_length) {
+        max_length = strlen(message->fields[i].name);
+      }
+    }
+
+    text_printf(text, "  switch (name_length) {\n");
+    for (length = 1; length <= max_length; length++) {
+      int has_length = 0;
+
+      for (i = 0; i < message->n_fields; i++) {
+        const field_t *field = &message->fields[i];
+        if (strlen(field->name) != length) {
+          continue;
+        }
+
+        if (!has_length) {
+          text_printf(text, "    case %zu:\n", length);
+          has_length = 1;
+        }
+
+        text_printf(text, "      if (!memcmp(name, \"%s\", %zu)) {\n", field->name, length);
+        text_printf(text, "        return %zu;\n", i);
+        text_printf(text, "      }\n");
+      }
+
+      if (has_length) {
+        text_printf(text, "      break;\n");
+      }
+    }
+    text_printf(text, "  }\n\n");
+  } else {
+    text_printf(text, "  (void)name;\n");
+    text_printf(text, "  (void)name_length;\n\n");
+  }
+
+  text_printf(text, "  return -1;\n");
+  text_printf(text, "}\n\n");
+}
+
+/*
+ * Decoder storing every value right into its member, with presence of fields
+ * tracked in a bitmap on the stack. Steps are the same as generic path takes
+ * in json2protobuf_reader_read_fields(), so are the errors.
+ */
+static void generate_read(text_t *text, const message_t *message, const file_t *file, const char *type_name, const char *lower_name) {
+  size_t n_words = (message->n_fields + 31) / 32;
+  int has_repeated = 0, has_enum = 0, has_message = 0;
+  size_t i;
+
+  for (i = 0; i < message->n_fields; i++) {
+    const field_t *field = &message->fields[i];
+
+    if (field->label == LABEL_REPEATED) {
+      has_repeated = 1;
+    } else if (field->type == TYPE_ENUM) {
+      has_enum = 1;
+    } else if (field->type == TYPE_MESSAGE) {
+      has_message = 1;
+    }
+  }
+
+  text_printf(text, "static int protobuf2json_read_%s(\n", lower_name);
+  text_printf(text, "  json2protobuf_reader_t *reader,\n");
+  text_printf(text, "  ProtobufCMessage *protobuf_message,\n");
+  text_printf(text, "  int depth,\n");
+  text_printf(text, "  char *error_string,\n");
+  text_printf(text, "  size_t error_size\n");
+  text_printf(text, ") {\n");
+  if (message->n_fields) {
+    text_printf(text, "  %s *message = (%s *)protobuf_message;\n", type_name, type_name);
+    text_printf(text, "  const ProtobufCFieldDescriptor *fields = %s__descriptor.fields;\n", lower_name);
+    text_printf(text, "  uint32_t presented_fields[%zu] = {0};\n", n_words);
+  }
+  text_printf(text, "  const char *key;\n");
+  text_printf(text, "  size_t key_length;\n");
+  text_printf(text, "  int more;\n");
+  if (has_enum) {
+    text_printf(text, "  int value_enum;\n");
+  }
+  if (has_message) {
+    text_printf(text, "  ProtobufCMessage *value_message;\n");
+  }
+  if (has_repeated) {
+    text_printf(text, "  size_t values_start;\n");
+    text_printf(text, "  int more_values;\n");
+    text_printf(text, "  int result;\n");
+  }
+  text_printf(text, "\n");
+  if (!has_repeated && !has_message) {
+    text_printf(text, "  (void)depth;\n\n");
+  }
+  text_printf(text, "  PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_begin_object(reader, &more, error_string, error_size));\n\n");
+  text_printf(text, "  while (more) {\n");
+  text_printf(text, "    PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_key(reader, &key, &key_length, error_string, error_size));\n\n");
+  text_printf(text, "    switch (protobuf2json_field_index_%s(key, key_length)) {\n", lower_name);
+
+  for (i = 0; i < message->n_fields; i++) {
+    const field_t *field = &message->fields[i];
+    char *member = field_member_name(field->name);
+    char *oneof_case_name = field_oneof_case_name(message, field);
+    size_t word = i / 32;
+    uint32_t bit = (uint32_t)1 << (i % 32);
+    text_t value = {NULL, 0, 0};
+
+    text_printf(text, "      case %zu: /* %s */\n", i, field->name);
+    text_printf(text, "        if (presented_fields[%zu] & 0x%" PRIx32 "u) {\n", word, bit);
+    text_printf(text, "          PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_duplicate_field(reader, protobuf_message, &fields[%zu], error_string, error_size));\n", i);
+    text_printf(text, "        }\n");
+    text_printf(text, "        presented_fields[%zu] |= 0x%" PRIx32 "u;\n", word, bit);
+
+    if (oneof_case_name) {
+      text_printf(text, "        json2protobuf_gen_release_oneof(reader, protobuf_message, (uint32_t *)&message->%s);\n", oneof_case_name);
+    }
+
+    text_printf(text, "        PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_colon(reader, error_string, error_size));\n");
+
+    if (field->label == LABEL_REPEATED) {
+      text_printf(&value, "&value");
+
+      text_printf(text, "        PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_begin_array(reader, depth + 1, &values_start, &more_values, error_string, error_size));\n");
+      text_printf(text, "        while (more_values) {\n");
+      if (field->type == TYPE_BYTES) {
+        text_printf(text, "          ProtobufCBinaryData value = {0, NULL};\n\n");
+      } else if (field->type == TYPE_STRING || field->type == TYPE_MESSAGE) {
+        text_printf(text, "          %svalue = NULL;\n\n", field_value_type(field));
+      } else {
+        text_printf(text, "          %s value = 0;\n\n", field_value_type(field));
+      }
+      text_printf(text, "          result = ");
+      generate_read_value(text, field, value.data, "depth + 2");
+      text_printf(text, ";\n");
+      text_printf(text, "          if (!result) {\n");
+      text_printf(text, "            result = json2protobuf_gen_push_value(reader, &fields[%zu], &value, sizeof(value), &more_values, error_string, error_size);\n", i);
+      text_printf(text, "          }\n");
+      text_printf(text, "          if (result) {\n");
+      text_printf(text, "            json2protobuf_gen_abort_array(reader, &fields[%zu], values_start);\n", i);
+      text_printf(text, "            return result;\n");
+      text_printf(text, "          }\n");
+      text_printf(text, "        }\n");
+      text_printf(
+        text,
+        "        PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_end_array(reader, &fields[%zu], values_start, &message->%s, &message->n_%s, error_string, error_size));\n",
+        i, member, member
+      );
+    } else {
+      if (field_has_quantifier(file, message, field)) {
+        text_printf(text, "        message->has_%s = 1;\n", member);
+      }
+
+      if (field->type == TYPE_ENUM) {
+        text_printf(&value, "&value_enum");
+      } else if (field->type == TYPE_MESSAGE) {
+        text_printf(&value, "&value_message");
+      } else {
+        text_printf(&value, "&message->%s", member);
+      }
+
+      text_printf(text, "        PROTOBUF2JSON_GEN_CHECK(");
+      generate_read_value(text, field, value.data, "depth + 1");
+      text_printf(text, ");\n");
+
+      if (field->type == TYPE_ENUM) {
+        text_printf(text, "        message->%s = value_enum;\n", member);
+      } else if (field->type == TYPE_MESSAGE) {
+        char *field_type_name = full_name_to_c(field->type_name, 0);
+
+        text_printf(text, "        message->%s = (%s *)value_message;\n", member, field_type_name);
+
+        free(field_type_name);
+      }
+    }
+
+    if (oneof_case_name) {
+      text_printf(text, "        message->%s = %d;\n", oneof_case_name, field->number);
+    }
+
+    text_printf(text, "        break;\n");
+
+    free(value.data);
+    free(oneof_case_name);
+    free(member);
+  }
+
+  text_printf(text, "      default:\n");
+  text_printf(text, "        return json2protobuf_gen_unknown_field(&%s__descriptor, key, error_string, error_size);\n", lower_name);
+  text_printf(text, "    }\n\n");
+  text_printf(text, "    PROTOBUF2JSON_GEN_CHECK(json2protobuf_gen_next_field(reader, &more, error_string, error_size));\n");
+  text_printf(text, "  }\n\n");
+
+  /* Required fields with default values may be omitted */
+  for (i = 0; i < message->n_fields; i++) {
+    const field_t *field = &message->fields[i];
+
+    if (field->label != LABEL_REQUIRED || field->has_default_value) {
+      continue;
+    }
+
+    text_printf(text, "  if (!(presented_fields[%zu] & 0x%" PRIx32 "u)) {\n", i / 32, (uint32_t)1 << (i % 32));
+    text_printf(text, "    return json2protobuf_gen_missing_field(&%s__descriptor, &fields[%zu], error_string, error_size);\n", lower_name, i);
+    text_printf(text, "  }\n\n");
+  }
+
+  text_printf(text, "  return 0;\n");
+  text_printf(text, "}\n\n");
+}
+
+static void generate_message(text_t *text, const file_t *file, message_t *message) {
+  char *type_name = full_name_to_c(message->full_name, 0);
+  char *lower_name = full_name_to_c(message->full_name, 1);
+
+  /* protobuf-c sorts fields by number */
+  qsort(message->fields, message->n_fields, sizeof(field_t), field_compare_numbers);
+
+  text_printf(text, "/* %s */\n\n", message->full_name);
+
+  generate_write(text, message, file, type_name, lower_name);
+  generate_field_index(text, message, lower_name);
+  generate_read(text, message, file, type_name, lower_name);
+
+  free(type_name);
+  free(lower_name);
+}
+
+static void generate_header(text_t *text, const file_t *file, const char *base_name, const char *symbol_name) {
+  char *guard = file_symbol_name(base_name);
+  size_t i;
+
+  for (i = 0; guard[i]; i++) {
+    guard[i] = (char)toupper((unsigned char)guard[i]);
+  }
+
+  text_printf(text, "/* Generated by protoc-gen-protobuf2json-c from %s, do not edit */\n\n", file->name);
+  text_printf(text, "#ifndef PROTOBUF2JSON_%s_PB2JSON_C_H\n", guard);
+  text_printf(text, "#define PROTOBUF2JSON_%s_PB2JSON_C_H 1\n\n", guard);
+  text_printf(text, "#include \"protobuf2json.h\"\n");
+  text_printf(text, "#include \"%s.pb-c.h\"\n\n", base_name);
+  text_printf(text, "#ifdef __cplusplus\n");
+  text_printf(text, "extern \"C\" {\n");
+  text_printf(text, "#endif\n\n");
+  text_printf(text, "/* Registers codecs of all messages of %s, see protobuf2json_register_codecs() */\n", file->name);
+  text_printf(text, "int %s__protobuf2json_register(char *error_string, size_t error_size);\n\n", symbol_name);
+  text_printf(text, "#ifdef __cplusplus\n");
+  text_printf(text, "}\n");
+  text_printf(text, "#endif\n\n");
+  text_printf(text, "#endif\n");
+
+  free(guard);
+}
+
+static void generate_source(text_t *text, file_t *file, const char *base_name, const char *symbol_name) {
+  size_t i, n_codecs = 0;
+
+  text_printf(text, "/* Generated by protoc-gen-protobuf2json-c from %s, do not edit */\n\n", file->name);
+  text_printf(text, "#include <string.h>\n\n");
+  text_printf(text, "#include \"%s.pb2json-c.h\"\n\n", base_name);
+  text_printf(text, "#define PROTOBUF2JSON_GEN_CHECK(call) \\\n");
+  text_printf(text, "do { \\\n");
+  text_printf(text, "  int gen_result = (call); \\\n");
+  text_printf(text, "  if (gen_result) { \\\n");
+  text_printf(text, "    return gen_result; \\\n");
+  text_printf(text, "  } \\\n");
+  text_printf(text, "} while (0)\n\n");
+
+  for (i = 0; i < file->n_messages; i++) {
+    if (message_is_supported(&file->messages[i])) {
+      generate_message(text, file, &file->messages[i]);
+      n_codecs++;
+    }
+  }
+
+  text_printf(text, "static const protobuf2json_codec_t %s__protobuf2json_codecs[] = {\n", symbol_name);
+  for (i = 0; i < file->n_messages; i++) {
+    if (message_is_supported(&file->messages[i])) {
+      char *lower_name = full_name_to_c(file->messages[i].full_name, 1);
+
+      text_printf(
+        text,
+        "  { &%s__descriptor, protobuf2json_write_%s, protobuf2json_read_%s, protobuf2json_field_index_%s },\n",
+        lower_name, lower_name, lower_name, lower_name
+      );
+
+      free(lower_name);
+    }
+  }
+  if (!n_codecs) {
+    text_printf(text, "  { NULL, NULL, NULL, NULL }\n");
+  }
+  text_printf(text, "};\n\n");
+
+  text_printf(text, "int %s__protobuf2json_register(char *error_string, size_t error_size) {\n", symbol_name);
+  text_printf(text, "  return protobuf2json_register_codecs(%s__protobuf2json_codecs, %zu, error_string, error_size);\n", symbol_name, n_codecs);
+  text_printf(text, "}\n");
+}
+
+/* === CodeGeneratorResponse === */
+
+static void response_varint(text_t *response, uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    text_printf(response, "%c", byte | (value ? 0x80 : 0));
+  } while (value);
+}
+
+static void response_bytes(text_t *response, uint32_t number, const char *data, size_t length) {
+  size_t i;
+
+  response_varint(response, (number << 3) | WIRE_LENGTH_DELIMITED);
+  response_varint(response, length);
+
+  /* Data may contain NUL bytes, which "%s" would stop at */
+  for (i = 0; i < length; i++) {
+    text_printf(response, "%c", data[i]);
+  }
+}
+
+/* CodeGeneratorResponse.File */
+static void response_file(text_t *response, const char *name, const text_t *content) {
+  text_t file = {NULL, 0, 0};
+
+  text_printf(&file, "%s", "");
+  response_bytes(&file, 1, name, strlen(name));
+  response_bytes(&file, 15, content->data, content->length);
+
+  response_bytes(response, 15, file.data, file.length);
+
+  free(file.data);
+}
+
+static int fail(const char *message) {
+  text_t response = {NULL, 0, 0};
+
+  text_printf(&response, "%s", "");
+  response_bytes(&response, 1, message, strlen(message));
+  fwrite(response.data, 1, response.length, stdout);
+
+  free(response.data);
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t *request = NULL;
+  size_t request_length = 0, request_size = 0;
+
+  if (argc > 1) {
+    fprintf(stderr, "Usage: protoc --plugin=protoc-gen-protobuf2json-c=%s --protobuf2json-c_out=DIR FILE.proto\n", argv[0]);
+    return 1;
+  }
+
+  for (;;) {
+    if (request_length == request_size) {
+      request_size = request_size ? request_size * 2 : 65536;
+      request = realloc(request, request_size);
+      if (!request) {
+        fprintf(stderr, "protoc-gen-protobuf2json-c: out of memory\n");
+        return 1;
+      }
+    }
+
+    size_t length = fread(request + request_length, 1, request_size - request_length, stdin);
+    if (!length) {
+      break;
+    }
+
+    request_length += length;
+  }
+
+  if (ferror(stdin)) {
+    fprintf(stderr, "protoc-gen-protobuf2json-c: cannot read request\n");
+    return 1;
+  }
+
+  /* CodeGeneratorRequest: files to generate and all files they depend on */
+  char **names = NULL;
+  size_t n_names = 0;
+  file_t *files = NULL;
+  size_t n_files = 0;
+
+  wire_t wire;
+  wire_field_t wire_field;
+  int result;
+
+  wire_init(&wire, request, request_length);
+  while ((result = wire_next(&wire, &wire_field)) > 0) {
+    if (wire_field.type != WIRE_LENGTH_DELIMITED) {
+      continue;
+    }
+
+    if (wire_field.number == 1) {
+      names = grow(names, n_names, sizeof(char *));
+      names[n_names++] = wire_string(&wire_field);
+    } else if (wire_field.number == 15) {
+      files = grow(files, n_files, sizeof(file_t));
+      if (parse_file(&files[n_files], wire_field.bytes, wire_field.bytes_length)) {
+        return fail("Malformed FileDescriptorProto in CodeGeneratorRequest");
+      }
+      n_files++;
+    }
+  }
+
+  if (result < 0) {
+    return fail("Malformed CodeGeneratorRequest");
+  }
+
+  text_t response = {NULL, 0, 0};
+  size_t i, j;
+
+  text_printf(&response, "%s", "");
+
+  /* supported_features */
+  response_varint(&response, (2 << 3) | WIRE_VARINT);
+  response_varint(&response, FEATURE_PROTO3_OPTIONAL);
+
+  for (i = 0; i < n_names; i++) {
+    file_t *file = NULL;
+
+    for (j = 0; j < n_files; j++) {
+      if (!strcmp(files[j].name, names[i])) {
+        file = &files[j];
+        break;
+      }
+    }
+
+    if (!file) {
+      return fail("File to generate is missing in CodeGeneratorRequest");
+    }
+
+    char *base_name = file_base_name(file->name);
+    char *symbol_name = file_symbol_name(base_name);
+    text_t header = {NULL, 0, 0};
+    text_t source = {NULL, 0, 0};
+    text_t header_name = {NULL, 0, 0};
+    text_t source_name = {NULL, 0, 0};
+
+    generate_header(&header, file, base_name, symbol_name);
+    generate_source(&source, file, base_name, symbol_name);
+
+    text_printf(&header_name, "%s.pb2json-c.h", base_name);
+    text_printf(&source_name, "%s.pb2json-c.c", base_name);
+
+    response_file(&response, header_name.data, &header);
+    response_file(&response, source_name.data, &source);
+
+    free(header.data);
+    free(source.data);
+    free(header_name.data);
+    free(source_name.data);
+    free(base_name);
+    free(symbol_name);
+  }
+
+  for (i = 0; i < n_names; i++) {
+    free(names[i]);
+  }
+  for (i = 0; i < n_files; i++) {
+    file_free(&files[i]);
+  }
+
+  free(names);
+  free(files);
+  free(request);
+
+  result = fwrite(response.data, 1, response.length, stdout) == response.length && !fflush(stdout);
+
+  free(response.data);
+
+  if (!result) {
+    fprintf(stderr, "protoc-gen-protobuf2json-c: cannot write response\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H 1
+
+#include <stdint.h>
+
+/* Power of 2, more than enough for descriptors of any real application */
+#define REGISTRY_SIZE 4096
+
+/* Filled up to 3/4 only, so lookups of absent keys stop at an empty slot soon */
+#define REGISTRY_MAX_ENTRIES (REGISTRY_SIZE / 4 * 3)
+
+/*
+ * Fixed-size open addressing set of entries keyed by pointer,
+ * every entry starts with its key. Entries are only added and never removed,
+ * so lookups need no locks: a slot, once published with compare-and-swap,
+ * never changes.
+ */
+typedef struct registry {
+  void *slots[REGISTRY_SIZE];
+  size_t count;
+} registry_t;
+
+static size_t registry_hash(const void *key)
+{
+  uintptr_t value = (uintptr_t)key;
+
+  /* Descriptors are aligned, so low bits carry nothing */
+  value ^= value >> 17;
+  value *= 0x9e3779b1U;
+
+  return (size_t)(value >> 4) & (REGISTRY_SIZE - 1);
+}
+
+static const void *registry_entry_key(void *entry)
+{
+  return *(const void **)entry;
+}
+
+/* Returns entry with the key or NULL if there is no such entry */
+static void *registry_get(registry_t *registry, const void *key)
+{
+  size_t i = registry_hash(key);
+  size_t probes;
+
+  for (probes = 0; probes < REGISTRY_SIZE; probes++) {
+    void *entry = __atomic_load_n(&registry->slots[i], __ATOMIC_ACQUIRE);
+    if (!entry) {
+      return NULL;
+    }
+
+    if (registry_entry_key(entry) == key) {
+      return entry;
+    }
+
+    i = (i + 1) & (REGISTRY_SIZE - 1);
+  }
+
+  return NULL;
+}
+
+/* Once it is full, entries should not be built just to be refused by registry_put() */
+static int registry_is_full(registry_t *registry)
+{
+  return __atomic_load_n(&registry->count, __ATOMIC_RELAXED) >= REGISTRY_MAX_ENTRIES;
+}
+
+/*
+ * Adds entry unless other one with the same key was added concurrently.
+ * Returns entry which is in registry now or NULL if registry is full,
+ * caller owns its entry if anything but this entry is returned.
+ */
+static void *registry_put(registry_t *registry, void *entry)
+{
+  const void *key = registry_entry_key(entry);
+  size_t i = registry_hash(key);
+  size_t probes;
+
+  if (registry_is_full(registry)) {
+    return NULL;
+  }
+
+  for (probes = 0; probes < REGISTRY_SIZE; probes++) {
+    void *expected = NULL;
+
+    if (__atomic_compare_exchange_n(&registry->slots[i], &expected, entry, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_add_fetch(&registry->count, 1, __ATOMIC_RELAXED);
+      return entry;
+    }
+
+    if (registry_entry_key(expected) == key) {
+      return expected;
+    }
+
+    i = (i + 1) & (REGISTRY_SIZE - 1);
+  }
+
+  return NULL;
+}
+
+#endif /* REGISTRY_H */
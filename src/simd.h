@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H 1
+
+/*
+ * Vector kernels are built with __attribute__((target(...))) rather than
+ * with -m flags for the whole library. Intrinsics of SSE4.1 and AVX2 are
+ * allowed in such functions since GCC 4.9 and clang 3.8, older compilers
+ * fail to build them, so scalar code is used there instead.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (                                   \
+      (defined(__clang__) &&                                                          \
+        (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) ||   \
+      (!defined(__clang__) && defined(__GNUC__) &&                                    \
+        (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))                     \
+    )
+#define SIMD_TARGET_ATTRIBUTE 1
+#endif
+
+#endif /* SIMD_H */
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef UTF8_H
+#define UTF8_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "simd.h"
+
+/* Returns length of valid UTF-8 sequence starting at `string` and its codepoint, or 0 */
+static size_t utf8_sequence(const unsigned char *string, size_t length, int32_t *codepoint)
+{
+  unsigned char first = string[0];
+  size_t sequence_length;
+  int32_t value;
+
+  if (first < 0x80) {
+    *codepoint = first;
+    return 1;
+  } else if (first < 0xC2) {
+    return 0;
+  } else if (first < 0xE0) {
+    sequence_length = 2;
+    value = first & 0x1F;
+  } else if (first < 0xF0) {
+    sequence_length = 3;
+    value = first & 0x0F;
+  } else if (first < 0xF5) {
+    sequence_length = 4;
+    value = first & 0x07;
+  } else {
+    return 0;
+  }
+
+  if (sequence_length > length) {
+    return 0;
+  }
+
+  size_t i;
+  for (i = 1; i < sequence_length; i++) {
+    if ((string[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    value = (value << 6) | (string[i] & 0x3F);
+  }
+
+  if ((sequence_length == 3 && value < 0x800)
+   || (sequence_length == 4 && value < 0x10000)
+   || (value >= 0xD800 && value <= 0xDFFF)
+   || value > 0x10FFFF
+  ) {
+    return 0;
+  }
+
+  *codepoint = value;
+  return sequence_length;
+}
+
+/*
+ * Vectorized validation of JSON string contents, which may have any UTF-8
+ * text but no quotes, backslashes or control characters.
+ *
+ * Blocks are checked with lookup tables indexed by nibbles of each byte
+ * and the byte before it (Keiser & Lemire, "Validating UTF-8 In Less Than
+ * One Instruction Per Byte"), so a block is accepted or rejected as a whole
+ * and the rest is checked by utf8_sequence().
+ */
+#if defined(SIMD_TARGET_ATTRIBUTE) && !defined(UTF8_NO_SIMD)
+#define UTF8_SIMD 1
+#endif
+
+#ifdef UTF8_SIMD
+
+#include <immintrin.h>
+
+/* Error classes of two-byte sequences, a bit is set in all three lookups only for invalid pair */
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/* Indexed by high nibble of the first byte */
+#define UTF8_BYTE_1_HIGH_TABLE                                                           \
+  UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,                            \
+  UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,                            \
+  UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,                        \
+  UTF8_TOO_SHORT | UTF8_OVERLONG_2,                                                      \
+  UTF8_TOO_SHORT,                                                                        \
+  UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,                                     \
+  UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+
+/* Indexed by low nibble of the first byte */
+#define UTF8_BYTE_1_LOW_TABLE                                                            \
+  UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,                      \
+  UTF8_CARRY | UTF8_OVERLONG_2,                                                          \
+  UTF8_CARRY,                                                                            \
+  UTF8_CARRY,                                                                            \
+  UTF8_CARRY | UTF8_TOO_LARGE,                                                           \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,                    \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                     \
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+
+/* Indexed by high nibble of the second byte */
+#define UTF8_BYTE_2_HIGH_TABLE                                                           \
+  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,                        \
+  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,                        \
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4, \
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,   \
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,    \
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,    \
+  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+
+__attribute__((target("sse4.1")))
+static size_t utf8_string_length_sse41(const char *string, size_t length)
+{
+  const __m128i byte_1_high_table = _mm_setr_epi8(UTF8_BYTE_1_HIGH_TABLE);
+  const __m128i byte_1_low_table = _mm_setr_epi8(UTF8_BYTE_1_LOW_TABLE);
+  const __m128i byte_2_high_table = _mm_setr_epi8(UTF8_BYTE_2_HIGH_TABLE);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  __m128i previous = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(string + i));
+
+    /* Bytes up to 0x1F unsigned, quotes and backslashes */
+    __m128i special = _mm_or_si128(
+      _mm_cmpeq_epi8(_mm_min_epu8(block, _mm_set1_epi8(0x1F)), block),
+      _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')))
+    );
+
+    __m128i previous_1 = _mm_alignr_epi8(block, previous, 16 - 1);
+    __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table, _mm_and_si128(_mm_srli_epi16(previous_1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(previous_1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+    __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    /* Third and fourth bytes of sequences must be continuations, which is the only case of TWO_CONTS allowed */
+    __m128i previous_2 = _mm_alignr_epi8(block, previous, 16 - 2);
+    __m128i previous_3 = _mm_alignr_epi8(block, previous, 16 - 3);
+    __m128i must_be_continuation = _mm_and_si128(
+      _mm_or_si128(_mm_subs_epu8(previous_2, _mm_set1_epi8(0xE0 - 0x80)), _mm_subs_epu8(previous_3, _mm_set1_epi8(0xF0 - 0x80))),
+      _mm_set1_epi8((char)0x80)
+    );
+
+    __m128i error = _mm_or_si128(special, _mm_xor_si128(must_be_continuation, special_cases));
+    if (!_mm_testz_si128(error, error)) {
+      break;
+    }
+
+    previous = block;
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t utf8_string_length_avx2(const char *string, size_t length)
+{
+  const __m256i byte_1_high_table = _mm256_setr_epi8(UTF8_BYTE_1_HIGH_TABLE, UTF8_BYTE_1_HIGH_TABLE);
+  const __m256i byte_1_low_table = _mm256_setr_epi8(UTF8_BYTE_1_LOW_TABLE, UTF8_BYTE_1_LOW_TABLE);
+  const __m256i byte_2_high_table = _mm256_setr_epi8(UTF8_BYTE_2_HIGH_TABLE, UTF8_BYTE_2_HIGH_TABLE);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i previous = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(string + i));
+
+    __m256i special = _mm256_or_si256(
+      _mm256_cmpeq_epi8(_mm256_min_epu8(block, _mm256_set1_epi8(0x1F)), block),
+      _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')))
+    );
+
+    /* Upper lane of previous block and lower lane of this one, so shifts cross the lane boundary */
+    __m256i previous_lanes = _mm256_permute2x128_si256(previous, block, 0x21);
+    __m256i previous_1 = _mm256_alignr_epi8(block, previous_lanes, 16 - 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(previous_1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(previous_1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i previous_2 = _mm256_alignr_epi8(block, previous_lanes, 16 - 2);
+    __m256i previous_3 = _mm256_alignr_epi8(block, previous_lanes, 16 - 3);
+    __m256i must_be_continuation = _mm256_and_si256(
+      _mm256_or_si256(_mm256_subs_epu8(previous_2, _mm256_set1_epi8(0xE0 - 0x80)), _mm256_subs_epu8(previous_3, _mm256_set1_epi8(0xF0 - 0x80))),
+      _mm256_set1_epi8((char)0x80)
+    );
+
+    __m256i error = _mm256_or_si256(special, _mm256_xor_si256(must_be_continuation, special_cases));
+    if (!_mm256_testz_si256(error, error)) {
+      break;
+    }
+
+    previous = block;
+  }
+
+  return i;
+}
+
+/* Vector kernels do not pay off below it */
+#define UTF8_SIMD_MIN_LENGTH 32
+
+static int utf8_has_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static int utf8_has_sse41(void)
+{
+  return __builtin_cpu_supports("sse4.1");
+}
+
+#endif /* UTF8_SIMD */
+
+/* Returns length of the longest prefix of `string` that is valid string contents */
+static size_t utf8_string_length(const char *string, size_t length)
+{
+  size_t valid = 0;
+
+#ifdef UTF8_SIMD
+  if (length >= UTF8_SIMD_MIN_LENGTH) {
+    if (utf8_has_avx2()) {
+      valid = utf8_string_length_avx2(string, length);
+    } else if (utf8_has_sse41()) {
+      valid = utf8_string_length_sse41(string, length);
+    }
+  }
+
+  /* Sequence cut by the end of the last block is checked again below */
+  size_t k;
+  for (k = 1; k <= 3 && k <= valid; k++) {
+    unsigned char c = (unsigned char)string[valid - k];
+
+    if (c < 0x80) {
+      break;
+    } else if (c >= 0xC0) {
+      size_t sequence_length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+
+      if (sequence_length > k) {
+        valid -= k;
+      }
+      break;
+    }
+  }
+#endif
+
+  while (valid < length) {
+    const unsigned char *s = (const unsigned char *)string + valid;
+    int32_t codepoint;
+
+    if (*s < 0x20 || *s == '"' || *s == '\\') {
+      break;
+    }
+
+    size_t sequence_length = utf8_sequence(s, length - valid, &codepoint);
+    if (!sequence_length) {
+      break;
+    }
+
+    valid += sequence_length;
+  }
+
+  return valid;
+}
+
+#endif /* UTF8_H */
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef WIRE_H
+#define WIRE_H 1
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Protobuf wire format primitives, the same encoding protobuf_c_message_pack()
+ * and protobuf_c_message_unpack() use.
+ */
+
+#define WIRE_TYPE_VARINT 0
+#define WIRE_TYPE_64BIT 1
+#define WIRE_TYPE_LENGTH_PREFIXED 2
+#define WIRE_TYPE_START_GROUP 3
+#define WIRE_TYPE_END_GROUP 4
+#define WIRE_TYPE_32BIT 5
+
+/* 64 bits by 7 */
+#define WIRE_MAX_VARINT_LENGTH 10
+
+/* Returns length of varint at the start of data, 0 if it is truncated or too long */
+static size_t wire_varint_length(const uint8_t *data, size_t length)
+{
+  size_t i;
+
+  if (length > WIRE_MAX_VARINT_LENGTH) {
+    length = WIRE_MAX_VARINT_LENGTH;
+  }
+
+  for (i = 0; i < length; i++) {
+    if (!(data[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Same as wire_varint_length(), bits above 64 are dropped */
+static size_t wire_read_varint(const uint8_t *data, size_t length, uint64_t *value)
+{
+  uint64_t result = 0;
+  size_t i;
+
+  if (length > WIRE_MAX_VARINT_LENGTH) {
+    length = WIRE_MAX_VARINT_LENGTH;
+  }
+
+  for (i = 0; i < length; i++) {
+    result |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+
+    if (!(data[i] & 0x80)) {
+      *value = result;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+static uint32_t wire_read_fixed32(const uint8_t *data)
+{
+  return (uint32_t)data[0]
+    | ((uint32_t)data[1] << 8)
+    | ((uint32_t)data[2] << 16)
+    | ((uint32_t)data[3] << 24);
+}
+
+static uint64_t wire_read_fixed64(const uint8_t *data)
+{
+  return (uint64_t)wire_read_fixed32(data) | ((uint64_t)wire_read_fixed32(data + 4) << 32);
+}
+
+static int32_t wire_zigzag32_decode(uint32_t value)
+{
+  return (int32_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static int64_t wire_zigzag64_decode(uint64_t value)
+{
+  return (int64_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+/* Number of bytes wire_write_varint() takes for value */
+static size_t wire_varint_size(uint64_t value)
+{
+  size_t size = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+
+  return size;
+}
+
+/* Needs up to WIRE_MAX_VARINT_LENGTH bytes, returns number of bytes written */
+static size_t wire_write_varint(uint8_t *data, uint64_t value)
+{
+  size_t i = 0;
+
+  while (value >= 0x80) {
+    data[i++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+
+  data[i++] = (uint8_t)value;
+
+  return i;
+}
+
+static void wire_write_fixed32(uint8_t *data, uint32_t value)
+{
+  data[0] = (uint8_t)value;
+  data[1] = (uint8_t)(value >> 8);
+  data[2] = (uint8_t)(value >> 16);
+  data[3] = (uint8_t)(value >> 24);
+}
+
+static void wire_write_fixed64(uint8_t *data, uint64_t value)
+{
+  wire_write_fixed32(data, (uint32_t)value);
+  wire_write_fixed32(data + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t wire_zigzag32_encode(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(0 - ((uint32_t)value >> 31));
+}
+
+static uint64_t wire_zigzag64_encode(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(0 - ((uint64_t)value >> 63));
+}
+
+#endif /* WIRE_H */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#ifndef ALLOC_COUNT_HELPER_H_
+#define ALLOC_COUNT_HELPER_H_
+
+#include <stdlib.h>
+
+/*
+ * Counts every malloc(3), calloc(3) and realloc(3) call of the process,
+ * including ones made by jansson and protobuf-c, by replacing them
+ * with wrappers around glibc internals. Not available elsewhere,
+ * under sanitizers, which replace allocator themselves, and under valgrind,
+ * which would not see allocations made by glibc internals directly.
+ */
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ALLOC_COUNT_SANITIZED 1
+#endif
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define ALLOC_COUNT_SANITIZED 1
+#endif
+
+#if defined(__GLIBC__) && !defined(ALLOC_COUNT_SANITIZED) && !defined(MY_VALGRIND)
+
+#define ALLOC_COUNT_ENABLED 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+size_t alloc_count = 0;
+
+void *malloc(size_t size) {
+  alloc_count++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  alloc_count++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  alloc_count++;
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  __libc_free(ptr);
+}
+
+#else
+
+size_t alloc_count = 0;
+
+#endif
+
+#endif /* ALLOC_COUNT_HELPER_H_ */
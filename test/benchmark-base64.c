@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "getrusage-helper.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+/* Kernels are measured alone as well as through the library */
+#include "../src/base64.h"
+
+#define BASE64_BLOB_SIZE (8 * 1024 * 1024)
+#define BASE64_ITERATIONS 20
+
+static void base64_printf(const char *message, double ru_stime, double ru_utime) {
+  double seconds = ru_stime + ru_utime;
+  double bytes = (double)BASE64_BLOB_SIZE * BASE64_ITERATIONS;
+
+  long maxrss = 0;
+
+  if (getrusage_helper_maxrss(&maxrss)) {
+    FATAL("getrusage_helper_maxrss failed");
+  }
+
+  getrusage_helper_printf(message, ru_stime, ru_utime);
+  printf("%s: %.2f GB/s of bytes field data, %ld KB peak RSS\n", message, seconds > 0 ? bytes / seconds / 1e9 : 0, maxrss);
+}
+
+static uint8_t *base64_blob_alloc(void) {
+  uint8_t *blob = malloc(BASE64_BLOB_SIZE);
+  ASSERT(blob);
+
+  size_t i;
+  for (i = 0; i < BASE64_BLOB_SIZE; i++) {
+    blob[i] = (uint8_t)(i * 2654435761U >> 24);
+  }
+
+  return blob;
+}
+
+BENCHMARK_IMPL(base64_kernels) {
+  double ru_stime = 0, ru_utime = 0;
+  int i;
+
+  uint8_t *blob = base64_blob_alloc();
+
+  char *encoded = malloc(base64_encoded_len(BASE64_BLOB_SIZE));
+  ASSERT(encoded);
+
+  char *decoded = malloc(BASE64_BLOB_SIZE);
+  ASSERT(decoded);
+
+  size_t encoded_length = 0;
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  for (i = 0; i < BASE64_ITERATIONS; i++) {
+    encoded_length = base64_encode(encoded, (const char *)blob, BASE64_BLOB_SIZE);
+  }
+
+  if (getrusage_helper_sub(&ru_stime, &ru_utime, ru_stime, ru_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  base64_printf("Base64 encode kernel", ru_stime, ru_utime);
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  for (i = 0; i < BASE64_ITERATIONS; i++) {
+    ASSERT(base64_decode(decoded, encoded, encoded_length) == BASE64_BLOB_SIZE);
+  }
+
+  if (getrusage_helper_sub(&ru_stime, &ru_utime, ru_stime, ru_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  base64_printf("Base64 decode kernel", ru_stime, ru_utime);
+
+  ASSERT(!memcmp(decoded, blob, BASE64_BLOB_SIZE));
+
+  free(decoded);
+  free(encoded);
+  free(blob);
+
+  RETURN_OK();
+}
+
+/* Large bytes field, so time is spent mostly in base64 encoding and decoding */
+BENCHMARK_IMPL(base64) {
+  double ru_stime = 0, ru_utime = 0;
+  int i, result;
+
+  uint8_t *blob = base64_blob_alloc();
+
+  Foo__Bar bar = FOO__BAR__INIT;
+
+  bar.string_required = "required";
+  bar.has_bytes_optional = 1;
+  bar.bytes_optional.len = BASE64_BLOB_SIZE;
+  bar.bytes_optional.data = blob;
+
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  for (i = 0; i < BASE64_ITERATIONS; i++) {
+    free(json_buffer);
+
+    result = protobuf2json_buffer(&bar.base, JSON_COMPACT, &json_buffer, &json_length, NULL, 0);
+    ASSERT_ZERO(result);
+  }
+
+  if (getrusage_helper_sub(&ru_stime, &ru_utime, ru_stime, ru_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  base64_printf("Base64 encode", ru_stime, ru_utime);
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  for (i = 0; i < BASE64_ITERATIONS; i++) {
+    ProtobufCMessage *protobuf_message = NULL;
+
+    result = json2protobuf_buffer(json_buffer, json_length, 0, &foo__bar__descriptor, &protobuf_message, NULL, 0);
+    ASSERT_ZERO(result);
+
+    Foo__Bar *decoded_bar = (Foo__Bar *)protobuf_message;
+    ASSERT(decoded_bar->bytes_optional.len == BASE64_BLOB_SIZE);
+
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  }
+
+  if (getrusage_helper_sub(&ru_stime, &ru_utime, ru_stime, ru_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  base64_printf("Base64 decode", ru_stime, ru_utime);
+
+  free(json_buffer);
+  free(blob);
+
+  RETURN_OK();
+}
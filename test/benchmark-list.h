@@ -6,8 +6,136 @@
  * See LICENSE for details.
  */
 
-BENCHMARK_DECLARE (dummy)
+BENCHMARK_DECLARE (protobuf2json_string__person)
+BENCHMARK_DECLARE (protobuf2json_string__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_string__bar)
+BENCHMARK_DECLARE (protobuf2json_string__something)
+BENCHMARK_DECLARE (protobuf2json_file__person)
+BENCHMARK_DECLARE (protobuf2json_file__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_file__bar)
+BENCHMARK_DECLARE (protobuf2json_file__something)
+BENCHMARK_DECLARE (protobuf2json_buffer__person)
+BENCHMARK_DECLARE (protobuf2json_buffer__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_buffer__bar)
+BENCHMARK_DECLARE (protobuf2json_buffer__something)
+BENCHMARK_DECLARE (protobuf2json_ctx_buffer__person)
+BENCHMARK_DECLARE (protobuf2json_ctx_buffer__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_ctx_buffer__bar)
+BENCHMARK_DECLARE (protobuf2json_ctx_buffer__something)
+#ifdef HAVE_PROTOC
+BENCHMARK_DECLARE (protobuf2json_codegen__person)
+BENCHMARK_DECLARE (protobuf2json_codegen__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_codegen__bar)
+BENCHMARK_DECLARE (protobuf2json_codegen__something)
+#endif
+BENCHMARK_DECLARE (protobuf2json_unpack__person)
+BENCHMARK_DECLARE (protobuf2json_unpack__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_unpack__bar)
+BENCHMARK_DECLARE (protobuf2json_unpack__something)
+BENCHMARK_DECLARE (protobuf2json_packed__person)
+BENCHMARK_DECLARE (protobuf2json_packed__repeated_values)
+BENCHMARK_DECLARE (protobuf2json_packed__bar)
+BENCHMARK_DECLARE (protobuf2json_packed__something)
+BENCHMARK_DECLARE (json2protobuf_string__person)
+BENCHMARK_DECLARE (json2protobuf_string__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_string__bar)
+BENCHMARK_DECLARE (json2protobuf_string__something)
+BENCHMARK_DECLARE (json2protobuf_file__person)
+BENCHMARK_DECLARE (json2protobuf_file__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_file__bar)
+BENCHMARK_DECLARE (json2protobuf_file__something)
+BENCHMARK_DECLARE (json2protobuf_buffer__person)
+BENCHMARK_DECLARE (json2protobuf_buffer__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_buffer__bar)
+BENCHMARK_DECLARE (json2protobuf_buffer__something)
+BENCHMARK_DECLARE (json2protobuf_ctx_buffer__person)
+BENCHMARK_DECLARE (json2protobuf_ctx_buffer__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_ctx_buffer__bar)
+BENCHMARK_DECLARE (json2protobuf_ctx_buffer__something)
+#ifdef HAVE_PROTOC
+BENCHMARK_DECLARE (json2protobuf_codegen__person)
+BENCHMARK_DECLARE (json2protobuf_codegen__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_codegen__bar)
+BENCHMARK_DECLARE (json2protobuf_codegen__something)
+#endif
+BENCHMARK_DECLARE (json2protobuf_pack__person)
+BENCHMARK_DECLARE (json2protobuf_pack__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_pack__bar)
+BENCHMARK_DECLARE (json2protobuf_pack__something)
+BENCHMARK_DECLARE (json2protobuf_packed__person)
+BENCHMARK_DECLARE (json2protobuf_packed__repeated_values)
+BENCHMARK_DECLARE (json2protobuf_packed__bar)
+BENCHMARK_DECLARE (json2protobuf_packed__something)
+BENCHMARK_DECLARE (repeated_values_by_type)
+BENCHMARK_DECLARE (protobuf2json_batch)
+BENCHMARK_DECLARE (base64_kernels)
+BENCHMARK_DECLARE (base64)
+BENCHMARK_DECLARE (strings)
 
 TASK_LIST_START
-  BENCHMARK_ENTRY  (dummy)
+  BENCHMARK_ENTRY  (protobuf2json_string__person)
+  BENCHMARK_ENTRY  (protobuf2json_string__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_string__bar)
+  BENCHMARK_ENTRY  (protobuf2json_string__something)
+  BENCHMARK_ENTRY  (protobuf2json_file__person)
+  BENCHMARK_ENTRY  (protobuf2json_file__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_file__bar)
+  BENCHMARK_ENTRY  (protobuf2json_file__something)
+  BENCHMARK_ENTRY  (protobuf2json_buffer__person)
+  BENCHMARK_ENTRY  (protobuf2json_buffer__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_buffer__bar)
+  BENCHMARK_ENTRY  (protobuf2json_buffer__something)
+  BENCHMARK_ENTRY  (protobuf2json_ctx_buffer__person)
+  BENCHMARK_ENTRY  (protobuf2json_ctx_buffer__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_ctx_buffer__bar)
+  BENCHMARK_ENTRY  (protobuf2json_ctx_buffer__something)
+#ifdef HAVE_PROTOC
+  BENCHMARK_ENTRY  (protobuf2json_codegen__person)
+  BENCHMARK_ENTRY  (protobuf2json_codegen__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_codegen__bar)
+  BENCHMARK_ENTRY  (protobuf2json_codegen__something)
+#endif
+  BENCHMARK_ENTRY  (protobuf2json_unpack__person)
+  BENCHMARK_ENTRY  (protobuf2json_unpack__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_unpack__bar)
+  BENCHMARK_ENTRY  (protobuf2json_unpack__something)
+  BENCHMARK_ENTRY  (protobuf2json_packed__person)
+  BENCHMARK_ENTRY  (protobuf2json_packed__repeated_values)
+  BENCHMARK_ENTRY  (protobuf2json_packed__bar)
+  BENCHMARK_ENTRY  (protobuf2json_packed__something)
+  BENCHMARK_ENTRY  (json2protobuf_string__person)
+  BENCHMARK_ENTRY  (json2protobuf_string__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_string__bar)
+  BENCHMARK_ENTRY  (json2protobuf_string__something)
+  BENCHMARK_ENTRY  (json2protobuf_file__person)
+  BENCHMARK_ENTRY  (json2protobuf_file__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_file__bar)
+  BENCHMARK_ENTRY  (json2protobuf_file__something)
+  BENCHMARK_ENTRY  (json2protobuf_buffer__person)
+  BENCHMARK_ENTRY  (json2protobuf_buffer__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_buffer__bar)
+  BENCHMARK_ENTRY  (json2protobuf_buffer__something)
+  BENCHMARK_ENTRY  (json2protobuf_ctx_buffer__person)
+  BENCHMARK_ENTRY  (json2protobuf_ctx_buffer__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_ctx_buffer__bar)
+  BENCHMARK_ENTRY  (json2protobuf_ctx_buffer__something)
+#ifdef HAVE_PROTOC
+  BENCHMARK_ENTRY  (json2protobuf_codegen__person)
+  BENCHMARK_ENTRY  (json2protobuf_codegen__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_codegen__bar)
+  BENCHMARK_ENTRY  (json2protobuf_codegen__something)
+#endif
+  BENCHMARK_ENTRY  (json2protobuf_pack__person)
+  BENCHMARK_ENTRY  (json2protobuf_pack__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_pack__bar)
+  BENCHMARK_ENTRY  (json2protobuf_pack__something)
+  BENCHMARK_ENTRY  (json2protobuf_packed__person)
+  BENCHMARK_ENTRY  (json2protobuf_packed__repeated_values)
+  BENCHMARK_ENTRY  (json2protobuf_packed__bar)
+  BENCHMARK_ENTRY  (json2protobuf_packed__something)
+  BENCHMARK_ENTRY  (repeated_values_by_type)
+  BENCHMARK_ENTRY  (protobuf2json_batch)
+  BENCHMARK_ENTRY  (base64_kernels)
+  BENCHMARK_ENTRY  (base64)
+  BENCHMARK_ENTRY  (strings)
 TASK_LIST_END
@@ -0,0 +1,685 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "getrusage-helper.h"
+#include "alloc-count-helper.h"
+#include "test.pb-c.h"
+#ifdef HAVE_PROTOC
+#include "test.pb2json-c.h"
+#endif
+#include "protobuf2json.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+/* Every size is measured for at least this CPU time */
+#define MESSAGES_MIN_SECONDS 0.25
+
+#define MESSAGES_JSON_FLAGS JSON_COMPACT
+
+typedef enum {
+  MESSAGES_PROTOBUF2JSON_STRING,
+  MESSAGES_PROTOBUF2JSON_FILE,
+  MESSAGES_PROTOBUF2JSON_BUFFER,
+  MESSAGES_PROTOBUF2JSON_CTX_BUFFER,
+  MESSAGES_PROTOBUF2JSON_CODEGEN,
+  MESSAGES_PROTOBUF2JSON_UNPACK_BUFFER,
+  MESSAGES_PROTOBUF2JSON_FROM_PACKED,
+  MESSAGES_JSON2PROTOBUF_STRING,
+  MESSAGES_JSON2PROTOBUF_FILE,
+  MESSAGES_JSON2PROTOBUF_BUFFER,
+  MESSAGES_JSON2PROTOBUF_CTX_BUFFER,
+  MESSAGES_JSON2PROTOBUF_CODEGEN,
+  MESSAGES_JSON2PROTOBUF_PACK_BUFFER,
+  MESSAGES_JSON2PROTOBUF_TO_PACKED
+} messages_function_t;
+
+static const char *messages_function_names[] = {
+  "protobuf2json_string",
+  "protobuf2json_file",
+  "protobuf2json_buffer",
+  "protobuf2json_ctx_buffer",
+  "protobuf2json_codegen",
+  "protobuf2json_unpack",
+  "protobuf2json_packed",
+  "json2protobuf_string",
+  "json2protobuf_file",
+  "json2protobuf_buffer",
+  "json2protobuf_ctx_buffer",
+  "json2protobuf_codegen",
+  "json2protobuf_pack",
+  "json2protobuf_packed"
+};
+
+typedef struct messages_text {
+  char *data;
+  size_t length;
+  size_t size;
+} messages_text_t;
+
+static void messages_text_append(messages_text_t *text, const char *format, ...) {
+  for (;;) {
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(text->data + text->length, text->size - text->length, format, args);
+    va_end(args);
+
+    ASSERT(length >= 0);
+
+    if ((size_t)length < text->size - text->length) {
+      text->length += length;
+      return;
+    }
+
+    text->size = (text->size + length + 1) * 2;
+    text->data = realloc(text->data, text->size);
+    ASSERT(text->data);
+  }
+}
+
+static void messages_text_repeat(messages_text_t *text, const char *string, size_t count) {
+  size_t i;
+  for (i = 0; i < count; i++) {
+    messages_text_append(text, "%s", string);
+  }
+}
+
+/* JSON of the shape, `size` is count of repeated values or length of strings */
+typedef void (*messages_shape_json_t)(messages_text_t *text, size_t size);
+
+static void messages_person_json(messages_text_t *text, size_t size) {
+  size_t i;
+
+  messages_text_append(text, "{\"name\":\"John Doe\",\"id\":42,\"email\":\"john@doe.name\",\"phone\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s{\"number\":\"+%09zu\",\"type\":\"%s\"}", i ? "," : "", i, i % 2 ? "WORK" : "MOBILE");
+  }
+  messages_text_append(text, "]}");
+}
+
+static void messages_repeated_values_json(messages_text_t *text, size_t size) {
+  static const char *integer_fields[] = {
+    "value_int32", "value_sint32", "value_sfixed32",
+    "value_int64", "value_sint64", "value_sfixed64"
+  };
+  static const char *unsigned_fields[] = {
+    "value_uint32", "value_fixed32", "value_uint64", "value_fixed64"
+  };
+  size_t i, j;
+
+  messages_text_append(text, "{");
+
+  for (j = 0; j < sizeof(integer_fields) / sizeof(integer_fields[0]); j++) {
+    messages_text_append(text, "\"%s\":[", integer_fields[j]);
+    for (i = 0; i < size; i++) {
+      messages_text_append(text, "%s%ld", i ? "," : "", (long)(i * 2654435761U % 2000000000) - 1000000000L);
+    }
+    messages_text_append(text, "],");
+  }
+
+  for (j = 0; j < sizeof(unsigned_fields) / sizeof(unsigned_fields[0]); j++) {
+    messages_text_append(text, "\"%s\":[", unsigned_fields[j]);
+    for (i = 0; i < size; i++) {
+      messages_text_append(text, "%s%zu", i ? "," : "", i * 2654435761U % 4000000000U);
+    }
+    messages_text_append(text, "],");
+  }
+
+  messages_text_append(text, "\"value_float\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s%g", i ? "," : "", (double)i / 7.0);
+  }
+
+  messages_text_append(text, "],\"value_double\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s%.17g", i ? "," : "", (double)i / 7.0e3);
+  }
+
+  messages_text_append(text, "],\"value_bool\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s%s", i ? "," : "", i % 3 ? "true" : "false");
+  }
+
+  messages_text_append(text, "],\"value_enum\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s\"%s\"", i ? "," : "", i % 2 ? "FIZZ" : "BUZZ");
+  }
+
+  messages_text_append(text, "],\"value_string\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s\"string %zu\"", i ? "," : "", i);
+  }
+
+  messages_text_append(text, "],\"value_bytes\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s\"Ynl0ZXM=\"", i ? "," : "");
+  }
+
+  messages_text_append(text, "],\"value_message\":[");
+  for (i = 0; i < size; i++) {
+    messages_text_append(text, "%s{\"name\":\"John Doe\",\"id\":%zu}", i ? "," : "", i);
+  }
+
+  messages_text_append(text, "]}");
+}
+
+static void messages_bar_json(messages_text_t *text, size_t size) {
+  messages_text_append(text, "{\"string_required\":\"required\",\"string_optional\":\"");
+  messages_text_repeat(text, "x", size);
+  messages_text_append(text, "\",\"bytes_optional\":\"");
+  messages_text_repeat(text, "AAAA", size / 3);
+  messages_text_append(text, "\",\"enum_optional\":\"BUZZ\"}");
+}
+
+static void messages_something_json(messages_text_t *text, size_t size) {
+  messages_text_append(text, "{\"oneof_string\":\"");
+  messages_text_repeat(text, "\\u0444", size / 2);
+  messages_text_append(text, "\"}");
+}
+
+typedef struct messages_shape {
+  const char *name;
+  const ProtobufCMessageDescriptor *descriptor;
+  messages_shape_json_t json;
+  size_t sizes[3];
+} messages_shape_t;
+
+static const messages_shape_t messages_shapes[] = {
+  { "Person", &foo__person__descriptor, messages_person_json, { 1, 32, 1024 } },
+  { "RepeatedValues", &foo__repeated_values__descriptor, messages_repeated_values_json, { 1, 32, 1024 } },
+  { "Bar", &foo__bar__descriptor, messages_bar_json, { 16, 1024, 65536 } },
+  { "Something", &foo__something__descriptor, messages_something_json, { 16, 1024, 65536 } }
+};
+
+typedef struct messages_state {
+  ProtobufCMessage *protobuf_message;
+  char *json_string;
+  size_t json_length;
+  char json_file[64];
+  protobuf2json_ctx_t *ctx;
+  uint8_t *packed_buffer;
+  size_t packed_length;
+} messages_state_t;
+
+static void messages_run_once(messages_function_t function, const messages_shape_t *shape, messages_state_t *state) {
+  ProtobufCMessage *protobuf_message = NULL;
+  char *json_string = NULL;
+  uint8_t *packed_buffer = NULL;
+  size_t packed_length = 0;
+  const char *ctx_json_string = NULL;
+  size_t json_length = 0;
+  int result = 0;
+
+  switch (function) {
+    case MESSAGES_PROTOBUF2JSON_STRING:
+      result = protobuf2json_string(state->protobuf_message, MESSAGES_JSON_FLAGS, &json_string, NULL, 0);
+      break;
+    case MESSAGES_PROTOBUF2JSON_FILE:
+      result = protobuf2json_file(state->protobuf_message, MESSAGES_JSON_FLAGS, state->json_file, "w", NULL, 0);
+      break;
+    case MESSAGES_PROTOBUF2JSON_BUFFER:
+    case MESSAGES_PROTOBUF2JSON_CODEGEN:
+      result = protobuf2json_buffer(state->protobuf_message, MESSAGES_JSON_FLAGS, &json_string, &json_length, NULL, 0);
+      break;
+    case MESSAGES_PROTOBUF2JSON_CTX_BUFFER:
+      result = protobuf2json_ctx_buffer(state->ctx, state->protobuf_message, MESSAGES_JSON_FLAGS, &ctx_json_string, &json_length, NULL, 0);
+      break;
+    case MESSAGES_PROTOBUF2JSON_UNPACK_BUFFER:
+      /* What protobuf2json_from_packed() replaces */
+      protobuf_message = protobuf_c_message_unpack(shape->descriptor, NULL, state->packed_length, state->packed_buffer);
+      ASSERT(protobuf_message);
+      result = protobuf2json_buffer(protobuf_message, MESSAGES_JSON_FLAGS, &json_string, &json_length, NULL, 0);
+      break;
+    case MESSAGES_PROTOBUF2JSON_FROM_PACKED:
+      result = protobuf2json_from_packed(shape->descriptor, state->packed_buffer, state->packed_length, MESSAGES_JSON_FLAGS, &json_string, &json_length, NULL, 0);
+      break;
+    case MESSAGES_JSON2PROTOBUF_STRING:
+      result = json2protobuf_string(state->json_string, 0, shape->descriptor, &protobuf_message, NULL, 0);
+      break;
+    case MESSAGES_JSON2PROTOBUF_FILE:
+      result = json2protobuf_file(state->json_file, 0, shape->descriptor, &protobuf_message, NULL, 0);
+      break;
+    case MESSAGES_JSON2PROTOBUF_BUFFER:
+    case MESSAGES_JSON2PROTOBUF_CODEGEN:
+      result = json2protobuf_buffer(state->json_string, state->json_length, 0, shape->descriptor, &protobuf_message, NULL, 0);
+      break;
+    case MESSAGES_JSON2PROTOBUF_CTX_BUFFER:
+      result = json2protobuf_ctx_buffer(state->ctx, state->json_string, state->json_length, 0, shape->descriptor, &protobuf_message, NULL, 0);
+      ASSERT_ZERO(result);
+
+      /* Message is released by reset, the way long-running workers do it */
+      protobuf2json_ctx_reset(state->ctx);
+      protobuf_message = NULL;
+      break;
+    case MESSAGES_JSON2PROTOBUF_PACK_BUFFER:
+      /* What json2protobuf_to_packed() replaces */
+      result = json2protobuf_buffer(state->json_string, state->json_length, 0, shape->descriptor, &protobuf_message, NULL, 0);
+      ASSERT_ZERO(result);
+
+      packed_length = protobuf_c_message_get_packed_size(protobuf_message);
+      packed_buffer = malloc(packed_length + 1);
+      ASSERT(packed_buffer);
+      ASSERT(protobuf_c_message_pack(protobuf_message, packed_buffer) == packed_length);
+      break;
+    case MESSAGES_JSON2PROTOBUF_TO_PACKED:
+      result = json2protobuf_to_packed(state->json_string, state->json_length, 0, shape->descriptor, &packed_buffer, &packed_length, NULL, 0);
+      break;
+  }
+
+  ASSERT_ZERO(result);
+
+  free(json_string);
+  free(packed_buffer);
+
+  if (protobuf_message) {
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  }
+}
+
+static void messages_state_init(const messages_shape_t *shape, size_t size, messages_state_t *state) {
+  messages_text_t text = { NULL, 0, 0 };
+  int result;
+
+  shape->json(&text, size);
+
+  result = json2protobuf_string(text.data, 0, shape->descriptor, &state->protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  free(text.data);
+
+  /* Input of decoding benchmarks is exactly what encoding ones produce */
+  result = protobuf2json_buffer(state->protobuf_message, MESSAGES_JSON_FLAGS, &state->json_string, &state->json_length, NULL, 0);
+  ASSERT_ZERO(result);
+
+  strcpy(state->json_file, "/tmp/protobuf2json-benchmark-XXXXXX");
+
+  int fd = mkstemp(state->json_file);
+  ASSERT(fd >= 0);
+  ASSERT(write(fd, state->json_string, state->json_length) == (ssize_t)state->json_length);
+  close(fd);
+
+  state->ctx = protobuf2json_ctx_new();
+  ASSERT(state->ctx);
+
+  state->packed_length = protobuf_c_message_get_packed_size(state->protobuf_message);
+  state->packed_buffer = malloc(state->packed_length + 1);
+  ASSERT(state->packed_buffer);
+  ASSERT(protobuf_c_message_pack(state->protobuf_message, state->packed_buffer) == state->packed_length);
+}
+
+static void messages_state_free(messages_state_t *state) {
+  free(state->packed_buffer);
+  protobuf2json_ctx_free(state->ctx);
+  unlink(state->json_file);
+  free(state->json_string);
+  protobuf_c_message_free_unpacked(state->protobuf_message, NULL);
+}
+
+static void messages_benchmark(messages_function_t function, const messages_shape_t *shape) {
+  double total_stime = 0, total_utime = 0;
+  size_t i;
+
+  if (getrusage_helper(&total_stime, &total_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+#ifdef HAVE_PROTOC
+  /* Same calls as buffer ones, but with generated codecs registered */
+  if (function == MESSAGES_PROTOBUF2JSON_CODEGEN || function == MESSAGES_JSON2PROTOBUF_CODEGEN) {
+    ASSERT_ZERO(test__protobuf2json_register(NULL, 0));
+  }
+#endif
+
+  for (i = 0; i < sizeof(shape->sizes) / sizeof(shape->sizes[0]); i++) {
+    messages_state_t state;
+    double ru_stime = 0, ru_utime = 0;
+    size_t messages = 0, batch = 1;
+    long maxrss = 0;
+
+    messages_state_init(shape, shape->sizes[i], &state);
+
+    /* Warm up caches and lazily built tables before measuring */
+    messages_run_once(function, shape, &state);
+
+    size_t allocs = alloc_count;
+
+    if (getrusage_helper(&ru_stime, &ru_utime)) {
+      FATAL("getrusage_helper failed");
+    }
+
+    double start_stime = ru_stime, start_utime = ru_utime;
+
+    do {
+      size_t j;
+      for (j = 0; j < batch; j++) {
+        messages_run_once(function, shape, &state);
+      }
+
+      messages += batch;
+      batch *= 2;
+
+      if (getrusage_helper_sub(&ru_stime, &ru_utime, start_stime, start_utime)) {
+        FATAL("getrusage_helper_sub failed");
+      }
+    } while (ru_stime + ru_utime < MESSAGES_MIN_SECONDS);
+
+    allocs = alloc_count - allocs;
+
+    if (getrusage_helper_maxrss(&maxrss)) {
+      FATAL("getrusage_helper_maxrss failed");
+    }
+
+    double seconds = ru_stime + ru_utime;
+
+    printf(
+      "%-24s %-14s size %-6zu %6zu bytes: %10.0f msgs/s %8.2f MB/s",
+      messages_function_names[function], shape->name, shape->sizes[i], state.json_length,
+      messages / seconds, messages * (double)state.json_length / seconds / 1e6
+    );
+
+#ifdef ALLOC_COUNT_ENABLED
+    printf(" %9.1f allocs/msg", (double)allocs / messages);
+#else
+    printf(" %9s allocs/msg", "n/a");
+#endif
+
+    printf(" %8ld KB peak RSS\n", maxrss);
+
+    messages_state_free(&state);
+  }
+
+  if (getrusage_helper_sub(&total_stime, &total_utime, total_stime, total_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  /* Including preparation of messages */
+  getrusage_helper_printf("Total", total_stime, total_utime);
+}
+
+/* Values of one RepeatedValues field, each type measured separately */
+#define MESSAGES_TYPES_VALUES 4096
+
+typedef struct messages_type {
+  const char *field_name;
+  /* printf(3) format of `i`-th value */
+  void (*value)(messages_text_t *text, size_t i);
+} messages_type_t;
+
+/* Spreads values over the whole range, so they have any number of digits */
+static uint64_t messages_types_mix(size_t i) {
+  uint64_t value = (uint64_t)(i + 1) * UINT64_C(0x9E3779B97F4A7C15);
+
+  return value >> (i % 64);
+}
+
+static void messages_types_int32(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%" PRId32, (int32_t)(uint32_t)messages_types_mix(i));
+}
+
+static void messages_types_uint32(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%" PRIu32, (uint32_t)messages_types_mix(i));
+}
+
+static void messages_types_int64(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%" PRId64, (int64_t)messages_types_mix(i));
+}
+
+/* jansson cannot read integers above INT64_MAX */
+static void messages_types_uint64(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%" PRIu64, messages_types_mix(i) >> 1);
+}
+
+static void messages_types_float(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%.9g", (float)((double)messages_types_mix(i) / 1e15));
+}
+
+static void messages_types_double(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%.17g", (double)messages_types_mix(i) / 1e15);
+}
+
+static void messages_types_bool(messages_text_t *text, size_t i) {
+  messages_text_append(text, "%s", messages_types_mix(i) & 1 ? "true" : "false");
+}
+
+static void messages_types_enum(messages_text_t *text, size_t i) {
+  messages_text_append(text, "\"%s\"", messages_types_mix(i) & 1 ? "FIZZ" : "BUZZ");
+}
+
+static const messages_type_t messages_types[] = {
+  { "value_int32", messages_types_int32 },
+  { "value_sint32", messages_types_int32 },
+  { "value_sfixed32", messages_types_int32 },
+  { "value_uint32", messages_types_uint32 },
+  { "value_fixed32", messages_types_uint32 },
+  { "value_int64", messages_types_int64 },
+  { "value_sint64", messages_types_int64 },
+  { "value_sfixed64", messages_types_int64 },
+  { "value_uint64", messages_types_uint64 },
+  { "value_fixed64", messages_types_uint64 },
+  { "value_float", messages_types_float },
+  { "value_double", messages_types_double },
+  { "value_bool", messages_types_bool },
+  { "value_enum", messages_types_enum }
+};
+
+/* Returns values per second of protobuf2json_buffer() or json2protobuf_buffer() of one field */
+static double messages_types_measure(int decode, ProtobufCMessage *protobuf_message, char *json_string, size_t json_length) {
+  double ru_stime = 0, ru_utime = 0;
+  size_t messages = 0, batch = 1;
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  double start_stime = ru_stime, start_utime = ru_utime;
+
+  do {
+    size_t j;
+    for (j = 0; j < batch; j++) {
+      if (decode) {
+        ProtobufCMessage *decoded_message = NULL;
+        ASSERT_ZERO(json2protobuf_buffer(json_string, json_length, 0, &foo__repeated_values__descriptor, &decoded_message, NULL, 0));
+        protobuf_c_message_free_unpacked(decoded_message, NULL);
+      } else {
+        char *encoded_string = NULL;
+        ASSERT_ZERO(protobuf2json_buffer(protobuf_message, MESSAGES_JSON_FLAGS, &encoded_string, NULL, NULL, 0));
+        free(encoded_string);
+      }
+    }
+
+    messages += batch;
+    batch *= 2;
+
+    if (getrusage_helper_sub(&ru_stime, &ru_utime, start_stime, start_utime)) {
+      FATAL("getrusage_helper_sub failed");
+    }
+  } while (ru_stime + ru_utime < MESSAGES_MIN_SECONDS);
+
+  return (double)messages * MESSAGES_TYPES_VALUES / (ru_stime + ru_utime);
+}
+
+BENCHMARK_IMPL(repeated_values_by_type) {
+  size_t i, j;
+
+  for (i = 0; i < sizeof(messages_types) / sizeof(messages_types[0]); i++) {
+    const messages_type_t *type = &messages_types[i];
+    messages_text_t text = { NULL, 0, 0 };
+    ProtobufCMessage *protobuf_message = NULL;
+
+    messages_text_append(&text, "{\"%s\":[", type->field_name);
+    for (j = 0; j < MESSAGES_TYPES_VALUES; j++) {
+      if (j) {
+        messages_text_append(&text, ",");
+      }
+      type->value(&text, j);
+    }
+    messages_text_append(&text, "]}");
+
+    ASSERT_ZERO(json2protobuf_string(text.data, 0, &foo__repeated_values__descriptor, &protobuf_message, NULL, 0));
+    free(text.data);
+
+    char *json_string = NULL;
+    size_t json_length = 0;
+    ASSERT_ZERO(protobuf2json_buffer(protobuf_message, MESSAGES_JSON_FLAGS, &json_string, &json_length, NULL, 0));
+
+    double encode = messages_types_measure(0, protobuf_message, json_string, json_length);
+    double decode = messages_types_measure(1, protobuf_message, json_string, json_length);
+    double bytes_per_value = (double)json_length / MESSAGES_TYPES_VALUES;
+
+    printf(
+      "%-14s %5.1f bytes/value: protobuf2json_buffer %7.2f M values/s %8.2f MB/s, json2protobuf_buffer %7.2f M values/s %8.2f MB/s\n",
+      type->field_name, bytes_per_value,
+      encode / 1e6, encode * bytes_per_value / 1e6,
+      decode / 1e6, decode * bytes_per_value / 1e6
+    );
+
+    free(json_string);
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  }
+
+  RETURN_OK();
+}
+
+/* Small messages converted together, the way log shippers do */
+#define MESSAGES_BATCH_SIZE 1024
+
+typedef enum {
+  MESSAGES_BATCH_ONE_BY_ONE,
+  MESSAGES_BATCH_BUFFER,
+  MESSAGES_BATCH_CALLBACK
+} messages_batch_function_t;
+
+static const char *messages_batch_function_names[] = {
+  "protobuf2json_buffer each",
+  "protobuf2json_batch_buffer",
+  "protobuf2json_batch_callback"
+};
+
+static int messages_batch_discard(const char *buffer, size_t size, void *data) {
+  return 0;
+}
+
+static void messages_batch_run_once(messages_batch_function_t function, ProtobufCMessage **protobuf_messages) {
+  char *json_string = NULL;
+  size_t i;
+
+  switch (function) {
+    case MESSAGES_BATCH_ONE_BY_ONE:
+      /* What batch functions replace: separate string for every message */
+      for (i = 0; i < MESSAGES_BATCH_SIZE; i++) {
+        ASSERT_ZERO(protobuf2json_buffer(protobuf_messages[i], MESSAGES_JSON_FLAGS, &json_string, NULL, NULL, 0));
+        free(json_string);
+      }
+      break;
+    case MESSAGES_BATCH_BUFFER:
+      ASSERT_ZERO(protobuf2json_batch_buffer(protobuf_messages, MESSAGES_BATCH_SIZE, MESSAGES_JSON_FLAGS, &json_string, NULL, NULL, 0));
+      free(json_string);
+      break;
+    case MESSAGES_BATCH_CALLBACK:
+      ASSERT_ZERO(protobuf2json_batch_callback(protobuf_messages, MESSAGES_BATCH_SIZE, MESSAGES_JSON_FLAGS, messages_batch_discard, NULL, NULL, 0));
+      break;
+  }
+}
+
+BENCHMARK_IMPL(protobuf2json_batch) {
+  static ProtobufCMessage *protobuf_messages[MESSAGES_BATCH_SIZE];
+  messages_text_t text = { NULL, 0, 0 };
+  size_t i;
+
+  for (i = 0; i < MESSAGES_BATCH_SIZE; i++) {
+    text.length = 0;
+    messages_text_append(&text, "{\"name\":\"user %zu\",\"id\":%zu,\"email\":\"user%zu@example.com\"}", i, i, i);
+
+    ASSERT_ZERO(json2protobuf_string(text.data, 0, &foo__person__descriptor, &protobuf_messages[i], NULL, 0));
+  }
+
+  free(text.data);
+
+  size_t function;
+  for (function = MESSAGES_BATCH_ONE_BY_ONE; function <= MESSAGES_BATCH_CALLBACK; function++) {
+    double ru_stime = 0, ru_utime = 0;
+    size_t batches = 0, batch = 1;
+
+    /* Warm up caches and lazily built tables before measuring */
+    messages_batch_run_once(function, protobuf_messages);
+
+    size_t allocs = alloc_count;
+
+    if (getrusage_helper(&ru_stime, &ru_utime)) {
+      FATAL("getrusage_helper failed");
+    }
+
+    double start_stime = ru_stime, start_utime = ru_utime;
+
+    do {
+      size_t j;
+      for (j = 0; j < batch; j++) {
+        messages_batch_run_once(function, protobuf_messages);
+      }
+
+      batches += batch;
+      batch *= 2;
+
+      if (getrusage_helper_sub(&ru_stime, &ru_utime, start_stime, start_utime)) {
+        FATAL("getrusage_helper_sub failed");
+      }
+    } while (ru_stime + ru_utime < MESSAGES_MIN_SECONDS);
+
+    allocs = alloc_count - allocs;
+
+    double messages = (double)batches * MESSAGES_BATCH_SIZE;
+
+    printf("%-30s %d Person messages: %10.0f msgs/s", messages_batch_function_names[function], MESSAGES_BATCH_SIZE, messages / (ru_stime + ru_utime));
+
+#ifdef ALLOC_COUNT_ENABLED
+    printf(" %9.3f allocs/msg\n", (double)allocs / messages);
+#else
+    printf(" %9s allocs/msg\n", "n/a");
+#endif
+  }
+
+  for (i = 0; i < MESSAGES_BATCH_SIZE; i++) {
+    protobuf_c_message_free_unpacked(protobuf_messages[i], NULL);
+  }
+
+  RETURN_OK();
+}
+
+#define MESSAGES_BENCHMARK_IMPL(function, function_id, shape_name, shape_index)     \
+  BENCHMARK_IMPL(function##__##shape_name) {                                       \
+    messages_benchmark(function_id, &messages_shapes[shape_index]);               \
+    RETURN_OK();                                                                   \
+  }
+
+#define MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(function, function_id)                 \
+  MESSAGES_BENCHMARK_IMPL(function, function_id, person, 0)                        \
+  MESSAGES_BENCHMARK_IMPL(function, function_id, repeated_values, 1)               \
+  MESSAGES_BENCHMARK_IMPL(function, function_id, bar, 2)                           \
+  MESSAGES_BENCHMARK_IMPL(function, function_id, something, 3)
+
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_string, MESSAGES_PROTOBUF2JSON_STRING)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_file, MESSAGES_PROTOBUF2JSON_FILE)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_buffer, MESSAGES_PROTOBUF2JSON_BUFFER)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_ctx_buffer, MESSAGES_PROTOBUF2JSON_CTX_BUFFER)
+#ifdef HAVE_PROTOC
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_codegen, MESSAGES_PROTOBUF2JSON_CODEGEN)
+#endif
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_unpack, MESSAGES_PROTOBUF2JSON_UNPACK_BUFFER)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(protobuf2json_packed, MESSAGES_PROTOBUF2JSON_FROM_PACKED)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_string, MESSAGES_JSON2PROTOBUF_STRING)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_file, MESSAGES_JSON2PROTOBUF_FILE)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_buffer, MESSAGES_JSON2PROTOBUF_BUFFER)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_ctx_buffer, MESSAGES_JSON2PROTOBUF_CTX_BUFFER)
+#ifdef HAVE_PROTOC
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_codegen, MESSAGES_JSON2PROTOBUF_CODEGEN)
+#endif
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_pack, MESSAGES_JSON2PROTOBUF_PACK_BUFFER)
+MESSAGES_BENCHMARK_IMPL_ALL_SHAPES(json2protobuf_packed, MESSAGES_JSON2PROTOBUF_TO_PACKED)
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "getrusage-helper.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+#define STRINGS_TEXT_SIZE (4 * 1024 * 1024)
+#define STRINGS_ITERATIONS 20
+
+static const char *strings_ascii_words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit"};
+static const char *strings_utf8_words[] = {"lorem", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "na\xc3\xafve", "\xe6\x97\xa5\xe6\x9c\xac", "sit", "\xe2\x82\xac", "caf\xc3\xa9", "\xf0\x9f\x98\x80"};
+
+/* Free text of words, with a quote every `quote_every` words and a line break every 16 words */
+static char *strings_text_alloc(const char **words, size_t quote_every) {
+  char *text = malloc(STRINGS_TEXT_SIZE + 1);
+  ASSERT(text);
+
+  size_t length = 0, n = 0;
+  while (length + 16 < STRINGS_TEXT_SIZE) {
+    const char *word = words[(n * 2654435761U >> 16) % 8];
+
+    if (quote_every && n % quote_every == 0) {
+      text[length++] = '"';
+    }
+
+    memcpy(text + length, word, strlen(word));
+    length += strlen(word);
+
+    text[length++] = (++n % 16) ? ' ' : '\n';
+  }
+
+  memset(text + length, '.', STRINGS_TEXT_SIZE - length);
+  text[STRINGS_TEXT_SIZE] = '\0';
+
+  return text;
+}
+
+static void strings_printf(const char *message, double ru_stime, double ru_utime) {
+  double seconds = ru_stime + ru_utime;
+  double bytes = (double)STRINGS_TEXT_SIZE * STRINGS_ITERATIONS;
+
+  long maxrss = 0;
+
+  if (getrusage_helper_maxrss(&maxrss)) {
+    FATAL("getrusage_helper_maxrss failed");
+  }
+
+  getrusage_helper_printf(message, ru_stime, ru_utime);
+  printf("%s: %.2f GB/s of string field data, %ld KB peak RSS\n", message, seconds > 0 ? bytes / seconds / 1e9 : 0, maxrss);
+}
+
+static void strings_benchmark(const char *encode_message, const char *decode_message, const char **words, size_t quote_every) {
+  double ru_stime = 0, ru_utime = 0;
+  int i, result;
+
+  Foo__Bar bar = FOO__BAR__INIT;
+  bar.string_required = strings_text_alloc(words, quote_every);
+
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  for (i = 0; i < STRINGS_ITERATIONS; i++) {
+    free(json_buffer);
+
+    result = protobuf2json_buffer(&bar.base, JSON_COMPACT, &json_buffer, &json_length, NULL, 0);
+    ASSERT_ZERO(result);
+  }
+
+  if (getrusage_helper_sub(&ru_stime, &ru_utime, ru_stime, ru_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  strings_printf(encode_message, ru_stime, ru_utime);
+
+  if (getrusage_helper(&ru_stime, &ru_utime)) {
+    FATAL("getrusage_helper failed");
+  }
+
+  for (i = 0; i < STRINGS_ITERATIONS; i++) {
+    ProtobufCMessage *protobuf_message = NULL;
+
+    result = json2protobuf_buffer(json_buffer, json_length, 0, &foo__bar__descriptor, &protobuf_message, NULL, 0);
+    ASSERT_ZERO(result);
+
+    Foo__Bar *decoded_bar = (Foo__Bar *)protobuf_message;
+    ASSERT(!strcmp(decoded_bar->string_required, bar.string_required));
+
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  }
+
+  if (getrusage_helper_sub(&ru_stime, &ru_utime, ru_stime, ru_utime)) {
+    FATAL("getrusage_helper_sub failed");
+  }
+
+  strings_printf(decode_message, ru_stime, ru_utime);
+
+  free(json_buffer);
+  free(bar.string_required);
+}
+
+/* Long free-text string field, so time is spent mostly in escaping and UTF-8 validation */
+BENCHMARK_IMPL(strings) {
+  strings_benchmark("Encode plain text", "Decode plain text", strings_ascii_words, 0);
+  strings_benchmark("Encode text with quotes", "Decode text with quotes", strings_ascii_words, 8);
+  strings_benchmark("Encode UTF-8 text", "Decode UTF-8 text", strings_utf8_words, 0);
+
+  RETURN_OK();
+}
@@ -36,6 +36,22 @@ static int getrusage_helper_sub(double *ru_stime, double *ru_utime, double ru_st
   return 0;
 }
 
+/* Peak resident set size of the process so far, in kilobytes */
+static int getrusage_helper_maxrss(long *maxrss) {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage))
+    return -errno;
+
+#ifdef __APPLE__
+  *maxrss = usage.ru_maxrss / 1024;
+#else
+  *maxrss = usage.ru_maxrss;
+#endif
+
+  return 0;
+}
+
 static void getrusage_helper_printf(const char *message, double ru_stime, double ru_utime) {
   printf("%s rusage: %.5f system, %.5f user\n", message, ru_stime, ru_utime);
 }
@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "test.pb2json-c.h"
+#include "protobuf2json.h"
+
+/* Every test runs in its own process, so codecs registered here do not affect other tests */
+
+static const size_t codegen_json_flags[] = {
+  0,
+  TEST_JSON_FLAGS,
+  JSON_COMPACT,
+  JSON_INDENT(4) | JSON_COMPACT,
+  JSON_SORT_KEYS,
+  JSON_ENSURE_ASCII | JSON_ESCAPE_SLASH,
+  JSON_REAL_PRECISION(5),
+  JSON_EMBED,
+  JSON_EMBED | JSON_INDENT(2),
+};
+
+#define CODEGEN_N_FLAGS (sizeof(codegen_json_flags) / sizeof(codegen_json_flags[0]))
+#define CODEGEN_N_MESSAGES 7
+
+typedef struct codegen_messages {
+  Foo__Person person;
+  Foo__Person__PhoneNumber person_phonenumber1;
+  Foo__Person__PhoneNumber person_phonenumber2;
+  Foo__Person__PhoneNumber *person_phonenumbers[2];
+  Foo__Bar bar;
+  Foo__RepeatedValues repeated_values;
+  Foo__RepeatedValues repeated_values_empty;
+  Foo__Person *value_message[1];
+  Foo__Something something_none;
+  Foo__Something something_string;
+  Foo__Something something_bytes;
+  ProtobufCMessage *all[CODEGEN_N_MESSAGES];
+} codegen_messages_t;
+
+static int32_t codegen_value_int32[] = { 2147483647, -2147483647 - 1, 0 };
+static uint32_t codegen_value_uint32[] = { 4294967295U, 0 };
+static int64_t codegen_value_int64[] = { 9223372036854775807LL, -9223372036854775807LL - 1, 0 };
+static uint64_t codegen_value_uint64[] = { 18446744073709551615ULL, 0 };
+static float codegen_value_float[] = { 0.33f, 0, -1.5e-7f };
+static double codegen_value_double[] = { 0.0077705550333011103, 0, 1e21 };
+static protobuf_c_boolean codegen_value_bool[] = { 1, 0 };
+static Foo__FizzBuzzType codegen_value_enum[] = { FOO__FIZZ_BUZZ_TYPE__FIZZ, FOO__FIZZ_BUZZ_TYPE__FIZZBUZZ };
+static char *codegen_value_string[] = { "", "qwerty", "\"\\\b\f\n\r\t\x1f/" };
+static ProtobufCBinaryData codegen_value_bytes[] = { { 0, NULL }, { 1, (uint8_t *)"?" }, { 3, (uint8_t *)"\xff\xff\xff" } };
+
+static void codegen_messages_init(codegen_messages_t *messages) {
+  Foo__Person person = FOO__PERSON__INIT;
+  Foo__Person__PhoneNumber person_phonenumber = FOO__PERSON__PHONE_NUMBER__INIT;
+  Foo__Bar bar = FOO__BAR__INIT;
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+  Foo__Something something = FOO__SOMETHING__INIT;
+
+  messages->person = person;
+  messages->person.name = "John \"Doe\" \xd0\x94\xd0\xb6\xd0\xbe\xd0\xbd \xf0\x9f\x98\x80";
+  messages->person.id = -42;
+  messages->person.email = "john@doe.name";
+
+  messages->person_phonenumber1 = person_phonenumber;
+  messages->person_phonenumber1.number = "+123456789";
+  messages->person_phonenumber1.has_type = 1;
+  messages->person_phonenumber1.type = FOO__PERSON__PHONE_TYPE__WORK;
+  messages->person_phonenumber2 = person_phonenumber;
+  messages->person_phonenumber2.number = "+987654321";
+
+  messages->person_phonenumbers[0] = &messages->person_phonenumber1;
+  messages->person_phonenumbers[1] = &messages->person_phonenumber2;
+  messages->person.n_phone = 2;
+  messages->person.phone = messages->person_phonenumbers;
+
+  messages->bar = bar;
+  messages->bar.string_required = "required";
+  messages->bar.has_bytes_optional = 1;
+  messages->bar.bytes_optional.len = 4;
+  messages->bar.bytes_optional.data = (uint8_t *)"\xff\xfe\xfd\xfc";
+  messages->bar.has_enum_optional = 1;
+  messages->bar.enum_optional = FOO__FIZZ_BUZZ_TYPE__BUZZ;
+
+  messages->repeated_values = repeated_values;
+  messages->repeated_values.n_value_int32 = 3;
+  messages->repeated_values.value_int32 = codegen_value_int32;
+  messages->repeated_values.n_value_sint32 = 3;
+  messages->repeated_values.value_sint32 = codegen_value_int32;
+  messages->repeated_values.n_value_sfixed32 = 3;
+  messages->repeated_values.value_sfixed32 = codegen_value_int32;
+  messages->repeated_values.n_value_uint32 = 2;
+  messages->repeated_values.value_uint32 = codegen_value_uint32;
+  messages->repeated_values.n_value_fixed32 = 2;
+  messages->repeated_values.value_fixed32 = codegen_value_uint32;
+  messages->repeated_values.n_value_int64 = 3;
+  messages->repeated_values.value_int64 = codegen_value_int64;
+  messages->repeated_values.n_value_sint64 = 3;
+  messages->repeated_values.value_sint64 = codegen_value_int64;
+  messages->repeated_values.n_value_sfixed64 = 3;
+  messages->repeated_values.value_sfixed64 = codegen_value_int64;
+  messages->repeated_values.n_value_uint64 = 2;
+  messages->repeated_values.value_uint64 = codegen_value_uint64;
+  messages->repeated_values.n_value_fixed64 = 2;
+  messages->repeated_values.value_fixed64 = codegen_value_uint64;
+  messages->repeated_values.n_value_float = 3;
+  messages->repeated_values.value_float = codegen_value_float;
+  messages->repeated_values.n_value_double = 3;
+  messages->repeated_values.value_double = codegen_value_double;
+  messages->repeated_values.n_value_bool = 2;
+  messages->repeated_values.value_bool = codegen_value_bool;
+  messages->repeated_values.n_value_enum = 2;
+  messages->repeated_values.value_enum = codegen_value_enum;
+  messages->repeated_values.n_value_string = 3;
+  messages->repeated_values.value_string = codegen_value_string;
+  messages->repeated_values.n_value_bytes = 3;
+  messages->repeated_values.value_bytes = codegen_value_bytes;
+  messages->value_message[0] = &messages->person;
+  messages->repeated_values.n_value_message = 1;
+  messages->repeated_values.value_message = messages->value_message;
+
+  messages->repeated_values_empty = repeated_values;
+
+  messages->something_none = something;
+
+  messages->something_string = something;
+  messages->something_string.something_case = FOO__SOMETHING__SOMETHING_ONEOF_STRING;
+  messages->something_string.oneof_string = "string";
+
+  messages->something_bytes = something;
+  messages->something_bytes.something_case = FOO__SOMETHING__SOMETHING_ONEOF_BYTES;
+  messages->something_bytes.oneof_bytes.len = 5;
+  messages->something_bytes.oneof_bytes.data = (uint8_t *)"bytes";
+
+  messages->all[0] = &messages->person.base;
+  messages->all[1] = &messages->bar.base;
+  messages->all[2] = &messages->repeated_values.base;
+  messages->all[3] = &messages->repeated_values_empty.base;
+  messages->all[4] = &messages->something_none.base;
+  messages->all[5] = &messages->something_string.base;
+  messages->all[6] = &messages->something_bytes.base;
+}
+
+static void codegen_register(void) {
+  char error_string[256] = {0};
+
+  ASSERT_ZERO(test__protobuf2json_register(error_string, sizeof(error_string)));
+}
+
+/* Generated decoder should produce exactly what jansson-based json2protobuf_string() does, including errors */
+static void codegen_assert_decode_equals_string(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *json_string,
+  size_t json_flags
+) {
+  int result_string, result_buffer;
+  char error_string_string[256] = {0};
+  char error_string_buffer[256] = {0};
+
+  ProtobufCMessage *protobuf_message_string = NULL;
+  result_string = json2protobuf_string((char *)json_string, json_flags, protobuf_message_descriptor, &protobuf_message_string, error_string_string, sizeof(error_string_string));
+
+  ProtobufCMessage *protobuf_message_buffer = NULL;
+  result_buffer = json2protobuf_buffer((char *)json_string, strlen(json_string), json_flags, protobuf_message_descriptor, &protobuf_message_buffer, error_string_buffer, sizeof(error_string_buffer));
+
+  ASSERT_EQUALS(result_buffer, result_string);
+  ASSERT_STRCMP(
+    error_string_buffer,
+    error_string_string
+  );
+
+  if (result_string) {
+    ASSERT(!protobuf_message_buffer);
+    return;
+  }
+
+  char *json_string_string = NULL;
+  ASSERT_ZERO(protobuf2json_string(protobuf_message_string, TEST_JSON_FLAGS, &json_string_string, NULL, 0));
+
+  char *json_string_buffer = NULL;
+  ASSERT_ZERO(protobuf2json_string(protobuf_message_buffer, TEST_JSON_FLAGS, &json_string_buffer, NULL, 0));
+
+  ASSERT_STRCMP(
+    json_string_buffer,
+    json_string_string
+  );
+
+  protobuf_c_message_free_unpacked(protobuf_message_string, NULL);
+  protobuf_c_message_free_unpacked(protobuf_message_buffer, NULL);
+  free(json_string_string);
+  free(json_string_buffer);
+}
+
+TEST_IMPL(codegen__same_as_generic) {
+  codegen_messages_t messages;
+  char *generic_json[CODEGEN_N_MESSAGES][CODEGEN_N_FLAGS];
+  size_t i, f;
+
+  codegen_messages_init(&messages);
+
+  for (i = 0; i < CODEGEN_N_MESSAGES; i++) {
+    for (f = 0; f < CODEGEN_N_FLAGS; f++) {
+      generic_json[i][f] = NULL;
+      ASSERT_ZERO(protobuf2json_buffer(messages.all[i], codegen_json_flags[f], &generic_json[i][f], NULL, NULL, 0));
+    }
+  }
+
+  codegen_register();
+
+  for (i = 0; i < CODEGEN_N_MESSAGES; i++) {
+    for (f = 0; f < CODEGEN_N_FLAGS; f++) {
+      char *json_buffer = NULL;
+      size_t json_length = 0;
+      ASSERT_ZERO(protobuf2json_buffer(messages.all[i], codegen_json_flags[f], &json_buffer, &json_length, NULL, 0));
+
+      ASSERT_STRCMP(
+        json_buffer,
+        generic_json[i][f]
+      );
+
+      size_t encoded_size = 0;
+      ASSERT_ZERO(protobuf2json_encoded_size(messages.all[i], codegen_json_flags[f], &encoded_size, NULL, 0));
+      ASSERT(encoded_size == json_length);
+
+      free(json_buffer);
+      free(generic_json[i][f]);
+    }
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(codegen__decode) {
+  codegen_messages_t messages;
+  char error_string[256] = {0};
+  size_t i;
+
+  codegen_messages_init(&messages);
+
+  codegen_register();
+
+  /* Keys are resolved by generated code, output of decoded message should be the same */
+  for (i = 0; i < CODEGEN_N_MESSAGES; i++) {
+    char *json_buffer = NULL;
+    size_t json_length = 0;
+    ASSERT_ZERO(protobuf2json_buffer(messages.all[i], TEST_JSON_FLAGS, &json_buffer, &json_length, NULL, 0));
+
+    ProtobufCMessage *protobuf_message = NULL;
+    ASSERT_ZERO(json2protobuf_buffer(json_buffer, json_length, 0, messages.all[i]->descriptor, &protobuf_message, NULL, 0));
+
+    char *decoded_json_buffer = NULL;
+    ASSERT_ZERO(protobuf2json_buffer(protobuf_message, TEST_JSON_FLAGS, &decoded_json_buffer, NULL, NULL, 0));
+
+    ASSERT_STRCMP(
+      decoded_json_buffer,
+      json_buffer
+    );
+
+    free(decoded_json_buffer);
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+    free(json_buffer);
+  }
+
+  /* Unknown keys, including ones of the same length as known */
+  const char *json_strings[] = {
+    "{\"name\":\"John\",\"id\":1,\"mail\":\"x\"}",
+    "{\"name\":\"John\",\"id\":1,\"emai\\u006c\":\"x\",\"phona\":[]}",
+  };
+  const char *expected_error_strings[] = {
+    "Unknown field 'mail' for message 'Foo.Person'",
+    "Unknown field 'phona' for message 'Foo.Person'",
+  };
+
+  for (i = 0; i < sizeof(json_strings) / sizeof(json_strings[0]); i++) {
+    ProtobufCMessage *protobuf_message = NULL;
+    int result = json2protobuf_buffer((char *)json_strings[i], strlen(json_strings[i]), 0, &foo__person__descriptor, &protobuf_message, error_string, sizeof(error_string));
+    ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_FIELD);
+
+    ASSERT_STRCMP(
+      error_string,
+      expected_error_strings[i]
+    );
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(codegen__decode_same_as_string) {
+  const char *person_json_strings[] = {
+    "{}",
+    "{ \"name\" : \"John\" , \"id\" : 1 }",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\"},{\"number\":\"2\",\"type\":\"WORK\"}]}",
+    "{\"name\":\"John\",\"id\":1,\"name\":\"Jane\",\"id\":2}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\"}],\"phone\":[{\"number\":\"2\"}]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\",\"type\":\"HOME\",\"type\":\"WORK\"}]}",
+    "{\"name\":\"John\"}",
+    "{\"id\":1}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{}]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\"},]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\"} {\"number\":\"2\"}]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\",\"type\":\"BAD\"}]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"1\",\"kind\":1}]}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":{}}",
+    "{\"name\":\"John\",\"id\":1,\"phone\":[",
+    "{\"name\":\"John\",\"id\":\"1\"}",
+    "{\"name\":1,\"id\":1}",
+    "{\"name\" \"John\"}",
+    "{\"name\":\"John\" \"id\":1}",
+    "{\"name\":\"John\",}",
+    "{\"name\":\"John\",\"id\":1}}",
+    "{\"na\\u0000me\":\"John\"}",
+  };
+
+  const char *bar_json_strings[] = {
+    "{\"string_required\":\"a\"}",
+    "{\"string_required\":\"a\",\"string_required_default\":\"b\",\"string_optional\":\"c\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"AAEC\\/w==\",\"enum_optional\":\"BUZZ\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"\",\"enum_optional_default\":\"FIZZ\"}",
+    "{\"string_required\":\"a\",\"enum_optional\":\"FIZZ\",\"enum_optional\":\"BUZZ\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"QUJD\",\"bytes_optional\":\"REVG\"}",
+    "{\"string_required\":\"a\",\"enum_optional\":\"NOPE\"}",
+    "{\"string_required\":\"a\",\"enum_optional\":3}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"QU@D\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":[]}",
+    "{\"string_optional\":\"a\"}",
+  };
+
+  const char *repeated_values_json_strings[] = {
+    "{\"value_int32\":[1,-2147483648,2147483647],\"value_uint64\":[4294967296],\"value_float\":[0.5,-1],\"value_bool\":[true,false]}",
+    "{\"value_enum\":[\"FIZZ\",\"BUZZ\"],\"value_string\":[\"a\",\"\\n\"],\"value_bytes\":[\"QUJD\",\"\"]}",
+    "{\"value_int32\":[1],\"value_int32\":[2,3]}",
+    "{\"value_message\":[{\"name\":\"a\",\"id\":1}],\"value_message\":[]}",
+    "{\"value_int32\":[1,]}",
+    "{\"value_int32\":[1 2]}",
+    "{\"value_int32\":[1.5]}",
+    "{\"value_int32\":1}",
+    "{\"value_int32\":[2147483648]}",
+    "{\"value_sfixed32\":[-99999999999]}",
+    "{\"value_uint32\":[-1]}",
+    "{\"value_fixed64\":[-9223372036854775808]}",
+    "{\"value_sint64\":[9223372036854775808]}",
+    "{\"value_double\":[\"1\"]}",
+    "{\"value_bool\":[1]}",
+    "{\"value_enum\":[\"FIZZ\",1]}",
+    "{\"value_string\":[\"a\",1]}",
+    "{\"value_bytes\":[\"QUJD\",\"QUJ@\"]}",
+    "{\"value_message\":[1]}",
+    "{\"value_message\":[{\"name\":\"a\",\"id\":1},{\"id\":2}]}",
+    "{\"value_message\":[{\"name\":\"a\",\"id\":1,\"phone\":[{\"number\":\"x\",\"type\":\"BAD\"}]}]}",
+  };
+
+  const char *something_json_strings[] = {
+    "{}",
+    "{\"oneof_string\":\"a\"}",
+    "{\"oneof_bytes\":\"QUJD\"}",
+    "{\"oneof_string\":1}",
+    "{\"oneof_bytes\":\"QUJ@\"}",
+  };
+
+  size_t json_flags[] = { 0, JSON_REJECT_DUPLICATES };
+  size_t i, f;
+
+  codegen_register();
+
+  for (f = 0; f < sizeof(json_flags) / sizeof(json_flags[0]); f++) {
+    for (i = 0; i < sizeof(person_json_strings) / sizeof(person_json_strings[0]); i++) {
+      codegen_assert_decode_equals_string(&foo__person__descriptor, person_json_strings[i], json_flags[f]);
+    }
+
+    for (i = 0; i < sizeof(bar_json_strings) / sizeof(bar_json_strings[0]); i++) {
+      codegen_assert_decode_equals_string(&foo__bar__descriptor, bar_json_strings[i], json_flags[f]);
+    }
+
+    for (i = 0; i < sizeof(repeated_values_json_strings) / sizeof(repeated_values_json_strings[0]); i++) {
+      codegen_assert_decode_equals_string(&foo__repeated_values__descriptor, repeated_values_json_strings[i], json_flags[f]);
+    }
+
+    for (i = 0; i < sizeof(something_json_strings) / sizeof(something_json_strings[0]); i++) {
+      codegen_assert_decode_equals_string(&foo__something__descriptor, something_json_strings[i], json_flags[f]);
+    }
+  }
+
+  /* Oneof members replace each other, the last one wins */
+  const char *oneof_json_strings[] = {
+    "{\"oneof_string\":\"a\",\"oneof_bytes\":\"QUJD\"}",
+    "{\"oneof_bytes\":\"QUJD\",\"oneof_string\":\"a\"}",
+    "{\"oneof_string\":\"a\",\"oneof_string\":\"b\"}",
+  };
+  const char *expected_oneof_json_strings[] = {
+    "{\"oneof_bytes\":\"QUJD\"}",
+    "{\"oneof_string\":\"a\"}",
+    "{\"oneof_string\":\"b\"}",
+  };
+
+  for (i = 0; i < sizeof(oneof_json_strings) / sizeof(oneof_json_strings[0]); i++) {
+    ProtobufCMessage *protobuf_message = NULL;
+    ASSERT_ZERO(json2protobuf_buffer((char *)oneof_json_strings[i], strlen(oneof_json_strings[i]), 0, &foo__something__descriptor, &protobuf_message, NULL, 0));
+
+    char *json_buffer = NULL;
+    ASSERT_ZERO(protobuf2json_buffer(protobuf_message, JSON_COMPACT, &json_buffer, NULL, NULL, 0));
+
+    ASSERT_STRCMP(
+      json_buffer,
+      expected_oneof_json_strings[i]
+    );
+
+    free(json_buffer);
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(codegen__errors) {
+  int result;
+  char error_string[256] = {0};
+
+  codegen_register();
+
+  Foo__Bar bar = FOO__BAR__INIT;
+
+  char *json_buffer = NULL;
+  result = protobuf2json_buffer(&bar.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot dump NULL string value of field 'string_required'"
+  );
+
+  bar.string_required = "required";
+  bar.has_enum_optional = 1;
+  bar.enum_optional = 777;
+
+  result = protobuf2json_buffer(&bar.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Unknown value 777 for enum 'Foo.FizzBuzzType'"
+  );
+
+  Foo__Person__PhoneNumber *person_phonenumbers[1] = { NULL };
+
+  Foo__Person person = FOO__PERSON__INIT;
+  person.name = "John";
+  person.n_phone = 1;
+  person.phone = person_phonenumbers;
+
+  result = protobuf2json_buffer(&person.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot dump NULL message value of field 'phone'"
+  );
+
+  /* Registering the same codecs again changes nothing */
+  codegen_register();
+
+  RETURN_OK();
+}
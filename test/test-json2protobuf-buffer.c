@@ -0,0 +1,808 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+/* json2protobuf_buffer() should produce exactly what json2protobuf_string() does, including errors */
+static void assert_buffer_equals_string(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *json_string,
+  size_t json_flags
+) {
+  int result_string, result_buffer;
+  char error_string_string[256] = {0};
+  char error_string_buffer[256] = {0};
+
+  ProtobufCMessage *protobuf_message_string = NULL;
+  result_string = json2protobuf_string((char *)json_string, json_flags, protobuf_message_descriptor, &protobuf_message_string, error_string_string, sizeof(error_string_string));
+
+  ProtobufCMessage *protobuf_message_buffer = NULL;
+  result_buffer = json2protobuf_buffer((char *)json_string, strlen(json_string), json_flags, protobuf_message_descriptor, &protobuf_message_buffer, error_string_buffer, sizeof(error_string_buffer));
+
+  ASSERT_EQUALS(result_buffer, result_string);
+  ASSERT_STRCMP(
+    error_string_buffer,
+    error_string_string
+  );
+
+  if (result_string) {
+    ASSERT(!protobuf_message_buffer);
+    return;
+  }
+
+  char *json_string_string = NULL;
+  ASSERT_ZERO(protobuf2json_string(protobuf_message_string, TEST_JSON_FLAGS, &json_string_string, NULL, 0));
+
+  char *json_string_buffer = NULL;
+  ASSERT_ZERO(protobuf2json_string(protobuf_message_buffer, TEST_JSON_FLAGS, &json_string_buffer, NULL, 0));
+
+  ASSERT_STRCMP(
+    json_string_buffer,
+    json_string_string
+  );
+
+  protobuf_c_message_free_unpacked(protobuf_message_string, NULL);
+  protobuf_c_message_free_unpacked(protobuf_message_buffer, NULL);
+  free(json_string_string);
+  free(json_string_buffer);
+}
+
+TEST_IMPL(json2protobuf_buffer__same_as_string) {
+  assert_buffer_equals_string(
+    &foo__person__descriptor,
+    "{\n"
+    "  \"name\": \"John \\\"Doe\\\" \\u0414\\ud83d\\ude00 \\/\\b\\f\\n\\r\\t\",\n"
+    "  \"id\": -42,\n"
+    "  \"email\": \"john@doe.name\",\n"
+    "  \"phone\": [\n"
+    "    { \"number\": \"+123456789\", \"type\": \"WORK\" },\n"
+    "    { \"number\": \"+987654321\" }\n"
+    "  ]\n"
+    "}",
+    0
+  );
+
+  assert_buffer_equals_string(
+    &foo__bar__descriptor,
+    "{\"string_required\":\"required\",\"bytes_optional\":\"AAEC\\/w==\",\"enum_optional\":\"BUZZ\"}",
+    0
+  );
+
+  assert_buffer_equals_string(
+    &foo__repeated_values__descriptor,
+    "{"
+      "\"value_int32\":[1,-2147483648,2147483647],"
+      "\"value_sint32\":[0],"
+      "\"value_sfixed32\":[-1],"
+      "\"value_uint32\":[4294967295],"
+      "\"value_fixed32\":[0,1,2,3,4,5,6,7,8,9],"
+      "\"value_int64\":[9223372036854775807,-9223372036854775808],"
+      "\"value_sint64\":[-1],"
+      "\"value_sfixed64\":[1],"
+      "\"value_uint64\":[1],"
+      "\"value_fixed64\":[2],"
+      "\"value_float\":[1,0.5,1e10,-1.5E-3],"
+      "\"value_double\":[0.1,1e308,5e-324,-0.0],"
+      "\"value_bool\":[true,false],"
+      "\"value_enum\":[\"FIZZ\",\"BUZZ\"],"
+      "\"value_string\":[\"a\",\"\",\"\\u0001\"],"
+      "\"value_bytes\":[\"\",\"YQ==\"],"
+      "\"value_message\":[{\"name\":\"a\",\"id\":1},{\"name\":\"b\",\"id\":2,\"phone\":[]}]"
+    "}",
+    0
+  );
+
+  assert_buffer_equals_string(&foo__repeated_values__descriptor, "{\"value_int32\":[],\"value_message\":[]}", 0);
+  assert_buffer_equals_string(&foo__something__descriptor, " {\"oneof_bytes\":\"YQ==\"}\n", 0);
+  assert_buffer_equals_string(&foo__something__descriptor, "{\"oneof_string\":\"a\\u0000b\"}", JSON_ALLOW_NUL);
+  assert_buffer_equals_string(&foo__something__descriptor, "{} x", JSON_DISABLE_EOF_CHECK);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__errors_same_as_string) {
+  const char *bar_json_strings[] = {
+    "",
+    "...",
+    "[]",
+    "42",
+    "{",
+    "{\"string_required\"",
+    "{\"string_required\":",
+    "{\"string_required\":\"a",
+    "{\"string_required\" \"a\"}",
+    "{\"string_required\":\"a\" \"string_optional\":\"b\"}",
+    "{\"string_required\":\"a\",}",
+    "{\"string_required\":\"a\\q\"}",
+    "{\"string_required\":\"a\\u00\"}",
+    "{\"string_required\":\"a\\ud800\"}",
+    "{\"string_required\":\"a\\ud800\\u0041\"}",
+    "{\"string_required\":\"a\\udc00\"}",
+    "{\"string_required\":\"a\\u0000\"}",
+    "{\"string_required\":\"a\tb\"}",
+    "{\"string_required\":\"a\xc0\xaf\"}",
+    "{\"string_required\":tru}",
+    "{\"string_required\":null}",
+    "{\"string_required\":@}",
+    "{\"string\\u0000required\":\"a\"}",
+    "{\"string_required\":\"a\",\"unknown\":1}",
+    "{\"string_required\":\"a\",\"enum_optional\":\"NOPE\"}",
+    "{\"string_required\":\"a\",\"enum_optional\":3}",
+    "{\"string_required\":\"a\",\"bytes_optional\":[]}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"Q\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"QU@D\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"QUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQU@D\"}",
+    "{\"string_optional\":\"a\"}",
+    "{\"string_required\":\"a\"} x",
+    "{\"string_required\":\"a\"}}",
+  };
+
+  const char *repeated_values_json_strings[] = {
+    "{\"value_int32\":[1,]}",
+    "{\"value_int32\":[1 2]}",
+    "{\"value_int32\":[01]}",
+    "{\"value_int32\":[-]}",
+    "{\"value_int32\":[1.]}",
+    "{\"value_int32\":[1e]}",
+    "{\"value_int32\":[1.5]}",
+    "{\"value_int32\":{}}",
+    "{\"value_int32\":1}",
+    "{\"value_int64\":[99999999999999999999]}",
+    "{\"value_int64\":[-99999999999999999999]}",
+    "{\"value_int32\":[2147483648]}",
+    "{\"value_int32\":[-2147483649]}",
+    "{\"value_sfixed32\":[-99999999999]}",
+    "{\"value_uint32\":[4294967296]}",
+    "{\"value_uint32\":[-1]}",
+    "{\"value_uint64\":[-1]}",
+    "{\"value_fixed64\":[-9223372036854775808]}",
+    "{\"value_int64\":[9223372036854775808]}",
+    "{\"value_int64\":[-9223372036854775809]}",
+    "{\"value_double\":[1e999]}",
+    "{\"value_double\":[-1e999]}",
+    "{\"value_double\":[\"1\"]}",
+    "{\"value_bool\":[1]}",
+    "{\"value_enum\":[1]}",
+    "{\"value_string\":[\"a\",1]}",
+    "{\"value_bytes\":[1]}",
+    "{\"value_bytes\":[\"QUJD\",\"QUJ@\"]}",
+    "{\"value_message\":[1]}",
+    "{\"value_message\":[{\"name\":\"a\"}]}",
+    "{\"value_message\":[{\"name\":\"a\",\"id\":1},{\"id\":2}]}",
+    "{\"value_message\":[{\"name\":\"a\",\"id\":1,\"phone\":[{\"number\":\"x\",\"type\":\"BAD\"}]}]}",
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(bar_json_strings) / sizeof(bar_json_strings[0]); i++) {
+    assert_buffer_equals_string(&foo__bar__descriptor, bar_json_strings[i], 0);
+  }
+
+  for (i = 0; i < sizeof(repeated_values_json_strings) / sizeof(repeated_values_json_strings[0]); i++) {
+    assert_buffer_equals_string(&foo__repeated_values__descriptor, repeated_values_json_strings[i], 0);
+  }
+
+  assert_buffer_equals_string(&foo__bar__descriptor, "42", JSON_DECODE_ANY);
+  assert_buffer_equals_string(&foo__repeated_values__descriptor, "{\"value_int32\":[1]}", JSON_DECODE_INT_AS_REAL);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__duplicate_field_last_wins) {
+  int result;
+
+  const char *initial_json_string = \
+    "{\n"
+    "  \"name\": \"John Doe\",\n"
+    "  \"id\": 42,\n"
+    "  \"phone\": [{\"number\": \"+123456789\"}],\n"
+    "  \"name\": \"Jack Impostor\",\n"
+    "  \"phone\": []\n"
+    "}"
+  ;
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer((char *)initial_json_string, strlen(initial_json_string), 0, &foo__person__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  Foo__Person *person = (Foo__Person *)protobuf_message;
+
+  ASSERT_STRCMP(person->name, "Jack Impostor");
+  ASSERT_EQUALS(person->id, 42);
+  ASSERT_EQUALS((int)person->n_phone, 0);
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+  /* Oneof members share memory, the last one in input wins */
+  const char *oneof_json_string = \
+    "{\"oneof_string\": \"hello\", \"oneof_bytes\": \"d29ybGQ=\", \"oneof_string\": \"again\"}"
+  ;
+
+  result = json2protobuf_buffer((char *)oneof_json_string, strlen(oneof_json_string), 0, &foo__something__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  Foo__Something *something = (Foo__Something *)protobuf_message;
+
+  ASSERT_EQUALS(something->something_case, FOO__SOMETHING__SOMETHING_ONEOF_STRING);
+  ASSERT_STRCMP(something->oneof_string, "again");
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__error_duplicate_field) {
+  int result;
+  char error_string[256] = {0};
+
+  const char *initial_json_string = \
+    "{\n"
+    "  \"name\": \"John Doe\",\n"
+    "  \"id\": 42,\n"
+    "  \"name\": \"Jack Impostor\"\n"
+    "}"
+  ;
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer((char *)initial_json_string, strlen(initial_json_string), JSON_REJECT_DUPLICATES, &foo__person__descriptor, &protobuf_message, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING);
+  ASSERT(!protobuf_message);
+
+  const char *expected_error_string = \
+    "JSON parsing error at line 4 column 8 (position 44): "
+    "duplicate object key near '\"name\"'"
+  ;
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__not_nul_terminated) {
+  int result;
+
+  const char *initial_json_string = "{\"oneof_string\": \"hello\"}{\"oneof_string\": \"world\"}";
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer((char *)initial_json_string, strlen(initial_json_string) / 2, 0, &foo__something__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  Foo__Something *something = (Foo__Something *)protobuf_message;
+
+  ASSERT_EQUALS(something->something_case, FOO__SOMETHING__SOMETHING_ONEOF_STRING);
+  ASSERT_STRCMP(something->oneof_string, "hello");
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__numbers) {
+  assert_buffer_equals_string(
+    &foo__repeated_values__descriptor,
+    "{"
+      "\"value_int32\":[0,-0,7,12345678,-123456789,1234567890,-2147483648,2147483647],"
+      "\"value_uint32\":[0,-0,99999999,100000000,4294967295],"
+      "\"value_int64\":[1234567812345678,-1234567812345678,999999999999999999,-9223372036854775808],"
+      "\"value_uint64\":[12345678123456781,9223372036854775807],"
+      "\"value_float\":[3.4028235e38,1.17549435e-38,1e-46,16777217],"
+      "\"value_double\":["
+        "0,-0,1.5e-0,0.000001,-0.0000001,123.456e-2,1E+22,1e23,9007199254740993,"
+        "12345678901234567890,0.1234567890123456789012,123456789012345678901234567890e-10,"
+        "2.2250738585072011e-308,1.7976931348623157e308,4.9406564584124654e-324,1e-400,"
+        "-9223372036854775808,18446744073709551616"
+      "]"
+    "}",
+    0
+  );
+
+  assert_buffer_equals_string(
+    &foo__repeated_values__descriptor,
+    "{\"value_double\":[1,-1,12345678901234567,-0],\"value_float\":[-3]}",
+    JSON_DECODE_INT_AS_REAL
+  );
+
+  /* Unlike jansson, the whole range of unsigned 64-bit integers is supported */
+  const char *json_string = "{\"value_uint64\":[18446744073709551615,9223372036854775808],\"value_fixed64\":[10000000000000000000]}";
+
+  ProtobufCMessage *protobuf_message = NULL;
+  ASSERT_ZERO(json2protobuf_buffer((char *)json_string, strlen(json_string), 0, &foo__repeated_values__descriptor, &protobuf_message, NULL, 0));
+
+  Foo__RepeatedValues *repeated_values = (Foo__RepeatedValues *)protobuf_message;
+
+  ASSERT_EQUALS((int)repeated_values->n_value_uint64, 2);
+  ASSERT(repeated_values->value_uint64[0] == UINT64_MAX);
+  ASSERT(repeated_values->value_uint64[1] == (uint64_t)INT64_MAX + 1);
+  ASSERT_EQUALS((int)repeated_values->n_value_fixed64, 1);
+  ASSERT(repeated_values->value_fixed64[0] == UINT64_C(10000000000000000000));
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+  char error_string[256] = {0};
+  json_string = "{\"value_uint64\":[18446744073709551616]}";
+
+  ASSERT_EQUALS(
+    json2protobuf_buffer((char *)json_string, strlen(json_string), 0, &foo__repeated_values__descriptor, &protobuf_message, error_string, sizeof(error_string)),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING
+  );
+
+  RETURN_OK();
+}
+
+/* Byte offsets next to 16-byte SSE and 32-byte AVX2 block boundaries */
+static int long_strings_near_block_boundary(size_t offset) {
+  return (offset + 3) % 16 < 6;
+}
+
+/* Strings longer than vector blocks ending, and having special or invalid bytes, around block boundaries */
+TEST_IMPL(json2protobuf_buffer__long_strings) {
+  const char *texts[] = {"a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80"};
+  const char *specials[] = {
+    "\\n", "\\u00e9", "\\ud83d\\ude00", "\\\"", "\x01", "\xff", "\x80", "\xc0\xaf", "\xe2\x82", "\xed\xa0\x80", "\xf4\x90\x80\x80"
+  };
+
+  char json_string[512];
+  size_t t, k, length, position;
+
+  for (t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+    size_t text_length = strlen(texts[t]);
+
+    for (k = 0; k < sizeof(specials) / sizeof(specials[0]); k++) {
+      for (length = 1; length <= 70; length++) {
+        if (!long_strings_near_block_boundary(length * text_length)) {
+          continue;
+        }
+
+        for (position = 0; position < length; position++) {
+          char *p = json_string;
+          size_t i;
+
+          if (!long_strings_near_block_boundary(position * text_length) && position + 1 != length) {
+            continue;
+          }
+
+          p += sprintf(p, "{\"string_required\":\"");
+          for (i = 0; i < length; i++) {
+            p += sprintf(p, "%s", i == position ? specials[k] : texts[t]);
+          }
+          sprintf(p, "\"}");
+
+          assert_buffer_equals_string(&foo__bar__descriptor, json_string, 0);
+        }
+      }
+    }
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__field_lookup) {
+  const ProtobufCMessageDescriptor *protobuf_message_descriptors[] = {
+    &foo__person__descriptor,
+    &foo__person__phone_number__descriptor,
+    &foo__bar__descriptor,
+    &foo__repeated_values__descriptor,
+    &foo__something__descriptor,
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(protobuf_message_descriptors) / sizeof(protobuf_message_descriptors[0]); i++) {
+    const ProtobufCMessageDescriptor *protobuf_message_descriptor = protobuf_message_descriptors[i];
+
+    unsigned int j;
+    for (j = 0; j < protobuf_message_descriptor->n_fields; j++) {
+      const char *name = protobuf_message_descriptor->fields[j].name;
+      char json_string[256];
+      char error_string[256] = {0};
+      ProtobufCMessage *protobuf_message = NULL;
+      int result;
+
+      /* Known field fails on value, not on key */
+      snprintf(json_string, sizeof(json_string), "{\"%s\": null}", name);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptor, &protobuf_message, error_string, sizeof(error_string));
+      ASSERT(result != PROTOBUF2JSON_ERR_UNKNOWN_FIELD);
+      if (!result) {
+        protobuf_c_message_free_unpacked(protobuf_message, NULL);
+      }
+
+      /* Prefix, extension and case change of known field are unknown */
+      snprintf(json_string, sizeof(json_string), "{\"%.*s\": null}", (int)strlen(name) - 1, name);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptor, &protobuf_message, error_string, sizeof(error_string));
+      ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_FIELD);
+
+      snprintf(json_string, sizeof(json_string), "{\"%s_\": null}", name);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptor, &protobuf_message, error_string, sizeof(error_string));
+      ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_FIELD);
+
+      snprintf(json_string, sizeof(json_string), "{\"%c%s\": null}", name[0] - 'a' + 'A', name + 1);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptor, &protobuf_message, error_string, sizeof(error_string));
+      ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_FIELD);
+    }
+  }
+
+  assert_buffer_equals_string(&foo__bar__descriptor, "{\"\": 1}", 0);
+  assert_buffer_equals_string(&foo__bar__descriptor, "{\"string_required\": \"a\", \"string_requiredd\": 1}", 0);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer__enum_lookup) {
+  const ProtobufCEnumDescriptor *protobuf_enum_descriptors[] = {
+    &foo__person__phone_type__descriptor,
+    &foo__fizz_buzz_type__descriptor,
+  };
+
+  const char *json_format_strings[] = {
+    "{\"name\": \"a\", \"id\": 1, \"phone\": [{\"number\": \"1\", \"type\": \"%s\"}]}",
+    "{\"value_enum\": [\"%s\"]}",
+  };
+
+  const ProtobufCMessageDescriptor *protobuf_message_descriptors[] = {
+    &foo__person__descriptor,
+    &foo__repeated_values__descriptor,
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(protobuf_enum_descriptors) / sizeof(protobuf_enum_descriptors[0]); i++) {
+    unsigned int j;
+    for (j = 0; j < protobuf_enum_descriptors[i]->n_values; j++) {
+      const char *name = protobuf_enum_descriptors[i]->values[j].name;
+      char value_string[64];
+      char json_string[256];
+      char error_string[256] = {0};
+      ProtobufCMessage *protobuf_message = NULL;
+      int result;
+
+      snprintf(json_string, sizeof(json_string), json_format_strings[i], name);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptors[i], &protobuf_message, error_string, sizeof(error_string));
+      ASSERT_ZERO(result);
+      protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+      /* Prefix, extension and case change of known name are unknown */
+      snprintf(value_string, sizeof(value_string), "%.*s", (int)strlen(name) - 1, name);
+      snprintf(json_string, sizeof(json_string), json_format_strings[i], value_string);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptors[i], &protobuf_message, error_string, sizeof(error_string));
+      ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+
+      snprintf(value_string, sizeof(value_string), "%s_", name);
+      snprintf(json_string, sizeof(json_string), json_format_strings[i], value_string);
+      result = json2protobuf_buffer(json_string, strlen(json_string), 0, protobuf_message_descriptors[i], &protobuf_message, error_string, sizeof(error_string));
+      ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+
+      snprintf(value_string, sizeof(value_string), "%c%s", name[0] - 'A' + 'a', name + 1);
+      snprintf(json_string, sizeof(json_string), json_format_strings[i], value_string);
+      assert_buffer_equals_string(protobuf_message_descriptors[i], json_string, 0);
+    }
+  }
+
+  assert_buffer_equals_string(&foo__repeated_values__descriptor, "{\"value_enum\": [\"FIZZ\", \"BUZZ\", \"FIZZBUZZ\", \"FIZZ\"]}", 0);
+  assert_buffer_equals_string(&foo__repeated_values__descriptor, "{\"value_enum\": [\"\"]}", 0);
+  assert_buffer_equals_string(&foo__repeated_values__descriptor, "{\"value_enum\": [\"FIZZ\\u0000BUZZ\"]}", JSON_ALLOW_NUL);
+
+  RETURN_OK();
+}
+
+/* More descriptors than fit into caches, the rest are looked up without tables */
+#define MANY_DESCRIPTORS_COUNT 4000
+
+TEST_IMPL(json2protobuf_buffer__many_descriptors) {
+  const char *json_string = "{\"string_required\": \"a\", \"enum_optional\": \"BUZZ\", \"bytes_optional\": \"QUJD\"}";
+  unsigned int n_fields = foo__bar__descriptor.n_fields;
+
+  ProtobufCMessageDescriptor *protobuf_message_descriptors = calloc(MANY_DESCRIPTORS_COUNT, sizeof(ProtobufCMessageDescriptor));
+  ProtobufCEnumDescriptor *protobuf_enum_descriptors = calloc(MANY_DESCRIPTORS_COUNT, sizeof(ProtobufCEnumDescriptor));
+  ProtobufCFieldDescriptor *field_descriptors = calloc(MANY_DESCRIPTORS_COUNT * n_fields, sizeof(ProtobufCFieldDescriptor));
+  ASSERT(protobuf_message_descriptors && protobuf_enum_descriptors && field_descriptors);
+
+  ProtobufCMessage *protobuf_message = NULL;
+  ASSERT_ZERO(json2protobuf_buffer((char *)json_string, strlen(json_string), 0, &foo__bar__descriptor, &protobuf_message, NULL, 0));
+
+  char *expected_json_buffer = NULL;
+  ASSERT_ZERO(protobuf2json_buffer(protobuf_message, TEST_JSON_FLAGS, &expected_json_buffer, NULL, NULL, 0));
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+  size_t i;
+  for (i = 0; i < MANY_DESCRIPTORS_COUNT; i++) {
+    ProtobufCFieldDescriptor *fields = field_descriptors + i * n_fields;
+    unsigned int j;
+
+    /* Same descriptors at other addresses */
+    protobuf_enum_descriptors[i] = foo__fizz_buzz_type__descriptor;
+    memcpy(fields, foo__bar__descriptor.fields, n_fields * sizeof(ProtobufCFieldDescriptor));
+    for (j = 0; j < n_fields; j++) {
+      if (fields[j].type == PROTOBUF_C_TYPE_ENUM) {
+        fields[j].descriptor = &protobuf_enum_descriptors[i];
+      }
+    }
+    protobuf_message_descriptors[i] = foo__bar__descriptor;
+    protobuf_message_descriptors[i].fields = fields;
+
+    char error_string[256] = {0};
+    ASSERT_ZERO(json2protobuf_buffer((char *)json_string, strlen(json_string), 0, &protobuf_message_descriptors[i], &protobuf_message, error_string, sizeof(error_string)));
+
+    const char *unknown_enum_json_string = "{\"string_required\": \"a\", \"enum_optional\": \"BUZ\"}";
+    ASSERT_EQUALS(
+      json2protobuf_buffer((char *)unknown_enum_json_string, strlen(unknown_enum_json_string), 0, &protobuf_message_descriptors[i], &protobuf_message, error_string, sizeof(error_string)),
+      PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE
+    );
+
+    /* Unpacked message gets original descriptor, so it is written with the copy explicitly */
+    protobuf_message->descriptor = &protobuf_message_descriptors[i];
+
+    char *json_buffer = NULL;
+    ASSERT_ZERO(protobuf2json_buffer(protobuf_message, TEST_JSON_FLAGS, &json_buffer, NULL, NULL, 0));
+    ASSERT_STRCMP(json_buffer, expected_json_buffer);
+
+    free(json_buffer);
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  }
+
+  free(expected_json_buffer);
+  free(field_descriptors);
+  free(protobuf_enum_descriptors);
+  free(protobuf_message_descriptors);
+
+  RETURN_OK();
+}
+
+static const char *allocator_json_string = \
+  "{\n"
+  "  \"value_int32\": [1, 2, 3, 4, 5, 6, 7, 8, 9],\n"
+  "  \"value_double\": [0.5, 1e10],\n"
+  "  \"value_string\": [\"qwerty\", \"\\u0444\", \"\"],\n"
+  "  \"value_bytes\": [\"Ynl0ZXM=\", \"\"],\n"
+  "  \"value_enum\": [\"FIZZ\", \"BUZZ\"],\n"
+  "  \"value_message\": [\n"
+  "    {\"name\": \"John\", \"id\": 1, \"phone\": [{\"number\": \"+1\", \"type\": \"WORK\"}, {\"number\": \"+2\"}]},\n"
+  "    {\"name\": \"Doe\", \"id\": 2, \"email\": \"doe@example.com\"}\n"
+  "  ]\n"
+  "}"
+;
+
+typedef struct counting_allocator_data {
+  size_t allocs;
+  size_t frees;
+  size_t fail_after;
+} counting_allocator_data_t;
+
+static void *counting_alloc(void *allocator_data, size_t size) {
+  counting_allocator_data_t *data = allocator_data;
+
+  if (data->fail_after && data->allocs >= data->fail_after) {
+    return NULL;
+  }
+
+  data->allocs++;
+
+  return malloc(size);
+}
+
+static void counting_free(void *allocator_data, void *pointer) {
+  counting_allocator_data_t *data = allocator_data;
+
+  data->frees++;
+
+  free(pointer);
+}
+
+TEST_IMPL(json2protobuf_buffer_allocator__arena) {
+  int result;
+
+  char *expected_json_string = NULL;
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer((char *)allocator_json_string, strlen(allocator_json_string), 0, &foo__repeated_values__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  result = protobuf2json_string(protobuf_message, TEST_JSON_FLAGS, &expected_json_string, NULL, 0);
+  ASSERT_ZERO(result);
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+  protobuf2json_arena_t *arena = protobuf2json_arena_new(0);
+  ASSERT(arena);
+
+  int i;
+  for (i = 0; i < 3; i++) {
+    char *json_string = NULL;
+
+    protobuf_message = NULL;
+    result = json2protobuf_buffer_allocator((char *)allocator_json_string, strlen(allocator_json_string), 0, protobuf2json_arena_allocator(arena), &foo__repeated_values__descriptor, &protobuf_message, NULL, 0);
+    ASSERT_ZERO(result);
+
+    result = protobuf2json_string(protobuf_message, TEST_JSON_FLAGS, &json_string, NULL, 0);
+    ASSERT_ZERO(result);
+
+    ASSERT_STRCMP(
+      json_string,
+      expected_json_string
+    );
+
+    free(json_string);
+
+    /* Should be no-op for arena */
+    protobuf_c_message_free_unpacked(protobuf_message, protobuf2json_arena_allocator(arena));
+
+    protobuf2json_arena_reset(arena);
+  }
+
+  /* Small blocks should spill over and be merged by reset */
+  protobuf2json_arena_free(arena);
+
+  arena = protobuf2json_arena_new(1);
+  ASSERT(arena);
+
+  for (i = 0; i < 3; i++) {
+    protobuf_message = NULL;
+    result = json2protobuf_buffer_allocator((char *)allocator_json_string, strlen(allocator_json_string), 0, protobuf2json_arena_allocator(arena), &foo__repeated_values__descriptor, &protobuf_message, NULL, 0);
+    ASSERT_ZERO(result);
+
+    Foo__RepeatedValues *repeated_values = (Foo__RepeatedValues *)protobuf_message;
+
+    ASSERT(repeated_values->n_value_int32 == 9);
+    ASSERT_EQUALS(repeated_values->value_int32[8], 9);
+    ASSERT(repeated_values->n_value_message == 2);
+    ASSERT_STRCMP(repeated_values->value_message[1]->email, "doe@example.com");
+
+    protobuf2json_arena_reset(arena);
+  }
+
+  protobuf2json_arena_free(arena);
+  free(expected_json_string);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer_allocator__balanced) {
+  int result;
+
+  counting_allocator_data_t allocator_data = { 0, 0, 0 };
+  ProtobufCAllocator allocator = { counting_alloc, counting_free, &allocator_data };
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer_allocator((char *)allocator_json_string, strlen(allocator_json_string), 0, &allocator, &foo__repeated_values__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(allocator_data.allocs > 0);
+  ASSERT(allocator_data.frees == 0);
+
+  protobuf_c_message_free_unpacked(protobuf_message, &allocator);
+
+  ASSERT(allocator_data.frees == allocator_data.allocs);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer_allocator__error_cannot_allocate) {
+  int result;
+  char error_string[256] = {0};
+
+  counting_allocator_data_t allocator_data = { 0, 0, 0 };
+  ProtobufCAllocator allocator = { counting_alloc, counting_free, &allocator_data };
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer_allocator((char *)allocator_json_string, strlen(allocator_json_string), 0, &allocator, &foo__repeated_values__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  protobuf_c_message_free_unpacked(protobuf_message, &allocator);
+
+  size_t allocs_required = allocator_data.allocs;
+
+  /* Every allocation failure should be reported without leaks */
+  size_t fail_after;
+  for (fail_after = 1; fail_after < allocs_required; fail_after++) {
+    allocator_data.allocs = 0;
+    allocator_data.frees = 0;
+    allocator_data.fail_after = fail_after;
+
+    protobuf_message = NULL;
+    result = json2protobuf_buffer_allocator((char *)allocator_json_string, strlen(allocator_json_string), 0, &allocator, &foo__repeated_values__descriptor, &protobuf_message, error_string, sizeof(error_string));
+    ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_ALLOCATE_MEMORY);
+    ASSERT(!protobuf_message);
+    ASSERT(allocator_data.frees == allocator_data.allocs);
+
+    ASSERT(!strncmp(error_string, "Cannot allocate ", strlen("Cannot allocate ")));
+    ASSERT(strstr(error_string, " bytes using allocator"));
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer_insitu__strings_in_place) {
+  int result;
+
+  char json_buffer[] = \
+    "{\n"
+    "  \"name\": \"John Doe\",\n"
+    "  \"id\": 42,\n"
+    "  \"email\": \"john\\u0040doe.name\",\n"
+    "  \"phone\": [{\"number\": \"+123456789\"}, {\"number\": \"\"}]\n"
+    "}"
+  ;
+  size_t json_length = strlen(json_buffer);
+
+  protobuf2json_arena_t *arena = protobuf2json_arena_new(0);
+  ASSERT(arena);
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer_insitu(json_buffer, json_length, 0, arena, &foo__person__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  Foo__Person *person = (Foo__Person *)protobuf_message;
+
+  ASSERT_STRCMP(person->name, "John Doe");
+  ASSERT_STRCMP(person->email, "john@doe.name");
+  ASSERT(person->n_phone == 2);
+  ASSERT_STRCMP(person->phone[0]->number, "+123456789");
+  ASSERT_STRCMP(person->phone[1]->number, "");
+
+  /* Strings without escapes point into the input, others are copied */
+  ASSERT(person->name > json_buffer && person->name < json_buffer + json_length);
+  ASSERT(person->phone[0]->number > json_buffer && person->phone[0]->number < json_buffer + json_length);
+  ASSERT(!(person->email >= json_buffer && person->email < json_buffer + json_length));
+
+  char *json_string = NULL;
+  result = protobuf2json_string(protobuf_message, JSON_COMPACT, &json_string, NULL, 0);
+  ASSERT_ZERO(result);
+
+  ASSERT_STRCMP(
+    json_string,
+    "{\"name\":\"John Doe\",\"id\":42,\"email\":\"john@doe.name\",\"phone\":[{\"number\":\"+123456789\",\"type\":\"HOME\"},{\"number\":\"\",\"type\":\"HOME\"}]}"
+  );
+
+  free(json_string);
+
+  protobuf2json_arena_free(arena);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_buffer_insitu__error) {
+  int result;
+  char error_string[256] = {0};
+
+  char json_buffer[] = "{\"name\": \"John Doe\", \"id\": \"42\"}";
+
+  protobuf2json_arena_t *arena = protobuf2json_arena_new(0);
+  ASSERT(arena);
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_buffer_insitu(json_buffer, strlen(json_buffer), 0, arena, &foo__person__descriptor, &protobuf_message, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_IS_NOT_INTEGER);
+  ASSERT(!protobuf_message);
+
+  ASSERT_STRCMP(
+    error_string,
+    "JSON value is not an integer required for GPB int32"
+  );
+
+  char bytes_json_buffer[] = "{\"string_required\": \"a\", \"bytes_optional\": \"QUJ@\"}";
+
+  result = json2protobuf_buffer_insitu(bytes_json_buffer, strlen(bytes_json_buffer), 0, arena, &foo__bar__descriptor, &protobuf_message, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_IS_NOT_BASE64);
+  ASSERT(!protobuf_message);
+
+  ASSERT_STRCMP(
+    error_string,
+    "JSON string is not base64 required for GPB bytes"
+  );
+
+  protobuf2json_arena_free(arena);
+
+  RETURN_OK();
+}
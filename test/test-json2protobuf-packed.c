@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+/* json2protobuf_to_packed() should produce exactly what json2protobuf_buffer() and protobuf_c_message_pack() do, including errors */
+static void assert_packed_equals_buffer(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *json_string,
+  size_t json_flags
+) {
+  int result_buffer, result_packed;
+  char error_string_buffer[256] = {0};
+  char error_string_packed[256] = {0};
+
+  ProtobufCMessage *protobuf_message = NULL;
+  result_buffer = json2protobuf_buffer((char *)json_string, strlen(json_string), json_flags, protobuf_message_descriptor, &protobuf_message, error_string_buffer, sizeof(error_string_buffer));
+
+  uint8_t *packed_buffer = NULL;
+  size_t packed_length = 0;
+  result_packed = json2protobuf_to_packed((char *)json_string, strlen(json_string), json_flags, protobuf_message_descriptor, &packed_buffer, &packed_length, error_string_packed, sizeof(error_string_packed));
+
+  ASSERT_EQUALS(result_packed, result_buffer);
+  ASSERT_STRCMP(
+    error_string_packed,
+    error_string_buffer
+  );
+
+  if (result_buffer) {
+    ASSERT(!packed_buffer);
+    return;
+  }
+
+  size_t expected_length = protobuf_c_message_get_packed_size(protobuf_message);
+  uint8_t *expected_buffer = malloc(expected_length + 1);
+  ASSERT(expected_buffer);
+  ASSERT(protobuf_c_message_pack(protobuf_message, expected_buffer) == expected_length);
+
+  ASSERT(packed_length == expected_length);
+  ASSERT_ZERO(memcmp(packed_buffer, expected_buffer, expected_length));
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  free(expected_buffer);
+  free(packed_buffer);
+}
+
+static void assert_packed_bytes(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const char *json_string,
+  const char *expected_bytes,
+  size_t expected_length
+) {
+  uint8_t *packed_buffer = NULL;
+  size_t packed_length = 0;
+  int result = json2protobuf_to_packed((char *)json_string, strlen(json_string), 0, protobuf_message_descriptor, &packed_buffer, &packed_length, NULL, 0);
+  ASSERT_ZERO(result);
+
+  ASSERT(packed_length == expected_length);
+  ASSERT_ZERO(memcmp(packed_buffer, expected_bytes, expected_length));
+
+  free(packed_buffer);
+}
+
+#define PACKED_BYTES(bytes) bytes, sizeof(bytes) - 1
+
+TEST_IMPL(json2protobuf_packed__same_as_pack) {
+  static const struct {
+    const ProtobufCMessageDescriptor *descriptor;
+    const char *json_string;
+  } messages[] = {
+    { &foo__person__descriptor, "{\"name\":\"John \\\"Doe\\\" \\u0414\\ud83d\\ude00 \\/\",\"id\":-42,\"email\":\"john@doe.name\"}" },
+    { &foo__person__descriptor, "{\"name\":\"John\",\"id\":42,\"phone\":[{\"number\":\"+123\",\"type\":\"WORK\"},{\"number\":\"+456\"}]}" },
+    { &foo__person__descriptor, "{\"name\":\"\",\"id\":0,\"phone\":[]}" },
+    { &foo__bar__descriptor, "{\"string_required\":\"required\",\"bytes_optional\":\"//79/A==\",\"enum_optional\":\"BUZZ\"}" },
+    { &foo__bar__descriptor, "{\"string_required\":\"\",\"string_required_default\":\"\",\"string_optional_default\":\"\",\"bytes_optional_default\":\"\"}" },
+    {
+      &foo__repeated_values__descriptor,
+      "{\"value_int32\":[2147483647,-2147483648,0],\"value_sint32\":[-1,1],\"value_sfixed32\":[-2147483648],"
+      "\"value_uint32\":[4294967295],\"value_fixed32\":[4294967295,0],\"value_int64\":[9223372036854775807,-1],"
+      "\"value_sint64\":[-9223372036854775808],\"value_sfixed64\":[-9223372036854775808],\"value_uint64\":[18446744073709551615],"
+      "\"value_fixed64\":[9223372036854775807],\"value_float\":[0.33,-1.5e-7],\"value_double\":[0.0077705550333011103,1e21],"
+      "\"value_bool\":[true,false],\"value_enum\":[\"FIZZ\",\"FIZZBUZZ\"],\"value_string\":[\"\",\"qwerty\"],"
+      "\"value_bytes\":[\"\",\"Pw==\"],\"value_message\":[{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"+1\"}]},{\"name\":\"\",\"id\":0}]}"
+    },
+    { &foo__something__descriptor, "{}" },
+    { &foo__something__descriptor, "{\"oneof_string\":\"\"}" },
+    { &foo__something__descriptor, "{\"oneof_bytes\":\"AQID\"}" },
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+    assert_packed_equals_buffer(messages[i].descriptor, messages[i].json_string, 0);
+  }
+
+  /* Strings are cut at NUL the same way */
+  assert_packed_equals_buffer(&foo__person__descriptor, "{\"name\":\"a\\u0000b\",\"id\":1}", JSON_ALLOW_NUL);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_packed__field_order) {
+  /* Keys out of declaration order and repeated keys are packed the way decoded message is */
+  assert_packed_equals_buffer(&foo__person__descriptor, "{\"phone\":[{\"type\":\"WORK\",\"number\":\"+1\"}],\"email\":\"e\",\"id\":1,\"name\":\"a\"}", 0);
+  assert_packed_equals_buffer(&foo__person__descriptor, "{\"id\":1,\"name\":\"a\",\"id\":2,\"phone\":[{\"number\":\"+1\"}],\"phone\":[]}", 0);
+  assert_packed_equals_buffer(&foo__person__descriptor, "{\"name\":\"aaaaaaaa\",\"id\":1,\"name\":\"b\"}", 0);
+  assert_packed_equals_buffer(&foo__something__descriptor, "{\"oneof_string\":\"a\",\"oneof_bytes\":\"AA==\"}", 0);
+  assert_packed_equals_buffer(&foo__something__descriptor, "{\"oneof_bytes\":\"AA==\",\"oneof_string\":\"a\",\"oneof_string\":\"b\"}", 0);
+
+  assert_packed_bytes(
+    &foo__person__descriptor,
+    "{\"id\":1,\"name\":\"a\",\"id\":2}",
+    PACKED_BYTES("\x0a\x01" "a" "\x10\x02")
+  );
+
+  assert_packed_bytes(
+    &foo__something__descriptor,
+    "{\"oneof_string\":\"a\",\"oneof_bytes\":\"AA==\"}",
+    PACKED_BYTES("\xb2\x01\x01\x00")
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_packed__long_values) {
+  char json_string[1024];
+  char name[201];
+
+  /* Length prefix of nested message takes two bytes */
+  memset(name, 'x', sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+
+  snprintf(json_string, sizeof(json_string), "{\"value_message\":[{\"id\":1,\"name\":\"%s\"},{\"name\":\"\",\"id\":2}],\"value_int32\":[1]}", name);
+  assert_packed_equals_buffer(&foo__repeated_values__descriptor, json_string, 0);
+
+  /* 172 base64 characters may take 129 bytes, but decode to 127, so length prefix is shorter than reserved */
+  char bytes[173];
+  memset(bytes, 'A', sizeof(bytes) - 1);
+  memcpy(bytes + sizeof(bytes) - 3, "==", 3);
+
+  snprintf(json_string, sizeof(json_string), "{\"value_bytes\":[\"%s\",\"%s\"]}", bytes, bytes);
+  assert_packed_equals_buffer(&foo__repeated_values__descriptor, json_string, 0);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_packed__packed_repeated) {
+  /*
+   * test.proto has no packed fields, so the same message is declared with all of them packed.
+   * Decoded message keeps original descriptor, so expected bytes are spelled out.
+   */
+  static ProtobufCFieldDescriptor packed_fields[32];
+  static ProtobufCMessageDescriptor packed_descriptor;
+
+  ASSERT(foo__repeated_values__descriptor.n_fields <= sizeof(packed_fields) / sizeof(packed_fields[0]));
+
+  memcpy(&packed_descriptor, &foo__repeated_values__descriptor, sizeof(packed_descriptor));
+  memcpy(packed_fields, foo__repeated_values__descriptor.fields, foo__repeated_values__descriptor.n_fields * sizeof(packed_fields[0]));
+
+  unsigned i;
+  for (i = 0; i < packed_descriptor.n_fields; i++) {
+    if (packed_fields[i].type != PROTOBUF_C_TYPE_STRING && packed_fields[i].type != PROTOBUF_C_TYPE_BYTES
+      && packed_fields[i].type != PROTOBUF_C_TYPE_MESSAGE) {
+      packed_fields[i].flags |= PROTOBUF_C_FIELD_FLAG_PACKED;
+    }
+  }
+  packed_descriptor.fields = packed_fields;
+
+  /* Strings and messages are never packed */
+  assert_packed_bytes(
+    &packed_descriptor,
+    "{\"value_int32\":[1,-1,300],\"value_sint32\":[-2,2],\"value_fixed64\":[72623859790382856],"
+    "\"value_float\":[1.5,-2.0],\"value_double\":[],\"value_bool\":[true,false],\"value_enum\":[\"FIZZ\",\"FIZZBUZZ\"],"
+    "\"value_string\":[\"a\",\"b\"]}",
+    PACKED_BYTES(
+      "\x0a\x0d\x01\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\xac\x02" "\x12\x02\x03\x04"
+      "\x52\x08\x08\x07\x06\x05\x04\x03\x02\x01" "\x5a\x08\x00\x00\xc0\x3f\x00\x00\x00\xc0"
+      "\x6a\x02\x01\x00" "\x72\x02\x03\x0f" "\x7a\x01" "a" "\x7a\x01" "b"
+    )
+  );
+
+  assert_packed_bytes(
+    &packed_descriptor,
+    "{\"value_int32\":[1,-1,300],\"value_sint32\":[-2,2],\"value_double\":[]}",
+    PACKED_BYTES("\x0a\x0d\x01\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\xac\x02" "\x12\x02\x03\x04")
+  );
+
+  /* Packed bytes are read back as well */
+  const char *json_string = "{\"value_sint32\":[-2,2],\"value_bool\":[true]}";
+  uint8_t *packed_buffer = NULL;
+  size_t packed_length = 0;
+  ASSERT_ZERO(json2protobuf_to_packed((char *)json_string, strlen(json_string), 0, &packed_descriptor, &packed_buffer, &packed_length, NULL, 0));
+
+  char *json_buffer = NULL;
+  ASSERT_ZERO(protobuf2json_from_packed(&foo__repeated_values__descriptor, packed_buffer, packed_length, JSON_COMPACT, &json_buffer, NULL, NULL, 0));
+
+  ASSERT_STRCMP(
+    json_buffer,
+    json_string
+  );
+
+  free(packed_buffer);
+  free(json_buffer);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_packed__errors_same_as_buffer) {
+  const char *bar_json_strings[] = {
+    "",
+    "[]",
+    "42",
+    "{",
+    "{\"string_required\":",
+    "{\"string_required\":\"a",
+    "{\"string_required\" \"a\"}",
+    "{\"string_required\":\"a\",}",
+    "{\"string_required\":\"a\\q\"}",
+    "{\"string_required\":\"a\\u0000\"}",
+    "{\"string_required\":null}",
+    "{\"string\\u0000required\":\"a\"}",
+    "{\"string_required\":\"a\",\"unknown\":1}",
+    "{\"string_required\":\"a\",\"enum_optional\":\"NOPE\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":[]}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"\\q\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"QU@D\"}",
+    "{\"string_required\":\"a\",\"bytes_optional\":\"QUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQU@D\"}",
+    "{\"string_optional\":\"a\"}",
+    "{\"string_required\":\"a\"} x",
+  };
+
+  const char *repeated_values_json_strings[] = {
+    "{\"value_int32\":[1,]}",
+    "{\"value_int32\":[1 2]}",
+    "{\"value_int32\":[1",
+    "{\"value_int32\":{}}",
+    "{\"value_int32\":[2147483648]}",
+    "{\"value_uint64\":[-1]}",
+    "{\"value_double\":[1e999]}",
+    "{\"value_string\":[\"a\",1]}",
+    "{\"value_bytes\":[1]}",
+    "{\"value_bytes\":[\"QUJD\",\"QUJ@\"]}",
+    "{\"value_message\":[1]}",
+    "{\"value_message\":[{\"name\":\"a\"}]}",
+    "{\"value_message\":[{\"name\":\"a\",\"id\":1,\"phone\":[{\"number\":\"x\",\"type\":\"BAD\"}]}]}",
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(bar_json_strings) / sizeof(bar_json_strings[0]); i++) {
+    assert_packed_equals_buffer(&foo__bar__descriptor, bar_json_strings[i], 0);
+  }
+
+  for (i = 0; i < sizeof(repeated_values_json_strings) / sizeof(repeated_values_json_strings[0]); i++) {
+    assert_packed_equals_buffer(&foo__repeated_values__descriptor, repeated_values_json_strings[i], 0);
+  }
+
+  assert_packed_equals_buffer(&foo__bar__descriptor, "42", JSON_DECODE_ANY);
+  assert_packed_equals_buffer(&foo__person__descriptor, "{\"name\":\"a\",\"id\":1,\"id\":2}", JSON_REJECT_DUPLICATES);
+  assert_packed_equals_buffer(&foo__person__descriptor, "{\"name\":\"a\",\"id\":1} x", JSON_DISABLE_EOF_CHECK);
+
+  RETURN_OK();
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+#include <unistd.h>
+
+typedef struct collected {
+  /* Messages encoded back, one per line */
+  char *data;
+  size_t length;
+  size_t calls;
+  size_t stop_after;
+} collected_t;
+
+static int collect_callback(ProtobufCMessage *protobuf_message, void *callback_data) {
+  collected_t *collected = (collected_t *)callback_data;
+
+  if (collected->stop_after && collected->calls >= collected->stop_after) {
+    return -1;
+  }
+
+  char *json_string = NULL;
+  size_t json_length = 0;
+  ASSERT_ZERO(protobuf2json_buffer(protobuf_message, JSON_COMPACT, &json_string, &json_length, NULL, 0));
+
+  collected->data = realloc(collected->data, collected->length + json_length + 2);
+  ASSERT(collected->data);
+
+  memcpy(collected->data + collected->length, json_string, json_length);
+  collected->length += json_length;
+  collected->data[collected->length++] = '\n';
+  collected->data[collected->length] = '\0';
+  collected->calls++;
+
+  free(json_string);
+
+  return 0;
+}
+
+/* Returns fd of temporary file with `json_string` written to it, positioned at start */
+static int stream_fd(const char *json_string, size_t json_length) {
+  char file_name[] = "/tmp/protobuf2json-stream-XXXXXX";
+  int fd = mkstemp(file_name);
+  ASSERT(fd >= 0);
+  unlink(file_name);
+
+  ASSERT(write(fd, json_string, json_length) == (ssize_t)json_length);
+  ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+
+  return fd;
+}
+
+static void assert_stream_equals(
+  const char *json_string,
+  const char *expected_string,
+  size_t expected_calls
+) {
+  collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  int fd = stream_fd(json_string, strlen(json_string));
+
+  int result = json2protobuf_stream_fd(fd, 0, &foo__person__descriptor, collect_callback, &collected, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(collected.calls == expected_calls);
+
+  ASSERT_STRCMP(
+    collected.data ? collected.data : "",
+    expected_string
+  );
+
+  close(fd);
+  free(collected.data);
+}
+
+static void assert_stream_error(
+  const char *json_string,
+  size_t json_flags,
+  int expected_result,
+  const char *expected_error_string,
+  size_t expected_calls
+) {
+  char error_string[256] = {0};
+  collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  int fd = stream_fd(json_string, strlen(json_string));
+
+  int result = json2protobuf_stream_fd(fd, json_flags, &foo__person__descriptor, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, expected_result);
+  ASSERT(collected.calls == expected_calls);
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  close(fd);
+  free(collected.data);
+}
+
+TEST_IMPL(json2protobuf_stream__ndjson) {
+  assert_stream_equals(
+    "{\"name\":\"John\",\"id\":1}\n"
+    "{\"name\":\"Jane\",\"id\":2,\"phone\":[{\"number\":\"+1\",\"type\":\"WORK\"}]}\n",
+    "{\"name\":\"John\",\"id\":1}\n"
+    "{\"name\":\"Jane\",\"id\":2,\"phone\":[{\"number\":\"+1\",\"type\":\"WORK\"}]}\n",
+    2
+  );
+
+  /* Empty lines, CRLF and missing newline at the end */
+  assert_stream_equals(
+    "\n\r\n{\"name\":\"John\",\"id\":1}\r\n\n   \n\t{\"name\":\"Jane\",\"id\":2}",
+    "{\"name\":\"John\",\"id\":1}\n"
+    "{\"name\":\"Jane\",\"id\":2}\n",
+    2
+  );
+
+  /* Brackets and quotes inside strings */
+  assert_stream_equals(
+    "{\"name\":\"}{\\\"][\\\\\",\"id\":1}\n"
+    "{\"name\":\"\\u007d\",\"id\":2}\n",
+    "{\"name\":\"}{\\\"][\\\\\",\"id\":1}\n"
+    "{\"name\":\"}\",\"id\":2}\n",
+    2
+  );
+
+  assert_stream_equals("", "", 0);
+  assert_stream_equals("\n\n  \n", "", 0);
+
+  /* Byte order mark at the start of stream is skipped */
+  assert_stream_equals(
+    "\xEF\xBB\xBF{\"name\":\"John\",\"id\":1}\n{\"name\":\"Jane\",\"id\":2}\n",
+    "{\"name\":\"John\",\"id\":1}\n"
+    "{\"name\":\"Jane\",\"id\":2}\n",
+    2
+  );
+  assert_stream_equals("\xEF\xBB\xBF", "", 0);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_stream__concatenated) {
+  assert_stream_equals(
+    "{\"name\":\"a\",\"id\":1}{\"name\":\"b\",\"id\":2} {\"name\":\"c\",\"id\":3}\n"
+    "{\n"
+    "  \"name\": \"d\",\n"
+    "  \"id\": 4\n"
+    "}\n",
+    "{\"name\":\"a\",\"id\":1}\n"
+    "{\"name\":\"b\",\"id\":2}\n"
+    "{\"name\":\"c\",\"id\":3}\n"
+    "{\"name\":\"d\",\"id\":4}\n",
+    4
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_stream__large) {
+  /* Records span read chunks, and some of them are longer than a chunk */
+  size_t records = 3000;
+  size_t long_length = 200000;
+  size_t size = records * 64 + long_length * 2 + 256;
+
+  char *json_string = malloc(size);
+  char *expected_string = malloc(size);
+  ASSERT(json_string && expected_string);
+
+  size_t json_length = 0, expected_length = 0;
+  size_t i;
+
+  for (i = 0; i < records; i++) {
+    if (i == 1000 || i == 2000) {
+      json_length += snprintf(json_string + json_length, size - json_length, "{\"id\":%zu,\"name\":\"", i);
+      expected_length += snprintf(expected_string + expected_length, size - expected_length, "{\"name\":\"");
+
+      memset(json_string + json_length, 'x', long_length);
+      memset(expected_string + expected_length, 'x', long_length);
+      json_length += long_length;
+      expected_length += long_length;
+
+      json_length += snprintf(json_string + json_length, size - json_length, "\"}\n");
+      expected_length += snprintf(expected_string + expected_length, size - expected_length, "\",\"id\":%zu}\n", i);
+    } else {
+      json_length += snprintf(json_string + json_length, size - json_length, "{\"name\":\"user %zu\",\"id\":%zu}\n", i, i);
+      expected_length += snprintf(expected_string + expected_length, size - expected_length, "{\"name\":\"user %zu\",\"id\":%zu}\n", i, i);
+    }
+  }
+
+  collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  int fd = stream_fd(json_string, json_length);
+
+  int result = json2protobuf_stream_fd(fd, 0, &foo__person__descriptor, collect_callback, &collected, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(collected.calls == records);
+  ASSERT(collected.length == expected_length);
+  ASSERT_ZERO(memcmp(collected.data, expected_string, expected_length));
+
+  close(fd);
+  free(collected.data);
+  free(json_string);
+  free(expected_string);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_stream__file) {
+  const char *json_string = "{\"name\":\"John\",\"id\":1}\n{\"name\":\"Jane\",\"id\":2}\n";
+
+  char file_name[] = "/tmp/protobuf2json-stream-XXXXXX";
+  int fd = mkstemp(file_name);
+  ASSERT(fd >= 0);
+  ASSERT(write(fd, json_string, strlen(json_string)) == (ssize_t)strlen(json_string));
+  close(fd);
+
+  collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  int result = json2protobuf_stream_file(file_name, 0, &foo__person__descriptor, collect_callback, &collected, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(collected.calls == 2);
+
+  ASSERT_STRCMP(
+    collected.data,
+    json_string
+  );
+
+  unlink(file_name);
+  free(collected.data);
+
+  char error_string[256] = {0};
+
+  result = json2protobuf_stream_file(file_name, 0, &foo__person__descriptor, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE);
+
+  ASSERT_STRNCMP(
+    error_string,
+    "Cannot open file '/tmp/protobuf2json-stream-",
+    strlen("Cannot open file '/tmp/protobuf2json-stream-")
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_stream__errors) {
+  /* Errors are reported with number and line of the record, place in the record is relative to it */
+  assert_stream_error(
+    "{\"name\":\"John\",\"id\":1}\n\n{\"name\":\"Jane\",\"id\":x}\n{\"name\":\"Joe\",\"id\":3}\n",
+    0,
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+    "Record 2 at line 3: JSON parsing error at line 1 column 21 (position 21): invalid token near 'x'",
+    1
+  );
+
+  assert_stream_error(
+    "{\"name\":\"John\",\"id\":1}\n{\"name\":\"Jane\"}\n",
+    0,
+    PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
+    "Record 2 at line 2: Required field 'id' is missing in message 'Foo.Person'",
+    1
+  );
+
+  assert_stream_error(
+    "{\n\"name\":\"John\",\n\"id\":1\n}\n42\n",
+    0,
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+    "Record 2 at line 5: JSON parsing error at line 1 column 2 (position 2): '[' or '{' expected near '42'",
+    1
+  );
+
+  assert_stream_error(
+    "[]\n",
+    0,
+    PROTOBUF2JSON_ERR_IS_NOT_OBJECT,
+    "Record 1 at line 1: JSON is not an object required for GPB message",
+    0
+  );
+
+  /* Truncated last record */
+  assert_stream_error(
+    "{\"name\":\"John\",\"id\":1}\n{\"name\":\"Jane\",\"id\":2",
+    0,
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+    "Record 2 at line 2: JSON parsing error at line 1 column 21 (position 21): '}' expected near end of file",
+    1
+  );
+
+  /* Unterminated string ends at newline */
+  assert_stream_error(
+    "{\"name\":\"John\n{\"name\":\"Jane\",\"id\":2}\n",
+    0,
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+    "Record 1 at line 1: JSON parsing error at line 1 column 13 (position 13): premature end of input near '\"John'",
+    0
+  );
+
+  /* Byte order mark is not skipped anywhere else */
+  assert_stream_error(
+    "{\"name\":\"John\",\"id\":1}\n\xEF\xBB\xBF{\"name\":\"Jane\",\"id\":2}\n",
+    0,
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+    "Record 2 at line 2: JSON parsing error at line 1 column 1 (position 1): '[' or '{' expected near '\xEF'",
+    1
+  );
+
+  /* Flags apply to every record */
+  assert_stream_error(
+    "{\"name\":\"John\",\"id\":1}\n{\"name\":\"Jane\",\"id\":2,\"id\":3}\n",
+    JSON_REJECT_DUPLICATES,
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_STRING,
+    "Record 2 at line 2: JSON parsing error at line 1 column 26 (position 26): duplicate object key near '\"id\"'",
+    1
+  );
+
+  /* Long errors are kept whole when caller's buffer fits them */
+  char json_string[512];
+  char key[301];
+  char expected_error_string[512];
+  char error_string[1024] = {0};
+
+  memset(key, 'x', sizeof(key) - 1);
+  key[sizeof(key) - 1] = '\0';
+
+  snprintf(json_string, sizeof(json_string), "{\"name\":\"John\",\"id\":1}\n{\"%s\":1}\n", key);
+  snprintf(expected_error_string, sizeof(expected_error_string), "Record 2 at line 2: Unknown field '%s' for message 'Foo.Person'", key);
+
+  collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  int fd = stream_fd(json_string, strlen(json_string));
+
+  int result = json2protobuf_stream_fd(fd, 0, &foo__person__descriptor, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_FIELD);
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  close(fd);
+  free(collected.data);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(json2protobuf_stream__error_callback) {
+  int result;
+  char error_string[256] = {0};
+
+  const char *json_string = "{\"name\":\"John\",\"id\":1}\n{\"name\":\"Jane\",\"id\":2}\n{\"name\":\"Joe\",\"id\":3}\n";
+
+  collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+  collected.stop_after = 1;
+
+  int fd = stream_fd(json_string, strlen(json_string));
+
+  result = json2protobuf_stream_fd(fd, 0, &foo__person__descriptor, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_STOPPED_BY_CALLBACK);
+  ASSERT(collected.calls == 1);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Callback stopped reading at record 2 at line 2"
+  );
+
+  /* Invalid arguments are told apart from callback stopping */
+  result = json2protobuf_stream_fd(fd, 0, &foo__person__descriptor, NULL, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INVALID_ARGUMENT);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot pass messages to NULL callback"
+  );
+
+  result = json2protobuf_stream_fd(fd, 0, NULL, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INVALID_ARGUMENT);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot decode messages with NULL descriptor"
+  );
+
+  close(fd);
+  free(collected.data);
+
+  result = json2protobuf_stream_fd(-1, 0, &foo__person__descriptor, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_PARSE_FILE);
+
+  ASSERT_STRNCMP(
+    error_string,
+    "Cannot read JSON from fd -1, errno=",
+    strlen("Cannot read JSON from fd -1, errno=")
+  );
+
+  RETURN_OK();
+}
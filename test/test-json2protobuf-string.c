@@ -253,6 +253,37 @@ TEST_IMPL_IS_NOT_INTEGER(sfixed64)
 TEST_IMPL_IS_NOT_INTEGER(uint64)
 TEST_IMPL_IS_NOT_INTEGER(fixed64)
 
+TEST_IMPL(json2protobuf_string__error_integer_out_of_range) {
+  const char *json_strings[] = {
+    "{\"value_int32\": [2147483648]}",
+    "{\"value_sint32\": [-2147483649]}",
+    "{\"value_uint32\": [4294967296]}",
+    "{\"value_fixed32\": [-1]}",
+    "{\"value_uint64\": [-1]}",
+  };
+
+  const char *expected_error_strings[] = {
+    "JSON integer 2147483648 is out of range for GPB int32",
+    "JSON integer -2147483649 is out of range for GPB sint32",
+    "JSON integer 4294967296 is out of range for GPB uint32",
+    "JSON integer -1 is out of range for GPB fixed32",
+    "JSON integer -1 is out of range for GPB uint64",
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(json_strings) / sizeof(json_strings[0]); i++) {
+    char error_string[256] = {0};
+    ProtobufCMessage *protobuf_message = NULL;
+
+    int result = json2protobuf_string((char *)json_strings[i], 0, &foo__repeated_values__descriptor, &protobuf_message, error_string, sizeof(error_string));
+    ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INTEGER_OUT_OF_RANGE);
+
+    ASSERT_STRCMP(error_string, expected_error_strings[i]);
+  }
+
+  RETURN_OK();
+}
+
 TEST_IMPL(json2protobuf_string__error_is_not_real_number_required_for_float) {
   int result;
   char error_string[256] = {0};
@@ -414,3 +445,30 @@ TEST_IMPL(json2protobuf_string__error_is_not_string_required_for_bytes) {
 
   RETURN_OK();
 }
+
+TEST_IMPL(json2protobuf_string__error_is_not_base64_required_for_bytes) {
+  int result;
+  char error_string[256] = {0};
+
+  const char *initial_json_string = \
+    "{\n"
+    "  \"value_bytes\": [\"QUJD\", \"QUJ@\"]\n"
+    "}"
+  ;
+
+  ProtobufCMessage *protobuf_message = NULL;
+
+  result = json2protobuf_string((char *)initial_json_string, 0, &foo__repeated_values__descriptor, &protobuf_message, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_IS_NOT_BASE64);
+
+  const char *expected_error_string = \
+    "JSON string is not base64 required for GPB bytes"
+  ;
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  RETURN_OK();
+}
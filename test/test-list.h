@@ -26,6 +26,31 @@ TEST_DECLARE(protobuf2json_string__error_cannot_create_json_array)
 TEST_DECLARE(protobuf2json_string__error_in_json_object_set_new_3)
 TEST_DECLARE(protobuf2json_string__error_cannot_dump_string)
 
+TEST_DECLARE(protobuf2json_buffer__same_as_string)
+TEST_DECLARE(protobuf2json_buffer__compact)
+TEST_DECLARE(protobuf2json_buffer__shortest_reals)
+TEST_DECLARE(protobuf2json_buffer__escaping)
+TEST_DECLARE(protobuf2json_buffer__enum_values)
+TEST_DECLARE(protobuf2json_buffer__encoded_size)
+TEST_DECLARE(protobuf2json_buffer__to_buffer)
+TEST_DECLARE(protobuf2json_buffer__to_buffer_prepared)
+TEST_DECLARE(protobuf2json_buffer__error_unknown_enum_value)
+TEST_DECLARE(protobuf2json_buffer__error_invalid_utf8)
+TEST_DECLARE(protobuf2json_buffer__error_non_finite_real)
+TEST_DECLARE(protobuf2json_buffer__error_null_string)
+TEST_DECLARE(protobuf2json_callback__same_as_string)
+TEST_DECLARE(protobuf2json_callback__error_callback)
+TEST_DECLARE(protobuf2json_packed__same_as_unpacked)
+TEST_DECLARE(protobuf2json_packed__wire_order)
+TEST_DECLARE(protobuf2json_packed__packed_repeated)
+TEST_DECLARE(protobuf2json_packed__errors)
+TEST_DECLARE(protobuf2json_batch__same_as_buffer)
+TEST_DECLARE(protobuf2json_batch__empty)
+TEST_DECLARE(protobuf2json_batch__callback_chunks)
+TEST_DECLARE(protobuf2json_batch__errors)
+TEST_DECLARE(protobuf2json_fd__success)
+TEST_DECLARE(protobuf2json_fd__error_bad_fd)
+
 TEST_DECLARE(json2protobuf_file__success)
 TEST_DECLARE(json2protobuf_file__error_cannot_parse_bad_message)
 TEST_DECLARE(json2protobuf_file__error_cannot_parse_bad_json)
@@ -48,12 +73,43 @@ TEST_DECLARE(json2protobuf_string__error_is_not_integer_required_for_sint64)
 TEST_DECLARE(json2protobuf_string__error_is_not_integer_required_for_sfixed64)
 TEST_DECLARE(json2protobuf_string__error_is_not_integer_required_for_uint64)
 TEST_DECLARE(json2protobuf_string__error_is_not_integer_required_for_fixed64)
+TEST_DECLARE(json2protobuf_string__error_integer_out_of_range)
 TEST_DECLARE(json2protobuf_string__error_is_not_real_number_required_for_float)
 TEST_DECLARE(json2protobuf_string__error_is_not_real_number_required_for_double)
 TEST_DECLARE(json2protobuf_string__error_is_not_boolean_required_for_bool)
 TEST_DECLARE(json2protobuf_string__error_is_not_string_required_for_enum)
 TEST_DECLARE(json2protobuf_string__error_is_not_string_required_for_string)
 TEST_DECLARE(json2protobuf_string__error_is_not_string_required_for_bytes)
+TEST_DECLARE(json2protobuf_string__error_is_not_base64_required_for_bytes)
+
+TEST_DECLARE(json2protobuf_buffer__same_as_string)
+TEST_DECLARE(json2protobuf_buffer__errors_same_as_string)
+TEST_DECLARE(json2protobuf_buffer__duplicate_field_last_wins)
+TEST_DECLARE(json2protobuf_buffer__error_duplicate_field)
+TEST_DECLARE(json2protobuf_buffer__not_nul_terminated)
+TEST_DECLARE(json2protobuf_buffer__numbers)
+TEST_DECLARE(json2protobuf_buffer__long_strings)
+TEST_DECLARE(json2protobuf_buffer__field_lookup)
+TEST_DECLARE(json2protobuf_buffer__enum_lookup)
+TEST_DECLARE(json2protobuf_buffer__many_descriptors)
+TEST_DECLARE(json2protobuf_buffer_allocator__arena)
+TEST_DECLARE(json2protobuf_buffer_allocator__balanced)
+TEST_DECLARE(json2protobuf_buffer_allocator__error_cannot_allocate)
+TEST_DECLARE(json2protobuf_buffer_insitu__strings_in_place)
+TEST_DECLARE(json2protobuf_buffer_insitu__error)
+TEST_DECLARE(json2protobuf_packed__same_as_pack)
+TEST_DECLARE(json2protobuf_packed__field_order)
+TEST_DECLARE(json2protobuf_packed__long_values)
+TEST_DECLARE(json2protobuf_packed__packed_repeated)
+TEST_DECLARE(json2protobuf_packed__errors_same_as_buffer)
+TEST_DECLARE(json2protobuf_stream__ndjson)
+TEST_DECLARE(json2protobuf_stream__concatenated)
+TEST_DECLARE(json2protobuf_stream__large)
+TEST_DECLARE(json2protobuf_stream__file)
+TEST_DECLARE(json2protobuf_stream__errors)
+TEST_DECLARE(json2protobuf_stream__error_callback)
+TEST_DECLARE(protobuf2json_ctx__reuse)
+TEST_DECLARE(protobuf2json_ctx__error_keeps_context)
 
 TEST_DECLARE(reversible__messages)
 TEST_DECLARE(reversible__default_values)
@@ -65,6 +121,12 @@ TEST_DECLARE(reversible__oneof_one)
 TEST_DECLARE(reversible__oneof_other)
 TEST_DECLARE(reversible__oneof_both_first)
 TEST_DECLARE(reversible__oneof_both_second)
+#ifdef HAVE_PROTOC
+TEST_DECLARE(codegen__same_as_generic)
+TEST_DECLARE(codegen__decode)
+TEST_DECLARE(codegen__decode_same_as_string)
+TEST_DECLARE(codegen__errors)
+#endif
 
 TASK_LIST_START
   TEST_ENTRY(protobuf2json_file__success)
@@ -87,6 +149,31 @@ TASK_LIST_START
   TEST_ENTRY(protobuf2json_string__error_in_json_object_set_new_3)
   TEST_ENTRY(protobuf2json_string__error_cannot_dump_string)
 
+  TEST_ENTRY(protobuf2json_buffer__same_as_string)
+  TEST_ENTRY(protobuf2json_buffer__compact)
+  TEST_ENTRY(protobuf2json_buffer__shortest_reals)
+  TEST_ENTRY(protobuf2json_buffer__escaping)
+  TEST_ENTRY(protobuf2json_buffer__enum_values)
+  TEST_ENTRY(protobuf2json_buffer__encoded_size)
+  TEST_ENTRY(protobuf2json_buffer__to_buffer)
+  TEST_ENTRY(protobuf2json_buffer__to_buffer_prepared)
+  TEST_ENTRY(protobuf2json_buffer__error_unknown_enum_value)
+  TEST_ENTRY(protobuf2json_buffer__error_invalid_utf8)
+  TEST_ENTRY(protobuf2json_buffer__error_non_finite_real)
+  TEST_ENTRY(protobuf2json_buffer__error_null_string)
+  TEST_ENTRY(protobuf2json_callback__same_as_string)
+  TEST_ENTRY(protobuf2json_callback__error_callback)
+  TEST_ENTRY(protobuf2json_packed__same_as_unpacked)
+  TEST_ENTRY(protobuf2json_packed__wire_order)
+  TEST_ENTRY(protobuf2json_packed__packed_repeated)
+  TEST_ENTRY(protobuf2json_packed__errors)
+  TEST_ENTRY(protobuf2json_batch__same_as_buffer)
+  TEST_ENTRY(protobuf2json_batch__empty)
+  TEST_ENTRY(protobuf2json_batch__callback_chunks)
+  TEST_ENTRY(protobuf2json_batch__errors)
+  TEST_ENTRY(protobuf2json_fd__success)
+  TEST_ENTRY(protobuf2json_fd__error_bad_fd)
+
   TEST_ENTRY(json2protobuf_file__success)
   TEST_ENTRY(json2protobuf_file__error_cannot_parse_bad_message)
   TEST_ENTRY(json2protobuf_file__error_cannot_parse_bad_json)
@@ -109,12 +196,43 @@ TASK_LIST_START
   TEST_ENTRY(json2protobuf_string__error_is_not_integer_required_for_sfixed64)
   TEST_ENTRY(json2protobuf_string__error_is_not_integer_required_for_uint64)
   TEST_ENTRY(json2protobuf_string__error_is_not_integer_required_for_fixed64)
+  TEST_ENTRY(json2protobuf_string__error_integer_out_of_range)
   TEST_ENTRY(json2protobuf_string__error_is_not_real_number_required_for_float)
   TEST_ENTRY(json2protobuf_string__error_is_not_real_number_required_for_double)
   TEST_ENTRY(json2protobuf_string__error_is_not_boolean_required_for_bool)
   TEST_ENTRY(json2protobuf_string__error_is_not_string_required_for_enum)
   TEST_ENTRY(json2protobuf_string__error_is_not_string_required_for_string)
   TEST_ENTRY(json2protobuf_string__error_is_not_string_required_for_bytes)
+  TEST_ENTRY(json2protobuf_string__error_is_not_base64_required_for_bytes)
+
+  TEST_ENTRY(json2protobuf_buffer__same_as_string)
+  TEST_ENTRY(json2protobuf_buffer__errors_same_as_string)
+  TEST_ENTRY(json2protobuf_buffer__duplicate_field_last_wins)
+  TEST_ENTRY(json2protobuf_buffer__error_duplicate_field)
+  TEST_ENTRY(json2protobuf_buffer__not_nul_terminated)
+  TEST_ENTRY(json2protobuf_buffer__numbers)
+  TEST_ENTRY(json2protobuf_buffer__long_strings)
+  TEST_ENTRY(json2protobuf_buffer__field_lookup)
+  TEST_ENTRY(json2protobuf_buffer__enum_lookup)
+  TEST_ENTRY(json2protobuf_buffer__many_descriptors)
+  TEST_ENTRY(json2protobuf_buffer_allocator__arena)
+  TEST_ENTRY(json2protobuf_buffer_allocator__balanced)
+  TEST_ENTRY(json2protobuf_buffer_allocator__error_cannot_allocate)
+  TEST_ENTRY(json2protobuf_buffer_insitu__strings_in_place)
+  TEST_ENTRY(json2protobuf_buffer_insitu__error)
+  TEST_ENTRY(json2protobuf_packed__same_as_pack)
+  TEST_ENTRY(json2protobuf_packed__field_order)
+  TEST_ENTRY(json2protobuf_packed__long_values)
+  TEST_ENTRY(json2protobuf_packed__packed_repeated)
+  TEST_ENTRY(json2protobuf_packed__errors_same_as_buffer)
+  TEST_ENTRY(json2protobuf_stream__ndjson)
+  TEST_ENTRY(json2protobuf_stream__concatenated)
+  TEST_ENTRY(json2protobuf_stream__large)
+  TEST_ENTRY(json2protobuf_stream__file)
+  TEST_ENTRY(json2protobuf_stream__errors)
+  TEST_ENTRY(json2protobuf_stream__error_callback)
+  TEST_ENTRY(protobuf2json_ctx__reuse)
+  TEST_ENTRY(protobuf2json_ctx__error_keeps_context)
 
   TEST_ENTRY(reversible__messages)
   TEST_ENTRY(reversible__default_values)
@@ -126,4 +244,10 @@ TASK_LIST_START
   TEST_ENTRY(reversible__oneof_other)
   TEST_ENTRY(reversible__oneof_both_first)
   TEST_ENTRY(reversible__oneof_both_second)
+#ifdef HAVE_PROTOC
+  TEST_ENTRY(codegen__same_as_generic)
+  TEST_ENTRY(codegen__decode)
+  TEST_ENTRY(codegen__decode_same_as_string)
+  TEST_ENTRY(codegen__errors)
+#endif
 TASK_LIST_END
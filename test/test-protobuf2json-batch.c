@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+typedef struct collected {
+  char data[65536];
+  size_t length;
+  size_t calls;
+} collected_t;
+
+static int collect_callback(const char *buffer, size_t size, void *data) {
+  collected_t *collected = (collected_t *)data;
+
+  ASSERT(collected->length + size < sizeof(collected->data));
+
+  memcpy(collected->data + collected->length, buffer, size);
+  collected->length += size;
+  collected->calls++;
+
+  return 0;
+}
+
+static int fail_callback(const char *buffer, size_t size, void *data) {
+  return -1;
+}
+
+TEST_IMPL(protobuf2json_batch__same_as_buffer) {
+  int result;
+
+  size_t json_flags[] = {
+    0,
+    TEST_JSON_FLAGS,
+    JSON_COMPACT,
+    JSON_COMPACT | JSON_SORT_KEYS,
+    JSON_INDENT(4) | JSON_ENSURE_ASCII,
+  };
+
+  Foo__Person__PhoneNumber person_phonenumber1 = FOO__PERSON__PHONE_NUMBER__INIT;
+  person_phonenumber1.number = "+123456789";
+  person_phonenumber1.has_type = 1;
+  person_phonenumber1.type = FOO__PERSON__PHONE_TYPE__WORK;
+
+  Foo__Person__PhoneNumber *person_phonenumbers[1] = { &person_phonenumber1 };
+
+  Foo__Person person1 = FOO__PERSON__INIT;
+  person1.name = "John \"Doe\" \xd0\x94\xd0\xb6\xd0\xbe\xd0\xbd\n";
+  person1.id = 42;
+  person1.n_phone = 1;
+  person1.phone = person_phonenumbers;
+
+  Foo__Person person2 = FOO__PERSON__INIT;
+  person2.name = "Jane";
+  person2.id = -1;
+  person2.email = "jane@doe.name";
+
+  Foo__Bar bar = FOO__BAR__INIT;
+  bar.string_required = "required";
+
+  Foo__Something something = FOO__SOMETHING__INIT;
+  something.something_case = FOO__SOMETHING__SOMETHING_ONEOF_STRING;
+  something.oneof_string = "one";
+
+  /* Messages of any types may go in one batch */
+  ProtobufCMessage *protobuf_messages[] = {
+    &person1.base,
+    &person2.base,
+    &bar.base,
+    &something.base,
+    &person1.base,
+  };
+  size_t protobuf_messages_count = sizeof(protobuf_messages) / sizeof(protobuf_messages[0]);
+
+  size_t i, j;
+  for (i = 0; i < sizeof(json_flags) / sizeof(json_flags[0]); i++) {
+    /* Every line is what protobuf2json_buffer() gives without indentation */
+    static char expected[65536];
+    size_t expected_length = 0;
+
+    for (j = 0; j < protobuf_messages_count; j++) {
+      char *json_string = NULL;
+      size_t json_length = 0;
+
+      result = protobuf2json_buffer(protobuf_messages[j], json_flags[i] & ~(size_t)JSON_MAX_INDENT, &json_string, &json_length, NULL, 0);
+      ASSERT_ZERO(result);
+      ASSERT(!memchr(json_string, '\n', json_length));
+
+      memcpy(expected + expected_length, json_string, json_length);
+      expected_length += json_length;
+      expected[expected_length++] = '\n';
+
+      free(json_string);
+    }
+
+    expected[expected_length] = '\0';
+
+    char *json_buffer = NULL;
+    size_t json_length = 0;
+
+    result = protobuf2json_batch_buffer(protobuf_messages, protobuf_messages_count, json_flags[i], &json_buffer, &json_length, NULL, 0);
+    ASSERT_ZERO(result);
+    ASSERT(json_length == expected_length);
+
+    ASSERT_STRCMP(
+      json_buffer,
+      expected
+    );
+
+    static collected_t collected;
+    memset(&collected, 0, sizeof(collected));
+
+    result = protobuf2json_batch_callback(protobuf_messages, protobuf_messages_count, json_flags[i], collect_callback, &collected, NULL, 0);
+    ASSERT_ZERO(result);
+
+    collected.data[collected.length] = '\0';
+
+    ASSERT_STRCMP(
+      collected.data,
+      expected
+    );
+
+    free(json_buffer);
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_batch__empty) {
+  int result;
+
+  char *json_buffer = NULL;
+  size_t json_length = 1;
+
+  result = protobuf2json_batch_buffer(NULL, 0, 0, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_length == 0);
+
+  ASSERT_STRCMP(
+    json_buffer,
+    ""
+  );
+
+  free(json_buffer);
+
+  static collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  result = protobuf2json_batch_callback(NULL, 0, 0, collect_callback, &collected, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(collected.calls == 0);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_batch__callback_chunks) {
+  int result;
+
+  /* Enough small messages to fill several chunks */
+  static Foo__Person persons[2000];
+  static ProtobufCMessage *protobuf_messages[2000];
+  Foo__Person person_init = FOO__PERSON__INIT;
+
+  size_t i;
+  for (i = 0; i < sizeof(persons) / sizeof(persons[0]); i++) {
+    persons[i] = person_init;
+    persons[i].name = "John";
+    persons[i].id = (int32_t)i;
+    protobuf_messages[i] = &persons[i].base;
+  }
+
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+
+  result = protobuf2json_batch_buffer(protobuf_messages, 2000, JSON_COMPACT, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_length > 16384);
+
+  ASSERT_STRNCMP(
+    json_buffer,
+    "{\"name\":\"John\",\"id\":0}\n{\"name\":\"John\",\"id\":1}\n",
+    strlen("{\"name\":\"John\",\"id\":0}\n{\"name\":\"John\",\"id\":1}\n")
+  );
+
+  static collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  result = protobuf2json_batch_callback(protobuf_messages, 2000, JSON_COMPACT, collect_callback, &collected, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(collected.calls > 1);
+  ASSERT(collected.length == json_length);
+  ASSERT_ZERO(memcmp(collected.data, json_buffer, json_length));
+
+  free(json_buffer);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_batch__errors) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__Person person1 = FOO__PERSON__INIT;
+  person1.name = "John";
+  person1.id = 1;
+
+  Foo__Person__PhoneNumber person_phonenumber = FOO__PERSON__PHONE_NUMBER__INIT;
+  person_phonenumber.number = "+1";
+  person_phonenumber.has_type = 1;
+  person_phonenumber.type = 999;
+
+  Foo__Person__PhoneNumber *person_phonenumbers[1] = { &person_phonenumber };
+
+  Foo__Person person2 = FOO__PERSON__INIT;
+  person2.name = "Jane";
+  person2.id = 2;
+  person2.n_phone = 1;
+  person2.phone = person_phonenumbers;
+
+  ProtobufCMessage *protobuf_messages[] = { &person1.base, &person2.base };
+
+  /* Error of any message fails the whole batch */
+  char *json_buffer = NULL;
+  result = protobuf2json_batch_buffer(protobuf_messages, 2, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Message 1: Unknown value 999 for enum 'Foo.Person.PhoneType'"
+  );
+
+  /* Prefixed error is cut at the size of caller's buffer, whatever it is */
+  char short_error_string[16];
+
+  result = protobuf2json_batch_buffer(protobuf_messages, 2, 0, &json_buffer, NULL, short_error_string, sizeof(short_error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+
+  ASSERT_STRCMP(
+    short_error_string,
+    "Message 1: Unkn"
+  );
+
+  char tiny_error_string[4];
+
+  result = protobuf2json_batch_buffer(protobuf_messages, 2, 0, &json_buffer, NULL, tiny_error_string, sizeof(tiny_error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+
+  ASSERT_STRCMP(
+    tiny_error_string,
+    "Mes"
+  );
+
+  static collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+
+  result = protobuf2json_batch_callback(protobuf_messages, 2, 0, collect_callback, &collected, NULL, 0);
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+
+  result = protobuf2json_batch_callback(protobuf_messages, 1, 0, fail_callback, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK);
+
+  result = protobuf2json_batch_callback(protobuf_messages, 1, 0, NULL, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot dump JSON to NULL callback"
+  );
+
+  /* Invalid arguments are rejected before anything is written */
+  ProtobufCMessage *null_protobuf_messages[] = { &person1.base, NULL };
+
+  result = protobuf2json_batch_buffer(null_protobuf_messages, 2, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INVALID_ARGUMENT);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Message 1: Cannot dump NULL message"
+  );
+
+  memset(&collected, 0, sizeof(collected));
+
+  result = protobuf2json_batch_callback(null_protobuf_messages, 2, 0, collect_callback, &collected, NULL, 0);
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INVALID_ARGUMENT);
+  ASSERT(collected.length == 0);
+
+  result = protobuf2json_batch_buffer(NULL, 3, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INVALID_ARGUMENT);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot dump NULL array of 3 messages"
+  );
+
+  result = protobuf2json_batch_buffer(NULL, 0, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_ZERO(result);
+  ASSERT_STRCMP(json_buffer, "");
+  free(json_buffer);
+
+  RETURN_OK();
+}
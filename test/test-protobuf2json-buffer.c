@@ -0,0 +1,712 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "alloc-count-helper.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+#include <math.h>
+
+/* Decodes JSON back and encodes it with protobuf2json_string(), so reals are written the same way */
+static char *reencode_json_string(const ProtobufCMessageDescriptor *protobuf_message_descriptor, const char *json_string, size_t json_flags) {
+  int result;
+
+  char *json_object_string = malloc(strlen(json_string) + 3);
+  ASSERT(json_object_string);
+
+  /* JSON_EMBED drops braces of the outer object */
+  if (json_flags & JSON_EMBED) {
+    sprintf(json_object_string, "{%s}", json_string);
+  } else {
+    strcpy(json_object_string, json_string);
+  }
+
+  ProtobufCMessage *protobuf_message = NULL;
+  result = json2protobuf_string(json_object_string, 0, protobuf_message_descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  char *reencoded_json_string = NULL;
+  result = protobuf2json_string(protobuf_message, TEST_JSON_FLAGS, &reencoded_json_string, NULL, 0);
+  ASSERT_ZERO(result);
+
+  protobuf_c_message_free_unpacked(protobuf_message, NULL);
+  free(json_object_string);
+
+  return reencoded_json_string;
+}
+
+/*
+ * protobuf2json_buffer() should produce exactly what protobuf2json_string() does
+ * when JSON_REAL_PRECISION is given, and the same values otherwise,
+ * as reals are written in the shortest form then.
+ */
+static void assert_buffer_equals_string(ProtobufCMessage *protobuf_message, size_t json_flags) {
+  int result;
+
+  char *json_string = NULL;
+  result = protobuf2json_string(protobuf_message, json_flags, &json_string, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_string);
+
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+  result = protobuf2json_buffer(protobuf_message, json_flags, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_buffer);
+
+  ASSERT(json_length == strlen(json_buffer));
+
+  size_t encoded_size = 0;
+  result = protobuf2json_encoded_size(protobuf_message, json_flags, &encoded_size, NULL, 0);
+  ASSERT_ZERO(result);
+
+  ASSERT(encoded_size == json_length);
+
+  if (json_flags & JSON_REAL_PRECISION(0x1F)) {
+    ASSERT_STRCMP(
+      json_buffer,
+      json_string
+    );
+  } else {
+    char *reencoded_json_buffer = reencode_json_string(protobuf_message->descriptor, json_buffer, json_flags);
+    char *reencoded_json_string = reencode_json_string(protobuf_message->descriptor, json_string, json_flags);
+
+    ASSERT_STRCMP(
+      reencoded_json_buffer,
+      reencoded_json_string
+    );
+
+    free(reencoded_json_buffer);
+    free(reencoded_json_string);
+  }
+
+  free(json_buffer);
+  free(json_string);
+}
+
+TEST_IMPL(protobuf2json_buffer__same_as_string) {
+  size_t json_flags[] = {
+    0,
+    TEST_JSON_FLAGS,
+    JSON_COMPACT,
+    JSON_INDENT(4) | JSON_COMPACT,
+    JSON_SORT_KEYS,
+    JSON_ENSURE_ASCII | JSON_ESCAPE_SLASH,
+    JSON_REAL_PRECISION(5),
+    JSON_REAL_PRECISION(17),
+    JSON_REAL_PRECISION(17) | JSON_INDENT(2) | JSON_SORT_KEYS | JSON_ENSURE_ASCII,
+    JSON_EMBED,
+  };
+
+  Foo__Person person = FOO__PERSON__INIT;
+  Foo__Person__PhoneNumber person_phonenumber1 = FOO__PERSON__PHONE_NUMBER__INIT;
+  Foo__Person__PhoneNumber person_phonenumber2 = FOO__PERSON__PHONE_NUMBER__INIT;
+  Foo__Person__PhoneNumber *person_phonenumbers[2] = { &person_phonenumber1, &person_phonenumber2 };
+
+  person.name = "John \"Doe\" \xd0\x94\xd0\xb6\xd0\xbe\xd0\xbd \xf0\x9f\x98\x80 /\t\x01";
+  person.id = -42;
+  person.email = "john@doe.name";
+
+  person_phonenumber1.number = "+123456789";
+  person_phonenumber1.has_type = 1;
+  person_phonenumber1.type = FOO__PERSON__PHONE_TYPE__WORK;
+  person_phonenumber2.number = "+987654321";
+
+  person.n_phone = 2;
+  person.phone = person_phonenumbers;
+
+  Foo__Bar bar = FOO__BAR__INIT;
+
+  bar.string_required = "required";
+  bar.has_bytes_optional = 1;
+  bar.bytes_optional.len = 4;
+  bar.bytes_optional.data = (uint8_t *)"\xff\xfe\xfd\xfc";
+
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+
+  int32_t value_int32[] = { 2147483647, -2147483647 - 1, 0 };
+  uint32_t value_uint32[] = { 4294967295U, 0 };
+  int64_t value_int64[] = { 9223372036854775807LL, -9223372036854775807LL - 1, 0 };
+  uint64_t value_uint64[] = { 9223372036854775807ULL, 0 };
+  float value_float[] = { 0.33f, 0, -1.5e-7f, 3.0e38f };
+  double value_double[] = { 0.0077705550333011103, 0, 1e21, -2.5e-300, 100 };
+  protobuf_c_boolean value_bool[] = { 1, 0 };
+  Foo__FizzBuzzType value_enum[] = { FOO__FIZZ_BUZZ_TYPE__FIZZ, FOO__FIZZ_BUZZ_TYPE__FIZZBUZZ };
+  char *value_string[] = { "", "qwerty", "\"\\\b\f\n\r\t\x1f" };
+  ProtobufCBinaryData value_bytes[] = { { 0, NULL }, { 1, (uint8_t *)"?" }, { 5, (uint8_t *)"bytes" } };
+  Foo__Person *value_message[] = { &person, &person };
+
+  repeated_values.n_value_int32 = 3;
+  repeated_values.value_int32 = value_int32;
+  repeated_values.n_value_sint32 = 3;
+  repeated_values.value_sint32 = value_int32;
+  repeated_values.n_value_sfixed32 = 3;
+  repeated_values.value_sfixed32 = value_int32;
+  repeated_values.n_value_uint32 = 2;
+  repeated_values.value_uint32 = value_uint32;
+  repeated_values.n_value_fixed32 = 2;
+  repeated_values.value_fixed32 = value_uint32;
+  repeated_values.n_value_int64 = 3;
+  repeated_values.value_int64 = value_int64;
+  repeated_values.n_value_sint64 = 3;
+  repeated_values.value_sint64 = value_int64;
+  repeated_values.n_value_sfixed64 = 3;
+  repeated_values.value_sfixed64 = value_int64;
+  repeated_values.n_value_uint64 = 2;
+  repeated_values.value_uint64 = value_uint64;
+  repeated_values.n_value_fixed64 = 2;
+  repeated_values.value_fixed64 = value_uint64;
+  repeated_values.n_value_float = 4;
+  repeated_values.value_float = value_float;
+  repeated_values.n_value_double = 5;
+  repeated_values.value_double = value_double;
+  repeated_values.n_value_bool = 2;
+  repeated_values.value_bool = value_bool;
+  repeated_values.n_value_enum = 2;
+  repeated_values.value_enum = value_enum;
+  repeated_values.n_value_string = 3;
+  repeated_values.value_string = value_string;
+  repeated_values.n_value_bytes = 3;
+  repeated_values.value_bytes = value_bytes;
+  repeated_values.n_value_message = 2;
+  repeated_values.value_message = value_message;
+
+  Foo__RepeatedValues repeated_values_empty = FOO__REPEATED_VALUES__INIT;
+
+  Foo__Something something = FOO__SOMETHING__INIT;
+
+  something.something_case = FOO__SOMETHING__SOMETHING_ONEOF_BYTES;
+  something.oneof_bytes.len = 5;
+  something.oneof_bytes.data = (uint8_t *)"bytes";
+
+  size_t i;
+  for (i = 0; i < sizeof(json_flags) / sizeof(json_flags[0]); i++) {
+    assert_buffer_equals_string(&person.base, json_flags[i]);
+    assert_buffer_equals_string(&bar.base, json_flags[i]);
+    assert_buffer_equals_string(&repeated_values.base, json_flags[i]);
+    assert_buffer_equals_string(&repeated_values_empty.base, json_flags[i]);
+    assert_buffer_equals_string(&something.base, json_flags[i]);
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__compact) {
+  int result;
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.name = "John Doe";
+  person.id = 42;
+  person.email = "john@doe.name";
+
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+  result = protobuf2json_buffer(&person.base, JSON_COMPACT, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_buffer);
+
+  ASSERT_STRCMP(
+    json_buffer,
+    "{\"name\":\"John Doe\",\"id\":42,\"email\":\"john@doe.name\"}"
+  );
+  ASSERT(json_length == strlen(json_buffer));
+
+  free(json_buffer);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__shortest_reals) {
+  int result;
+
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+
+  float value_float[] = { 0.33f, 0, -0.0f, 1, -1.5e-7f, 3.0e38f, 1.0f / 3, 16777216.0f, 1.4e-45f };
+  double value_double[] = {
+    0.1, 0.0077705550333011103, 100, 1e21, 1e22, -2.5e-300, 1e-6, 1e-7,
+    123456789012345680000.0, 1.7976931348623157e308, 5e-324, 0.30000000000000004
+  };
+
+  repeated_values.n_value_float = sizeof(value_float) / sizeof(value_float[0]);
+  repeated_values.value_float = value_float;
+  repeated_values.n_value_double = sizeof(value_double) / sizeof(value_double[0]);
+  repeated_values.value_double = value_double;
+
+  char *json_buffer = NULL;
+  result = protobuf2json_buffer(&repeated_values.base, JSON_COMPACT, &json_buffer, NULL, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_buffer);
+
+  ASSERT_STRCMP(
+    json_buffer,
+    "{\"value_float\":[0.33,0.0,-0.0,1.0,-1.5e-7,3e38,0.33333334,16777216.0,1e-45],"
+    "\"value_double\":[0.1,0.00777055503330111,100.0,1e21,1e22,-2.5e-300,0.000001,1e-7,"
+    "123456789012345680000.0,1.7976931348623157e308,5e-324,0.30000000000000004]}"
+  );
+
+  free(json_buffer);
+
+  /* JSON_REAL_PRECISION keeps jansson formatting */
+  result = protobuf2json_buffer(&repeated_values.base, JSON_COMPACT | JSON_REAL_PRECISION(3), &json_buffer, NULL, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_buffer);
+
+  ASSERT_STRCMP(
+    json_buffer,
+    "{\"value_float\":[0.33,0.0,-0.0,1.0,-1.5e-7,3e38,0.333,1.68e7,1.4e-45],"
+    "\"value_double\":[0.1,0.00777,100.0,1e21,1e22,-2.5e-300,1e-6,1e-7,"
+    "1.23e20,1.8e308,4.94e-324,0.3]}"
+  );
+
+  free(json_buffer);
+
+  RETURN_OK();
+}
+
+/* Special characters at every position of strings longer than vector blocks, written exactly as jansson does */
+TEST_IMPL(protobuf2json_buffer__escaping) {
+  const char *specials[] = {"\"", "\\", "/", "\n", "\x01", "\x1f", "\x7f", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80"};
+  size_t flags[] = {0, JSON_ESCAPE_SLASH, JSON_ENSURE_ASCII};
+
+  char string[128];
+  size_t f, k, length, position;
+
+  for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+    for (k = 0; k < sizeof(specials) / sizeof(specials[0]); k++) {
+      for (length = 1; length <= 72; length++) {
+        for (position = 0; position < length; position++) {
+          size_t special_length = strlen(specials[k]);
+
+          /* Plain prefix of `position` bytes, special character and plain suffix */
+          memset(string, 'a' + position % 26, length + special_length);
+          memcpy(string + position, specials[k], special_length);
+          string[length + special_length] = '\0';
+
+          Foo__Bar bar = FOO__BAR__INIT;
+          bar.string_required = string;
+
+          char *json_string = NULL;
+          ASSERT_ZERO(protobuf2json_string(&bar.base, flags[f] | JSON_COMPACT, &json_string, NULL, 0));
+
+          char *json_buffer = NULL;
+          ASSERT_ZERO(protobuf2json_buffer(&bar.base, flags[f] | JSON_COMPACT, &json_buffer, NULL, NULL, 0));
+
+          ASSERT_STRCMP(
+            json_buffer,
+            json_string
+          );
+
+          size_t encoded_size = 0;
+          ASSERT_ZERO(protobuf2json_encoded_size(&bar.base, flags[f] | JSON_COMPACT, &encoded_size, NULL, 0));
+          ASSERT(encoded_size == strlen(json_buffer));
+
+          free(json_string);
+          free(json_buffer);
+        }
+      }
+    }
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__enum_values) {
+  int values[] = {INT32_MIN, -1, 0, 1, 2, 3, 4, 5, 6, 14, 15, 16, INT32_MAX};
+
+  size_t i;
+  for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    char error_string_string[256] = {0};
+    char error_string_buffer[256] = {0};
+    int result_string, result_buffer;
+
+    Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+    repeated_values.n_value_enum = 1;
+    repeated_values.value_enum = (Foo__FizzBuzzType *)&values[i];
+
+    char *json_string = NULL;
+    result_string = protobuf2json_string(&repeated_values.base, JSON_COMPACT, &json_string, error_string_string, sizeof(error_string_string));
+
+    char *json_buffer = NULL;
+    result_buffer = protobuf2json_buffer(&repeated_values.base, JSON_COMPACT, &json_buffer, NULL, error_string_buffer, sizeof(error_string_buffer));
+
+    ASSERT_EQUALS(result_buffer, result_string);
+    ASSERT_STRCMP(
+      error_string_buffer,
+      error_string_string
+    );
+
+    if (!result_string) {
+      ASSERT_STRCMP(
+        json_buffer,
+        json_string
+      );
+    }
+
+    free(json_string);
+    free(json_buffer);
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__encoded_size) {
+  size_t json_flags[] = {0, JSON_COMPACT, JSON_ESCAPE_SLASH, JSON_ENSURE_ASCII | JSON_INDENT(8)};
+  int result;
+
+  /* Bytes longer than base64 chunk, all-ones bytes are all slashes in base64 */
+  size_t data_length = 10000;
+  uint8_t *data = malloc(data_length);
+  ASSERT(data);
+  memset(data, 0xff, data_length);
+
+  char *value_string[] = { "\xe2\x82\xac / \"\x01\"", "" };
+  int64_t value_int64[] = { -9223372036854775807LL - 1, -1, 0, 7, 1000000 };
+
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+  ProtobufCBinaryData value_bytes[] = { { data_length, data } };
+
+  repeated_values.n_value_bytes = 1;
+  repeated_values.value_bytes = value_bytes;
+  repeated_values.n_value_string = 2;
+  repeated_values.value_string = value_string;
+  repeated_values.n_value_int64 = 5;
+  repeated_values.value_int64 = value_int64;
+
+  size_t i;
+  for (i = 0; i < sizeof(json_flags) / sizeof(json_flags[0]); i++) {
+    char *json_buffer = NULL;
+    size_t json_length = 0;
+    result = protobuf2json_buffer(&repeated_values.base, json_flags[i], &json_buffer, &json_length, NULL, 0);
+    ASSERT_ZERO(result);
+
+    size_t encoded_size = 0;
+    result = protobuf2json_encoded_size(&repeated_values.base, json_flags[i], &encoded_size, NULL, 0);
+    ASSERT_ZERO(result);
+
+    ASSERT(encoded_size == json_length);
+
+    free(json_buffer);
+  }
+
+  free(data);
+
+  /* Same errors as protobuf2json_buffer() */
+  char error_string[256] = {0};
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.name = "John \xc0\xaf Doe";
+  person.id = 42;
+
+  size_t encoded_size = 0;
+  result = protobuf2json_encoded_size(&person.base, 0, &encoded_size, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Invalid UTF-8 sequence at position 5 in string value"
+  );
+
+  RETURN_OK();
+}
+
+/* Buffer of every size up to the needed one and a bit more, nothing is written past its end */
+static void assert_to_buffer_same_as_buffer(ProtobufCMessage *protobuf_message, size_t json_flags) {
+  int result;
+  char error_string[256] = {0};
+
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+  result = protobuf2json_buffer(protobuf_message, json_flags, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+
+  char *buffer = malloc(json_length + 16);
+  ASSERT(buffer);
+
+  size_t size;
+  for (size = 0; size <= json_length + 8; size++) {
+    memset(buffer, '#', json_length + 16);
+
+    size_t written = 0;
+    result = protobuf2json_to_buffer(protobuf_message, json_flags, buffer, size, &written, error_string, sizeof(error_string));
+    ASSERT(written == json_length);
+    ASSERT(buffer[size] == '#');
+
+    if (size < json_length) {
+      ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_BUFFER_TOO_SMALL);
+    } else {
+      ASSERT_ZERO(result);
+      ASSERT_ZERO(memcmp(buffer, json_buffer, json_length));
+    }
+  }
+
+  free(buffer);
+  free(json_buffer);
+}
+
+TEST_IMPL(protobuf2json_buffer__to_buffer) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+
+  int64_t value_int64[] = { -9223372036854775807LL - 1, -1, 0, 7, 1000000 };
+  double value_double[] = { 0.1, -2.5e-300 };
+  Foo__FizzBuzzType value_enum[] = { FOO__FIZZ_BUZZ_TYPE__FIZZ, FOO__FIZZ_BUZZ_TYPE__FIZZBUZZ };
+  char *value_string[] = { "\xe2\x82\xac / \"\x01\"", "" };
+  ProtobufCBinaryData value_bytes[] = { { 5, (uint8_t *)"bytes" }, { 3, (uint8_t *)"\xff\xff\xff" } };
+
+  repeated_values.n_value_int64 = 5;
+  repeated_values.value_int64 = value_int64;
+  repeated_values.n_value_double = 2;
+  repeated_values.value_double = value_double;
+  repeated_values.n_value_enum = 2;
+  repeated_values.value_enum = value_enum;
+  repeated_values.n_value_string = 2;
+  repeated_values.value_string = value_string;
+  repeated_values.n_value_bytes = 2;
+  repeated_values.value_bytes = value_bytes;
+
+  assert_to_buffer_same_as_buffer(&repeated_values.base, 0);
+  assert_to_buffer_same_as_buffer(&repeated_values.base, JSON_COMPACT | JSON_ESCAPE_SLASH | JSON_ENSURE_ASCII);
+  assert_to_buffer_same_as_buffer(&repeated_values.base, JSON_INDENT(2) | JSON_SORT_KEYS | JSON_REAL_PRECISION(5));
+
+  /* Bytes longer than base64 chunk */
+  size_t data_length = 10000;
+  uint8_t *data = malloc(data_length);
+  ASSERT(data);
+  memset(data, 0x5a, data_length);
+
+  Foo__Bar bar = FOO__BAR__INIT;
+
+  bar.string_required = "required";
+  bar.has_bytes_optional = 1;
+  bar.bytes_optional.len = data_length;
+  bar.bytes_optional.data = data;
+
+  char buffer[8192];
+  size_t written = 0;
+  result = protobuf2json_to_buffer(&bar.base, JSON_COMPACT, buffer, sizeof(buffer), &written, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_BUFFER_TOO_SMALL);
+  ASSERT_EQUALS((int)written, 13557);
+
+  ASSERT_STRCMP(
+    error_string,
+    "JSON of 13557 bytes does not fit into buffer of 8192 bytes"
+  );
+
+  /* Empty buffer only measures JSON */
+  written = 0;
+  result = protobuf2json_to_buffer(&bar.base, JSON_COMPACT, NULL, 0, &written, NULL, 0);
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_BUFFER_TOO_SMALL);
+  ASSERT_EQUALS((int)written, 13557);
+
+  free(data);
+
+  /* Other errors take precedence */
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.name = "John \xc0\xaf Doe";
+  person.id = 42;
+
+  result = protobuf2json_to_buffer(&person.base, 0, buffer, 4, &written, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__to_buffer_prepared) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__Person__PhoneNumber person_phonenumber = FOO__PERSON__PHONE_NUMBER__INIT;
+  person_phonenumber.number = "+123456789";
+  person_phonenumber.has_type = 1;
+  person_phonenumber.type = FOO__PERSON__PHONE_TYPE__WORK;
+
+  Foo__Person__PhoneNumber *person_phonenumbers[1] = { &person_phonenumber };
+
+  Foo__Person person = FOO__PERSON__INIT;
+  person.name = "John";
+  person.id = 42;
+  person.n_phone = 1;
+  person.phone = person_phonenumbers;
+
+  Foo__Person *value_message[1] = { &person };
+  Foo__FizzBuzzType value_enum[] = { FOO__FIZZ_BUZZ_TYPE__FIZZ, FOO__FIZZ_BUZZ_TYPE__BUZZ };
+
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+  repeated_values.n_value_enum = 2;
+  repeated_values.value_enum = value_enum;
+  repeated_values.n_value_message = 1;
+  repeated_values.value_message = value_message;
+
+  /* Tables of nested messages and enums are built too */
+  result = protobuf2json_prepare_descriptor(&foo__repeated_values__descriptor, error_string, sizeof(error_string));
+  ASSERT_ZERO(result);
+
+  char buffer[1024];
+  size_t written = 0;
+  size_t allocs = alloc_count;
+
+  result = protobuf2json_to_buffer(&repeated_values.base, JSON_COMPACT, buffer, sizeof(buffer), &written, error_string, sizeof(error_string));
+  ASSERT_ZERO(result);
+
+#ifdef ALLOC_COUNT_ENABLED
+  ASSERT(alloc_count == allocs);
+#else
+  (void)allocs;
+#endif
+
+  const char *expected_json_string = "{\"value_enum\":[\"FIZZ\",\"BUZZ\"],\"value_message\":[{\"name\":\"John\",\"id\":42,\"phone\":[{\"number\":\"+123456789\",\"type\":\"WORK\"}]}]}";
+
+  ASSERT(written == strlen(expected_json_string));
+  ASSERT_ZERO(memcmp(buffer, expected_json_string, written));
+
+  /* Preparing again finds everything built */
+  result = protobuf2json_prepare_descriptor(&foo__repeated_values__descriptor, error_string, sizeof(error_string));
+  ASSERT_ZERO(result);
+
+  result = protobuf2json_prepare_descriptor(NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_INVALID_ARGUMENT);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot prepare NULL descriptor"
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__error_unknown_enum_value) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__Person person = FOO__PERSON__INIT;
+  Foo__Person__PhoneNumber person_phonenumber1 = FOO__PERSON__PHONE_NUMBER__INIT;
+  Foo__Person__PhoneNumber *person_phonenumbers[1] = { &person_phonenumber1 };
+
+  person.name = "John Doe";
+  person.id = 42;
+
+  person_phonenumber1.number = "+123456789";
+  person_phonenumber1.has_type = 1;
+  person_phonenumber1.type = 777; // Unknown enum value
+
+  person.n_phone = 1;
+  person.phone = person_phonenumbers;
+
+  char *json_buffer = NULL;
+  result = protobuf2json_buffer(&person.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE);
+  ASSERT(!json_buffer);
+
+  const char *expected_error_string = \
+    "Unknown value 777 for enum 'Foo.Person.PhoneType'"
+  ;
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__error_invalid_utf8) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.name = "John \xc0\xaf Doe"; // Overlong '/'
+  person.id = 42;
+
+  char *json_buffer = NULL;
+  result = protobuf2json_buffer(&person.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  const char *expected_error_string = \
+    "Invalid UTF-8 sequence at position 5 in string value"
+  ;
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  /* Invalid byte after a long plain run */
+  person.name = "0123456789abcdef0123456789abcdef0123456789\xff";
+
+  result = protobuf2json_buffer(&person.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Invalid UTF-8 sequence at position 42 in string value"
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__error_non_finite_real) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__RepeatedValues repeated_values = FOO__REPEATED_VALUES__INIT;
+
+  double value_double[] = { 1.0, INFINITY };
+
+  repeated_values.n_value_double = 2;
+  repeated_values.value_double = value_double;
+
+  char *json_buffer = NULL;
+  result = protobuf2json_buffer(&repeated_values.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  const char *expected_error_string = \
+    "Cannot dump non-finite real value inf"
+  ;
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_buffer__error_null_string) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.id = 42;
+
+  char *json_buffer = NULL;
+  result = protobuf2json_buffer(&person.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  const char *expected_error_string = \
+    "Cannot dump NULL string value of field 'name'"
+  ;
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  RETURN_OK();
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+typedef struct collected {
+  char data[65536];
+  size_t length;
+  size_t calls;
+  size_t max_size;
+  size_t fail_after;
+} collected_t;
+
+static int collect_callback(const char *buffer, size_t size, void *data) {
+  collected_t *collected = (collected_t *)data;
+
+  if (collected->fail_after && collected->calls >= collected->fail_after) {
+    return -1;
+  }
+
+  ASSERT(collected->length + size < sizeof(collected->data));
+
+  memcpy(collected->data + collected->length, buffer, size);
+  collected->length += size;
+  collected->calls++;
+
+  if (size > collected->max_size) {
+    collected->max_size = size;
+  }
+
+  return 0;
+}
+
+static void init_big_bar(Foo__Bar *bar, char *string, uint8_t *bytes, size_t size) {
+  Foo__Bar bar_init = FOO__BAR__INIT;
+  size_t i;
+
+  for (i = 0; i < size - 1; i++) {
+    string[i] = (i % 64 == 0) ? '/' : 'a' + (i % 26);
+  }
+  string[size - 1] = '\0';
+
+  for (i = 0; i < size; i++) {
+    bytes[i] = (uint8_t)(i * 7);
+  }
+
+  *bar = bar_init;
+
+  bar->string_required = string;
+  bar->has_bytes_optional = 1;
+  bar->bytes_optional.len = size;
+  bar->bytes_optional.data = bytes;
+}
+
+TEST_IMPL(protobuf2json_callback__same_as_string) {
+  int result;
+
+  size_t json_flags[] = {
+    0,
+    TEST_JSON_FLAGS,
+    JSON_COMPACT,
+    JSON_ESCAPE_SLASH,
+  };
+
+  static char string[10000];
+  static uint8_t bytes[10000];
+
+  Foo__Bar bar;
+  init_big_bar(&bar, string, bytes, sizeof(bytes));
+
+  size_t i;
+  for (i = 0; i < sizeof(json_flags) / sizeof(json_flags[0]); i++) {
+    char *json_string = NULL;
+    result = protobuf2json_string(&bar.base, json_flags[i], &json_string, NULL, 0);
+    ASSERT_ZERO(result);
+    ASSERT(json_string);
+
+    static collected_t collected;
+    memset(&collected, 0, sizeof(collected));
+
+    result = protobuf2json_callback(&bar.base, json_flags[i], collect_callback, &collected, NULL, 0);
+    ASSERT_ZERO(result);
+
+    collected.data[collected.length] = '\0';
+
+    ASSERT_STRCMP(
+      collected.data,
+      json_string
+    );
+
+    /* Output should come in several bounded chunks */
+    ASSERT(collected.calls > 1);
+    ASSERT(collected.max_size <= 16384);
+
+    free(json_string);
+  }
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_callback__error_callback) {
+  int result;
+  char error_string[256] = {0};
+
+  static char string[10000];
+  static uint8_t bytes[10000];
+
+  Foo__Bar bar;
+  init_big_bar(&bar, string, bytes, sizeof(bytes));
+
+  static collected_t collected;
+  memset(&collected, 0, sizeof(collected));
+  collected.fail_after = 1;
+
+  result = protobuf2json_callback(&bar.base, 0, collect_callback, &collected, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_CALLBACK);
+  ASSERT(collected.calls == 1);
+
+  ASSERT_STRNCMP(
+    error_string,
+    "Callback failed to write ",
+    strlen("Callback failed to write ")
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_fd__success) {
+  int result;
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.name = "John Doe";
+  person.id = 42;
+
+  char file_name[] = "/tmp/protobuf2json-fd-XXXXXX";
+  int fd = mkstemp(file_name);
+  ASSERT(fd >= 0);
+  unlink(file_name);
+
+  result = protobuf2json_fd(&person.base, JSON_COMPACT, fd, NULL, 0);
+  ASSERT_ZERO(result);
+
+  char json_buffer[256] = {0};
+  ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+  ASSERT(read(fd, json_buffer, sizeof(json_buffer) - 1) > 0);
+
+  ASSERT_STRCMP(
+    json_buffer,
+    "{\"name\":\"John Doe\",\"id\":42}"
+  );
+
+  close(fd);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_fd__error_bad_fd) {
+  int result;
+  char error_string[256] = {0};
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.name = "John Doe";
+  person.id = 42;
+
+  result = protobuf2json_fd(&person.base, 0, -1, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_FILE);
+
+  char expected_error_string[256];
+  snprintf(expected_error_string, sizeof(expected_error_string), "Cannot write JSON to fd -1, errno=%d", EBADF);
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+
+  RETURN_OK();
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+static const char *ctx_json_strings[] = {
+  "{\"name\":\"John Doe\",\"id\":42,\"email\":\"john@doe.name\",\"phone\":[{\"number\":\"+123\",\"type\":\"WORK\"},{\"number\":\"+456\"}]}",
+  "{\"name\":\"Jane \\\"Doe\\\" \\u0414\",\"id\":-1}",
+  "{\"name\":\"\",\"id\":0,\"phone\":[]}",
+};
+
+TEST_IMPL(protobuf2json_ctx__reuse) {
+  int result;
+
+  protobuf2json_ctx_t *ctx = protobuf2json_ctx_new();
+  ASSERT(ctx);
+
+  int round;
+  for (round = 0; round < 3; round++) {
+    size_t i;
+    for (i = 0; i < sizeof(ctx_json_strings) / sizeof(ctx_json_strings[0]); i++) {
+      const char *json_string = ctx_json_strings[i];
+
+      ProtobufCMessage *protobuf_message = NULL;
+      result = json2protobuf_ctx_buffer(ctx, (char *)json_string, strlen(json_string), 0, &foo__person__descriptor, &protobuf_message, NULL, 0);
+      ASSERT_ZERO(result);
+      ASSERT(protobuf_message);
+
+      char *expected_json_buffer = NULL;
+      result = protobuf2json_buffer(protobuf_message, TEST_JSON_FLAGS, &expected_json_buffer, NULL, NULL, 0);
+      ASSERT_ZERO(result);
+
+      const char *json_buffer = NULL;
+      size_t json_length = 0;
+      result = protobuf2json_ctx_buffer(ctx, protobuf_message, TEST_JSON_FLAGS, &json_buffer, &json_length, NULL, 0);
+      ASSERT_ZERO(result);
+      ASSERT(json_buffer);
+
+      ASSERT_STRCMP(
+        json_buffer,
+        expected_json_buffer
+      );
+      ASSERT(json_length == strlen(expected_json_buffer));
+
+      free(expected_json_buffer);
+    }
+
+    /* Messages of all iterations above are released here at once */
+    protobuf2json_ctx_reset(ctx);
+  }
+
+  protobuf2json_ctx_free(ctx);
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_ctx__error_keeps_context) {
+  int result;
+  char error_string[256] = {0};
+
+  protobuf2json_ctx_t *ctx = protobuf2json_ctx_new();
+  ASSERT(ctx);
+
+  Foo__Person person = FOO__PERSON__INIT;
+
+  person.id = 42;
+
+  const char *json_buffer = NULL;
+  result = protobuf2json_ctx_buffer(ctx, &person.base, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_CANNOT_DUMP_VALUE);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Cannot dump NULL string value of field 'name'"
+  );
+
+  person.name = "John Doe";
+
+  size_t json_length = 0;
+  result = protobuf2json_ctx_buffer(ctx, &person.base, JSON_COMPACT, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+
+  ASSERT_STRCMP(
+    json_buffer,
+    "{\"name\":\"John Doe\",\"id\":42}"
+  );
+  ASSERT(json_length == strlen(json_buffer));
+
+  const char *invalid_json_string = "{\"name\":\"John Doe\",\"id\":1,\"phone\":[{\"number\":\"1\"},{}]}";
+
+  ProtobufCMessage *protobuf_message = NULL;
+  result = json2protobuf_ctx_buffer(ctx, (char *)invalid_json_string, strlen(invalid_json_string), 0, &foo__person__descriptor, &protobuf_message, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING);
+  ASSERT(!protobuf_message);
+
+  ASSERT_STRCMP(
+    error_string,
+    "Required field 'number' is missing in message 'Foo.Person.PhoneNumber'"
+  );
+
+  result = json2protobuf_ctx_buffer(ctx, (char *)json_buffer, json_length, 0, &foo__person__descriptor, &protobuf_message, NULL, 0);
+  ASSERT_ZERO(result);
+
+  Foo__Person *decoded_person = (Foo__Person *)protobuf_message;
+
+  ASSERT_STRCMP(decoded_person->name, "John Doe");
+  ASSERT_EQUALS(decoded_person->id, 42);
+
+  protobuf2json_ctx_free(ctx);
+
+  /* Should be no-op */
+  protobuf2json_ctx_free(NULL);
+
+  RETURN_OK();
+}
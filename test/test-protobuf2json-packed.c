@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2014-2016 Oleg Efimov <efimovov@gmail.com>
+ *
+ * protobuf2json-c is free software; you can redistribute it
+ * and/or modify it under the terms of the MIT license.
+ * See LICENSE for details.
+ */
+
+#include "task.h"
+#include "test.pb-c.h"
+#include "protobuf2json.h"
+
+#define PACKED(bytes) (const uint8_t *)(bytes), sizeof(bytes) - 1
+
+static void assert_packed_equals(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *packed_buffer,
+  size_t packed_length,
+  const char *expected_json_string
+) {
+  char *json_buffer = NULL;
+  size_t json_length = 0;
+  int result = protobuf2json_from_packed(protobuf_message_descriptor, packed_buffer, packed_length, JSON_COMPACT, &json_buffer, &json_length, NULL, 0);
+  ASSERT_ZERO(result);
+  ASSERT(json_length == strlen(json_buffer));
+
+  ASSERT_STRCMP(
+    json_buffer,
+    expected_json_string
+  );
+
+  free(json_buffer);
+}
+
+static void assert_packed_error(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *packed_buffer,
+  size_t packed_length,
+  int expected_result,
+  const char *expected_error_string
+) {
+  char error_string[256] = {0};
+  char *json_buffer = NULL;
+  int result = protobuf2json_from_packed(protobuf_message_descriptor, packed_buffer, packed_length, 0, &json_buffer, NULL, error_string, sizeof(error_string));
+  ASSERT_EQUALS(result, expected_result);
+  ASSERT(!json_buffer);
+
+  ASSERT_STRCMP(
+    error_string,
+    expected_error_string
+  );
+}
+
+/* Output of protobuf2json_from_packed() is the same as protobuf2json_buffer() of unpacked message */
+static void assert_packed_same_as_unpacked(
+  const ProtobufCMessageDescriptor *protobuf_message_descriptor,
+  const uint8_t *packed_buffer,
+  size_t packed_length
+) {
+  static const size_t json_flags[] = {
+    0,
+    TEST_JSON_FLAGS,
+    JSON_COMPACT,
+    JSON_SORT_KEYS,
+    JSON_EMBED | JSON_INDENT(2),
+    JSON_ENSURE_ASCII | JSON_ESCAPE_SLASH,
+    JSON_REAL_PRECISION(5)
+  };
+
+  ProtobufCMessage *unpacked_message = protobuf_c_message_unpack(protobuf_message_descriptor, NULL, packed_length, packed_buffer);
+  ASSERT(unpacked_message);
+
+  size_t f;
+  for (f = 0; f < sizeof(json_flags) / sizeof(json_flags[0]); f++) {
+    char *expected_json_buffer = NULL;
+    ASSERT_ZERO(protobuf2json_buffer(unpacked_message, json_flags[f], &expected_json_buffer, NULL, NULL, 0));
+
+    char *json_buffer = NULL;
+    size_t json_length = 0;
+    ASSERT_ZERO(protobuf2json_from_packed(protobuf_message_descriptor, packed_buffer, packed_length, json_flags[f], &json_buffer, &json_length, NULL, 0));
+    ASSERT(json_length == strlen(json_buffer));
+
+    ASSERT_STRCMP(
+      json_buffer,
+      expected_json_buffer
+    );
+
+    free(json_buffer);
+    free(expected_json_buffer);
+  }
+
+  protobuf_c_message_free_unpacked(unpacked_message, NULL);
+}
+
+TEST_IMPL(protobuf2json_packed__same_as_unpacked) {
+  static const struct {
+    const ProtobufCMessageDescriptor *descriptor;
+    const char *json_string;
+  } messages[] = {
+    { &foo__person__descriptor, "{\"name\":\"John \\\"Doe\\\" \\u0414\\u0436\\u043e\\u043d/\",\"id\":-42,\"email\":\"john@doe.name\"}" },
+    { &foo__person__descriptor, "{\"name\":\"John\",\"id\":42,\"phone\":[{\"number\":\"+123\",\"type\":\"WORK\"},{\"number\":\"+456\"}]}" },
+    { &foo__bar__descriptor, "{\"string_required\":\"required\",\"bytes_optional\":\"//79/A==\",\"enum_optional\":\"BUZZ\"}" },
+    { &foo__bar__descriptor, "{\"string_required\":\"\",\"string_required_default\":\"\",\"string_optional_default\":\"\",\"bytes_optional_default\":\"\"}" },
+    {
+      &foo__repeated_values__descriptor,
+      "{\"value_int32\":[2147483647,-2147483648,0],\"value_sint32\":[-1,1],\"value_sfixed32\":[-2147483648],"
+      "\"value_uint32\":[4294967295],\"value_fixed32\":[4294967295,0],\"value_int64\":[9223372036854775807,-1],"
+      "\"value_sint64\":[-9223372036854775808],\"value_sfixed64\":[-9223372036854775808],\"value_uint64\":[0],"
+      "\"value_fixed64\":[9223372036854775807],\"value_float\":[0.33,-1.5e-7],\"value_double\":[0.0077705550333011103,1e21],"
+      "\"value_bool\":[true,false],\"value_enum\":[\"FIZZ\",\"FIZZBUZZ\"],\"value_string\":[\"\",\"qwerty\"],"
+      "\"value_bytes\":[\"\",\"Pw==\"],\"value_message\":[{\"name\":\"John\",\"id\":1,\"phone\":[{\"number\":\"+1\"}]},{\"name\":\"\",\"id\":0}]}"
+    },
+    { &foo__repeated_values__descriptor, "{}" },
+    { &foo__something__descriptor, "{}" },
+    { &foo__something__descriptor, "{\"oneof_string\":\"string\"}" },
+    { &foo__something__descriptor, "{\"oneof_bytes\":\"Ynl0ZXM=\"}" }
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+    ProtobufCMessage *protobuf_message = NULL;
+    ASSERT_ZERO(json2protobuf_string((char *)messages[i].json_string, 0, messages[i].descriptor, &protobuf_message, NULL, 0));
+
+    size_t packed_length = protobuf_c_message_get_packed_size(protobuf_message);
+    uint8_t *packed_buffer = malloc(packed_length + 1);
+    ASSERT(packed_buffer);
+    ASSERT(protobuf_c_message_pack(protobuf_message, packed_buffer) == packed_length);
+
+    protobuf_c_message_free_unpacked(protobuf_message, NULL);
+
+    assert_packed_same_as_unpacked(messages[i].descriptor, packed_buffer, packed_length);
+
+    free(packed_buffer);
+  }
+
+  /* Required fields with default values may be missing on the wire, defaults are written then */
+  assert_packed_same_as_unpacked(&foo__bar__descriptor, PACKED("\x0a\x01" "a"));
+  assert_packed_same_as_unpacked(&foo__bar__descriptor, PACKED("\x0a\x01" "a" "\x2a\x02" "\x01\x02"));
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_packed__wire_order) {
+  /* Fields in any order, the last value of singular field wins, unknown fields are skipped */
+  assert_packed_equals(
+    &foo__person__descriptor,
+    PACKED("\x10\x01" "\xf8\x06\x05" "\x0a\x01" "a" "\x9d\x06\x01\x02\x03\x04" "\x10\x07" "\x0a\x02" "bc" "\xa1\x06\x01\x02\x03\x04\x05\x06\x07\x08" "\xfa\x06\x01" "x"),
+    "{\"name\":\"bc\",\"id\":7}"
+  );
+
+  /* Repeated values interleaved with other fields, defaults of absent optional fields */
+  assert_packed_equals(
+    &foo__person__descriptor,
+    PACKED("\x22\x04\x0a\x02" "12" "\x0a\x01" "a" "\x10\x00" "\x22\x06\x10\x02\x0a\x02" "34"),
+    "{\"name\":\"a\",\"id\":0,\"phone\":[{\"number\":\"12\",\"type\":\"HOME\"},{\"number\":\"34\",\"type\":\"WORK\"}]}"
+  );
+
+  assert_packed_equals(
+    &foo__bar__descriptor,
+    PACKED("\x12\x00" "\x0a\x01" "r"),
+    "{\"string_required\":\"r\",\"string_required_default\":\"\",\"string_optional_default\":\"default value 2\","
+    "\"bytes_optional_default\":\"ZGVmYXVsdCB2YWx1ZSAz\",\"enum_optional_default\":\"FIZZBUZZ\"}"
+  );
+
+  /* Strings end at NUL, negative int32 takes 10 bytes */
+  assert_packed_equals(
+    &foo__person__descriptor,
+    PACKED("\x0a\x05" "ab\0cd" "\x10\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"),
+    "{\"name\":\"ab\",\"id\":-1}"
+  );
+
+  /* The last member of oneof wins */
+  assert_packed_equals(
+    &foo__something__descriptor,
+    PACKED("\x5a\x01" "s" "\xb2\x01\x01" "b"),
+    "{\"oneof_bytes\":\"Yg==\"}"
+  );
+
+  assert_packed_equals(
+    &foo__something__descriptor,
+    PACKED("\xb2\x01\x01" "b" "\x5a\x01" "s"),
+    "{\"oneof_string\":\"s\"}"
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_packed__packed_repeated) {
+  /* Packed and not packed values of the same field are concatenated, empty packed value adds nothing */
+  assert_packed_equals(
+    &foo__repeated_values__descriptor,
+    PACKED(
+      "\x0a\x0d\x01\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\xac\x02" "\x08\x05"
+      "\x10\x03" "\x12\x01\x04"
+      "\x22\x00"
+      "\x52\x08\x08\x07\x06\x05\x04\x03\x02\x01"
+      "\x5a\x04\x00\x00\xc0\x3f" "\x5d\x00\x00\x00\xc0"
+      "\x6a\x02\x01\x00"
+      "\x72\x02\x03\x0f"
+    ),
+    "{\"value_int32\":[1,-1,300,5],\"value_sint32\":[-2,2],\"value_fixed64\":[72623859790382856],"
+    "\"value_float\":[1.5,-2.0],\"value_bool\":[true,false],\"value_enum\":[\"FIZZ\",\"FIZZBUZZ\"]}"
+  );
+
+  RETURN_OK();
+}
+
+TEST_IMPL(protobuf2json_packed__errors) {
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x0a"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 1: truncated length-prefixed value"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x10\x01\x0a\x05" "ab"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 3: truncated length-prefixed value"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x10\xff"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 1: truncated varint"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x0a\x00\x15\x01\x02"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 3: truncated fixed-size value"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x12\x01" "a"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 0: wire type 2 does not match field 'id'"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x0b"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 0: unsupported wire type"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x00\x01"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person' at offset 0: invalid tag"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x0a\x01" "a"),
+    PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
+    "Required field 'id' is missing in message 'Foo.Person'"
+  );
+
+  /* Offsets are counted from the start of the whole buffer */
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x0a\x01" "a" "\x10\x01" "\x22\x02\x10\x01"),
+    PROTOBUF2JSON_ERR_REQUIRED_IS_MISSING,
+    "Required field 'number' is missing in message 'Foo.Person.PhoneNumber'"
+  );
+
+  assert_packed_error(
+    &foo__person__descriptor,
+    PACKED("\x0a\x01" "a" "\x10\x01" "\x22\x02\x0a\x05"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.Person.PhoneNumber' at offset 8: truncated length-prefixed value"
+  );
+
+  assert_packed_error(
+    &foo__repeated_values__descriptor,
+    PACKED("\x0a\x01\xff"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.RepeatedValues' at offset 2: truncated packed repeated value"
+  );
+
+  assert_packed_error(
+    &foo__repeated_values__descriptor,
+    PACKED("\x2a\x03\x01\x02\x03"),
+    PROTOBUF2JSON_ERR_CANNOT_PARSE_PACKED,
+    "Cannot parse message 'Foo.RepeatedValues' at offset 2: truncated packed repeated value"
+  );
+
+  assert_packed_error(
+    &foo__bar__descriptor,
+    PACKED("\x0a\x01" "r" "\x12\x00" "\x38\x89\x06"),
+    PROTOBUF2JSON_ERR_UNKNOWN_ENUM_VALUE,
+    "Unknown value 777 for enum 'Foo.FizzBuzzType'"
+  );
+
+  RETURN_OK();
+}